@@ -0,0 +1,424 @@
+#define _GNU_SOURCE
+#include "p2p_client.h"
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+/*
+    load generator for the server. It registers and connects a set of users and then sends
+    LIST_USERS, LIST_CONTENT and SEARCH requests asynchronously through the client library,
+    printing the throughput and the latency percentiles at the end. With -a it runs on the listed
+    cpus only, so it can be kept off the cpus of the server (see -a of the server) when comparing
+    the placements of the server threads. With -U it sends HEARTBEAT and PRESENCE to the UDP port
+    of the server instead, one synchronous datagram at a time from every one of the -c threads.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define DEFAULT_HOST "localhost"
+#define DEFAULT_PORT 7777
+#define DEFAULT_NUM_OF_CONNECTIONS 4
+#define DEFAULT_NUM_OF_REQUESTS 100000
+#define NUM_OF_USERS 64
+#define MAX_USERNAME_LEN 32
+#define FIRST_LISTEN_PORT 20000
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct load_stats {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_done;
+    uint64_t num_of_done;
+    uint64_t num_of_failed;
+    uint64_t* latencies;    // nanoseconds, one per request
+};
+
+struct udp_load {
+    struct load_stats* p_stats;
+    char* host;
+    int port;
+    char (*usernames)[MAX_USERNAME_LEN + 1];
+    uint64_t first;         // position of the first request in the latencies
+    uint64_t num_of_requests;
+};
+
+struct load_request {
+    struct load_stats* p_stats;
+    uint64_t idx;           // position in the latencies
+    uint64_t start;
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+
+int compare_latencies(const void* p_a, const void* p_b)
+{
+    uint64_t a = *(const uint64_t*) p_a;
+    uint64_t b = *(const uint64_t*) p_b;
+
+    return a < b ? -1 : a > b;
+}
+
+
+
+void on_response(int status, struct client_response* p_response, void* arg)
+{
+    struct load_request* p_req = arg;
+    struct load_stats* p_stats = p_req->p_stats;
+    uint64_t latency = now_ns() - p_req->start;
+
+    pthread_mutex_lock(&p_stats->mutex);
+    p_stats->latencies[p_req->idx] = latency;
+    if (status != CLIENT_SUCCESS || p_response->result != 0)
+        p_stats->num_of_failed++;
+    p_stats->num_of_done++;
+    pthread_cond_signal(&p_stats->cond_done);
+    pthread_mutex_unlock(&p_stats->mutex);
+
+    free(p_req);
+}
+
+
+
+/*
+    sends the requests of the udp load one after another, the thread of every -c.
+*/
+void* run_udp_load(void* arg)
+{
+    struct udp_load* p_load = arg;
+    struct load_stats* p_stats = p_load->p_stats;
+    struct client_udp* p_udp = NULL;
+    uint64_t num_of_failed = 0;
+
+    if (client_udp_open(p_load->host, p_load->port, 0, &p_udp) != CLIENT_SUCCESS)
+        num_of_failed = p_load->num_of_requests;
+
+    for (uint64_t i = 0; p_udp != NULL && i < p_load->num_of_requests; i++)
+    {
+        struct client_response response;
+        char* type = i % 2 == 0 ? CLIENT_REQ_HEARTBEAT : CLIENT_REQ_PRESENCE;
+        uint64_t start = now_ns();
+        int status = client_udp_call(p_udp, type, p_load->usernames[i % NUM_OF_USERS], &response);
+        p_stats->latencies[p_load->first + i] = now_ns() - start;
+
+        if (status != CLIENT_SUCCESS || response.result != 0)
+            num_of_failed++;
+        if (status == CLIENT_SUCCESS)
+            client_free_response(&response);
+    }
+
+    if (p_udp != NULL)
+        client_udp_close(p_udp);
+
+    pthread_mutex_lock(&p_stats->mutex);
+    p_stats->num_of_failed += num_of_failed;
+    p_stats->num_of_done += p_load->num_of_requests;
+    pthread_mutex_unlock(&p_stats->mutex);
+
+    return NULL;
+}
+
+
+
+/*
+    registers and connects the users used by the load.
+    Returns 0 on success and -1 on fail
+*/
+int prepare_users(struct client_pool* p_pool, char usernames[][MAX_USERNAME_LEN + 1])
+{
+    struct client_response response;
+
+    for (int i = 0; i < NUM_OF_USERS; i++)
+    {
+        sprintf(usernames[i], "loadgen%d", i);
+
+        // the user may be left from a previous run, so only the transport errors matter
+        if (client_register(p_pool, usernames[i], &response) != CLIENT_SUCCESS)
+            return -1;
+        client_free_response(&response);
+
+        if (client_connect(p_pool, usernames[i], FIRST_LISTEN_PORT + i, &response)
+            != CLIENT_SUCCESS)
+            return -1;
+        client_free_response(&response);
+    }
+
+    return 0;
+}
+
+
+
+/*
+    parses the cpu list (numbers and ranges separated by commas, e.g. "4-7,12") into the set.
+    Returns 0 on success and -1 if the list is invalid
+*/
+int parse_cpu_list(char* cpu_list, cpu_set_t* p_set)
+{
+    char* p = cpu_list;
+    CPU_ZERO(p_set);
+
+    while (*p != '\0')
+    {
+        char* p_end;
+        long first = strtol(p, &p_end, 10);
+        long last = first;
+        if (p_end == p)
+            return -1;
+
+        p = p_end;
+        if (*p == '-')
+        {
+            last = strtol(++p, &p_end, 10);
+            if (p_end == p)
+                return -1;
+            p = p_end;
+        }
+
+        if (first < 0 || last < first || last >= CPU_SETSIZE)
+            return -1;
+        for (long cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, p_set);
+
+        if (*p == ',')
+            p++;
+        else if (*p != '\0')
+            return -1;
+    }
+
+    return CPU_COUNT(p_set) > 0 ? 0 : -1;
+}
+
+
+
+void print_usage()
+{
+    printf("Usage: loadgen [-s <host>] [-p <port>] [-c <connections>] [-n <requests>] "
+        "[-w <window>] [-a <cpu>,<first cpu>-<last cpu>,...] [-z (compressed listings)] "
+        "[-U <UDP port> (HEARTBEAT and PRESENCE over UDP)]\n");
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// main
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char* argv[])
+{
+    char* host = DEFAULT_HOST;
+    int port = DEFAULT_PORT;
+    uint32_t num_of_connections = DEFAULT_NUM_OF_CONNECTIONS;
+    uint64_t num_of_requests = DEFAULT_NUM_OF_REQUESTS;
+    uint32_t window = CLIENT_DEFAULT_WINDOW;
+    char* cpu_list = NULL;
+    int is_compressed = 0;
+    int udp_port = 0;
+    int option = 0;
+
+    while ((option = getopt(argc, argv, "s:p:c:n:w:a:zU:")) != -1)
+    {
+        switch (option)
+        {
+            case 's':
+                host = optarg;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'c':
+                num_of_connections = strtoul(optarg, NULL, 10);
+                break;
+            case 'n':
+                num_of_requests = strtoull(optarg, NULL, 10);
+                break;
+            case 'w':
+                window = strtoul(optarg, NULL, 10);
+                break;
+            case 'a':
+                cpu_list = optarg;
+                break;
+            case 'z':
+                is_compressed = 1;
+                break;
+            case 'U':
+                udp_port = atoi(optarg);
+                break;
+            default:
+                print_usage();
+                return -1;
+        }
+    }
+
+    if (num_of_requests == 0 || (udp_port != 0 && num_of_connections == 0))
+    {
+        print_usage();
+        return -1;
+    }
+
+    // before the threads of the pool are started, they inherit the cpus
+    cpu_set_t cpus;
+    if (cpu_list != NULL && (parse_cpu_list(cpu_list, &cpus) != 0
+        || sched_setaffinity(0, sizeof(cpus), &cpus) != 0))
+    {
+        printf("ERROR loadgen - could not run on the cpus %s\n", cpu_list);
+        return -1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    struct client_pool* p_pool = NULL;
+    int res = client_pool_create(host, port, num_of_connections, window, &p_pool);
+    if (res != CLIENT_SUCCESS)
+    {
+        printf("ERROR loadgen - could not create the connection pool. Code: %d\n", res);
+        return -1;
+    }
+    if (is_compressed)
+        client_pool_accept_compression(p_pool);
+
+    char usernames[NUM_OF_USERS][MAX_USERNAME_LEN + 1];
+    if (prepare_users(p_pool, usernames) != 0)
+    {
+        printf("ERROR loadgen - could not prepare the users\n");
+        client_pool_destroy(p_pool);
+        return -1;
+    }
+
+    struct load_stats stats;
+    memset(&stats, 0, sizeof(stats));
+    pthread_mutex_init(&stats.mutex, NULL);
+    pthread_cond_init(&stats.cond_done, NULL);
+    stats.latencies = calloc(num_of_requests, sizeof(uint64_t));
+    if (stats.latencies == NULL)
+    {
+        printf("ERROR loadgen - could not allocate the statistics\n");
+        client_pool_destroy(p_pool);
+        return -1;
+    }
+
+    char str_max_results[] = "10";
+    char query[] = "loadgen";
+    char* fields[3];
+    struct client_request request;
+    uint64_t num_of_submitted = 0;
+    uint64_t start = now_ns();
+
+    // the udp threads split the requests, the pool only prepared the users
+    pthread_t udp_threads[num_of_connections];
+    struct udp_load udp_loads[num_of_connections];
+    for (uint32_t i = 0; udp_port != 0 && i < num_of_connections; i++)
+    {
+        struct udp_load* p_load = &udp_loads[i];
+        p_load->p_stats = &stats;
+        p_load->host = host;
+        p_load->port = udp_port;
+        p_load->usernames = usernames;
+        p_load->first = num_of_requests * i / num_of_connections;
+        p_load->num_of_requests = num_of_requests * (i + 1) / num_of_connections - p_load->first;
+        if (pthread_create(&udp_threads[i], NULL, run_udp_load, p_load) != 0)
+        {
+            printf("ERROR loadgen - could not start the udp threads\n");
+            return -1;
+        }
+    }
+    for (uint32_t i = 0; udp_port != 0 && i < num_of_connections; i++)
+        pthread_join(udp_threads[i], NULL);
+    if (udp_port != 0)
+        num_of_submitted = num_of_requests;
+
+    for (uint64_t i = 0; udp_port == 0 && i < num_of_requests; i++)
+    {
+        struct load_request* p_req = malloc(sizeof(struct load_request));
+        if (p_req == NULL)
+            break;
+        p_req->p_stats = &stats;
+
+        memset(&request, 0, sizeof(request));
+        request.fields = fields;
+        fields[0] = usernames[i % NUM_OF_USERS];
+        switch (i % 3)
+        {
+            case 0:
+                request.type = CLIENT_REQ_LIST_USERS;
+                request.num_of_fields = 1;
+                break;
+            case 1:
+                request.type = CLIENT_REQ_LIST_CONTENT;
+                fields[1] = usernames[(i / 3) % NUM_OF_USERS];
+                request.num_of_fields = 2;
+                break;
+            default:
+                request.type = CLIENT_REQ_SEARCH;
+                fields[1] = query;
+                fields[2] = str_max_results;
+                request.num_of_fields = 3;
+                break;
+        }
+
+        p_req->idx = num_of_submitted;
+        p_req->start = now_ns();
+        if (client_submit(p_pool, &request, on_response, p_req) != CLIENT_SUCCESS)
+        {
+            // e.g. the connection was closed by the server, the next request reopens it
+            free(p_req);
+            pthread_mutex_lock(&stats.mutex);
+            stats.num_of_failed++;
+            pthread_mutex_unlock(&stats.mutex);
+            continue;
+        }
+        num_of_submitted++;
+    }
+
+    pthread_mutex_lock(&stats.mutex);
+    while (stats.num_of_done < num_of_submitted)
+        pthread_cond_wait(&stats.cond_done, &stats.mutex);
+    pthread_mutex_unlock(&stats.mutex);
+
+    double seconds = (now_ns() - start) / 1e9;
+    client_pool_destroy(p_pool);
+
+    if (num_of_submitted == 0)
+    {
+        printf("ERROR loadgen - no request could be sent\n");
+        free(stats.latencies);
+        return -1;
+    }
+
+    qsort(stats.latencies, num_of_submitted, sizeof(uint64_t), compare_latencies);
+    printf("requests: %lu, sent: %lu, failed: %lu, connections: %u, window: %u\n",
+        (unsigned long) num_of_requests, (unsigned long) num_of_submitted,
+        (unsigned long) stats.num_of_failed,
+        num_of_connections, window);
+    printf("throughput: %.0f req/s\n", num_of_submitted / seconds);
+    printf("latency p50: %.1f us, p99: %.1f us, max: %.1f us\n",
+        stats.latencies[num_of_submitted / 2] / 1e3,
+        stats.latencies[num_of_submitted * 99 / 100] / 1e3,
+        stats.latencies[num_of_submitted - 1] / 1e3);
+
+    free(stats.latencies);
+    pthread_mutex_destroy(&stats.mutex);
+    pthread_cond_destroy(&stats.cond_done);
+
+    return 0;
+}
@@ -0,0 +1,1409 @@
+#include "p2p_client.h"
+#include "lines.h"
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <zlib.h>
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define READ_BUFFER_SIZE (64 * 1024)
+#define MAX_NUMBER_LEN 20
+#define MAX_ANNOUNCE_FIELDS (5 + 65536)
+// kinds of responses, i.e. what follows the result code
+#define RESPONSE_SIMPLE 0
+#define RESPONSE_USERS 1
+#define RESPONSE_CONTENT 2
+#define RESPONSE_PAIRS 3
+#define RESPONSE_SOURCES 4
+#define RESPONSE_FILE 5
+#define RESPONSE_REPLICATION 6
+#define RESPONSE_DUMP 7
+#define RESPONSE_BATCH 8
+#define RESPONSE_ENCODING 9
+#define RESPONSE_MULTI_CONTENT 10
+// compressed listings
+#define COMPRESSION_ENCODING "deflate"
+#define MAX_UNCOMPRESSED_LEN (1024 * 1024 * 1024)
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    request which was sent and waits for its response
+*/
+struct pending {
+    int response_kind;
+    client_callback callback;
+    void* arg;
+    struct pending* p_next;
+};
+
+/*
+    buffered reading of the responses, used only by the reader thread of the connection
+*/
+struct response_reader {
+    int fd;
+    char buffer[READ_BUFFER_SIZE];
+    size_t pos;
+    size_t len;
+    int is_compressing;     // 1 after the server accepted the compression of the listings
+};
+
+struct client_connection {
+    struct client_pool* p_pool;
+    int fd;
+    // held while a request is written, so pipelined requests do not interleave
+    pthread_mutex_t mutex_write;
+    // protects the queue of pending requests
+    pthread_mutex_t mutex_queue;
+    pthread_cond_t cond_pending;
+    pthread_cond_t cond_window;
+    struct pending* p_head;
+    struct pending* p_tail;
+    uint32_t num_of_pending;
+    pthread_t reader;
+    struct response_reader resp_reader;
+};
+
+struct client_pool {
+    struct sockaddr_in server_addr;
+    uint32_t window;
+    uint32_t num_of_connections;
+    struct client_connection* connections;
+    uint32_t next_connection;
+    int is_closing;
+    int is_compression_accepted;
+};
+
+/*
+    UDP socket of client_udp_call(). Every request gets the next tag, the responses with another
+    tag (late responses of earlier requests) are dropped.
+*/
+struct client_udp {
+    int socket;             // connected to the server, so only its datagrams are received
+    uint64_t next_tag;
+};
+
+struct client_subscription {
+    struct response_reader reader;  // of the connection, which is used for nothing else
+};
+
+/*
+    state of a synchronous call waiting for its response
+*/
+struct sync_call {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int is_done;
+    int status;
+    struct client_response response;
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// reading responses
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    Returns 0 if the reader has data buffered (reads from the socket if needed) and -1 on fail
+*/
+int fill_buffer(struct response_reader* p_reader)
+{
+    while (p_reader->pos == p_reader->len)
+    {
+        ssize_t r = read(p_reader->fd, p_reader->buffer, READ_BUFFER_SIZE);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+
+        p_reader->pos = 0;
+        p_reader->len = r;
+    }
+
+    return 0;
+}
+
+
+
+/*
+    reads exactly len bytes.
+    Returns 0 on success and -1 on fail
+*/
+int read_exact(struct response_reader* p_reader, char* out, uint64_t len)
+{
+    while (len > 0)
+    {
+        if (fill_buffer(p_reader) != 0)
+            return -1;
+
+        size_t chunk = p_reader->len - p_reader->pos;
+        if (chunk > len)
+            chunk = len;
+
+        memcpy(out, p_reader->buffer + p_reader->pos, chunk);
+        p_reader->pos += chunk;
+        out += chunk;
+        len -= chunk;
+    }
+
+    return 0;
+}
+
+
+
+/*
+    reads one field finished by '\0' or '\n' into field, which has room for CLIENT_MAX_FIELD_LEN
+    characters (the rest is skipped).
+    Returns 0 on success and -1 on fail
+*/
+int read_string(struct response_reader* p_reader, char* field)
+{
+    size_t len = 0;
+
+    for (;;)
+    {
+        if (fill_buffer(p_reader) != 0)
+            return -1;
+
+        char ch = p_reader->buffer[p_reader->pos++];
+        if (ch == '\0' || ch == '\n')
+            break;
+        if (len < CLIENT_MAX_FIELD_LEN)
+            field[len++] = ch;
+    }
+    field[len] = '\0';
+
+    return 0;
+}
+
+
+
+/*
+    appends a copy of the field to the response.
+    Returns 0 on success and -1 on fail
+*/
+int append_field(struct client_response* p_response, uint32_t* p_capacity, char* field)
+{
+    if (p_response->num_of_fields == *p_capacity)
+    {
+        uint32_t new_capacity = *p_capacity == 0 ? 8 : 2 * *p_capacity;
+        char** new_fields = realloc(p_response->fields, new_capacity * sizeof(char*));
+        if (new_fields == NULL)
+            return -1;
+        p_response->fields = new_fields;
+        *p_capacity = new_capacity;
+    }
+
+    char* copy = strdup(field);
+    if (copy == NULL)
+        return -1;
+    p_response->fields[p_response->num_of_fields++] = copy;
+
+    return 0;
+}
+
+
+
+/*
+    reads one field finished by '\0' or '\n' and appends it to the response.
+    Returns 0 on success and -1 on fail
+*/
+int read_field(struct response_reader* p_reader, struct client_response* p_response,
+    uint32_t* p_capacity)
+{
+    char field[CLIENT_MAX_FIELD_LEN + 1];
+
+    if (read_string(p_reader, field) != 0)
+        return -1;
+
+    return append_field(p_response, p_capacity, field);
+}
+
+
+
+/*
+    reads a field which is a number and puts its value where p_number points.
+    Returns 0 on success and -1 on fail
+*/
+int read_number_field(struct response_reader* p_reader, struct client_response* p_response,
+    uint32_t* p_capacity, uint64_t* p_number)
+{
+    if (read_field(p_reader, p_response, p_capacity) != 0)
+        return -1;
+
+    *p_number = strtoull(p_response->fields[p_response->num_of_fields - 1], NULL, 10);
+
+    return 0;
+}
+
+
+
+/*
+    reads count fields.
+    Returns 0 on success and -1 on fail
+*/
+int read_fields(struct response_reader* p_reader, struct client_response* p_response,
+    uint32_t* p_capacity, uint64_t count)
+{
+    for (uint64_t i = 0; i < count; i++)
+    {
+        if (read_field(p_reader, p_response, p_capacity) != 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+
+/*
+    reads the encoding of a listing sent to a connection which accepts the compression. A
+    compressed payload is read and uncompressed, its fields are appended to the response and
+    1 is put where p_is_read points. Otherwise the payload follows in the usual form.
+    Returns 0 on success and -1 on fail
+*/
+int read_compressed_listing(struct response_reader* p_reader, struct client_response* p_response,
+    uint32_t* p_capacity, int* p_is_read)
+{
+    char field[CLIENT_MAX_FIELD_LEN + 1];
+    *p_is_read = 0;
+
+    if (read_string(p_reader, field) != 0)
+        return -1;
+    if (strcmp(field, COMPRESSION_ENCODING) != 0)
+        return 0;
+
+    uint64_t raw_len = 0;
+    uint64_t len = 0;
+    if (read_string(p_reader, field) != 0 || (raw_len = strtoull(field, NULL, 10)) == 0
+        || raw_len > MAX_UNCOMPRESSED_LEN || read_string(p_reader, field) != 0
+        || (len = strtoull(field, NULL, 10)) == 0 || len > compressBound(raw_len))
+        return -1;
+
+    char* compressed = malloc(len);
+    char* payload = malloc(raw_len);
+    uLongf payload_len = raw_len;
+    int res = -1;
+    if (compressed != NULL && payload != NULL && read_exact(p_reader, compressed, len) == 0
+        && uncompress((Bytef*) payload, &payload_len, (Bytef*) compressed, len) == Z_OK
+        && payload_len == raw_len && payload[raw_len - 1] == '\0')
+    {
+        // the fields of the payload one after another, each finished by '\0'
+        res = 0;
+        for (char* p = payload; res == 0 && p < payload + raw_len; p += strlen(p) + 1)
+            res = append_field(p_response, p_capacity, p);
+        *p_is_read = 1;
+    }
+
+    free(compressed);
+    free(payload);
+
+    return res;
+}
+
+
+
+/*
+    reads the response of the kind.
+    Returns 0 on success and -1 on fail
+*/
+int read_response(struct response_reader* p_reader, int response_kind,
+    struct client_response* p_response)
+{
+    memset(p_response, 0, sizeof(struct client_response));
+    uint32_t capacity = 0;
+    uint64_t number = 0;
+    uint64_t num_of_chunks = 0;
+    uint64_t num_of_files = 0;
+
+    char res_code[2];
+    if (read_exact(p_reader, res_code, 2) != 0)
+        return -1;
+    p_response->result = res_code[0];
+
+    if (p_response->result != 0)    // only successful responses carry more data
+        return 0;
+
+    // the listings have the encoding first
+    int is_read = 0;
+    if (p_reader->is_compressing 
+        && (response_kind == RESPONSE_USERS || response_kind == RESPONSE_CONTENT)
+        && (read_compressed_listing(p_reader, p_response, &capacity, &is_read) != 0 || is_read))
+        return is_read ? 0 : -1;
+
+    switch (response_kind)
+    {
+        case RESPONSE_USERS:    // number of users, then username, ip and port of each
+            if (read_number_field(p_reader, p_response, &capacity, &number) != 0)
+                return -1;
+            return read_fields(p_reader, p_response, &capacity, 3 * number);
+
+        case RESPONSE_CONTENT:  // number of files, then the name of each
+            if (read_number_field(p_reader, p_response, &capacity, &number) != 0)
+                return -1;
+            return read_fields(p_reader, p_response, &capacity, number);
+
+        case RESPONSE_PAIRS:    // number of pairs (e.g. owner and file name of a search result)
+            if (read_number_field(p_reader, p_response, &capacity, &number) != 0)
+                return -1;
+            return read_fields(p_reader, p_response, &capacity, 2 * number);
+
+        case RESPONSE_SOURCES:  // size, chunk size, chunks, hashes, sources, 4 fields per source
+            if (read_fields(p_reader, p_response, &capacity, 2) != 0
+                || read_number_field(p_reader, p_response, &capacity, &num_of_chunks) != 0
+                || read_fields(p_reader, p_response, &capacity, num_of_chunks) != 0
+                || read_number_field(p_reader, p_response, &capacity, &number) != 0)
+                return -1;
+            return read_fields(p_reader, p_response, &capacity, 4 * number);
+
+        case RESPONSE_FILE:     // total size, length of the range and the raw bytes
+            if (read_fields(p_reader, p_response, &capacity, 1) != 0
+                || read_number_field(p_reader, p_response, &capacity, &number) != 0)
+                return -1;
+            p_response->data = malloc(number + 1);
+            if (p_response->data == NULL)
+                return -1;
+            p_response->data_len = number;
+            return read_exact(p_reader, p_response->data, number);
+
+        case RESPONSE_REPLICATION:  // connected, applied and primary sequence numbers, lag
+            return read_fields(p_reader, p_response, &capacity, 4);
+
+        case RESPONSE_DUMP:     // ip, port, number of files, then name and description of each
+            if (read_fields(p_reader, p_response, &capacity, 2) != 0
+                || read_number_field(p_reader, p_response, &capacity, &number) != 0)
+                return -1;
+            return read_fields(p_reader, p_response, &capacity, 2 * number);
+
+        case RESPONSE_BATCH:    // result of every item
+            return read_fields(p_reader, p_response, &capacity, 1);
+
+        case RESPONSE_MULTI_CONTENT:    // number of owners, then owner, result and list of each
+            if (read_number_field(p_reader, p_response, &capacity, &number) != 0)
+                return -1;
+            for (uint64_t i = 0; i < number; i++)
+            {
+                if (read_fields(p_reader, p_response, &capacity, 2) != 0)
+                    return -1;
+                if (strcmp(p_response->fields[p_response->num_of_fields - 1], "0") != 0)
+                    continue;
+                if (read_number_field(p_reader, p_response, &capacity, &num_of_files) != 0
+                    || read_fields(p_reader, p_response, &capacity, num_of_files) != 0)
+                    return -1;
+            }
+            return 0;
+
+        case RESPONSE_ENCODING: // the encoding the server chose, the listings use it from now on
+            p_reader->is_compressing = 1;
+            return read_fields(p_reader, p_response, &capacity, 1);
+
+        default:
+            return 0;
+    }
+}
+
+
+
+int get_response_kind(struct client_request* p_request)
+{
+    char* type = p_request->type;
+
+    // the response is the one of the forwarded request
+    if (strcmp(type, CLIENT_REQ_SHARD) == 0 || strcmp(type, CLIENT_REQ_SHARD_FANOUT) == 0)
+    {
+        if (p_request->num_of_fields < 2)
+            return RESPONSE_SIMPLE;
+        type = p_request->fields[1];
+    }
+
+    if (strcmp(type, CLIENT_REQ_LIST_USERS) == 0 || strcmp(type, CLIENT_REQ_WHO_HAS) == 0
+        || strcmp(type, CLIENT_REQ_LIST_USERS_FILTER) == 0)
+        return RESPONSE_USERS;
+    if (strcmp(type, CLIENT_REQ_LIST_CONTENT) == 0 || strcmp(type, CLIENT_REQ_SHARD_USERS) == 0
+        || strcmp(type, CLIENT_REQ_LIST_CONTENT_FILTER) == 0)
+        return RESPONSE_CONTENT;
+    if (strcmp(type, CLIENT_REQ_LIST_CONTENT_MULTI) == 0)
+        return RESPONSE_MULTI_CONTENT;
+    if (strcmp(type, CLIENT_REQ_SEARCH) == 0 || strcmp(type, CLIENT_REQ_METRICS) == 0)
+        return RESPONSE_PAIRS;
+    if (strcmp(type, CLIENT_REQ_GET_SOURCES) == 0)
+        return RESPONSE_SOURCES;
+    if (strcmp(type, CLIENT_REQ_GET_FILE) == 0)
+        return RESPONSE_FILE;
+    if (strcmp(type, CLIENT_REQ_REPLICATION_STATUS) == 0)
+        return RESPONSE_REPLICATION;
+    if (strcmp(type, CLIENT_REQ_USER_DUMP) == 0)
+        return RESPONSE_DUMP;
+    if (strcmp(type, CLIENT_REQ_ACCEPT_ENCODING) == 0)
+        return RESPONSE_ENCODING;
+    if (strcmp(type, CLIENT_REQ_REGISTER_BATCH) == 0 
+        || strcmp(type, CLIENT_REQ_UNREGISTER_BATCH) == 0
+        || strcmp(type, CLIENT_REQ_PUBLISH_BATCH) == 0)
+        return RESPONSE_BATCH;
+
+    return RESPONSE_SIMPLE;
+}
+
+
+
+void client_free_response(struct client_response* p_response)
+{
+    for (uint32_t i = 0; i < p_response->num_of_fields; i++)
+        free(p_response->fields[i]);
+
+    free(p_response->fields);
+    free(p_response->data);
+    memset(p_response, 0, sizeof(struct client_response));
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// connections
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    fails all pending requests of the connection and closes it, so the next request reopens it.
+*/
+void fail_connection(struct client_connection* p_conn, int fd, int status)
+{
+    // detach the connection first, without the write lock: a writer may be holding it while it
+    // waits for room in the window
+    pthread_mutex_lock(&p_conn->mutex_queue);
+
+    if (p_conn->fd == fd)
+        p_conn->fd = -1;
+
+    struct pending* p_failed = p_conn->p_head;
+    p_conn->p_head = NULL;
+    p_conn->p_tail = NULL;
+    p_conn->num_of_pending = 0;
+    p_conn->resp_reader.pos = 0;
+    p_conn->resp_reader.len = 0;
+    p_conn->resp_reader.is_compressing = 0;
+    pthread_cond_broadcast(&p_conn->cond_window);
+
+    pthread_mutex_unlock(&p_conn->mutex_queue);
+
+    // close it once nobody writes to it anymore, so its descriptor can't be reused meanwhile
+    pthread_mutex_lock(&p_conn->mutex_write);
+    if (fd >= 0)
+        close(fd);
+    pthread_mutex_unlock(&p_conn->mutex_write);
+
+    // callbacks are called without locks, they may submit new requests
+    struct client_response empty;
+    while (p_failed != NULL)
+    {
+        struct pending* p_next = p_failed->p_next;
+        memset(&empty, 0, sizeof(empty));
+        p_failed->callback(status, &empty, p_failed->arg);
+        free(p_failed);
+        p_failed = p_next;
+    }
+}
+
+
+
+/*
+    reads the responses of the connection in the order the requests were sent and calls their
+    callbacks.
+*/
+void* read_responses(void* p_connection)
+{
+    struct client_connection* p_conn = p_connection;
+    struct client_response response;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&p_conn->mutex_queue);
+        while (p_conn->p_head == NULL && !p_conn->p_pool->is_closing)
+            pthread_cond_wait(&p_conn->cond_pending, &p_conn->mutex_queue);
+
+        if (p_conn->p_head == NULL)  // closing and nothing to wait for
+        {
+            pthread_mutex_unlock(&p_conn->mutex_queue);
+            break;
+        }
+
+        int fd = p_conn->fd;
+        int response_kind = p_conn->p_head->response_kind;
+        pthread_mutex_unlock(&p_conn->mutex_queue);
+
+        p_conn->resp_reader.fd = fd;
+        if (read_response(&p_conn->resp_reader, response_kind, &response) != 0)
+        {
+            client_free_response(&response);
+            fail_connection(p_conn, fd, p_conn->p_pool->is_closing ?
+                CLIENT_ERR_CLOSED : CLIENT_ERR_RECEIVE);
+            continue;
+        }
+
+        pthread_mutex_lock(&p_conn->mutex_queue);
+        struct pending* p_done = p_conn->p_head;
+        p_conn->p_head = p_done->p_next;
+        if (p_conn->p_head == NULL)
+            p_conn->p_tail = NULL;
+        p_conn->num_of_pending--;
+        pthread_cond_signal(&p_conn->cond_window);
+        pthread_mutex_unlock(&p_conn->mutex_queue);
+
+        p_done->callback(CLIENT_SUCCESS, &response, p_done->arg);
+        client_free_response(&response);
+        free(p_done);
+    }
+
+    return NULL;
+}
+
+
+
+/*
+    callback of the requests whose response the library does not need.
+*/
+void ignore_response(int status, struct client_response* p_response, void* arg)
+{
+}
+
+
+
+/*
+    opens the connection to the server. Must be called with mutex_write locked.
+    Returns 0 on success and -1 on fail
+*/
+int open_connection(struct client_connection* p_conn)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, (struct sockaddr*) &p_conn->p_pool->server_addr,
+        sizeof(struct sockaddr_in)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    // pipelined requests are small, don't wait to coalesce them
+    int no_delay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+    // negotiated before any other request, the reader learns the outcome from the response
+    struct pending* p_pending = NULL;
+    if (p_conn->p_pool->is_compression_accepted)
+    {
+        p_pending = malloc(sizeof(struct pending));
+        char request[] = CLIENT_REQ_ACCEPT_ENCODING "\0" COMPRESSION_ENCODING;
+        if (p_pending == NULL || send_msg(fd, request, sizeof(request)) != 0)
+        {
+            free(p_pending);
+            close(fd);
+            return -1;
+        }
+        p_pending->response_kind = RESPONSE_ENCODING;
+        p_pending->callback = ignore_response;
+        p_pending->arg = NULL;
+        p_pending->p_next = NULL;
+    }
+
+    pthread_mutex_lock(&p_conn->mutex_queue);
+    p_conn->fd = fd;
+    if (p_pending != NULL)
+    {
+        p_conn->p_head = p_pending;
+        p_conn->p_tail = p_pending;
+        p_conn->num_of_pending++;
+        pthread_cond_signal(&p_conn->cond_pending);
+    }
+    pthread_mutex_unlock(&p_conn->mutex_queue);
+
+    return 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// pool
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int client_pool_create(char* host, int port, uint32_t num_of_connections, uint32_t window,
+    struct client_pool** pp_pool)
+{
+    struct client_pool* p_pool = calloc(1, sizeof(struct client_pool));
+    if (p_pool == NULL)
+        return CLIENT_ERR_MEMORY;
+
+    struct hostent* p_host = gethostbyname(host);
+    if (p_host == NULL)
+    {
+        free(p_pool);
+        return CLIENT_ERR_CONNECT;
+    }
+
+    p_pool->server_addr.sin_family = AF_INET;
+    p_pool->server_addr.sin_port = htons(port);
+    memcpy(&p_pool->server_addr.sin_addr, p_host->h_addr, p_host->h_length);
+    p_pool->window = window > 0 ? window : CLIENT_DEFAULT_WINDOW;
+    p_pool->num_of_connections = num_of_connections > 0 ? num_of_connections : 1;
+    p_pool->connections = calloc(p_pool->num_of_connections, sizeof(struct client_connection));
+    if (p_pool->connections == NULL)
+    {
+        free(p_pool);
+        return CLIENT_ERR_MEMORY;
+    }
+
+    for (uint32_t i = 0; i < p_pool->num_of_connections; i++)
+    {
+        struct client_connection* p_conn = &p_pool->connections[i];
+        p_conn->p_pool = p_pool;
+        p_conn->fd = -1;
+        pthread_mutex_init(&p_conn->mutex_write, NULL);
+        pthread_mutex_init(&p_conn->mutex_queue, NULL);
+        pthread_cond_init(&p_conn->cond_pending, NULL);
+        pthread_cond_init(&p_conn->cond_window, NULL);
+        pthread_create(&p_conn->reader, NULL, read_responses, p_conn);
+    }
+
+    *pp_pool = p_pool;
+
+    return CLIENT_SUCCESS;
+}
+
+
+
+void client_pool_accept_compression(struct client_pool* p_pool)
+{
+    p_pool->is_compression_accepted = 1;
+}
+
+
+
+void client_pool_destroy(struct client_pool* p_pool)
+{
+    for (uint32_t i = 0; i < p_pool->num_of_connections; i++)
+    {
+        struct client_connection* p_conn = &p_pool->connections[i];
+
+        pthread_mutex_lock(&p_conn->mutex_queue);
+        p_pool->is_closing = 1;
+        if (p_conn->fd >= 0)
+            shutdown(p_conn->fd, SHUT_RDWR);    // wakes up the reader
+        pthread_cond_broadcast(&p_conn->cond_pending);
+        pthread_cond_broadcast(&p_conn->cond_window);
+        pthread_mutex_unlock(&p_conn->mutex_queue);
+    }
+
+    for (uint32_t i = 0; i < p_pool->num_of_connections; i++)
+    {
+        struct client_connection* p_conn = &p_pool->connections[i];
+        pthread_join(p_conn->reader, NULL);
+
+        if (p_conn->fd >= 0)
+            close(p_conn->fd);
+        pthread_mutex_destroy(&p_conn->mutex_write);
+        pthread_mutex_destroy(&p_conn->mutex_queue);
+        pthread_cond_destroy(&p_conn->cond_pending);
+        pthread_cond_destroy(&p_conn->cond_window);
+    }
+
+    free(p_pool->connections);
+    free(p_pool);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// client_submit
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    serializes the fields of the request into one message, so it's sent with one write.
+    Returns the message (which has to be deleted afterwards) or NULL if there is no memory
+*/
+char* serialize_request(struct client_request* p_request, size_t* p_len)
+{
+    size_t len = strlen(p_request->type) + 1;
+    for (uint32_t i = 0; i < p_request->num_of_fields; i++)
+        len += strlen(p_request->fields[i]) + 1;
+
+    char* message = malloc(len);
+    if (message == NULL)
+        return NULL;
+
+    char* p = stpcpy(message, p_request->type) + 1;
+    for (uint32_t i = 0; i < p_request->num_of_fields; i++)
+        p = stpcpy(p, p_request->fields[i]) + 1;
+
+    *p_len = len;
+
+    return message;
+}
+
+
+
+int client_submit(struct client_pool* p_pool, struct client_request* p_request,
+    client_callback callback, void* arg)
+{
+    size_t message_len = 0;
+    char* message = serialize_request(p_request, &message_len);
+    struct pending* p_pending = malloc(sizeof(struct pending));
+    if (message == NULL || p_pending == NULL)
+    {
+        free(message);
+        free(p_pending);
+        return CLIENT_ERR_MEMORY;
+    }
+
+    p_pending->response_kind = get_response_kind(p_request);
+    p_pending->callback = callback;
+    p_pending->arg = arg;
+    p_pending->p_next = NULL;
+
+    uint32_t idx = __atomic_fetch_add(&p_pool->next_connection, 1, __ATOMIC_RELAXED);
+    struct client_connection* p_conn = &p_pool->connections[idx % p_pool->num_of_connections];
+    int res = CLIENT_SUCCESS;
+    int fd = -1;
+
+    pthread_mutex_lock(&p_conn->mutex_write);
+
+    if (p_pool->is_closing)
+        res = CLIENT_ERR_CLOSED;
+    else if (p_conn->fd < 0 && open_connection(p_conn) != 0)
+        res = CLIENT_ERR_CONNECT;
+
+    if (res == CLIENT_SUCCESS)
+    {
+        // wait for room in the window, then queue the request before its response can arrive
+        pthread_mutex_lock(&p_conn->mutex_queue);
+        while (p_conn->num_of_pending >= p_pool->window && !p_pool->is_closing)
+            pthread_cond_wait(&p_conn->cond_window, &p_conn->mutex_queue);
+
+        fd = p_conn->fd;    // -1 if the connection failed meanwhile
+        if (!p_pool->is_closing && fd >= 0)
+        {
+            if (p_conn->p_tail != NULL)
+                p_conn->p_tail->p_next = p_pending;
+            else
+                p_conn->p_head = p_pending;
+            p_conn->p_tail = p_pending;
+            p_conn->num_of_pending++;
+            pthread_cond_signal(&p_conn->cond_pending);
+        }
+        else
+            res = p_pool->is_closing ? CLIENT_ERR_CLOSED : CLIENT_ERR_CONNECT;
+        pthread_mutex_unlock(&p_conn->mutex_queue);
+    }
+
+    if (res == CLIENT_SUCCESS)
+    {
+        if (send_msg(fd, message, message_len) != 0
+            || (p_request->data_len > 0
+            && send_msg(fd, p_request->data, p_request->data_len) != 0))
+        {
+            // the reader fails all the pending requests, including this one
+            shutdown(fd, SHUT_RDWR);
+        }
+    }
+
+    pthread_mutex_unlock(&p_conn->mutex_write);
+
+    free(message);
+    if (res != CLIENT_SUCCESS)
+        free(p_pending);
+
+    return res;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// client_call
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void complete_sync_call(int status, struct client_response* p_response, void* arg)
+{
+    struct sync_call* p_call = arg;
+
+    pthread_mutex_lock(&p_call->mutex);
+    p_call->status = status;
+    p_call->response = *p_response;
+    memset(p_response, 0, sizeof(struct client_response));  // the caller owns it now
+    p_call->is_done = 1;
+    pthread_cond_signal(&p_call->cond);
+    pthread_mutex_unlock(&p_call->mutex);
+}
+
+
+
+int client_call(struct client_pool* p_pool, struct client_request* p_request,
+    struct client_response* p_response)
+{
+    struct sync_call call;
+    memset(&call, 0, sizeof(call));
+    memset(p_response, 0, sizeof(struct client_response));
+    pthread_mutex_init(&call.mutex, NULL);
+    pthread_cond_init(&call.cond, NULL);
+
+    int res = client_submit(p_pool, p_request, complete_sync_call, &call);
+    if (res == CLIENT_SUCCESS)
+    {
+        pthread_mutex_lock(&call.mutex);
+        while (!call.is_done)
+            pthread_cond_wait(&call.cond, &call.mutex);
+        pthread_mutex_unlock(&call.mutex);
+
+        res = call.status;
+        *p_response = call.response;
+    }
+
+    pthread_mutex_destroy(&call.mutex);
+    pthread_cond_destroy(&call.cond);
+
+    return res;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// synchronous calls
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int call_with_fields(struct client_pool* p_pool, char* type, char** fields,
+    uint32_t num_of_fields, struct client_response* p_resp)
+{
+    struct client_request request;
+    memset(&request, 0, sizeof(request));
+    request.type = type;
+    request.fields = fields;
+    request.num_of_fields = num_of_fields;
+
+    return client_call(p_pool, &request, p_resp);
+}
+
+
+
+int client_register(struct client_pool* p_pool, char* username, struct client_response* p_resp)
+{
+    char* fields[] = { username };
+    return call_with_fields(p_pool, CLIENT_REQ_REGISTER, fields, 1, p_resp);
+}
+
+
+
+int client_unregister(struct client_pool* p_pool, char* username, struct client_response* p_resp)
+{
+    char* fields[] = { username };
+    return call_with_fields(p_pool, CLIENT_REQ_UNREGISTER, fields, 1, p_resp);
+}
+
+
+
+int client_connect(struct client_pool* p_pool, char* username, int listen_port,
+    struct client_response* p_resp)
+{
+    char str_port[MAX_NUMBER_LEN + 1];
+    sprintf(str_port, "%d", listen_port);
+    char* fields[] = { username, str_port };
+    return call_with_fields(p_pool, CLIENT_REQ_CONNECT, fields, 2, p_resp);
+}
+
+
+
+int client_disconnect(struct client_pool* p_pool, char* username, struct client_response* p_resp)
+{
+    char* fields[] = { username };
+    return call_with_fields(p_pool, CLIENT_REQ_DISCONNECT, fields, 1, p_resp);
+}
+
+
+
+int client_heartbeat(struct client_pool* p_pool, char* username, struct client_response* p_resp)
+{
+    char* fields[] = { username };
+    return call_with_fields(p_pool, CLIENT_REQ_HEARTBEAT, fields, 1, p_resp);
+}
+
+
+
+int client_publish(struct client_pool* p_pool, char* username, char* file_name, char* description,
+    struct client_response* p_resp)
+{
+    char* fields[] = { username, file_name, description };
+    return call_with_fields(p_pool, CLIENT_REQ_PUBLISH, fields, 3, p_resp);
+}
+
+
+
+int client_delete(struct client_pool* p_pool, char* username, char* file_name,
+    struct client_response* p_resp)
+{
+    char* fields[] = { username, file_name };
+    return call_with_fields(p_pool, CLIENT_REQ_DELETE, fields, 2, p_resp);
+}
+
+
+
+int client_list_users(struct client_pool* p_pool, char* username, struct client_response* p_resp)
+{
+    char* fields[] = { username };
+    return call_with_fields(p_pool, CLIENT_REQ_LIST_USERS, fields, 1, p_resp);
+}
+
+
+
+int client_list_content(struct client_pool* p_pool, char* username, char* owner,
+    struct client_response* p_resp)
+{
+    char* fields[] = { username, owner };
+    return call_with_fields(p_pool, CLIENT_REQ_LIST_CONTENT, fields, 2, p_resp);
+}
+
+
+
+int client_list_users_filter(struct client_pool* p_pool, char* username, char* filter,
+    char* first, char* second, struct client_response* p_resp)
+{
+    char* fields[] = { username, filter, first, second };
+    return call_with_fields(p_pool, CLIENT_REQ_LIST_USERS_FILTER, fields, 4, p_resp);
+}
+
+
+
+int client_list_content_filter(struct client_pool* p_pool, char* username, char* owner,
+    char* filter, char* first, char* second, struct client_response* p_resp)
+{
+    char* fields[] = { username, owner, filter, first, second };
+    return call_with_fields(p_pool, CLIENT_REQ_LIST_CONTENT_FILTER, fields, 5, p_resp);
+}
+
+
+
+int client_put_file(struct client_pool* p_pool, char* username, char* file_name, char* content,
+    uint64_t size, struct client_response* p_resp)
+{
+    char str_size[MAX_NUMBER_LEN + 1];
+    sprintf(str_size, "%lu", (unsigned long) size);
+    char* fields[] = { username, file_name, str_size };
+
+    struct client_request request;
+    memset(&request, 0, sizeof(request));
+    request.type = CLIENT_REQ_PUT_FILE;
+    request.fields = fields;
+    request.num_of_fields = 3;
+    request.data = content;
+    request.data_len = size;
+
+    return client_call(p_pool, &request, p_resp);
+}
+
+
+
+int client_get_file(struct client_pool* p_pool, char* username, char* owner, char* file_name,
+    uint64_t offset, uint64_t length, struct client_response* p_resp)
+{
+    char str_offset[MAX_NUMBER_LEN + 1];
+    char str_length[MAX_NUMBER_LEN + 1];
+    sprintf(str_offset, "%lu", (unsigned long) offset);
+    sprintf(str_length, "%lu", (unsigned long) length);
+    char* fields[] = { username, owner, file_name, str_offset, str_length };
+    return call_with_fields(p_pool, CLIENT_REQ_GET_FILE, fields, 5, p_resp);
+}
+
+
+
+int client_search(struct client_pool* p_pool, char* username, char* query, uint32_t max_results,
+    struct client_response* p_resp)
+{
+    char str_max[MAX_NUMBER_LEN + 1];
+    sprintf(str_max, "%u", max_results);
+    char* fields[] = { username, query, str_max };
+    return call_with_fields(p_pool, CLIENT_REQ_SEARCH, fields, 3, p_resp);
+}
+
+
+
+int client_who_has(struct client_pool* p_pool, char* username, char* file_name,
+    struct client_response* p_resp)
+{
+    char* fields[] = { username, file_name };
+    return call_with_fields(p_pool, CLIENT_REQ_WHO_HAS, fields, 2, p_resp);
+}
+
+
+
+int client_announce(struct client_pool* p_pool, char* username, char* file_name, uint64_t size,
+    uint32_t chunk_size, uint32_t num_of_chunks, char** chunk_hashes,
+    struct client_response* p_resp)
+{
+    if (5 + (uint64_t) num_of_chunks > MAX_ANNOUNCE_FIELDS)
+        return CLIENT_ERR_INVALID;
+
+    char str_size[MAX_NUMBER_LEN + 1];
+    char str_chunk_size[MAX_NUMBER_LEN + 1];
+    char str_num_of_chunks[MAX_NUMBER_LEN + 1];
+    sprintf(str_size, "%lu", (unsigned long) size);
+    sprintf(str_chunk_size, "%u", chunk_size);
+    sprintf(str_num_of_chunks, "%u", num_of_chunks);
+
+    char** fields = malloc((5 + num_of_chunks) * sizeof(char*));
+    if (fields == NULL)
+        return CLIENT_ERR_MEMORY;
+
+    fields[0] = username;
+    fields[1] = file_name;
+    fields[2] = str_size;
+    fields[3] = str_chunk_size;
+    fields[4] = str_num_of_chunks;
+    memcpy(fields + 5, chunk_hashes, num_of_chunks * sizeof(char*));
+
+    int res = call_with_fields(p_pool, CLIENT_REQ_ANNOUNCE, fields, 5 + num_of_chunks, p_resp);
+    free(fields);
+
+    return res;
+}
+
+
+
+int client_get_sources(struct client_pool* p_pool, char* username, char* file_name,
+    uint32_t max_sources, struct client_response* p_resp)
+{
+    char str_max[MAX_NUMBER_LEN + 1];
+    sprintf(str_max, "%u", max_sources);
+    char* fields[] = { username, file_name, str_max };
+    return call_with_fields(p_pool, CLIENT_REQ_GET_SOURCES, fields, 3, p_resp);
+}
+
+
+
+int client_release_sources(struct client_pool* p_pool, char* username, char* file_name,
+    struct client_response* p_resp)
+{
+    char* fields[] = { username, file_name };
+    return call_with_fields(p_pool, CLIENT_REQ_RELEASE_SOURCES, fields, 2, p_resp);
+}
+
+
+
+int client_metrics(struct client_pool* p_pool, struct client_response* p_resp)
+{
+    return call_with_fields(p_pool, CLIENT_REQ_METRICS, NULL, 0, p_resp);
+}
+
+
+
+int client_replication_status(struct client_pool* p_pool, struct client_response* p_resp)
+{
+    return call_with_fields(p_pool, CLIENT_REQ_REPLICATION_STATUS, NULL, 0, p_resp);
+}
+
+
+
+/*
+    calls the batch of the type: the fields before the items (first_fields), the number of the
+    items and the fields of the items.
+*/
+int call_batch(struct client_pool* p_pool, char* type, char** first_fields,
+    uint32_t num_of_first_fields, char** item_fields, uint32_t num_of_items,
+    uint32_t fields_per_item, struct client_response* p_resp)
+{
+    if (num_of_items > CLIENT_MAX_BATCH_SIZE)
+        return CLIENT_ERR_INVALID;
+
+    char str_num_of_items[MAX_NUMBER_LEN + 1];
+    sprintf(str_num_of_items, "%u", num_of_items);
+
+    uint32_t num_of_fields = num_of_first_fields + 1 + num_of_items * fields_per_item;
+    char** fields = malloc(num_of_fields * sizeof(char*));
+    if (fields == NULL)
+        return CLIENT_ERR_MEMORY;
+
+    memcpy(fields, first_fields, num_of_first_fields * sizeof(char*));
+    fields[num_of_first_fields] = str_num_of_items;
+    memcpy(fields + num_of_first_fields + 1, item_fields, 
+        num_of_items * fields_per_item * sizeof(char*));
+
+    int res = call_with_fields(p_pool, type, fields, num_of_fields, p_resp);
+    free(fields);
+
+    return res;
+}
+
+
+
+int client_register_batch(struct client_pool* p_pool, char** usernames, uint32_t num_of_users,
+    struct client_response* p_resp)
+{
+    return call_batch(p_pool, CLIENT_REQ_REGISTER_BATCH, NULL, 0, usernames, num_of_users, 1,
+        p_resp);
+}
+
+
+
+int client_unregister_batch(struct client_pool* p_pool, char** usernames, uint32_t num_of_users,
+    struct client_response* p_resp)
+{
+    return call_batch(p_pool, CLIENT_REQ_UNREGISTER_BATCH, NULL, 0, usernames, num_of_users, 1,
+        p_resp);
+}
+
+
+
+int client_list_content_multi(struct client_pool* p_pool, char* username, char** owners,
+    uint32_t num_of_owners, struct client_response* p_resp)
+{
+    if (num_of_owners > CLIENT_MAX_LISTED_OWNERS)
+        return CLIENT_ERR_INVALID;
+
+    char* first_fields[] = { username };
+    return call_batch(p_pool, CLIENT_REQ_LIST_CONTENT_MULTI, first_fields, 1, owners,
+        num_of_owners, 1, p_resp);
+}
+
+
+
+int client_publish_batch(struct client_pool* p_pool, char* username, char** file_names,
+    char** descriptions, uint32_t num_of_files, struct client_response* p_resp)
+{
+    if (num_of_files > CLIENT_MAX_BATCH_SIZE)
+        return CLIENT_ERR_INVALID;
+
+    // name and description of every file
+    char** items = malloc((2 * (uint64_t) num_of_files + 1) * sizeof(char*));
+    if (items == NULL)
+        return CLIENT_ERR_MEMORY;
+
+    for (uint32_t i = 0; i < num_of_files; i++)
+    {
+        items[2 * i] = file_names[i];
+        items[2 * i + 1] = descriptions[i];
+    }
+
+    char* first_fields[] = { username };
+    int res = call_batch(p_pool, CLIENT_REQ_PUBLISH_BATCH, first_fields, 1, items, num_of_files,
+        2, p_resp);
+    free(items);
+
+    return res;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// udp
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int client_udp_open(char* host, int port, uint32_t timeout_ms, struct client_udp** pp_udp)
+{
+    struct hostent* p_host = gethostbyname(host);
+    if (p_host == NULL)
+        return CLIENT_ERR_CONNECT;
+
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    memcpy(&server_addr.sin_addr, p_host->h_addr, p_host->h_length);
+
+    struct client_udp* p_udp = calloc(1, sizeof(struct client_udp));
+    if (p_udp == NULL)
+        return CLIENT_ERR_MEMORY;
+
+    if (timeout_ms == 0)
+        timeout_ms = CLIENT_UDP_DEFAULT_TIMEOUT_MS;
+    struct timeval timeout = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+
+    p_udp->socket = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (p_udp->socket < 0
+        || setsockopt(p_udp->socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0
+        || connect(p_udp->socket, (struct sockaddr*) &server_addr, sizeof(server_addr)) != 0)
+    {
+        if (p_udp->socket >= 0)
+            close(p_udp->socket);
+        free(p_udp);
+        return CLIENT_ERR_CONNECT;
+    }
+
+    *pp_udp = p_udp;
+
+    return CLIENT_SUCCESS;
+}
+
+
+
+void client_udp_close(struct client_udp* p_udp)
+{
+    close(p_udp->socket);
+    free(p_udp);
+}
+
+
+
+int client_udp_call(struct client_udp* p_udp, char* type, char* username,
+    struct client_response* p_response)
+{
+    memset(p_response, 0, sizeof(struct client_response));
+
+    // tag, type and username, each finished by '\0'
+    char request[CLIENT_MAX_DATAGRAM_LEN];
+    char tag[21];
+    sprintf(tag, "%lu", (unsigned long) p_udp->next_tag++);
+    int len = snprintf(request, sizeof(request), "%s%c%s%c%s%c", tag, '\0', type, '\0',
+        username, '\0');
+    if (len < 0 || len >= (int) sizeof(request))
+        return CLIENT_ERR_INVALID;
+
+    if (send(p_udp->socket, request, len, 0) != len)
+        return CLIENT_ERR_SEND;
+
+    char response[CLIENT_MAX_DATAGRAM_LEN + 1];
+    for (;;)
+    {
+        ssize_t response_len = recv(p_udp->socket, response, CLIENT_MAX_DATAGRAM_LEN, 0);
+        if (response_len < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK ? CLIENT_ERR_TIMEOUT :
+                CLIENT_ERR_RECEIVE;
+
+        // the tag, the result code with its '\0', then the fields
+        response[response_len] = '\0';
+        size_t tag_len = strlen(response);
+        if (strcmp(response, tag) != 0 || tag_len + 2 > (size_t) response_len)
+            continue;   // a late response of an earlier request
+
+        p_response->result = (uint8_t) response[tag_len + 1];
+        uint32_t capacity = 0;
+        size_t pos = tag_len + 3;
+        for (; pos < (size_t) response_len; pos += strlen(response + pos) + 1)
+        {
+            if (append_field(p_response, &capacity, response + pos) != 0)
+            {
+                client_free_response(p_response);
+                return CLIENT_ERR_MEMORY;
+            }
+        }
+
+        return CLIENT_SUCCESS;
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// subscriptions
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int client_subscribe(char* host, int port, char* username, char** owners,
+    uint32_t num_of_owners, uint8_t* p_result, struct client_subscription** pp_subscription)
+{
+    if (num_of_owners > CLIENT_MAX_SUBSCRIBED_OWNERS)
+        return CLIENT_ERR_INVALID;
+
+    struct hostent* p_host = gethostbyname(host);
+    if (p_host == NULL)
+        return CLIENT_ERR_CONNECT;
+
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    memcpy(&server_addr.sin_addr, p_host->h_addr, p_host->h_length);
+
+    // username, number of owners and the owners
+    char str_num_of_owners[MAX_NUMBER_LEN + 1];
+    sprintf(str_num_of_owners, "%u", num_of_owners);
+    char** fields = malloc((num_of_owners + 2) * sizeof(char*));
+    struct client_subscription* p_subscription = calloc(1, sizeof(struct client_subscription));
+    if (fields == NULL || p_subscription == NULL)
+    {
+        free(fields);
+        free(p_subscription);
+        return CLIENT_ERR_MEMORY;
+    }
+
+    fields[0] = username;
+    fields[1] = str_num_of_owners;
+    memcpy(fields + 2, owners, num_of_owners * sizeof(char*));
+    struct client_request request = { CLIENT_REQ_SUBSCRIBE, fields, num_of_owners + 2, NULL, 0 };
+    size_t message_len = 0;
+    char* message = serialize_request(&request, &message_len);
+    free(fields);
+
+    int res = CLIENT_SUCCESS;
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    char res_code[2];
+    p_subscription->reader.fd = fd;
+    if (message == NULL)
+        res = CLIENT_ERR_MEMORY;
+    else if (fd < 0 || connect(fd, (struct sockaddr*) &server_addr, sizeof(server_addr)) != 0)
+        res = CLIENT_ERR_CONNECT;
+    else if (send_msg(fd, message, message_len) != 0)
+        res = CLIENT_ERR_SEND;
+    else if (read_exact(&p_subscription->reader, res_code, 2) != 0)
+        res = CLIENT_ERR_RECEIVE;
+    free(message);
+
+    if (res == CLIENT_SUCCESS)
+        *p_result = res_code[0];
+
+    if (res != CLIENT_SUCCESS || res_code[0] != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        free(p_subscription);
+        return res;
+    }
+
+    *pp_subscription = p_subscription;
+
+    return CLIENT_SUCCESS;
+}
+
+
+
+int client_next_event(struct client_subscription* p_subscription, struct client_response* p_event)
+{
+    memset(p_event, 0, sizeof(struct client_response));
+    uint32_t capacity = 0;
+    char type[CLIENT_MAX_FIELD_LEN + 1];
+
+    do
+    {
+        if (read_string(&p_subscription->reader, type) != 0)
+            return CLIENT_ERR_RECEIVE;
+    }
+    while (strcmp(type, "H") == 0);
+
+    // the owner and the file name follow a change
+    uint32_t num_of_fields = strcmp(type, "R") == 0 ? 0 : 2;
+    if (append_field(p_event, &capacity, type) != 0
+        || read_fields(&p_subscription->reader, p_event, &capacity, num_of_fields) != 0)
+    {
+        client_free_response(p_event);
+        return CLIENT_ERR_RECEIVE;
+    }
+
+    return CLIENT_SUCCESS;
+}
+
+
+
+void client_unsubscribe(struct client_subscription* p_subscription)
+{
+    close(p_subscription->reader.fd);
+    free(p_subscription);
+}
@@ -0,0 +1,269 @@
+#include <stdint.h>
+/*
+    C client library for the server. Requests are sent over a pool of persistent connections which
+    is safe to use from many threads. Every request can be sent synchronously (the call returns
+    when the response arrives) or asynchronously (the call returns as soon as the request is sent
+    and a callback is called with the response). Asynchronous requests are pipelined, i.e. many
+    requests are sent over one connection without waiting for the previous responses.
+    The messages use the same framing as the server (see lines.h). Writing to a connection which
+    the server closed raises SIGPIPE, so the application should ignore it.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// request types
+#define CLIENT_REQ_REGISTER "REGISTER"
+#define CLIENT_REQ_UNREGISTER "UNREGISTER"
+#define CLIENT_REQ_CONNECT "CONNECT"
+#define CLIENT_REQ_DISCONNECT "DISCONNECT"
+#define CLIENT_REQ_HEARTBEAT "HEARTBEAT"
+#define CLIENT_REQ_PUBLISH "PUBLISH"
+#define CLIENT_REQ_DELETE "DELETE"
+#define CLIENT_REQ_LIST_USERS "LIST_USERS"
+#define CLIENT_REQ_LIST_CONTENT "LIST_CONTENT"
+#define CLIENT_REQ_LIST_CONTENT_MULTI "LIST_CONTENT_MULTI"
+#define CLIENT_REQ_LIST_USERS_FILTER "LIST_USERS_FILTER"
+#define CLIENT_REQ_LIST_CONTENT_FILTER "LIST_CONTENT_FILTER"
+#define CLIENT_REQ_SUBSCRIBE "SUBSCRIBE"
+#define CLIENT_REQ_PUT_FILE "PUT_FILE"
+#define CLIENT_REQ_GET_FILE "GET_FILE"
+#define CLIENT_REQ_SEARCH "SEARCH"
+#define CLIENT_REQ_WHO_HAS "WHO_HAS"
+#define CLIENT_REQ_ANNOUNCE "ANNOUNCE"
+#define CLIENT_REQ_GET_SOURCES "GET_SOURCES"
+#define CLIENT_REQ_RELEASE_SOURCES "RELEASE_SOURCES"
+#define CLIENT_REQ_METRICS "METRICS"
+#define CLIENT_REQ_REPLICATION_STATUS "REPLICATION_STATUS"
+#define CLIENT_REQ_REGISTER_BATCH "REGISTER_BATCH"
+#define CLIENT_REQ_UNREGISTER_BATCH "UNREGISTER_BATCH"
+#define CLIENT_REQ_PUBLISH_BATCH "PUBLISH_BATCH"
+#define CLIENT_REQ_ACCEPT_ENCODING "ACCEPT_ENCODING"
+// sent over UDP only, see client_udp_call()
+#define CLIENT_REQ_PRESENCE "PRESENCE"
+// used between a sharding proxy and the servers behind it. SHARD is followed by the client's ip
+// address and the forwarded request (its type and fields), SHARD_FANOUT the same for a request
+// whose user the proxy checked already, see README.md
+#define CLIENT_REQ_SHARD "SHARD"
+#define CLIENT_REQ_SHARD_FANOUT "SHARD_FANOUT"
+#define CLIENT_REQ_USER_STATUS "USER_STATUS"
+#define CLIENT_REQ_SHARD_USERS "SHARD_USERS"
+#define CLIENT_REQ_USER_DUMP "USER_DUMP"
+// status of a call
+#define CLIENT_SUCCESS 0
+#define CLIENT_ERR_CONNECT 1
+#define CLIENT_ERR_SEND 2
+#define CLIENT_ERR_RECEIVE 3
+#define CLIENT_ERR_MEMORY 4
+#define CLIENT_ERR_CLOSED 5
+#define CLIENT_ERR_INVALID 6
+#define CLIENT_ERR_TIMEOUT 7
+// result code of a request rejected by the server because it's overloaded or the client sent
+// too many requests, the server closes the connection afterwards
+#define CLIENT_RESULT_BUSY 255
+// result code of a request which is not a read sent to a replica, the server closes the
+// connection afterwards
+#define CLIENT_RESULT_READ_ONLY 254
+// limits
+#define CLIENT_MAX_FIELD_LEN 1024
+#define CLIENT_DEFAULT_WINDOW 64
+#define CLIENT_MAX_BATCH_SIZE 10000 // items of a *_BATCH request
+#define CLIENT_MAX_LISTED_OWNERS 1000 // of a LIST_CONTENT_MULTI request
+#define CLIENT_MAX_SUBSCRIBED_OWNERS 1000
+#define CLIENT_MAX_DATAGRAM_LEN 512
+#define CLIENT_UDP_DEFAULT_TIMEOUT_MS 500
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct client_pool;
+struct client_udp;
+struct client_subscription;
+
+struct client_request {
+    char* type;             // one of CLIENT_REQ_*
+    char** fields;          // fields in the order the server expects them
+    uint32_t num_of_fields;
+    char* data;             // raw content which follows the fields (PUT_FILE)
+    uint64_t data_len;
+};
+
+/*
+    the response exactly as the server sent it: the result code and the fields which follow it,
+    e.g. for LIST_USERS the number of users and then username, ip and port of every user. Raw
+    content (GET_FILE) is put in data.
+*/
+struct client_response {
+    uint8_t result;
+    char** fields;
+    uint32_t num_of_fields;
+    char* data;
+    uint64_t data_len;
+};
+
+/*
+    called from the thread reading the responses when the response of an asynchronous request
+    arrives (status is CLIENT_SUCCESS) or the request failed (status is one of CLIENT_ERR_*, the
+    response is empty then). The response belongs to the library and is deleted after the
+    callback returns.
+*/
+typedef void (*client_callback)(int status, struct client_response* p_response, void* arg);
+
+
+
+/*
+    creates a pool of at most num_of_connections connections to the server at host:port, each of
+    them with at most window requests waiting for their responses. Connections are opened
+    lazily and reopened after errors. The pool is put where pp_pool points.
+    Returns:
+        CLIENT_SUCCESS      - success
+        CLIENT_ERR_MEMORY   - could not allocate the pool
+        CLIENT_ERR_CONNECT  - could not resolve the host
+*/
+int client_pool_create(char* host, int port, uint32_t num_of_connections, uint32_t window,
+    struct client_pool** pp_pool);
+/*
+    asks the server to compress the big listings (LIST_USERS, LIST_CONTENT) on every connection of
+    the pool, must be called before the first request. The library uncompresses them, so the
+    responses look the same. A server which does not compress them (e.g. a sharding proxy) sends
+    them as usual.
+*/
+void client_pool_accept_compression(struct client_pool* p_pool);
+/*
+    closes the connections of the pool and deletes it. Requests which are still waiting for their
+    responses fail with CLIENT_ERR_CLOSED.
+*/
+void client_pool_destroy(struct client_pool* p_pool);
+/*
+    sends the request without waiting for the response, callback is called with arg when it
+    arrives. Blocks only if the window of the chosen connection is full.
+    Returns:
+        CLIENT_SUCCESS      - the request was queued, the callback will be called exactly once
+        CLIENT_ERR_*        - the request could not be queued, the callback won't be called
+*/
+int client_submit(struct client_pool* p_pool, struct client_request* p_request,
+    client_callback callback, void* arg);
+/*
+    sends the request and waits for the response, which is put where p_response points. It has
+    to be deleted afterwards with client_free_response().
+    Returns CLIENT_SUCCESS or one of CLIENT_ERR_*
+*/
+int client_call(struct client_pool* p_pool, struct client_request* p_request,
+    struct client_response* p_response);
+/*
+    deletes the fields and data of the response.
+*/
+void client_free_response(struct client_response* p_response);
+
+/*
+    synchronous calls for every request type. They fill in the request and call client_call(),
+    so the response has to be deleted afterwards with client_free_response().
+    Returns CLIENT_SUCCESS or one of CLIENT_ERR_*, the result of the request is in the response.
+*/
+int client_register(struct client_pool* p_pool, char* username, struct client_response* p_resp);
+int client_unregister(struct client_pool* p_pool, char* username, struct client_response* p_resp);
+int client_connect(struct client_pool* p_pool, char* username, int listen_port,
+    struct client_response* p_resp);
+int client_disconnect(struct client_pool* p_pool, char* username, struct client_response* p_resp);
+int client_heartbeat(struct client_pool* p_pool, char* username, struct client_response* p_resp);
+int client_publish(struct client_pool* p_pool, char* username, char* file_name, char* description,
+    struct client_response* p_resp);
+int client_delete(struct client_pool* p_pool, char* username, char* file_name,
+    struct client_response* p_resp);
+int client_list_users(struct client_pool* p_pool, char* username, struct client_response* p_resp);
+int client_list_content(struct client_pool* p_pool, char* username, char* owner,
+    struct client_response* p_resp);
+/*
+    like client_list_users and client_list_content, but only the users (the files) whose names
+    match the filter are listed, sorted by the name. filter is "" (all of them), "prefix" (first
+    is the prefix), "glob" (first is the shell pattern) or "range" (from first to second, second
+    excluded, an empty bound is open).
+*/
+int client_list_users_filter(struct client_pool* p_pool, char* username, char* filter,
+    char* first, char* second, struct client_response* p_resp);
+int client_list_content_filter(struct client_pool* p_pool, char* username, char* owner,
+    char* filter, char* first, char* second, struct client_response* p_resp);
+/*
+    lists the content of at most CLIENT_MAX_LISTED_OWNERS owners in one request. The fields of a
+    successful response are the number of owners and for each owner, in the order the server
+    finished them in: owner, its result as a digit ("0" on success) and, on success, the number
+    of files and the name of each.
+*/
+int client_list_content_multi(struct client_pool* p_pool, char* username, char** owners,
+    uint32_t num_of_owners, struct client_response* p_resp);
+int client_put_file(struct client_pool* p_pool, char* username, char* file_name, char* content,
+    uint64_t size, struct client_response* p_resp);
+int client_get_file(struct client_pool* p_pool, char* username, char* owner, char* file_name,
+    uint64_t offset, uint64_t length, struct client_response* p_resp);
+int client_search(struct client_pool* p_pool, char* username, char* query, uint32_t max_results,
+    struct client_response* p_resp);
+int client_who_has(struct client_pool* p_pool, char* username, char* file_name,
+    struct client_response* p_resp);
+int client_announce(struct client_pool* p_pool, char* username, char* file_name, uint64_t size,
+    uint32_t chunk_size, uint32_t num_of_chunks, char** chunk_hashes,
+    struct client_response* p_resp);
+int client_get_sources(struct client_pool* p_pool, char* username, char* file_name,
+    uint32_t max_sources, struct client_response* p_resp);
+int client_release_sources(struct client_pool* p_pool, char* username, char* file_name,
+    struct client_response* p_resp);
+int client_metrics(struct client_pool* p_pool, struct client_response* p_resp);
+int client_replication_status(struct client_pool* p_pool, struct client_response* p_resp);
+/*
+    batches of at most CLIENT_MAX_BATCH_SIZE items. The only field of a successful response is
+    the result of every item as a digit, e.g. "010" when the second of three usernames was taken.
+*/
+int client_register_batch(struct client_pool* p_pool, char** usernames, uint32_t num_of_users,
+    struct client_response* p_resp);
+int client_unregister_batch(struct client_pool* p_pool, char** usernames, uint32_t num_of_users,
+    struct client_response* p_resp);
+int client_publish_batch(struct client_pool* p_pool, char* username, char** file_names,
+    char** descriptions, uint32_t num_of_files, struct client_response* p_resp);
+/*
+    opens a UDP socket to the UDP port of the server (server -U) at host:port, for HEARTBEAT and
+    PRESENCE in one datagram each way. A call waits at most timeout_ms (0 for
+    CLIENT_UDP_DEFAULT_TIMEOUT_MS) for its response. The socket is put where pp_udp points, it
+    must be used by one thread at a time.
+    Returns:
+        CLIENT_SUCCESS      - success
+        CLIENT_ERR_MEMORY   - could not allocate the socket
+        CLIENT_ERR_CONNECT  - could not resolve the host or open the socket
+*/
+int client_udp_open(char* host, int port, uint32_t timeout_ms, struct client_udp** pp_udp);
+/*
+    closes the UDP socket and deletes it.
+*/
+void client_udp_close(struct client_udp* p_udp);
+/*
+    sends the request of the type (CLIENT_REQ_HEARTBEAT or CLIENT_REQ_PRESENCE) for the username
+    in one datagram and waits for the response, which is put where p_response points. It has to
+    be deleted afterwards with client_free_response(). The fields of a PRESENCE response of a
+    connected user are its ip address and port. A lost datagram is not sent again, the call
+    fails with CLIENT_ERR_TIMEOUT and the caller decides whether to retry.
+    Returns CLIENT_SUCCESS or one of CLIENT_ERR_*
+*/
+int client_udp_call(struct client_udp* p_udp, char* type, char* username,
+    struct client_response* p_response);
+/*
+    opens a connection to the server at host:port which gets the changes of the files of at most
+    CLIENT_MAX_SUBSCRIBED_OWNERS owners (SUBSCRIBE) instead of polling their listings. The result
+    code of the request is put where p_result points and, when it's 0, the subscription where
+    pp_subscription points. It must be used by one thread at a time.
+    Returns CLIENT_SUCCESS or one of CLIENT_ERR_*
+*/
+int client_subscribe(char* host, int port, char* username, char** owners,
+    uint32_t num_of_owners, uint8_t* p_result, struct client_subscription** pp_subscription);
+/*
+    waits for the next change, which is put where p_event points. It has to be deleted
+    afterwards with client_free_response(). The first field is the type: "P" (published) or "X"
+    (deleted) followed by the owner and the file name, or "R" without fields when the server
+    dropped changes because they were not taken fast enough, the owners should be listed again
+    then. The heartbeats of the server are skipped.
+    Returns CLIENT_SUCCESS or one of CLIENT_ERR_*, the subscription can't be used after an error
+*/
+int client_next_event(struct client_subscription* p_subscription, struct client_response* p_event);
+/*
+    closes the connection of the subscription and deletes it.
+*/
+void client_unsubscribe(struct client_subscription* p_subscription);
@@ -0,0 +1,276 @@
+#include "admission.h"
+#include "config.h"
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define RATE_BUCKETS_BITS 12
+#define NUM_OF_RATE_BUCKETS (1 << RATE_BUCKETS_BITS)
+#define MAX_PROBES 8
+#define EMPTY_IP 0
+// tokens are counted in thousandths, so a millisecond refills exactly the requests per second
+#define TOKEN 1000
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    token bucket of one ip address. The state is updated with compare and swap as a whole: the
+    upper 32 bits are the time of the last update in milliseconds and the lower 32 bits are the
+    tokens left. State 0 means a bucket which was not used yet, i.e. a full one.
+*/
+struct rate_bucket {
+    uint32_t ip;
+    uint64_t state;
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// global variables
+///////////////////////////////////////////////////////////////////////////////////////////////////
+uint32_t num_of_connections;
+uint32_t num_of_in_flight_requests;
+// ip -> token bucket, open addressing, slots are never removed only taken over
+struct rate_bucket* rate_buckets;
+struct timespec admission_start;
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    Returns milliseconds since init_admission(), never 0 so it can't be confused with an unused
+    bucket. It wraps around after ~49 days, which only makes one refill of a bucket shorter.
+*/
+uint32_t now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+
+    uint64_t ms = (ts.tv_sec - admission_start.tv_sec) * 1000
+        + (ts.tv_nsec - admission_start.tv_nsec) / 1000000;
+
+    return (uint32_t) ms | 1;
+}
+
+
+
+uint32_t hash_ip(uint32_t ip)
+{
+    // Fibonacci hashing, the upper bits are the best mixed
+    return (ip * 2654435769u) >> (32 - RATE_BUCKETS_BITS);
+}
+
+
+
+/*
+    Returns the tokens of a full bucket, in thousandths
+*/
+uint64_t full_bucket(const struct config* p_config)
+{
+    return (uint64_t) p_config->rate_limit_burst * TOKEN;
+}
+
+
+
+/*
+    Returns the time after which an unused bucket is full again, so it can be given to another ip
+*/
+uint32_t bucket_refill_ms(const struct config* p_config)
+{
+    return (uint32_t) (full_bucket(p_config) / p_config->rate_limit_per_second);
+}
+
+
+
+/*
+    Returns the bucket of the ip, taking over a free or a long unused slot if the ip has none, or
+    NULL if all the slots where the ip can be are in use.
+*/
+struct rate_bucket* find_rate_bucket(uint32_t ip, uint32_t now, const struct config* p_config)
+{
+    uint32_t slot = hash_ip(ip);
+
+    for (uint32_t i = 0; i < MAX_PROBES; i++)
+    {
+        struct rate_bucket* p_bucket = &rate_buckets[(slot + i) & (NUM_OF_RATE_BUCKETS - 1)];
+        uint32_t bucket_ip = __atomic_load_n(&p_bucket->ip, __ATOMIC_ACQUIRE);
+
+        if (bucket_ip == ip)
+            return p_bucket;
+
+        if (bucket_ip == EMPTY_IP)
+        {
+            // the state of an empty slot is 0, i.e. a full bucket
+            if (__atomic_compare_exchange_n(&p_bucket->ip, &bucket_ip, ip, 0, __ATOMIC_ACQ_REL,
+                __ATOMIC_ACQUIRE) || bucket_ip == ip)
+                return p_bucket;
+        }
+    }
+
+    // take over the first bucket which would be full anyway
+    for (uint32_t i = 0; i < MAX_PROBES; i++)
+    {
+        struct rate_bucket* p_bucket = &rate_buckets[(slot + i) & (NUM_OF_RATE_BUCKETS - 1)];
+        uint64_t state = __atomic_load_n(&p_bucket->state, __ATOMIC_ACQUIRE);
+        uint32_t bucket_ip = __atomic_load_n(&p_bucket->ip, __ATOMIC_ACQUIRE);
+
+        if (state != 0 && now - (uint32_t) (state >> 32) < bucket_refill_ms(p_config))
+            continue;
+
+        if (__atomic_compare_exchange_n(&p_bucket->ip, &bucket_ip, ip, 0, __ATOMIC_ACQ_REL,
+            __ATOMIC_ACQUIRE))
+        {
+            // a request of the previous ip which is just being counted may take one token of
+            // the new one, which does not matter
+            __atomic_store_n(&p_bucket->state, 0, __ATOMIC_RELEASE);
+            return p_bucket;
+        }
+    }
+
+    return NULL;
+}
+
+
+
+/*
+    takes one token from the bucket of the ip.
+    Returns 1 if there was a token and 0 if no
+*/
+int take_token(uint32_t ip)
+{
+    uint32_t now = now_ms();
+    const struct config* p_config = get_config();
+    struct rate_bucket* p_bucket = find_rate_bucket(ip, now, p_config);
+    if (p_bucket == NULL)
+        return 1;   // too many active clients to track, the in-flight limit still applies
+
+    uint64_t state = __atomic_load_n(&p_bucket->state, __ATOMIC_ACQUIRE);
+    for (;;)
+    {
+        uint64_t tokens = full_bucket(p_config);
+        uint32_t stamp = now;
+        if (state != 0)
+        {
+            // another thread may have stored a later time since now was read, which must not
+            // wrap into a long elapsed time refilling the bucket
+            uint32_t last = (uint32_t) (state >> 32);
+            uint32_t elapsed = (int32_t) (now - last) > 0 ? now - last : 0;
+            if (elapsed == 0)
+                stamp = last;
+            tokens = (uint32_t) state;
+            if (elapsed >= bucket_refill_ms(p_config))
+                tokens = full_bucket(p_config);
+            else
+            {
+                tokens += (uint64_t) elapsed * p_config->rate_limit_per_second;
+                if (tokens > full_bucket(p_config))
+                    tokens = full_bucket(p_config);
+            }
+        }
+
+        if (tokens < TOKEN)
+            return 0;
+
+        uint64_t new_state = ((uint64_t) stamp << 32) | (tokens - TOKEN);
+        if (__atomic_compare_exchange_n(&p_bucket->state, &state, new_state, 1,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return 1;
+    }
+}
+
+
+
+/*
+    increments the counter if it's lower than the limit.
+    Returns 1 if it was incremented and 0 if no
+*/
+int try_increment(uint32_t* p_counter, uint32_t limit)
+{
+    if (__atomic_add_fetch(p_counter, 1, __ATOMIC_ACQ_REL) <= limit)
+        return 1;
+
+    __atomic_sub_fetch(p_counter, 1, __ATOMIC_ACQ_REL);
+
+    return 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// init / destroy
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int init_admission()
+{
+    rate_buckets = calloc(NUM_OF_RATE_BUCKETS, sizeof(struct rate_bucket));
+    if (rate_buckets == NULL)
+        return INIT_ADMISSION_ERR_MEMORY;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &admission_start);
+
+    return INIT_ADMISSION_SUCCESS;
+}
+
+
+
+void destroy_admission()
+{
+    free(rate_buckets);
+    rate_buckets = NULL;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// connections
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int admission_enter_connection()
+{
+    return try_increment(&num_of_connections, get_config()->max_connections) ?
+        ADMISSION_SUCCESS : ADMISSION_ERR_BUSY;
+}
+
+
+
+void admission_leave_connection()
+{
+    __atomic_sub_fetch(&num_of_connections, 1, __ATOMIC_ACQ_REL);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// requests
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int admission_enter_request(uint32_t ip)
+{
+    // local clients (e.g. tools running on the server) are not rate limited
+    int is_loopback = (ntohl(ip) >> 24) == 127;
+
+    if (!is_loopback && !take_token(ip))
+        return ADMISSION_ERR_RATE_LIMITED;
+
+    return try_increment(&num_of_in_flight_requests, get_config()->max_in_flight_requests) ?
+        ADMISSION_SUCCESS : ADMISSION_ERR_BUSY;
+}
+
+
+
+void admission_leave_request()
+{
+    __atomic_sub_fetch(&num_of_in_flight_requests, 1, __ATOMIC_ACQ_REL);
+}
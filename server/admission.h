@@ -0,0 +1,60 @@
+#include <stdint.h>
+/*
+    admission control of the server. It bounds the number of connections (i.e. request threads)
+    and of the requests processed at the same time, and limits the rate of the requests of every
+    client ip address with a token bucket. Everything is lock-free, so a request can be rejected
+    quickly with the BUSY result code even when the server is overloaded. The limits are taken
+    from the configuration (see config.h) on every request, so a reload changes them at once.
+    IMPORTANT before any operation will be performed it is required to call the init() function and
+    if the admission control won't be used anymore then the destroy() function must be called.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// defaults of the limits
+#define MAX_NUMBER_OF_CONNECTIONS 1024
+#define MAX_IN_FLIGHT_REQUESTS 256
+#define RATE_LIMIT_REQUESTS_PER_SECOND 500
+#define RATE_LIMIT_BURST 1000
+// init
+#define INIT_ADMISSION_SUCCESS 0
+#define INIT_ADMISSION_ERR_MEMORY 1
+// admit
+#define ADMISSION_SUCCESS 0
+#define ADMISSION_ERR_BUSY 1
+#define ADMISSION_ERR_RATE_LIMITED 2
+
+
+
+/*
+    must be called exactly once at the beginning, before the first call to any function
+    from this file has been done.
+    Returns:
+        INIT_ADMISSION_SUCCESS      - success
+        INIT_ADMISSION_ERR_MEMORY   - could not allocate the rate limiting table
+*/
+int init_admission();
+/*
+    must be called exactly once when the functions won't be used anymore.
+*/
+void destroy_admission();
+/*
+    reserves a connection. If ADMISSION_SUCCESS is returned then admission_leave_connection()
+    must be called when the connection is closed.
+    Returns:
+        ADMISSION_SUCCESS   - success
+        ADMISSION_ERR_BUSY  - there are already MAX_NUMBER_OF_CONNECTIONS connections
+*/
+int admission_enter_connection();
+void admission_leave_connection();
+/*
+    reserves processing of a request which came from the ip address (in network byte order). If
+    ADMISSION_SUCCESS is returned then admission_leave_request() must be called when the request
+    is processed. Requests from the loopback addresses are not rate limited.
+    Returns:
+        ADMISSION_SUCCESS           - success
+        ADMISSION_ERR_BUSY          - there are already MAX_IN_FLIGHT_REQUESTS requests processed
+        ADMISSION_ERR_RATE_LIMITED  - the ip address sent too many requests recently
+*/
+int admission_enter_request(uint32_t ip);
+void admission_leave_request();
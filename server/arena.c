@@ -0,0 +1,122 @@
+#include "arena.h"
+#include "metrics.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct arena_block {
+    struct arena_block* p_next;
+    size_t size;
+    size_t used;
+    char data[] __attribute__((aligned(ARENA_ALIGNMENT)));
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// arena
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void destroy_arena(struct arena* p_arena)
+{
+    arena_reset(p_arena);
+
+    free(p_arena->p_first);
+    p_arena->p_first = NULL;
+    p_arena->p_current = NULL;
+}
+
+
+
+void* arena_alloc(struct arena* p_arena, size_t size)
+{
+    if (p_arena == NULL)
+        return malloc(size);
+
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+    struct arena_block* p_block = p_arena->p_current;
+    if (p_block == NULL || p_block->size - p_block->used < size)
+    {
+        // a bigger allocation gets a block of its own
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        p_block = malloc(sizeof(struct arena_block) + block_size);
+        if (p_block == NULL)
+            return NULL;
+
+        p_block->p_next = NULL;
+        p_block->size = block_size;
+        p_block->used = 0;
+        if (p_arena->p_current == NULL)
+            p_arena->p_first = p_block;
+        else
+            p_arena->p_current->p_next = p_block;
+        p_arena->p_current = p_block;
+        p_arena->num_of_blocks++;
+    }
+
+    void* p_memory = p_block->data + p_block->used;
+    p_block->used += size;
+    p_arena->num_of_allocations++;
+    p_arena->num_of_bytes += size;
+
+    return p_memory;
+}
+
+
+
+char* arena_strdup(struct arena* p_arena, char* str)
+{
+    size_t len = strlen(str);
+    char* copy = arena_alloc(p_arena, len + 1);
+    if (copy != NULL)
+        memcpy(copy, str, len + 1);
+
+    return copy;
+}
+
+
+
+void arena_reset(struct arena* p_arena)
+{
+    if (p_arena->p_first == NULL)
+        return;
+
+    struct arena_block* p_next;
+    for (struct arena_block* p_block = p_arena->p_first->p_next; p_block != NULL; p_block = p_next)
+    {
+        p_next = p_block->p_next;
+        free(p_block);
+    }
+    p_arena->p_first->p_next = NULL;
+    p_arena->p_first->used = 0;
+
+    // a first block made for one big allocation is not kept, a default one takes its place
+    if (p_arena->p_first->size > ARENA_BLOCK_SIZE)
+    {
+        free(p_arena->p_first);
+        p_arena->p_first = malloc(sizeof(struct arena_block) + ARENA_BLOCK_SIZE);
+        if (p_arena->p_first != NULL)
+        {
+            p_arena->p_first->p_next = NULL;
+            p_arena->p_first->size = ARENA_BLOCK_SIZE;
+            p_arena->p_first->used = 0;
+        }
+    }
+    p_arena->p_current = p_arena->p_first;
+
+    if (p_arena->num_of_allocations > 0)
+    {
+        metrics_add(METRIC_ARENA_ALLOCATIONS, p_arena->num_of_allocations);
+        metrics_add(METRIC_ARENA_BYTES, p_arena->num_of_bytes);
+        metrics_add(METRIC_ARENA_BLOCKS, p_arena->num_of_blocks);
+    }
+    p_arena->num_of_allocations = 0;
+    p_arena->num_of_bytes = 0;
+    p_arena->num_of_blocks = 0;
+}
@@ -0,0 +1,60 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <stddef.h>
+#include <stdint.h>
+/*
+    bump allocator for the memory which is needed only while one request is processed, e.g. the
+    lists sent in a response. An allocation just moves a pointer in the current block and nothing
+    is freed one by one: arena_reset releases everything at once at the end of the request. Every
+    request thread has its own arena, so allocating takes no lock. The first block is kept between
+    the requests (one of ARENA_BLOCK_SIZE), the blocks added for bigger requests are freed by the
+    reset.
+    The allocations are counted in the arena and added to the metrics (METRIC_ARENA_*) by the
+    reset, so the shared counters are not touched by every allocation.
+    A zeroed arena is empty and ready to be used, so a thread-local one needs no initialization.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define ARENA_BLOCK_SIZE 65536
+#define ARENA_ALIGNMENT 16
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct arena_block;
+
+struct arena {
+    struct arena_block* p_first;    // kept by the reset
+    struct arena_block* p_current;  // the allocations are taken from its end
+    uint64_t num_of_allocations;    // since the last reset
+    uint64_t num_of_bytes;
+    uint64_t num_of_blocks;
+};
+
+
+
+/*
+    frees all the blocks of the arena. It's empty afterwards and can be used again.
+*/
+void destroy_arena(struct arena* p_arena);
+/*
+    allocates size bytes aligned to ARENA_ALIGNMENT in the arena, they are valid till the next
+    arena_reset. When p_arena is NULL the memory is allocated with malloc() and has to be freed.
+    Returns the memory or NULL if it could not be allocated
+*/
+void* arena_alloc(struct arena* p_arena, size_t size);
+/*
+    copies the string into the arena (or with malloc() when p_arena is NULL), see arena_alloc.
+    Returns the copy or NULL if it could not be allocated
+*/
+char* arena_strdup(struct arena* p_arena, char* str);
+/*
+    releases all the allocations of the arena at once and adds their numbers to the metrics.
+*/
+void arena_reset(struct arena* p_arena);
+
+#endif
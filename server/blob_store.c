@@ -0,0 +1,265 @@
+#include "blob_store.h"
+#include "metrics.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <openssl/sha.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// blobs/<2 hex digits>/<62 hex digits>
+#define BLOB_PATH_LEN (strlen(BLOB_DIR_PATH) + 2 * SHA256_DIGEST_LENGTH + 1)
+// of the links created next to a file before they replace it
+#define MAX_LINK_NAME_LEN 64
+// a file whose blob is deleted while it's being linked to it tries again
+#define MAX_LINK_ATTEMPTS 3
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// global variables
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// makes the names of the links unique
+uint64_t num_of_links;
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    puts the path of the blob of the len bytes of data into path, which must have room for
+    BLOB_PATH_LEN + 1 characters.
+*/
+void get_blob_path(const unsigned char* data, size_t len, char* path)
+{
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    SHA256(data, len, hash);
+
+    char* p = path + sprintf(path, "%s%02x/", BLOB_DIR_PATH, hash[0]);
+    for (int i = 1; i < SHA256_DIGEST_LENGTH; i++)
+        p += sprintf(p, "%02x", hash[i]);
+}
+
+
+
+/*
+    puts the path of the blob of the content of the file opened as fd into path, see
+    get_blob_path. The file is mapped, not copied.
+    Returns 0 on success and -1 if the file could not be read
+*/
+int get_fd_blob_path(int fd, char* path)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        return -1;
+
+    if (st.st_size == 0)
+    {
+        get_blob_path((const unsigned char*) "", 0, path);
+        return 0;
+    }
+
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+        return -1;
+
+    get_blob_path(data, st.st_size, path);
+    munmap(data, st.st_size);
+
+    return 0;
+}
+
+
+
+/*
+    puts the path of the blob of the content of the file into path, see get_fd_blob_path.
+    Returns 0 on success and -1 if the file could not be read
+*/
+int get_file_blob_path(char* file_path, char* path)
+{
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    int res = get_fd_blob_path(fd, path);
+    close(fd);
+
+    return res;
+}
+
+
+
+/*
+    Returns 1 if the link failed because of the error, errno, the file system can't link the file
+    (too many links, other file system, no hard links at all), so it's not shared
+*/
+int is_unsharable(int error)
+{
+    return error == EMLINK || error == EXDEV || error == EPERM;
+}
+
+
+
+/*
+    puts a unique hidden name in the directory of the file with the path into link_path, which
+    must have room for strlen(path) + MAX_LINK_NAME_LEN + 1 characters.
+*/
+void get_link_path(char* path, char* link_path)
+{
+    char* name = strrchr(path, '/');
+    size_t dir_len = name != NULL ? name - path + 1 : 0;
+
+    memcpy(link_path, path, dir_len);
+    sprintf(link_path + dir_len, ".link.%ld.%lu", (long) getpid(),
+        (unsigned long) __atomic_add_fetch(&num_of_links, 1, __ATOMIC_RELAXED));
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// init
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int init_blob_store()
+{
+    if (mkdir(BLOB_DIR_PATH, S_IRWXU) != 0 && errno != EEXIST)
+        return INIT_BLOB_STORE_ERR_FOLDER_CREATION;
+
+    // the directories of the first byte of the hash, so linking never has to create them
+    char dir_path[strlen(BLOB_DIR_PATH) + 3];
+    for (int i = 0; i < 256; i++)
+    {
+        sprintf(dir_path, "%s%02x", BLOB_DIR_PATH, i);
+        if (mkdir(dir_path, S_IRWXU) != 0 && errno != EEXIST)
+            return INIT_BLOB_STORE_ERR_FOLDER_CREATION;
+    }
+
+    return INIT_BLOB_STORE_SUCCESS;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// link_blob
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int link_blob(char* data, size_t len, char* path)
+{
+    char blob_path[BLOB_PATH_LEN + 1];
+    get_blob_path((const unsigned char*) data, len, blob_path);
+
+    if (link(blob_path, path) == 0)
+    {
+        metrics_increment(METRIC_FILES_DEDUPLICATED);
+        return LINK_BLOB_SUCCESS;
+    }
+
+    if (errno == EEXIST)
+        return LINK_BLOB_ERR_EXISTS;
+    if (errno == ENOENT || is_unsharable(errno))
+        return LINK_BLOB_ERR_NO_BLOB;
+
+    return LINK_BLOB_ERR_LINK;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// dedup_file
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int dedup_file(char* path, char* data, uint64_t len)
+{
+    char blob_path[BLOB_PATH_LEN + 1];
+    if (data != NULL)
+        get_blob_path((const unsigned char*) data, len, blob_path);
+    else if (get_file_blob_path(path, blob_path) != 0)
+        return DEDUP_FILE_ERR_READ;
+
+    char link_path[strlen(path) + MAX_LINK_NAME_LEN + 1];
+    get_link_path(path, link_path);
+
+    for (int i = 0; i < MAX_LINK_ATTEMPTS; i++)
+    {
+        // the first file with the content becomes its blob
+        if (link(path, blob_path) == 0)
+            return DEDUP_FILE_SUCCESS;
+        if (errno != EEXIST)
+            return is_unsharable(errno) ? DEDUP_FILE_SUCCESS : DEDUP_FILE_ERR_LINK;
+
+        struct stat file_st, blob_st;
+        if (stat(path, &file_st) != 0)
+            return DEDUP_FILE_ERR_READ;
+        if (stat(blob_path, &blob_st) != 0)
+            continue;   // deleted by the reclaimer meanwhile
+        if (file_st.st_ino == blob_st.st_ino && file_st.st_dev == blob_st.st_dev)
+            return DEDUP_FILE_SUCCESS;
+
+        // the link replaces the file with one rename, its readers see the same content
+        if (link(blob_path, link_path) != 0)
+        {
+            if (errno == ENOENT)
+                continue;
+            return is_unsharable(errno) ? DEDUP_FILE_SUCCESS : DEDUP_FILE_ERR_LINK;
+        }
+
+        if (rename(link_path, path) != 0)
+        {
+            unlink(link_path);
+            return DEDUP_FILE_ERR_LINK;
+        }
+
+        metrics_increment(METRIC_FILES_DEDUPLICATED);
+        return DEDUP_FILE_LINKED;
+    }
+
+    // the blobs keep being deleted, the file stays as it is
+    return DEDUP_FILE_SUCCESS;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// release_blob
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void release_blob(char* data, size_t len)
+{
+    char blob_path[BLOB_PATH_LEN + 1];
+    get_blob_path((const unsigned char*) data, len, blob_path);
+
+    // a file linked to it meanwhile keeps the content, only the sharing is lost
+    struct stat st;
+    if (stat(blob_path, &st) == 0 && st.st_nlink == 1 && unlink(blob_path) == 0)
+        metrics_increment(METRIC_FILES_RECLAIMED);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// release_file_blob
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void release_file_blob(int fd)
+{
+    // a shared file is its blob, when that's the last link nothing else needs the content
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_nlink != 1)
+        return;
+
+    char blob_path[BLOB_PATH_LEN + 1];
+    struct stat blob_st;
+    if (get_fd_blob_path(fd, blob_path) == 0 && stat(blob_path, &blob_st) == 0
+        && blob_st.st_ino == st.st_ino && blob_st.st_dev == st.st_dev && blob_st.st_nlink == 1
+        && unlink(blob_path) == 0)
+        metrics_increment(METRIC_FILES_RECLAIMED);
+}
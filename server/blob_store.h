@@ -0,0 +1,78 @@
+#include <stddef.h>
+#include <stdint.h>
+/*
+    content-addressed store of the descriptions and of the relayed file content. Many users publish
+    the same files with the same descriptions, so every distinct content is kept once, as a blob
+    named by its SHA-256 hash: blobs/<2 hex digits>/<62 hex digits>. The files of the users (in
+    storage/ and content/) are hard links to their blobs, so reading them does not change at all,
+    a shared content takes its disk blocks and its pages in the page cache once, and the reference
+    count of a blob is kept by the file system as its link count: the blob is not needed anymore
+    when it's its only link. Such blobs are deleted by the reclaimer (see reclaimer.h).
+    The files are never changed in place, they are created and then replaced or deleted as a whole,
+    so sharing them is safe. The store needs no lock: a blob deleted by the reclaimer just when it
+    is linked again only loses the sharing, the content stays in the file linking to it. A content
+    whose blob can't take more links (e.g. the link limit of the file system) is kept unshared.
+    IMPORTANT before any operation will be performed it is required to call the init() function.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// the blobs must be on the same file system as the storage and the content
+#define BLOB_DIR_PATH "blobs/"
+// init
+#define INIT_BLOB_STORE_SUCCESS 0
+#define INIT_BLOB_STORE_ERR_FOLDER_CREATION 1
+// link blob
+#define LINK_BLOB_SUCCESS 0
+#define LINK_BLOB_ERR_NO_BLOB 1
+#define LINK_BLOB_ERR_EXISTS 2
+#define LINK_BLOB_ERR_LINK 3
+// dedup file
+#define DEDUP_FILE_SUCCESS 0
+#define DEDUP_FILE_LINKED 1
+#define DEDUP_FILE_ERR_READ 2
+#define DEDUP_FILE_ERR_LINK 3
+
+
+
+/*
+    must be called exactly once at the beginning, before the first call to any function
+    from this file has been done.
+    Returns:
+        INIT_BLOB_STORE_SUCCESS             - success
+        INIT_BLOB_STORE_ERR_FOLDER_CREATION - could not create the blobs folder
+*/
+int init_blob_store();
+/*
+    creates the file with the path as a link to the blob of the len bytes of data, if there is
+    one, so nothing has to be written.
+    Returns:
+        LINK_BLOB_SUCCESS       - success
+        LINK_BLOB_ERR_NO_BLOB   - there is no blob of the data (or it can't be linked), the file
+                                  has to be written and then passed to dedup_file()
+        LINK_BLOB_ERR_EXISTS    - the file exists already
+        LINK_BLOB_ERR_LINK      - could not create the file
+*/
+int link_blob(char* data, size_t len, char* path);
+/*
+    shares the content of the file with the path: the file becomes the blob of its content or,
+    when there is one already, it's replaced by a link to the blob. The file is replaced with one
+    rename(), so its readers see the same content all the time. data are the len bytes of the
+    content when the caller has them, when it's NULL the file is read.
+    Returns:
+        DEDUP_FILE_SUCCESS      - success, the file is the blob of its content (or it can't be)
+        DEDUP_FILE_LINKED       - success, the file was replaced by a link to the blob
+        DEDUP_FILE_ERR_READ     - could not read the file
+        DEDUP_FILE_ERR_LINK     - could not link the file
+*/
+int dedup_file(char* path, char* data, uint64_t len);
+/*
+    deletes the blob of the len bytes of data if nothing links to it anymore, right after the
+    caller deleted a file with the data.
+*/
+void release_blob(char* data, size_t len);
+/*
+    deletes the blob of the file opened as fd if nothing links to it anymore, right after the
+    caller dropped a link to the file. The file is read only when the blob is its last link.
+*/
+void release_file_blob(int fd);
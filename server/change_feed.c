@@ -0,0 +1,667 @@
+#define _GNU_SOURCE
+#include "change_feed.h"
+#include "config.h"
+#include "user_dao.h"
+#include "connected_users.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define NUM_OF_USER_LOCKS 64        // must be a power of 2, at most 64 (a bit mask of them is used)
+#define FEED_QUEUE_SIZE 16
+#define MAX_CHANGES_IN_BATCH 1024
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    change in the log. The fields are stored one after another, each finished by '\0', exactly as
+    they are sent. NULL fields mean that the change could not be stored, the replicas which did
+    not get it yet have to start over.
+*/
+struct feed_change {
+    uint64_t seq;
+    uint64_t time_ms;
+    char type;
+    char* fields;
+    size_t fields_len;
+};
+
+/*
+    connected replica, served by its own thread
+*/
+struct feed_replica {
+    int socket;
+    struct feed_replica* p_prev;
+    struct feed_replica* p_next;
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// global variables
+///////////////////////////////////////////////////////////////////////////////////////////////////
+int is_feed_enabled;
+// the users are locked also without the feed, they serialize the changes of a user
+pthread_mutex_t user_locks[NUM_OF_USER_LOCKS] = {
+    [0 ... NUM_OF_USER_LOCKS - 1] = PTHREAD_MUTEX_INITIALIZER
+};
+/*
+    the log, the replicas and the feed state, protected by mutex_feed. cond_feed is signaled when
+    a change is appended and when the feed is destroyed, cond_replicas when a replica disconnects.
+*/
+pthread_mutex_t mutex_feed;
+pthread_cond_t cond_feed;
+pthread_cond_t cond_replicas;
+struct feed_change* feed_log;
+uint64_t next_seq;
+int is_feed_running;
+struct feed_replica* replicas;
+uint32_t num_of_replicas;
+int feed_socket;
+pthread_t t_feed_accept;
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint64_t feed_time_ms()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+
+
+uint32_t get_user_lock_idx(char* username)
+{
+    uint32_t hash = 5381;
+    for (char* p = username; *p != '\0'; p++)
+        hash = hash * 33 + (unsigned char) *p;
+
+    return hash & (NUM_OF_USER_LOCKS - 1);
+}
+
+
+
+pthread_mutex_t* get_user_lock(char* username)
+{
+    return &user_locks[get_user_lock_idx(username)];
+}
+
+
+
+void write_feed_field(FILE* p_stream, char* field)
+{
+    fputs(field, p_stream);
+    fputc('\0', p_stream);
+}
+
+
+
+void write_feed_number(FILE* p_stream, uint64_t number)
+{
+    fprintf(p_stream, "%lu", (unsigned long) number);
+    fputc('\0', p_stream);
+}
+
+
+
+/*
+    writes the field to the stream pointed by arg, used with the scans.
+*/
+void write_feed_field_arg(char* field, void* arg)
+{
+    write_feed_field(arg, field);
+}
+
+
+
+void write_snapshot_user(char* username, void* arg)
+{
+    write_feed_field(arg, FEED_SNAPSHOT_USER);
+    write_feed_field(arg, username);
+}
+
+
+
+/*
+    writes the user (see write_snapshot_user) with its files and its connection, which must be
+    locked, to the snapshot.
+    Returns 0 on success and -1 on fail
+*/
+int write_snapshot_user_state(FILE* p_snapshot, char* username)
+{
+    // unregistered after it was listed
+    char** files = NULL;
+    uint32_t num_of_files = 0;
+    int list_res = get_user_files_list(username, &files, &num_of_files, NULL);
+    if (list_res == GET_USER_FILES_LIST_ERR_NO_SUCH_USER)
+        return 0;
+    if (list_res != GET_USER_FILES_LIST_SUCCESS)
+        return -1;
+
+    write_snapshot_user(username, p_snapshot);
+    for (uint32_t i = 0; i < num_of_files; i++)
+    {
+        write_feed_field(p_snapshot, FEED_SNAPSHOT_FILE);
+        write_feed_field(p_snapshot, username);
+        write_feed_field(p_snapshot, files[i]);
+        free(files[i]);
+    }
+    free(files);
+
+    user user_data;
+    if (get_connected_user(username, &user_data))
+    {
+        write_feed_field(p_snapshot, FEED_SNAPSHOT_CONNECTED);
+        write_feed_field(p_snapshot, username);
+        write_feed_field(p_snapshot, user_data.ip);
+        write_feed_field(p_snapshot, user_data.port);
+    }
+
+    return 0;
+}
+
+
+
+/*
+    writes the snapshot of the state to the replica and puts the sequence number it is taken at
+    where p_seq points. The users are listed without any lock and each is then written with only
+    its own lock held, so the changes go on meanwhile. A change of a user is appended to the feed
+    under its lock after it's done, so the state of every user includes all the changes up to the
+    sequence number and maybe some later ones, which the replica applies again (they set the
+    state, so applying them twice changes nothing). The snapshot is built in memory and sent
+    afterwards.
+    Returns 0 on success and -1 on fail
+*/
+int send_feed_snapshot(FILE* p_stream, uint64_t* p_seq)
+{
+    char* usernames = NULL;
+    size_t usernames_len = 0;
+    FILE* p_usernames = open_memstream(&usernames, &usernames_len);
+    if (p_usernames == NULL)
+        return -1;
+
+    char* snapshot = NULL;
+    size_t snapshot_len = 0;
+    FILE* p_snapshot = open_memstream(&snapshot, &snapshot_len);
+    if (p_snapshot == NULL)
+    {
+        fclose(p_usernames);
+        free(usernames);
+        return -1;
+    }
+
+    // taken before the users are read, the later changes are sent after the snapshot
+    pthread_mutex_lock(&mutex_feed);
+    *p_seq = next_seq - 1;
+    pthread_mutex_unlock(&mutex_feed);
+
+    write_feed_field(p_snapshot, FEED_SNAPSHOT);
+    write_feed_number(p_snapshot, *p_seq);
+    write_feed_number(p_snapshot, feed_time_ms());
+
+    int res = scan_users_unlocked(write_feed_field_arg, p_usernames) == SCAN_USERS_SUCCESS
+        ? 0 : -1;
+    if (fclose(p_usernames) != 0)
+        res = -1;
+
+    for (size_t offset = 0; res == 0 && offset < usernames_len;
+        offset += strlen(usernames + offset) + 1)
+    {
+        char* username = usernames + offset;
+        change_feed_lock_user(username);
+        res = write_snapshot_user_state(p_snapshot, username);
+        change_feed_unlock_user(username);
+    }
+    free(usernames);
+
+    write_feed_field(p_snapshot, FEED_SNAPSHOT_END);
+    if (fclose(p_snapshot) != 0)
+        res = -1;
+
+    if (res == 0 && (fwrite(snapshot, 1, snapshot_len, p_stream) != snapshot_len
+        || fflush(p_stream) != 0))
+        res = -1;
+
+    free(snapshot);
+
+    return res;
+}
+
+
+
+/*
+    writes the changes following seq to the replica till it disconnects, falls too far behind or
+    the feed is destroyed. The changes are copied to p_batch with the mutex locked and sent after
+    it's unlocked.
+*/
+void send_feed_changes(FILE* p_stream, FILE* p_batch, char** p_batch_buf, size_t* p_batch_len,
+    uint64_t seq)
+{
+    pthread_mutex_lock(&mutex_feed);
+
+    while (is_feed_running)
+    {
+        uint64_t oldest_seq = next_seq > FEED_LOG_SIZE ? next_seq - FEED_LOG_SIZE : 1;
+        if (seq + 1 < oldest_seq)
+            break;  // overwritten, the replica has to start over
+
+        rewind(p_batch);
+
+        if (seq + 1 == next_seq)
+        {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += FEED_HEARTBEAT_MS * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L)
+            {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+
+            int wait_res = 0;
+            while (is_feed_running && seq + 1 == next_seq && wait_res != ETIMEDOUT)
+                wait_res = pthread_cond_timedwait(&cond_feed, &mutex_feed, &deadline);
+
+            if (!is_feed_running || seq + 1 != next_seq)
+                continue;
+
+            write_feed_field(p_batch, FEED_HEARTBEAT);
+            write_feed_number(p_batch, seq);
+            write_feed_number(p_batch, feed_time_ms());
+        }
+        else
+        {
+            int is_lost = 0;
+            char type[2] = {0, 0};
+
+            for (int i = 0; i < MAX_CHANGES_IN_BATCH && seq + 1 < next_seq; i++)
+            {
+                struct feed_change* p_change = &feed_log[(seq + 1) & (FEED_LOG_SIZE - 1)];
+                if (p_change->fields == NULL)
+                {
+                    is_lost = 1;
+                    break;
+                }
+
+                type[0] = p_change->type;
+                write_feed_field(p_batch, type);
+                write_feed_number(p_batch, p_change->seq);
+                write_feed_number(p_batch, p_change->time_ms);
+                fwrite(p_change->fields, 1, p_change->fields_len, p_batch);
+                seq++;
+            }
+
+            if (is_lost)
+                break;
+        }
+
+        pthread_mutex_unlock(&mutex_feed);
+
+        int res = fflush(p_batch) == 0
+            && fwrite(*p_batch_buf, 1, *p_batch_len, p_stream) == *p_batch_len
+            && fflush(p_stream) == 0;
+
+        pthread_mutex_lock(&mutex_feed);
+
+        if (!res)
+            break;  // the replica disconnected
+    }
+
+    pthread_mutex_unlock(&mutex_feed);
+}
+
+
+
+void* serve_replica(void* p_replica_arg)
+{
+    struct feed_replica* p_replica = p_replica_arg;
+    FILE* p_stream = fdopen(p_replica->socket, "w");
+    char* batch = NULL;
+    size_t batch_len = 0;
+    FILE* p_batch = open_memstream(&batch, &batch_len);
+    uint64_t seq = 0;
+
+    if (p_stream != NULL && p_batch != NULL && send_feed_snapshot(p_stream, &seq) == 0)
+        send_feed_changes(p_stream, p_batch, &batch, &batch_len, seq);
+
+    pthread_mutex_lock(&mutex_feed);
+    if (p_replica->p_prev != NULL)
+        p_replica->p_prev->p_next = p_replica->p_next;
+    else
+        replicas = p_replica->p_next;
+    if (p_replica->p_next != NULL)
+        p_replica->p_next->p_prev = p_replica->p_prev;
+    num_of_replicas--;
+    pthread_cond_signal(&cond_replicas);
+    pthread_mutex_unlock(&mutex_feed);
+
+    if (p_batch != NULL)
+        fclose(p_batch);
+    free(batch);
+
+    if (p_stream != NULL)
+        fclose(p_stream);
+    else
+        close(p_replica->socket);
+    free(p_replica);
+
+    printf("replica disconnected\n");
+
+    return NULL;
+}
+
+
+
+void* accept_replicas(void* arg)
+{
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    while (1)
+    {
+        int sd = accept(feed_socket, NULL, NULL);
+        if (sd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;  // the feed is destroyed
+        }
+
+        int no_delay = 1;
+        setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+        struct feed_replica* p_replica = malloc(sizeof(struct feed_replica));
+        if (p_replica == NULL)
+        {
+            close(sd);
+            continue;
+        }
+        p_replica->socket = sd;
+        p_replica->p_prev = NULL;
+
+        pthread_mutex_lock(&mutex_feed);
+
+        if (!is_feed_running)
+        {
+            pthread_mutex_unlock(&mutex_feed);
+            close(sd);
+            free(p_replica);
+            break;
+        }
+
+        p_replica->p_next = replicas;
+        if (replicas != NULL)
+            replicas->p_prev = p_replica;
+        replicas = p_replica;
+        num_of_replicas++;
+
+        pthread_t t_replica;
+        if (pthread_create(&t_replica, &attr, serve_replica, p_replica) != 0)
+        {
+            replicas = p_replica->p_next;
+            if (replicas != NULL)
+                replicas->p_prev = NULL;
+            num_of_replicas--;
+            close(sd);
+            free(p_replica);
+        }
+        else
+            printf("replica connected\n");
+
+        pthread_mutex_unlock(&mutex_feed);
+    }
+
+    pthread_attr_destroy(&attr);
+
+    return NULL;
+}
+
+
+
+int open_feed_socket(int port)
+{
+    int sd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sd < 0)
+        return -1;
+
+    int enable = 1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (get_config()->address[0] != '\0')
+        inet_pton(AF_INET, get_config()->address, &addr.sin_addr);
+
+    if (setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) != 0
+        || bind(sd, (struct sockaddr*) &addr, sizeof(addr)) != 0
+        || listen(sd, FEED_QUEUE_SIZE) != 0)
+    {
+        close(sd);
+        return -1;
+    }
+
+    return sd;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// init / destroy
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int init_change_feed(int port)
+{
+    feed_log = calloc(FEED_LOG_SIZE, sizeof(struct feed_change));
+    if (feed_log == NULL)
+        return INIT_CHANGE_FEED_ERR_MEMORY;
+
+    feed_socket = open_feed_socket(port);
+    if (feed_socket < 0)
+    {
+        free(feed_log);
+        return INIT_CHANGE_FEED_ERR_SOCKET;
+    }
+
+    pthread_mutex_init(&mutex_feed, NULL);
+    pthread_cond_init(&cond_feed, NULL);
+    pthread_cond_init(&cond_replicas, NULL);
+    next_seq = 1;
+    replicas = NULL;
+    num_of_replicas = 0;
+    is_feed_running = 1;
+
+    if (pthread_create(&t_feed_accept, NULL, accept_replicas, NULL) != 0)
+    {
+        close(feed_socket);
+        free(feed_log);
+        return INIT_CHANGE_FEED_ERR_THREAD;
+    }
+
+    is_feed_enabled = 1;
+
+    return INIT_CHANGE_FEED_SUCCESS;
+}
+
+
+
+void destroy_change_feed()
+{
+    if (!is_feed_enabled)
+        return;
+
+    pthread_mutex_lock(&mutex_feed);
+    is_feed_running = 0;
+    pthread_cond_broadcast(&cond_feed);
+    pthread_mutex_unlock(&mutex_feed);
+
+    // wakes up the accept
+    shutdown(feed_socket, SHUT_RDWR);
+    pthread_join(t_feed_accept, NULL);
+    close(feed_socket);
+
+    pthread_mutex_lock(&mutex_feed);
+    for (struct feed_replica* p_replica = replicas; p_replica != NULL;
+        p_replica = p_replica->p_next)
+        shutdown(p_replica->socket, SHUT_RDWR);
+    while (num_of_replicas > 0)
+        pthread_cond_wait(&cond_replicas, &mutex_feed);
+    pthread_mutex_unlock(&mutex_feed);
+
+    is_feed_enabled = 0;
+
+    for (uint32_t i = 0; i < FEED_LOG_SIZE; i++)
+        free(feed_log[i].fields);
+    free(feed_log);
+
+    pthread_cond_destroy(&cond_replicas);
+    pthread_cond_destroy(&cond_feed);
+    pthread_mutex_destroy(&mutex_feed);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// changes
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void change_feed_lock_user(char* username)
+{
+    pthread_mutex_lock(get_user_lock(username));
+}
+
+
+
+void change_feed_unlock_user(char* username)
+{
+    pthread_mutex_unlock(get_user_lock(username));
+}
+
+
+
+/*
+    Returns the mask of the locks of the users, a bit for every lock.
+*/
+uint64_t get_user_locks_mask(char** usernames, uint32_t num_of_users)
+{
+    uint64_t mask = 0;
+    for (uint32_t i = 0; i < num_of_users; i++)
+        mask |= 1ull << get_user_lock_idx(usernames[i]);
+
+    return mask;
+}
+
+
+
+void change_feed_lock_users(char** usernames, uint32_t num_of_users)
+{
+    // in the same order as the snapshot, so they can't deadlock
+    uint64_t mask = get_user_locks_mask(usernames, num_of_users);
+    for (int i = 0; i < NUM_OF_USER_LOCKS; i++)
+    {
+        if (mask & (1ull << i))
+            pthread_mutex_lock(&user_locks[i]);
+    }
+}
+
+
+
+void change_feed_unlock_users(char** usernames, uint32_t num_of_users)
+{
+    uint64_t mask = get_user_locks_mask(usernames, num_of_users);
+    for (int i = NUM_OF_USER_LOCKS - 1; i >= 0; i--)
+    {
+        if (mask & (1ull << i))
+            pthread_mutex_unlock(&user_locks[i]);
+    }
+}
+
+
+
+void change_feed_append(char type, char** fields, int num_of_fields)
+{
+    if (!is_feed_enabled)
+        return;
+
+    size_t fields_len = 0;
+    for (int i = 0; i < num_of_fields; i++)
+        fields_len += strlen(fields[i]) + 1;
+
+    // if it fails the change is marked as lost, see struct feed_change
+    char* copy = malloc(fields_len);
+    if (copy != NULL)
+    {
+        char* p = copy;
+        for (int i = 0; i < num_of_fields; i++)
+        {
+            size_t len = strlen(fields[i]) + 1;
+            memcpy(p, fields[i], len);
+            p += len;
+        }
+    }
+
+    pthread_mutex_lock(&mutex_feed);
+
+    struct feed_change* p_change = &feed_log[next_seq & (FEED_LOG_SIZE - 1)];
+    free(p_change->fields);
+    p_change->seq = next_seq++;
+    p_change->time_ms = feed_time_ms();
+    p_change->type = type;
+    p_change->fields = copy;
+    p_change->fields_len = fields_len;
+
+    pthread_cond_broadcast(&cond_feed);
+    pthread_mutex_unlock(&mutex_feed);
+}
+
+
+
+uint64_t change_feed_last_seq()
+{
+    if (!is_feed_enabled)
+        return 0;
+
+    pthread_mutex_lock(&mutex_feed);
+    uint64_t seq = next_seq - 1;
+    pthread_mutex_unlock(&mutex_feed);
+
+    return seq;
+}
+
+
+
+uint32_t change_feed_num_of_replicas()
+{
+    if (!is_feed_enabled)
+        return 0;
+
+    pthread_mutex_lock(&mutex_feed);
+    uint32_t num = num_of_replicas;
+    pthread_mutex_unlock(&mutex_feed);
+
+    return num;
+}
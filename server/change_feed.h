@@ -0,0 +1,93 @@
+#include <stdint.h>
+/*
+    change feed of the primary server for the read replicas (see replica.h). Every change of the
+    registered users, of their published files and of the connected users is appended to an
+    in-memory log with an increasing sequence number. A replica connects to the feed port, gets a
+    snapshot of the whole state and then the changes which followed it, in order. When nothing
+    changes a heartbeat is sent every FEED_HEARTBEAT_MS, so the replica knows how far behind it is.
+    A replica which falls more than FEED_LOG_SIZE changes behind is disconnected and starts over
+    with a new snapshot.
+    The changes of one user are ordered by the lock of the user: it's held from the change of the
+    state till the change is appended, see change_feed_lock_user. The snapshot is taken user by
+    user, each with its lock held, so it contains all the changes before its sequence number and
+    maybe some later ones, which the replica applies again without effect. The feed listens on
+    the address of the configuration when it is set. The locks of
+    the users are used also when the feed is not, so the changes of a user and the checks they
+    depend on (e.g. that the user is registered) are never interleaved.
+    IMPORTANT before any operation will be performed it is required to call the init() function and
+    if the feed won't be used anymore then the destroy() function must be called. When the server
+    is not a primary the feed is not initialized and all the functions except the locks of the
+    users do nothing.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define FEED_LOG_SIZE 65536         // must be a power of 2
+#define FEED_HEARTBEAT_MS 200
+// records, each field is finished by '\0' like in the requests
+#define FEED_SNAPSHOT "S"           // sequence number the snapshot is taken at, time
+#define FEED_SNAPSHOT_USER "U"      // username
+#define FEED_SNAPSHOT_FILE "F"      // username, file name
+#define FEED_SNAPSHOT_CONNECTED "N" // username, ip, port
+#define FEED_SNAPSHOT_END "E"
+#define FEED_HEARTBEAT "H"          // sequence number of the last change, time
+// changes, followed by the sequence number, the time and the fields
+#define FEED_REGISTER 'R'           // username
+#define FEED_UNREGISTER 'D'         // username, also removes the files and disconnects
+#define FEED_PUBLISH 'P'            // username, file name
+#define FEED_DELETE 'X'             // username, file name
+#define FEED_CONNECT 'C'            // username, ip, port
+#define FEED_DISCONNECT 'Q'         // username
+// init
+#define INIT_CHANGE_FEED_SUCCESS 0
+#define INIT_CHANGE_FEED_ERR_MEMORY 1
+#define INIT_CHANGE_FEED_ERR_SOCKET 2
+#define INIT_CHANGE_FEED_ERR_THREAD 3
+
+
+
+/*
+    must be called exactly once at the beginning, before the first call to any function
+    from this file has been done. Starts accepting replicas on the port.
+    Returns:
+        INIT_CHANGE_FEED_SUCCESS        - success
+        INIT_CHANGE_FEED_ERR_MEMORY     - could not allocate the log
+        INIT_CHANGE_FEED_ERR_SOCKET     - could not listen on the port
+        INIT_CHANGE_FEED_ERR_THREAD     - could not start the thread accepting replicas
+*/
+int init_change_feed(int port);
+/*
+    must be called exactly once when the functions won't be used anymore. Disconnects the
+    replicas.
+*/
+void destroy_change_feed();
+/*
+    locks the user, so the change of the state, of the in-memory indexes and its append to the
+    feed are not interleaved with the changes of the same user made by other threads.
+*/
+void change_feed_lock_user(char* username);
+/*
+    unlocks the user locked with change_feed_lock_user.
+*/
+void change_feed_unlock_user(char* username);
+/*
+    locks all the num_of_users users at once, for the changes of a batch.
+*/
+void change_feed_lock_users(char** usernames, uint32_t num_of_users);
+/*
+    unlocks the users locked with change_feed_lock_users.
+*/
+void change_feed_unlock_users(char** usernames, uint32_t num_of_users);
+/*
+    appends a change (FEED_*) to the feed. fields are the num_of_fields fields of the change, see
+    the constants. The user of the change must be locked.
+*/
+void change_feed_append(char type, char** fields, int num_of_fields);
+/*
+    Returns the sequence number of the last change, 0 if there was none.
+*/
+uint64_t change_feed_last_seq();
+/*
+    Returns the number of the connected replicas.
+*/
+uint32_t change_feed_num_of_replicas();
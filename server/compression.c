@@ -0,0 +1,220 @@
+#include "compression.h"
+#include "connected_users.h"
+#include "metrics.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct cached_listing {
+    pthread_mutex_t mutex;
+    uint64_t generation;    // incremented by every invalidation
+    char owner[MAX_USERNAME_LEN + 1];
+    struct compressed_payload* p_payload;   // NULL if there is none
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// global variables
+///////////////////////////////////////////////////////////////////////////////////////////////////
+struct cached_listing* cached_listings;
+uint32_t num_of_cached_listings;
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    Returns the slot of the owner in the cache
+*/
+struct cached_listing* get_slot(char* owner)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (char* p = owner; *p != '\0'; p++)
+        hash = (hash ^ (uint8_t) *p) * 16777619u;
+
+    return &cached_listings[hash % num_of_cached_listings];
+}
+
+
+
+/*
+    drops the listing of the slot and increments its generation. Must be called with the mutex of
+    the slot locked.
+*/
+void invalidate_slot(struct cached_listing* p_slot)
+{
+    release_compressed_payload(p_slot->p_payload);
+    p_slot->p_payload = NULL;
+    p_slot->generation++;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// init / destroy
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int init_compression(uint32_t num_of_slots)
+{
+    cached_listings = malloc(num_of_slots * sizeof(struct cached_listing));
+    if (cached_listings == NULL)
+        return INIT_COMPRESSION_ERR_MEMORY;
+
+    for (uint32_t i = 0; i < num_of_slots; i++)
+    {
+        if (pthread_mutex_init(&cached_listings[i].mutex, NULL) != 0)
+        {
+            while (i-- > 0)
+                pthread_mutex_destroy(&cached_listings[i].mutex);
+            free(cached_listings);
+            cached_listings = NULL;
+            return INIT_COMPRESSION_ERR_MUTEX_INIT;
+        }
+        cached_listings[i].generation = 0;
+        cached_listings[i].p_payload = NULL;
+    }
+    num_of_cached_listings = num_of_slots;
+
+    return INIT_COMPRESSION_SUCCESS;
+}
+
+
+
+void destroy_compression()
+{
+    for (uint32_t i = 0; i < num_of_cached_listings; i++)
+    {
+        release_compressed_payload(cached_listings[i].p_payload);
+        cached_listings[i].p_payload = NULL;
+        pthread_mutex_destroy(&cached_listings[i].mutex);
+    }
+
+    free(cached_listings);
+    cached_listings = NULL;
+    num_of_cached_listings = 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// payloads
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int compress_payload(char* data, size_t len, struct compressed_payload** pp_payload)
+{
+    uLongf compressed_len = compressBound(len);
+    struct compressed_payload* p_payload = malloc(sizeof(struct compressed_payload)
+        + compressed_len);
+    if (p_payload == NULL)
+        return COMPRESS_PAYLOAD_ERR_MEMORY;
+
+    if (compress2((Bytef*) p_payload->data, &compressed_len, (Bytef*) data, len,
+        Z_DEFAULT_COMPRESSION) != Z_OK)
+    {
+        free(p_payload);
+        return COMPRESS_PAYLOAD_ERR_ZLIB;
+    }
+
+    p_payload->refcount = 1;
+    p_payload->raw_len = len;
+    p_payload->len = compressed_len;
+    metrics_increment(METRIC_COMPRESSIONS);
+    *pp_payload = p_payload;
+
+    return COMPRESS_PAYLOAD_SUCCESS;
+}
+
+
+
+void release_compressed_payload(struct compressed_payload* p_payload)
+{
+    if (p_payload != NULL && __atomic_sub_fetch(&p_payload->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+        free(p_payload);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// cache
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct compressed_payload* get_cached_listing(char* owner)
+{
+    struct cached_listing* p_slot = get_slot(owner);
+    struct compressed_payload* p_payload = NULL;
+
+    pthread_mutex_lock(&p_slot->mutex);
+    if (p_slot->p_payload != NULL && strcmp(p_slot->owner, owner) == 0)
+    {
+        p_payload = p_slot->p_payload;
+        __atomic_add_fetch(&p_payload->refcount, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&p_slot->mutex);
+
+    return p_payload;
+}
+
+
+
+uint64_t get_listing_generation(char* owner)
+{
+    struct cached_listing* p_slot = get_slot(owner);
+
+    pthread_mutex_lock(&p_slot->mutex);
+    uint64_t generation = p_slot->generation;
+    pthread_mutex_unlock(&p_slot->mutex);
+
+    return generation;
+}
+
+
+
+void cache_listing(char* owner, uint64_t generation, struct compressed_payload* p_payload)
+{
+    struct cached_listing* p_slot = get_slot(owner);
+
+    pthread_mutex_lock(&p_slot->mutex);
+    if (p_slot->generation == generation)
+    {
+        // the owner takes the slot from the one hashed to it before
+        release_compressed_payload(p_slot->p_payload);
+        strcpy(p_slot->owner, owner);
+        p_slot->p_payload = p_payload;
+        __atomic_add_fetch(&p_payload->refcount, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&p_slot->mutex);
+}
+
+
+
+void invalidate_cached_listing(char* owner)
+{
+    struct cached_listing* p_slot = get_slot(owner);
+
+    pthread_mutex_lock(&p_slot->mutex);
+    invalidate_slot(p_slot);
+    pthread_mutex_unlock(&p_slot->mutex);
+}
+
+
+
+void invalidate_cached_listings()
+{
+    for (uint32_t i = 0; i < num_of_cached_listings; i++)
+    {
+        pthread_mutex_lock(&cached_listings[i].mutex);
+        invalidate_slot(&cached_listings[i]);
+        pthread_mutex_unlock(&cached_listings[i].mutex);
+    }
+}
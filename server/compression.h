@@ -0,0 +1,101 @@
+#include <stddef.h>
+#include <stdint.h>
+/*
+    compression of the big listing responses (LIST_USERS and LIST_CONTENT) for the clients which
+    accept it (ACCEPT_ENCODING). The payload of a response, i.e. what follows the result code, is
+    compressed with zlib (deflate) when it has at least compression_threshold bytes (see
+    config.h), smaller ones are sent as they are. A compressed payload is immutable and reference
+    counted, so it's shared by all the responses sending the same listing, and it's compressed
+    only once: the compressed
+    LIST_CONTENT listings are cached by their owner till the files of the owner change, the
+    compressed LIST_USERS is kept with its snapshot (see connected_users.h).
+    The cache has a fixed number of slots, an owner has one of them (by the hash of its name).
+    Every change of the files of an owner increments the generation of its slot, a listing read
+    before the change is not cached afterwards.
+    IMPORTANT before any operation will be performed it is required to call the init() function and
+    if the cache won't be used anymore then the destroy() function must be called.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define COMPRESSION_ENCODING "deflate"
+#define COMPRESSION_ENCODING_RAW "raw"   // the payload of a response under the threshold
+#define COMPRESSION_THRESHOLD 4096      // default
+#define NUM_OF_CACHED_LISTINGS 1024     // default
+// init
+#define INIT_COMPRESSION_SUCCESS 0
+#define INIT_COMPRESSION_ERR_MUTEX_INIT 1
+#define INIT_COMPRESSION_ERR_MEMORY 2
+// compress
+#define COMPRESS_PAYLOAD_SUCCESS 0
+#define COMPRESS_PAYLOAD_ERR_MEMORY 1
+#define COMPRESS_PAYLOAD_ERR_ZLIB 2
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    compressed payload, it must not be changed. It's released when the last reference is released.
+*/
+struct compressed_payload {
+    uint32_t refcount;
+    size_t raw_len;     // length of the payload before the compression
+    size_t len;
+    char data[];
+};
+
+
+
+/*
+    must be called exactly once at the beginning, before the first call to any function
+    from this file has been done. The cache gets num_of_slots slots.
+    Returns:
+        INIT_COMPRESSION_SUCCESS            - success
+        INIT_COMPRESSION_ERR_MUTEX_INIT     - could not initialize the mutexes of the cache
+        INIT_COMPRESSION_ERR_MEMORY         - could not allocate the cache
+*/
+int init_compression(uint32_t num_of_slots);
+/*
+    must be called exactly once when the functions won't be used anymore. Releases the cached
+    listings.
+*/
+void destroy_compression();
+/*
+    compresses len bytes of data and puts the payload (with one reference) where pp_payload points.
+    Returns:
+        COMPRESS_PAYLOAD_SUCCESS        - success
+        COMPRESS_PAYLOAD_ERR_MEMORY     - could not allocate the payload
+        COMPRESS_PAYLOAD_ERR_ZLIB       - could not compress the data
+*/
+int compress_payload(char* data, size_t len, struct compressed_payload** pp_payload);
+/*
+    releases the reference to the payload, NULL is ignored.
+*/
+void release_compressed_payload(struct compressed_payload* p_payload);
+/*
+    Returns the compressed LIST_CONTENT listing of the owner's files with a reference, which has to
+    be released, or NULL if it's not cached
+*/
+struct compressed_payload* get_cached_listing(char* owner);
+/*
+    Returns the generation of the owner's slot, it has to be read before the files of the owner
+    are listed and passed to cache_listing.
+*/
+uint64_t get_listing_generation(char* owner);
+/*
+    caches the compressed listing of the owner's files (with a reference of its own), unless they
+    changed since the generation was read.
+*/
+void cache_listing(char* owner, uint64_t generation, struct compressed_payload* p_payload);
+/*
+    drops the cached listing of the owner, must be called after every change of the owner's files
+    (including the unregistration of the owner).
+*/
+void invalidate_cached_listing(char* owner);
+/*
+    drops all the cached listings.
+*/
+void invalidate_cached_listings();
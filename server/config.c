@@ -0,0 +1,405 @@
+#include "config.h"
+#include "admission.h"
+#include "compression.h"
+#include "reclaimer.h"
+#include "worker_pool.h"
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define CONFIG_INT 0
+#define CONFIG_PATH 1
+#define CONFIG_ADDRESS 2
+// the tokens of a full bucket (in thousandths) must fit into 32 bits, see admission.c
+#define MAX_RATE_LIMIT 1000000
+#define MAX_TIMEOUT_MS 3600000
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    a key of the file and the field of struct config it sets
+*/
+struct config_key
+{
+    char* name;
+    int type;           // CONFIG_*
+    size_t offset;      // of the field in struct config
+    size_t size;        // of a string field
+    int32_t min;        // of an int field
+    int32_t max;
+    int is_live;        // 0 if it's applied at start only
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// global variables
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define INT_KEY(name, min, max, is_live) \
+    { #name, CONFIG_INT, offsetof(struct config, name), 0, min, max, is_live }
+#define STRING_KEY(name, type, is_live) \
+    { #name, type, offsetof(struct config, name), sizeof(((struct config*) 0)->name), 0, 0, \
+        is_live }
+
+struct config_key config_keys[] =
+{
+    STRING_KEY(address, CONFIG_ADDRESS, 0),
+    INT_KEY(port, 1024, 49151, 0),
+    STRING_KEY(data_dir, CONFIG_PATH, 0),
+    INT_KEY(cached_listings, 1, 1 << 20, 0),
+    INT_KEY(workers, 1, MAX_WORKER_POOL_SIZE, 0),
+    INT_KEY(backlog, 1, 65535, 1),
+    INT_KEY(max_connections, 1, 1 << 20, 1),
+    INT_KEY(max_in_flight_requests, 1, 1 << 20, 1),
+    INT_KEY(rate_limit_per_second, 1, MAX_RATE_LIMIT, 1),
+    INT_KEY(rate_limit_burst, 1, MAX_RATE_LIMIT, 1),
+    INT_KEY(idle_timeout_ms, 100, MAX_TIMEOUT_MS, 1),
+    INT_KEY(request_timeout_ms, 100, MAX_TIMEOUT_MS, 1),
+    INT_KEY(min_transfer_rate, 1, INT32_MAX, 1),
+    INT_KEY(drain_timeout_ms, 1000, MAX_TIMEOUT_MS, 1),
+    INT_KEY(tcp_nodelay, 0, 1, 1),
+    INT_KEY(tcp_keepalive, 0, 1, 1),
+    INT_KEY(tcp_keepalive_idle, 0, 86400, 1),
+    INT_KEY(tcp_keepalive_interval, 0, 86400, 1),
+    INT_KEY(tcp_keepalive_count, 0, 127, 1),
+    INT_KEY(send_buffer_size, 0, 1 << 30, 1),
+    INT_KEY(receive_buffer_size, 0, 1 << 30, 1),
+    INT_KEY(compression_threshold, 0, INT32_MAX, 1),
+    INT_KEY(reclaim_batch_size, 1, 1 << 20, 1),
+    INT_KEY(reclaim_pause_ms, 0, 10000, 1),
+};
+#define NUM_OF_CONFIG_KEYS (sizeof(config_keys) / sizeof(config_keys[0]))
+
+/*
+    the current snapshot, it points to the ones it replaced
+*/
+struct config* p_current_config;
+pthread_mutex_t mutex_reload = PTHREAD_MUTEX_INITIALIZER;
+char config_path[MAX_CONFIG_PATH_LEN + 1];
+void (*on_config_reload)(const struct config* p_config);
+pthread_t t_config;
+int is_config_thread_started;
+int is_config_running;
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    sets the defaults into the configuration
+*/
+void set_defaults(struct config* p_config)
+{
+    memset(p_config, 0, sizeof(struct config));
+
+    p_config->port = DEFAULT_PORT;
+    p_config->cached_listings = NUM_OF_CACHED_LISTINGS;
+    p_config->workers = WORKER_POOL_SIZE;
+    p_config->backlog = REQUESTS_QUEUE_SIZE;
+    p_config->max_connections = MAX_NUMBER_OF_CONNECTIONS;
+    p_config->max_in_flight_requests = MAX_IN_FLIGHT_REQUESTS;
+    p_config->rate_limit_per_second = RATE_LIMIT_REQUESTS_PER_SECOND;
+    p_config->rate_limit_burst = RATE_LIMIT_BURST;
+    p_config->idle_timeout_ms = IDLE_TIMEOUT_MS;
+    p_config->request_timeout_ms = REQUEST_TIMEOUT_MS;
+    p_config->min_transfer_rate = MIN_TRANSFER_RATE;
+    p_config->drain_timeout_ms = DRAIN_TIMEOUT_MS;
+    // responses are written in several small pieces, don't let them wait for the acks of the
+    // previous ones when requests are pipelined
+    p_config->tcp_nodelay = 1;
+    p_config->compression_threshold = COMPRESSION_THRESHOLD;
+    p_config->reclaim_batch_size = RECLAIM_BATCH_SIZE;
+    p_config->reclaim_pause_ms = RECLAIM_PAUSE_MS;
+}
+
+
+
+/*
+    Returns the string without the white space around it, which is cut off
+*/
+char* trim(char* str)
+{
+    while (isspace((unsigned char) *str))
+        str++;
+
+    char* end = str + strlen(str);
+    while (end > str && isspace((unsigned char) end[-1]))
+        end--;
+    *end = '\0';
+
+    return str;
+}
+
+
+
+/*
+    sets the value of the key into the configuration.
+    Returns 0 on success and -1 if the value is invalid
+*/
+int set_value(struct config* p_config, struct config_key* p_key, char* value)
+{
+    char* p_field = (char*) p_config + p_key->offset;
+
+    if (p_key->type == CONFIG_INT)
+    {
+        char* end;
+        errno = 0;
+        long number = strtol(value, &end, 10);
+        if (errno != 0 || end == value || *end != '\0' || number < p_key->min
+            || number > p_key->max)
+            return -1;
+
+        *(int32_t*) p_field = (int32_t) number;
+        return 0;
+    }
+
+    struct in_addr addr;
+    if (strlen(value) >= p_key->size || (p_key->type == CONFIG_ADDRESS && *value != '\0'
+        && inet_pton(AF_INET, value, &addr) != 1))
+        return -1;
+
+    strcpy(p_field, value);
+    return 0;
+}
+
+
+
+/*
+    reads the file into the configuration, over the defaults.
+    Returns 0 on success, RELOAD_CONFIG_ERR_FILE if the file could not be read and
+    RELOAD_CONFIG_ERR_INVALID if it has an invalid line
+*/
+int read_config(char* path, struct config* p_config)
+{
+    set_defaults(p_config);
+
+    FILE* p_file = fopen(path, "r");
+    if (p_file == NULL)
+    {
+        printf("ERROR config - could not open %s\n", path);
+        return RELOAD_CONFIG_ERR_FILE;
+    }
+
+    char line[MAX_CONFIG_LINE_LEN + 1];
+    int line_number = 0;
+    int res = 0;
+
+    while (res == 0 && fgets(line, sizeof(line), p_file) != NULL)
+    {
+        line_number++;
+
+        char* comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+
+        char* key = trim(line);
+        if (*key == '\0')
+            continue;
+
+        char* value = strchr(key, '=');
+        struct config_key* p_key = NULL;
+        if (value != NULL)
+        {
+            *value++ = '\0';
+            key = trim(key);
+            value = trim(value);
+
+            for (uint32_t i = 0; i < NUM_OF_CONFIG_KEYS && p_key == NULL; i++)
+            {
+                if (strcmp(config_keys[i].name, key) == 0)
+                    p_key = &config_keys[i];
+            }
+        }
+
+        if (p_key == NULL || set_value(p_config, p_key, value) != 0)
+        {
+            printf("ERROR config - invalid line %d of %s\n", line_number, path);
+            res = RELOAD_CONFIG_ERR_INVALID;
+        }
+    }
+
+    if (res == 0 && ferror(p_file))
+        res = RELOAD_CONFIG_ERR_FILE;
+    fclose(p_file);
+
+    return res;
+}
+
+
+
+/*
+    waits for SIGHUP and reloads the configuration till destroy() is called
+*/
+void* reload_on_sighup(void* arg)
+{
+    (void) arg;
+
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGHUP);
+
+    for (;;)
+    {
+        int sig;
+        if (sigwait(&set, &sig) != 0)
+            continue;
+
+        if (!__atomic_load_n(&is_config_running, __ATOMIC_ACQUIRE))
+            break;
+
+        int reload_config_res = reload_config();
+        if (reload_config_res != RELOAD_CONFIG_SUCCESS)
+        {
+            printf("ERROR config - could not reload %s. Code: %d\n", config_path,
+                reload_config_res);
+            continue;
+        }
+
+        printf("reloaded %s\n", config_path);
+        if (on_config_reload != NULL)
+            on_config_reload(get_config());
+    }
+
+    return NULL;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// init / destroy
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int init_config(char* path, void (*on_reload)(const struct config* p_config))
+{
+    // only the thread of the configuration gets SIGHUP, without a file it stays pending and the
+    // server is not killed by it
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    struct config* p_config = malloc(sizeof(struct config));
+    if (p_config == NULL)
+        return INIT_CONFIG_ERR_MEMORY;
+
+    if (path == NULL)
+    {
+        set_defaults(p_config);
+        p_current_config = p_config;
+        return INIT_CONFIG_SUCCESS;
+    }
+
+    int read_config_res = read_config(path, p_config);
+    if (read_config_res != 0)
+    {
+        free(p_config);
+        return read_config_res == RELOAD_CONFIG_ERR_FILE ?
+            INIT_CONFIG_ERR_FILE : INIT_CONFIG_ERR_INVALID;
+    }
+    p_current_config = p_config;
+    snprintf(config_path, sizeof(config_path), "%s", path);
+    on_config_reload = on_reload;
+
+    is_config_running = 1;
+    if (pthread_create(&t_config, NULL, reload_on_sighup, NULL) != 0)
+    {
+        is_config_running = 0;
+        p_current_config = NULL;
+        free(p_config);
+        return INIT_CONFIG_ERR_THREAD;
+    }
+    is_config_thread_started = 1;
+
+    return INIT_CONFIG_SUCCESS;
+}
+
+
+
+void destroy_config()
+{
+    if (is_config_thread_started)
+    {
+        __atomic_store_n(&is_config_running, 0, __ATOMIC_RELEASE);
+        pthread_kill(t_config, SIGHUP);
+        pthread_join(t_config, NULL);
+        is_config_thread_started = 0;
+    }
+
+    while (p_current_config != NULL)
+    {
+        struct config* p_previous = p_current_config->p_previous;
+        free(p_current_config);
+        p_current_config = p_previous;
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// get / reload
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+const struct config* get_config()
+{
+    return __atomic_load_n(&p_current_config, __ATOMIC_ACQUIRE);
+}
+
+
+
+int reload_config()
+{
+    struct config* p_config = malloc(sizeof(struct config));
+    if (p_config == NULL)
+        return RELOAD_CONFIG_ERR_MEMORY;
+
+    pthread_mutex_lock(&mutex_reload);
+
+    int res = read_config(config_path, p_config);
+    if (res != 0)
+    {
+        pthread_mutex_unlock(&mutex_reload);
+        free(p_config);
+        return res;
+    }
+
+    // the ones applied at start stay as they are
+    struct config* p_previous = p_current_config;
+    for (uint32_t i = 0; i < NUM_OF_CONFIG_KEYS; i++)
+    {
+        struct config_key* p_key = &config_keys[i];
+        size_t size = p_key->type == CONFIG_INT ? sizeof(int32_t) : p_key->size;
+        char* p_field = (char*) p_config + p_key->offset;
+        char* p_previous_field = (char*) p_previous + p_key->offset;
+
+        if (!p_key->is_live && memcmp(p_field, p_previous_field, size) != 0)
+        {
+            printf("config - %s takes effect after a restart\n", p_key->name);
+            memcpy(p_field, p_previous_field, size);
+        }
+    }
+
+    p_config->p_previous = p_previous;
+    __atomic_store_n(&p_current_config, p_config, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&mutex_reload);
+
+    return RELOAD_CONFIG_SUCCESS;
+}
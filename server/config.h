@@ -0,0 +1,112 @@
+#include <stdint.h>
+/*
+    runtime configuration of the server, read from a file of "key = value" lines ('#' starts a
+    comment). The keys which are not in the file keep their defaults, see the defines below and in
+    admission.h, compression.h, reclaimer.h and worker_pool.h. The configuration is an immutable
+    snapshot: SIGHUP reloads the file into a new one which replaces the current one at once, so a
+    thread which took the configuration sees consistent values. The old snapshots are freed by
+    destroy(), a reload costs only a few hundred bytes.
+    The tunables applied at start (address, port, data_dir, cached_listings, workers) keep their
+    values on a reload, a change is reported and takes effect after a restart. A file with an
+    invalid line is rejected as a whole and the configuration stays as it was.
+    IMPORTANT before any operation will be performed it is required to call the init() function and
+    if the configuration won't be used anymore then the destroy() function must be called.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define MAX_CONFIG_LINE_LEN 512
+#define MAX_CONFIG_PATH_LEN 255
+#define MAX_CONFIG_ADDRESS_LEN 15   // IPv4
+// defaults of the tunables of the server itself
+#define DEFAULT_PORT 7777
+// connections wait in the queue while the server is restarted (see handoff.h)
+#define REQUESTS_QUEUE_SIZE SOMAXCONN
+#define IDLE_TIMEOUT_MS 60000
+#define REQUEST_TIMEOUT_MS 10000
+#define MIN_TRANSFER_RATE (16 * 1024)   // bytes per second, slower transfers time out
+// handoff, requests still in flight after this time are interrupted
+#define DRAIN_TIMEOUT_MS 10000
+// init
+#define INIT_CONFIG_SUCCESS 0
+#define INIT_CONFIG_ERR_FILE 1
+#define INIT_CONFIG_ERR_INVALID 2
+#define INIT_CONFIG_ERR_MEMORY 3
+#define INIT_CONFIG_ERR_THREAD 4
+// reload
+#define RELOAD_CONFIG_SUCCESS 0
+#define RELOAD_CONFIG_ERR_FILE 1
+#define RELOAD_CONFIG_ERR_INVALID 2
+#define RELOAD_CONFIG_ERR_MEMORY 3
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct config
+{
+    // applied at start
+    char address[MAX_CONFIG_ADDRESS_LEN + 1];   // the server listens on, "" for all of them
+    int32_t port;
+    char data_dir[MAX_CONFIG_PATH_LEN + 1];     // of the storage, content, ..., "" for the current
+    int32_t cached_listings;                    // slots of the cache of compressed listings
+    int32_t workers;                            // of the pool, see worker_pool.h
+    // applied live
+    int32_t backlog;                    // of the listening socket
+    int32_t max_connections;            // i.e. request threads
+    int32_t max_in_flight_requests;
+    int32_t rate_limit_per_second;      // requests of an ip address
+    int32_t rate_limit_burst;
+    int32_t idle_timeout_ms;
+    int32_t request_timeout_ms;
+    int32_t min_transfer_rate;          // bytes per second
+    int32_t drain_timeout_ms;
+    int32_t tcp_nodelay;                // 0 or 1, options of the accepted connections
+    int32_t tcp_keepalive;              // 0 or 1
+    int32_t tcp_keepalive_idle;         // seconds, 0 for the system default
+    int32_t tcp_keepalive_interval;     // seconds, 0 for the system default
+    int32_t tcp_keepalive_count;        // 0 for the system default
+    int32_t send_buffer_size;           // bytes, 0 for the system default
+    int32_t receive_buffer_size;        // bytes, 0 for the system default
+    int32_t compression_threshold;      // bytes
+    int32_t reclaim_batch_size;
+    int32_t reclaim_pause_ms;
+    struct config* p_previous;          // the snapshot this one replaced
+};
+
+
+
+/*
+    must be called exactly once at the beginning, before any other thread is started (SIGHUP is
+    blocked in the threads started afterwards) and before the first call to any function from this
+    file has been done. Reads the file on the path, NULL for the defaults. With a file a thread
+    waits for SIGHUP, reloads the file and calls on_reload (unless NULL) with the new configuration,
+    without it SIGHUP is ignored.
+    Returns:
+        INIT_CONFIG_SUCCESS         - success
+        INIT_CONFIG_ERR_FILE        - could not read the file
+        INIT_CONFIG_ERR_INVALID     - the file has an invalid line
+        INIT_CONFIG_ERR_MEMORY      - could not allocate the configuration
+        INIT_CONFIG_ERR_THREAD      - could not start the thread waiting for SIGHUP
+*/
+int init_config(char* path, void (*on_reload)(const struct config* p_config));
+/*
+    must be called exactly once when the functions won't be used anymore. Stops the thread and
+    frees the snapshots, the configuration must not be used afterwards.
+*/
+void destroy_config();
+/*
+    Returns the current configuration
+*/
+const struct config* get_config();
+/*
+    reads the file again and replaces the current configuration, see above. Called on SIGHUP.
+    Returns:
+        RELOAD_CONFIG_SUCCESS       - success
+        RELOAD_CONFIG_ERR_FILE      - could not read the file, nothing changed
+        RELOAD_CONFIG_ERR_INVALID   - the file has an invalid line, nothing changed
+        RELOAD_CONFIG_ERR_MEMORY    - could not allocate the configuration, nothing changed
+*/
+int reload_config();
@@ -0,0 +1,946 @@
+#include "connected_users.h"
+#include "compression.h"
+#include "metrics.h"
+#include "sorted_names.h"
+#include "timer_wheel.h"
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define INITIAL_NUM_OF_NAMES 1024       // must be a power of 2
+#define INITIAL_NAME_POOL_SIZE 65536
+#define MIN_NAME_POOL_GARBAGE 4096      // released names which are worth compacting the pool
+#define NO_ID UINT32_MAX                // empty slot of the names table
+#define NOT_CONNECTED UINT32_MAX        // position of a user which is not connected
+#define IP_LEN 16                       // IPv6, IPv4 is mapped
+#define LEASES_PER_CHUNK 1024
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    lease of the user with the id. A heartbeat only moves expires_at_ms, the timer is moved when
+    it fires before that time. An expired lease is queued for the reaper thread, the users can't be
+    disconnected from the wheel thread.
+*/
+struct lease {
+    struct timer timer;
+    uint64_t expires_at_ms;
+    uint32_t id;
+    int is_queued;                      // protected by mutex_expired
+    struct lease* p_next_expired;
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// global variables
+///////////////////////////////////////////////////////////////////////////////////////////////////
+pthread_rwlock_t lock_connected_users;
+/*
+    interned usernames, indexed by the id: the offset of the name in the pool, the hash of the
+    name and the position of the user in the connected arrays (NOT_CONNECTED if it's not).
+    num_of_names ids were handed out, the released ones are in free_ids and their names are
+    name_pool_garbage bytes of the pool.
+*/
+char* name_pool;
+size_t name_pool_len;
+size_t name_pool_size;
+size_t name_pool_garbage;
+uint32_t* name_offsets;
+uint32_t* name_hashes;
+uint32_t* name_positions;
+uint32_t num_of_names;
+uint32_t max_num_of_names;
+uint32_t* free_ids;
+uint32_t num_of_free_ids;
+// username -> id, open addressing with 2 slots for every possible name
+uint32_t* names_table;
+/*
+    connected users, structure of arrays without gaps: a disconnected user is replaced with the
+    last one.
+*/
+uint32_t* connected_ids;
+uint8_t (*connected_ips)[IP_LEN];
+uint16_t* connected_ports;
+uint32_t num_of_connected_users;
+size_t connected_names_len;             // sum of the lengths of the usernames
+// the usernames of the connected users in order, for the filtered listings
+struct sorted_names connected_names;
+// snapshot of the connected users, NULL after a change till the next reader builds it
+struct users_snapshot* p_users_snapshot;
+/*
+    leases of the connected users, 0 lease_ms if there are none. The leases are in chunks, so they
+    don't move when more of them are needed (the wheel links them).
+*/
+uint64_t lease_ms;
+void (*on_lease_expired)(char* username);
+struct lease** lease_chunks;
+uint32_t num_of_lease_chunks;
+// leases which expired, for the reaper thread
+pthread_mutex_t mutex_expired = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t cond_expired = PTHREAD_COND_INITIALIZER;
+struct lease* p_expired_leases;
+int is_reaper_running;
+pthread_t t_lease_reaper;
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t hash_username(char* username)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    while (*username)
+    {
+        hash ^= (uint8_t) *username++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+
+/*
+    Returns the address of the slot of the names table with the id of the username, which is
+    NO_ID if the username is not interned. Must be called with the lock held.
+*/
+uint32_t* find_name(char* username, uint32_t hash)
+{
+    uint32_t mask = 2 * max_num_of_names - 1;
+    uint32_t* p_slot = &names_table[hash & mask];
+    while (*p_slot != NO_ID && (name_hashes[*p_slot] != hash
+        || strcmp(name_pool + name_offsets[*p_slot], username) != 0))
+        p_slot = &names_table[(p_slot - names_table + 1) & mask];
+
+    return p_slot;
+}
+
+
+
+/*
+    doubles the room for the names and for the connected users. Must be called with the write lock
+    held.
+    Returns 0 on success and -1 if the memory could not be allocated
+*/
+int grow_names()
+{
+    uint32_t new_max = max_num_of_names * 2;
+    uint32_t* new_table = malloc(2 * new_max * sizeof(uint32_t));
+    uint32_t* new_offsets = realloc(name_offsets, new_max * sizeof(uint32_t));
+    if (new_offsets != NULL)
+        name_offsets = new_offsets;
+    uint32_t* new_hashes = realloc(name_hashes, new_max * sizeof(uint32_t));
+    if (new_hashes != NULL)
+        name_hashes = new_hashes;
+    uint32_t* new_positions = realloc(name_positions, new_max * sizeof(uint32_t));
+    if (new_positions != NULL)
+        name_positions = new_positions;
+    uint32_t* new_ids = realloc(connected_ids, new_max * sizeof(uint32_t));
+    if (new_ids != NULL)
+        connected_ids = new_ids;
+    uint8_t (*new_ips)[IP_LEN] = realloc(connected_ips, new_max * IP_LEN);
+    if (new_ips != NULL)
+        connected_ips = new_ips;
+    uint16_t* new_ports = realloc(connected_ports, new_max * sizeof(uint16_t));
+    if (new_ports != NULL)
+        connected_ports = new_ports;
+    uint32_t* new_free_ids = realloc(free_ids, new_max * sizeof(uint32_t));
+    if (new_free_ids != NULL)
+        free_ids = new_free_ids;
+
+    // the arrays which did grow are just bigger than needed
+    if (new_table == NULL || new_offsets == NULL || new_hashes == NULL || new_positions == NULL
+        || new_ids == NULL || new_ips == NULL || new_ports == NULL || new_free_ids == NULL)
+    {
+        free(new_table);
+        return -1;
+    }
+
+    // only the connected users are interned
+    free(names_table);
+    names_table = new_table;
+    max_num_of_names = new_max;
+    memset(names_table, 0xff, 2 * max_num_of_names * sizeof(uint32_t));
+    for (uint32_t i = 0; i < num_of_connected_users; i++)
+    {
+        uint32_t id = connected_ids[i];
+        *find_name(name_pool + name_offsets[id], name_hashes[id]) = id;
+    }
+
+    return 0;
+}
+
+
+
+/*
+    Returns the id of the username, the username is interned if it's not yet. NO_ID if it could
+    not be allocated. Must be called with the write lock held.
+*/
+uint32_t intern_name(char* username)
+{
+    uint32_t hash = hash_username(username);
+    uint32_t* p_slot = find_name(username, hash);
+    if (*p_slot != NO_ID)
+        return *p_slot;
+
+    size_t len = strlen(username) + 1;
+    if (name_pool_len + len > name_pool_size)
+    {
+        size_t new_size = name_pool_size * 2 >= name_pool_len + len ? name_pool_size * 2
+            : name_pool_len + len;
+        char* new_pool = realloc(name_pool, new_size);
+        if (new_pool == NULL)
+            return NO_ID;
+        name_pool = new_pool;
+        name_pool_size = new_size;
+    }
+
+    // the released ids are reused first
+    if (num_of_free_ids == 0 && num_of_names == max_num_of_names)
+    {
+        if (grow_names() != 0)
+            return NO_ID;
+        p_slot = find_name(username, hash);
+    }
+
+    uint32_t id = num_of_free_ids > 0 ? free_ids[--num_of_free_ids] : num_of_names++;
+    memcpy(name_pool + name_pool_len, username, len);
+    name_offsets[id] = name_pool_len;
+    name_pool_len += len;
+    name_hashes[id] = hash;
+    name_positions[id] = NOT_CONNECTED;
+    *p_slot = id;
+
+    return id;
+}
+
+
+
+/*
+    moves the names of the connected users to a new pool, without the names of the released ids.
+    Must be called with the write lock held.
+*/
+void compact_name_pool()
+{
+    size_t live_len = name_pool_len - name_pool_garbage;
+    size_t new_size = INITIAL_NAME_POOL_SIZE;
+    while (new_size < 2 * live_len)
+        new_size *= 2;
+
+    char* new_pool = malloc(new_size);
+    if (new_pool == NULL)
+        return;     // the garbage stays till the next release
+
+    size_t new_len = 0;
+    for (uint32_t i = 0; i < num_of_connected_users; i++)
+    {
+        uint32_t id = connected_ids[i];
+        size_t len = strlen(name_pool + name_offsets[id]) + 1;
+        memcpy(new_pool + new_len, name_pool + name_offsets[id], len);
+        name_offsets[id] = new_len;
+        new_len += len;
+    }
+
+    free(name_pool);
+    name_pool = new_pool;
+    name_pool_size = new_size;
+    name_pool_len = new_len;
+    name_pool_garbage = 0;
+}
+
+
+
+/*
+    releases the id of the username, which must not be connected, so it's reused (with its lease)
+    by the next interned name. The pool is compacted when most of it are released names. Must be
+    called with the write lock held.
+*/
+void release_name(uint32_t id)
+{
+    // the following names of the cluster move back, so the lookups don't need tombstones
+    uint32_t mask = 2 * max_num_of_names - 1;
+    uint32_t hole = find_name(name_pool + name_offsets[id], name_hashes[id]) - names_table;
+    for (uint32_t next = (hole + 1) & mask; names_table[next] != NO_ID; next = (next + 1) & mask)
+    {
+        // it can fill the hole if the hole is between the slot of its hash and it
+        uint32_t home = name_hashes[names_table[next]] & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            names_table[hole] = names_table[next];
+            hole = next;
+        }
+    }
+    names_table[hole] = NO_ID;
+
+    name_pool_garbage += strlen(name_pool + name_offsets[id]) + 1;
+    free_ids[num_of_free_ids++] = id;
+
+    if (name_pool_garbage >= MIN_NAME_POOL_GARBAGE && name_pool_garbage > name_pool_len / 2)
+        compact_name_pool();
+}
+
+
+
+/*
+    Returns the position of the user in the connected arrays, NOT_CONNECTED if it's not connected.
+    Must be called with the lock held.
+*/
+uint32_t find_connected_user(char* username)
+{
+    uint32_t id = *find_name(username, hash_username(username));
+
+    return id == NO_ID ? NOT_CONNECTED : name_positions[id];
+}
+
+
+
+/*
+    parses the textual ip address (IPv4 or IPv6) into the binary one.
+    Returns 1 on success and 0 if the address is invalid
+*/
+int parse_address(char* text, uint8_t* ip)
+{
+    struct in_addr ipv4;
+    if (inet_pton(AF_INET, text, &ipv4) == 1)
+    {
+        memset(ip, 0, 10);
+        ip[10] = 0xff;
+        ip[11] = 0xff;
+        memcpy(ip + 12, &ipv4, 4);
+        return 1;
+    }
+
+    return inet_pton(AF_INET6, text, ip) == 1;
+}
+
+
+
+/*
+    formats the binary ip address into text, which must have room for MAX_IP_ADDR_LEN + 1
+    characters.
+    Returns the length of the text
+*/
+size_t format_address(uint8_t* ip, char* text)
+{
+    static const uint8_t ipv4_prefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+
+    if (memcmp(ip, ipv4_prefix, sizeof(ipv4_prefix)) == 0)
+        inet_ntop(AF_INET, ip + 12, text, MAX_IP_ADDR_LEN + 1);
+    else
+        inet_ntop(AF_INET6, ip, text, MAX_IP_ADDR_LEN + 1);
+
+    return strlen(text);
+}
+
+
+
+/*
+    puts the text form of the connected user at the position where p_user points. Must be called
+    with the lock held.
+*/
+void get_user_at(uint32_t position, user* p_user)
+{
+    strcpy(p_user->username, name_pool + name_offsets[connected_ids[position]]);
+    format_address(connected_ips[position], p_user->ip);
+    sprintf(p_user->port, "%u", (unsigned int) connected_ports[position]);
+}
+
+
+
+uint64_t lease_now_ms()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+
+
+/*
+    Returns the lease of the user with the id. Must be called with the lock held.
+*/
+struct lease* get_lease(uint32_t id)
+{
+    return &lease_chunks[id / LEASES_PER_CHUNK][id % LEASES_PER_CHUNK];
+}
+
+
+
+/*
+    called from the wheel thread when the timer of the lease fires, queues it for the reaper.
+*/
+void queue_expired_lease(void* arg)
+{
+    struct lease* p_lease = arg;
+
+    pthread_mutex_lock(&mutex_expired);
+    if (!p_lease->is_queued)
+    {
+        p_lease->is_queued = 1;
+        p_lease->p_next_expired = p_expired_leases;
+        p_expired_leases = p_lease;
+        pthread_cond_signal(&cond_expired);
+    }
+    pthread_mutex_unlock(&mutex_expired);
+}
+
+
+
+/*
+    starts the lease of the user with the id. Must be called with the write lock held.
+    Returns 0 on success and -1 if the lease could not be allocated
+*/
+int start_lease(uint32_t id)
+{
+    uint32_t chunk = id / LEASES_PER_CHUNK;
+    if (chunk >= num_of_lease_chunks)
+    {
+        struct lease** new_chunks = realloc(lease_chunks, (chunk + 1) * sizeof(struct lease*));
+        if (new_chunks == NULL)
+            return -1;
+        lease_chunks = new_chunks;
+        for (; num_of_lease_chunks <= chunk; num_of_lease_chunks++)
+            lease_chunks[num_of_lease_chunks] = NULL;
+    }
+
+    if (lease_chunks[chunk] == NULL)
+    {
+        lease_chunks[chunk] = calloc(LEASES_PER_CHUNK, sizeof(struct lease));
+        if (lease_chunks[chunk] == NULL)
+            return -1;
+
+        for (uint32_t i = 0; i < LEASES_PER_CHUNK; i++)
+        {
+            lease_chunks[chunk][i].id = chunk * LEASES_PER_CHUNK + i;
+            init_timer(&lease_chunks[chunk][i].timer, queue_expired_lease, &lease_chunks[chunk][i]);
+        }
+    }
+
+    struct lease* p_lease = get_lease(id);
+    __atomic_store_n(&p_lease->expires_at_ms, lease_now_ms() + lease_ms, __ATOMIC_RELAXED);
+    timer_wheel_schedule(&p_lease->timer, lease_ms);
+
+    return 0;
+}
+
+
+
+/*
+    disconnects the users whose leases expired, the timers of the renewed leases are moved.
+*/
+void* run_lease_reaper(void* arg)
+{
+    pthread_mutex_lock(&mutex_expired);
+
+    while (is_reaper_running)
+    {
+        if (p_expired_leases == NULL)
+        {
+            pthread_cond_wait(&cond_expired, &mutex_expired);
+            continue;
+        }
+
+        struct lease* p_lease = p_expired_leases;
+        p_expired_leases = p_lease->p_next_expired;
+        p_lease->is_queued = 0;
+        pthread_mutex_unlock(&mutex_expired);
+
+        // the user could have disconnected, or connected again, meanwhile
+        char username[MAX_USERNAME_LEN + 1];
+        int is_expired = 0;
+        pthread_rwlock_rdlock(&lock_connected_users);
+        if (name_positions[p_lease->id] != NOT_CONNECTED)
+        {
+            uint64_t now = lease_now_ms();
+            uint64_t expires_at = __atomic_load_n(&p_lease->expires_at_ms, __ATOMIC_RELAXED);
+            if (now >= expires_at)
+            {
+                strcpy(username, name_pool + name_offsets[p_lease->id]);
+                is_expired = 1;
+            }
+            else
+                timer_wheel_schedule(&p_lease->timer, expires_at - now);
+        }
+        pthread_rwlock_unlock(&lock_connected_users);
+
+        if (is_expired)
+            on_lease_expired(username);
+
+        pthread_mutex_lock(&mutex_expired);
+    }
+
+    pthread_mutex_unlock(&mutex_expired);
+
+    return NULL;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// init / destroy
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int init_connected_users()
+{
+    max_num_of_names = INITIAL_NUM_OF_NAMES;
+    name_pool_size = INITIAL_NAME_POOL_SIZE;
+    name_pool = malloc(name_pool_size);
+    name_offsets = malloc(max_num_of_names * sizeof(uint32_t));
+    name_hashes = malloc(max_num_of_names * sizeof(uint32_t));
+    name_positions = malloc(max_num_of_names * sizeof(uint32_t));
+    names_table = malloc(2 * max_num_of_names * sizeof(uint32_t));
+    connected_ids = malloc(max_num_of_names * sizeof(uint32_t));
+    connected_ips = malloc(max_num_of_names * IP_LEN);
+    connected_ports = malloc(max_num_of_names * sizeof(uint16_t));
+    free_ids = malloc(max_num_of_names * sizeof(uint32_t));
+    if (name_pool == NULL || name_offsets == NULL || name_hashes == NULL || name_positions == NULL
+        || names_table == NULL || connected_ids == NULL || connected_ips == NULL
+        || connected_ports == NULL || free_ids == NULL)
+        return INIT_CONNECTED_USERS_ERR_MEMORY;
+
+    memset(names_table, 0xff, 2 * max_num_of_names * sizeof(uint32_t));
+
+    if (pthread_rwlock_init(&lock_connected_users, NULL) != 0)
+        return INIT_CONNECTED_USERS_ERR_LOCK_INIT;
+
+    return INIT_CONNECTED_USERS_SUCCESS;
+}
+
+
+
+int init_leases(uint64_t lease_length_ms, void (*on_expire)(char* username))
+{
+    if (lease_length_ms == 0)
+        return INIT_LEASES_SUCCESS;
+
+    pthread_rwlock_wrlock(&lock_connected_users);
+
+    int res = INIT_LEASES_SUCCESS;
+    lease_ms = lease_length_ms;
+    on_lease_expired = on_expire;
+    is_reaper_running = 1;
+    if (pthread_create(&t_lease_reaper, NULL, run_lease_reaper, NULL) != 0)
+        res = INIT_LEASES_ERR_THREAD;
+
+    // the users connected already (e.g. taken over from the previous process) get a full lease
+    for (uint32_t i = 0; res == INIT_LEASES_SUCCESS && i < num_of_connected_users; i++)
+    {
+        if (start_lease(connected_ids[i]) != 0)
+            res = INIT_LEASES_ERR_MEMORY;
+    }
+
+    pthread_rwlock_unlock(&lock_connected_users);
+
+    return res;
+}
+
+
+
+void destroy_leases()
+{
+    if (lease_ms == 0)
+        return;
+
+    pthread_mutex_lock(&mutex_expired);
+    is_reaper_running = 0;
+    pthread_cond_signal(&cond_expired);
+    pthread_mutex_unlock(&mutex_expired);
+    pthread_join(t_lease_reaper, NULL);
+
+    pthread_rwlock_wrlock(&lock_connected_users);
+    for (uint32_t i = 0; i < num_of_lease_chunks; i++)
+    {
+        for (uint32_t j = 0; lease_chunks[i] != NULL && j < LEASES_PER_CHUNK; j++)
+            timer_wheel_cancel(&lease_chunks[i][j].timer);
+        free(lease_chunks[i]);
+    }
+    free(lease_chunks);
+    lease_chunks = NULL;
+    num_of_lease_chunks = 0;
+    p_expired_leases = NULL;
+    lease_ms = 0;
+    pthread_rwlock_unlock(&lock_connected_users);
+}
+
+
+
+void destroy_connected_users()
+{
+    drop_cached_snapshot(&p_users_snapshot);
+    destroy_sorted_names(&connected_names);
+    free(free_ids);
+    free(connected_ports);
+    free(connected_ips);
+    free(connected_ids);
+    free(names_table);
+    free(name_positions);
+    free(name_hashes);
+    free(name_offsets);
+    free(name_pool);
+    pthread_rwlock_destroy(&lock_connected_users);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// connect_user
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int connect_user(char* username, char* ip, char* port)
+{
+    uint8_t binary_ip[IP_LEN];
+    char* port_end;
+    unsigned long binary_port = strtoul(port, &port_end, 10);
+    if (!parse_address(ip, binary_ip) || *port == '\0' || *port_end != '\0'
+        || binary_port > UINT16_MAX || strlen(username) > MAX_USERNAME_LEN)
+        return CONNECT_USER_ERR_ADDRESS;
+
+    int res = CONNECT_USER_SUCCESS;
+    pthread_rwlock_wrlock(&lock_connected_users);
+
+    uint32_t id = intern_name(username);
+    if (id == NO_ID)
+        res = CONNECT_USER_ERR_MEMORY;
+    else if (name_positions[id] != NOT_CONNECTED)
+        res = CONNECT_USER_ERR_ALREADY_CONNECTED;
+    else if (sorted_names_insert(&connected_names, username) != SORTED_NAMES_INSERT_SUCCESS)
+    {
+        release_name(id);
+        res = CONNECT_USER_ERR_MEMORY;
+    }
+    else if (lease_ms != 0 && start_lease(id) != 0)
+    {
+        sorted_names_remove(&connected_names, username);
+        release_name(id);
+        res = CONNECT_USER_ERR_MEMORY;
+    }
+    else
+    {
+        // there is room for every interned name
+        uint32_t position = num_of_connected_users++;
+        connected_ids[position] = id;
+        memcpy(connected_ips[position], binary_ip, IP_LEN);
+        connected_ports[position] = binary_port;
+        name_positions[id] = position;
+        connected_names_len += strlen(username);
+        drop_cached_snapshot(&p_users_snapshot);
+    }
+
+    pthread_rwlock_unlock(&lock_connected_users);
+
+    return res;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// disconnect_user
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int disconnect_user(char* username)
+{
+    int res = DISCONNECT_USER_SUCCESS;
+    pthread_rwlock_wrlock(&lock_connected_users);
+
+    uint32_t position = find_connected_user(username);
+    if (position != NOT_CONNECTED)
+    {
+        uint32_t id = connected_ids[position];
+        if (lease_ms != 0)
+            timer_wheel_cancel(&get_lease(id)->timer);
+
+        // the last user takes the place of the disconnected one
+        uint32_t last = --num_of_connected_users;
+        name_positions[id] = NOT_CONNECTED;
+        if (position != last)
+        {
+            connected_ids[position] = connected_ids[last];
+            memcpy(connected_ips[position], connected_ips[last], IP_LEN);
+            connected_ports[position] = connected_ports[last];
+            name_positions[connected_ids[position]] = position;
+        }
+        connected_names_len -= strlen(username);
+        sorted_names_remove(&connected_names, username);
+        release_name(id);
+        drop_cached_snapshot(&p_users_snapshot);
+    }
+    else
+        res = DISCONNECT_USER_ERR_NOT_CONNECTED;
+
+    pthread_rwlock_unlock(&lock_connected_users);
+
+    return res;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// queries
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int is_connected(char* username)
+{
+    pthread_rwlock_rdlock(&lock_connected_users);
+    int res = find_connected_user(username) != NOT_CONNECTED;
+    pthread_rwlock_unlock(&lock_connected_users);
+
+    return res;
+}
+
+
+
+int get_connected_user(char* username, user* p_user)
+{
+    pthread_rwlock_rdlock(&lock_connected_users);
+
+    uint32_t position = find_connected_user(username);
+    if (position != NOT_CONNECTED)
+        get_user_at(position, p_user);
+
+    pthread_rwlock_unlock(&lock_connected_users);
+
+    return position != NOT_CONNECTED;
+}
+
+
+
+int renew_lease(char* username)
+{
+    pthread_rwlock_rdlock(&lock_connected_users);
+
+    uint32_t position = find_connected_user(username);
+    if (position != NOT_CONNECTED && lease_ms != 0)
+        __atomic_store_n(&get_lease(connected_ids[position])->expires_at_ms,
+            lease_now_ms() + lease_ms, __ATOMIC_RELAXED);
+
+    pthread_rwlock_unlock(&lock_connected_users);
+
+    return position != NOT_CONNECTED ? RENEW_LEASE_SUCCESS : RENEW_LEASE_ERR_NOT_CONNECTED;
+}
+
+
+
+int is_lease_expired(char* username)
+{
+    pthread_rwlock_rdlock(&lock_connected_users);
+
+    uint32_t position = find_connected_user(username);
+    int res = position != NOT_CONNECTED && lease_ms != 0 && lease_now_ms()
+        >= __atomic_load_n(&get_lease(connected_ids[position])->expires_at_ms, __ATOMIC_RELAXED);
+
+    pthread_rwlock_unlock(&lock_connected_users);
+
+    return res;
+}
+
+
+
+struct users_snapshot* get_users_snapshot()
+{
+    // the snapshot is dropped only with the write lock held
+    pthread_rwlock_rdlock(&lock_connected_users);
+
+    struct users_snapshot* p_snapshot = acquire_cached_snapshot(&p_users_snapshot);
+    if (p_snapshot == NULL)
+    {
+        // every user takes at most its name, the longest address, the longest port and the '\0's
+        p_snapshot = new_users_snapshot(num_of_connected_users,
+            connected_names_len + num_of_connected_users * (MAX_IP_ADDR_LEN + MAX_PORT_LEN + 3));
+        for (uint32_t i = 0; p_snapshot != NULL && i < num_of_connected_users; i++)
+        {
+            char* username = name_pool + name_offsets[connected_ids[i]];
+            size_t username_len = strlen(username) + 1;
+            memcpy(p_snapshot->data + p_snapshot->len, username, username_len);
+            p_snapshot->len += username_len;
+            p_snapshot->len += format_address(connected_ips[i], p_snapshot->data + p_snapshot->len)
+                + 1;
+            p_snapshot->len += sprintf(p_snapshot->data + p_snapshot->len, "%u",
+                (unsigned int) connected_ports[i]) + 1;
+        }
+
+        if (p_snapshot != NULL)
+        {
+            metrics_increment(METRIC_USERS_SNAPSHOTS);
+            cache_users_snapshot(&p_users_snapshot, p_snapshot);
+        }
+    }
+
+    pthread_rwlock_unlock(&lock_connected_users);
+
+    return p_snapshot;
+}
+
+
+
+/*
+    adds the length of the username to the number pointed by arg. Used with sorted_names_select.
+*/
+void add_username_len(char* username, void* arg)
+{
+    *(size_t*) arg += strlen(username);
+}
+
+
+
+/*
+    appends the connected user with the username to the snapshot pointed by arg. Used with
+    sorted_names_select, with the lock held.
+*/
+void append_connected_user(char* username, void* arg)
+{
+    struct users_snapshot* p_snapshot = arg;
+    uint32_t position = find_connected_user(username);
+
+    size_t username_len = strlen(username) + 1;
+    memcpy(p_snapshot->data + p_snapshot->len, username, username_len);
+    p_snapshot->len += username_len;
+    p_snapshot->len += format_address(connected_ips[position], p_snapshot->data + p_snapshot->len)
+        + 1;
+    p_snapshot->len += sprintf(p_snapshot->data + p_snapshot->len, "%u",
+        (unsigned int) connected_ports[position]) + 1;
+}
+
+
+
+struct users_snapshot* get_filtered_users_snapshot(struct name_filter* p_filter)
+{
+    pthread_rwlock_rdlock(&lock_connected_users);
+
+    // the first pass only measures the matching users
+    size_t names_len = 0;
+    uint32_t num_of_users = sorted_names_select(&connected_names, p_filter, add_username_len,
+        &names_len);
+    struct users_snapshot* p_snapshot = new_users_snapshot(num_of_users,
+        names_len + num_of_users * (MAX_IP_ADDR_LEN + MAX_PORT_LEN + 3));
+    if (p_snapshot != NULL)
+        sorted_names_select(&connected_names, p_filter, append_connected_user, p_snapshot);
+
+    pthread_rwlock_unlock(&lock_connected_users);
+
+    return p_snapshot;
+}
+
+
+
+void release_users_snapshot(struct users_snapshot* p_snapshot)
+{
+    if (p_snapshot != NULL && __atomic_sub_fetch(&p_snapshot->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        release_compressed_payload(p_snapshot->p_compressed);
+        free(p_snapshot);
+    }
+}
+
+
+
+struct compressed_payload* get_compressed_users_snapshot(struct users_snapshot* p_snapshot)
+{
+    struct compressed_payload* p_compressed = __atomic_load_n(&p_snapshot->p_compressed,
+        __ATOMIC_ACQUIRE);
+    if (p_compressed != NULL)
+        return p_compressed;
+
+    // the readers compressing it at the same time keep the first one
+    if (compress_payload(p_snapshot->data, p_snapshot->len, &p_compressed)
+        != COMPRESS_PAYLOAD_SUCCESS)
+        return NULL;
+
+    struct compressed_payload* p_expected = NULL;
+    if (!__atomic_compare_exchange_n(&p_snapshot->p_compressed, &p_expected, p_compressed, 0,
+        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        release_compressed_payload(p_compressed);
+        p_compressed = p_expected;
+    }
+
+    return p_compressed;
+}
+
+
+
+void for_each_connected_user(void (*on_user)(char* username, char* ip, char* port, void* arg),
+    void* arg)
+{
+    pthread_rwlock_rdlock(&lock_connected_users);
+
+    user user_data;
+    for (uint32_t i = 0; i < num_of_connected_users; i++)
+    {
+        get_user_at(i, &user_data);
+        on_user(user_data.username, user_data.ip, user_data.port, arg);
+    }
+
+    pthread_rwlock_unlock(&lock_connected_users);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// users snapshots
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct users_snapshot* new_users_snapshot(uint32_t num_of_users, size_t max_users_len)
+{
+    char str_num_of_users[11];
+    int num_len = sprintf(str_num_of_users, "%u", num_of_users) + 1;
+
+    struct users_snapshot* p_snapshot = malloc(sizeof(struct users_snapshot) + num_len
+        + max_users_len);
+    if (p_snapshot != NULL)
+    {
+        p_snapshot->refcount = 1;
+        p_snapshot->num_of_users = num_of_users;
+        p_snapshot->p_compressed = NULL;
+        memcpy(p_snapshot->data, str_num_of_users, num_len);
+        p_snapshot->len = num_len;
+    }
+
+    return p_snapshot;
+}
+
+
+
+struct users_snapshot* acquire_cached_snapshot(struct users_snapshot** pp_cache)
+{
+    struct users_snapshot* p_snapshot = __atomic_load_n(pp_cache, __ATOMIC_ACQUIRE);
+    if (p_snapshot != NULL)
+        __atomic_add_fetch(&p_snapshot->refcount, 1, __ATOMIC_RELAXED);
+
+    return p_snapshot;
+}
+
+
+
+void cache_users_snapshot(struct users_snapshot** pp_cache, struct users_snapshot* p_snapshot)
+{
+    // another reader could have cached the same users meanwhile, then it's kept
+    __atomic_add_fetch(&p_snapshot->refcount, 1, __ATOMIC_RELAXED);
+    struct users_snapshot* p_expected = NULL;
+    if (!__atomic_compare_exchange_n(pp_cache, &p_expected, p_snapshot, 0, __ATOMIC_ACQ_REL,
+        __ATOMIC_ACQUIRE))
+        release_users_snapshot(p_snapshot);
+}
+
+
+
+void drop_cached_snapshot(struct users_snapshot** pp_cache)
+{
+    release_users_snapshot(__atomic_exchange_n(pp_cache, NULL, __ATOMIC_ACQ_REL));
+}
@@ -0,0 +1,194 @@
+#ifndef CONNECTED_USERS_H
+#define CONNECTED_USERS_H
+#include <stddef.h>
+#include <stdint.h>
+/*
+    registry of the users which are connected to the system, i.e. which sent CONNECT with the port
+    they listen on for file transfers and did not DISCONNECT yet. Kept in memory only.
+    The users are kept compact: the usernames are interned (stored once, referred to by an id) and
+    the connected users are a structure of arrays of the ids, the binary addresses (IPv4 as
+    IPv4-mapped IPv6) and the ports, without gaps. They are converted to text only when they are
+    read, so listing all of them walks a few dense arrays. The id of a user which disconnects is
+    released and reused, with its lease, by the next user which connects, and the pool of the
+    names is compacted when most of it are released names, so the memory follows the number of
+    the connected users rather than of all the users which ever connected.
+    The list of the connected users is kept serialized in an immutable, reference counted snapshot
+    (see get_users_snapshot). It's built by the first reader after a change and shared by all the
+    readers till the next CONNECT or DISCONNECT drops it, so a reader only takes a reference.
+    The usernames of the connected users are also kept in order (see sorted_names.h), so a listing
+    filtered by a prefix, a pattern or a range of the usernames reads only the matching users.
+    When leases are used (see init_leases) a connected user has to renew its lease (HEARTBEAT)
+    before it expires, otherwise it's disconnected. Every lease has a timer in the timer wheel, so
+    nothing is scanned to find the expired ones.
+    IMPORTANT before any operation will be performed it is required to call the init() function and
+    if the registry won't be used anymore then the destroy() function must be called.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// user data
+#define MAX_USERNAME_LEN 256
+#define MAX_IP_ADDR_LEN 45     // IPv6
+#define MAX_PORT_LEN 5
+// init
+#define INIT_CONNECTED_USERS_SUCCESS 0
+#define INIT_CONNECTED_USERS_ERR_MEMORY 1
+#define INIT_CONNECTED_USERS_ERR_LOCK_INIT 2
+// connect user
+#define CONNECT_USER_SUCCESS 0
+#define CONNECT_USER_ERR_ALREADY_CONNECTED 1
+#define CONNECT_USER_ERR_MEMORY 2
+#define CONNECT_USER_ERR_ADDRESS 3
+// disconnect user
+#define DISCONNECT_USER_SUCCESS 0
+#define DISCONNECT_USER_ERR_NOT_CONNECTED 1
+// init leases
+#define INIT_LEASES_SUCCESS 0
+#define INIT_LEASES_ERR_THREAD 1
+#define INIT_LEASES_ERR_MEMORY 2
+// renew lease
+#define RENEW_LEASE_SUCCESS 0
+#define RENEW_LEASE_ERR_NOT_CONNECTED 1
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct user_data {
+    char username[MAX_USERNAME_LEN + 1];
+    char ip[MAX_IP_ADDR_LEN + 1];
+    char port[MAX_PORT_LEN + 1];
+};
+
+typedef struct user_data user;
+
+struct compressed_payload;
+struct name_filter;
+
+/*
+    serialized list of the connected users, it must not be changed. It's released when the last
+    reference is released.
+*/
+struct users_snapshot {
+    uint32_t refcount;
+    uint32_t num_of_users;
+    struct compressed_payload* p_compressed;    // the data compressed, NULL till it's needed
+    size_t len;
+    char data[];    // the number of the users and the users, each field finished by '\0'
+};
+
+
+
+/*
+    must be called exactly once at the beginning, before the first call to any function
+    from this file has been done.
+    Returns:
+        INIT_CONNECTED_USERS_SUCCESS        - success
+        INIT_CONNECTED_USERS_ERR_MEMORY     - could not allocate the registry
+        INIT_CONNECTED_USERS_ERR_LOCK_INIT  - could not initialize the registry lock
+*/
+int init_connected_users();
+/*
+    must be called exactly once when the functions won't be used anymore.
+*/
+void destroy_connected_users();
+/*
+    starts giving leases of lease_ms milliseconds to the connected users, 0 means no leases. When a
+    lease expires on_expire is called with the username from the thread of the leases, it should
+    disconnect the user if is_lease_expired() (the user could have renewed the lease meanwhile).
+    Must be called after init_connected_users() and init_timer_wheel() (see timer_wheel.h), the
+    users connected already get a full lease.
+    Returns:
+        INIT_LEASES_SUCCESS         - success
+        INIT_LEASES_ERR_THREAD      - could not start the thread of the leases
+        INIT_LEASES_ERR_MEMORY      - could not allocate the leases
+*/
+int init_leases(uint64_t lease_ms, void (*on_expire)(char* username));
+/*
+    stops the leases, must be called before destroy_connected_users() and destroy_timer_wheel().
+*/
+void destroy_leases();
+/*
+    marks the user as connected from the ip address (IPv4 or IPv6), listening on the port.
+    Returns:
+        CONNECT_USER_SUCCESS                - success
+        CONNECT_USER_ERR_ALREADY_CONNECTED  - the user is already connected
+        CONNECT_USER_ERR_MEMORY             - could not allocate memory
+        CONNECT_USER_ERR_ADDRESS            - the ip address or the port is invalid
+*/
+int connect_user(char* username, char* ip, char* port);
+/*
+    marks the user as disconnected.
+    Returns:
+        DISCONNECT_USER_SUCCESS             - success
+        DISCONNECT_USER_ERR_NOT_CONNECTED   - the user is not connected
+*/
+int disconnect_user(char* username);
+/*
+    renews the lease of the connected user, so it expires lease_ms milliseconds from now.
+    Returns:
+        RENEW_LEASE_SUCCESS             - success (also when there are no leases)
+        RENEW_LEASE_ERR_NOT_CONNECTED   - the user is not connected, e.g. its lease expired
+*/
+int renew_lease(char* username);
+/*
+    checks if the lease of the connected user expired.
+    Returns 1 if the user is connected and its lease expired and 0 if no
+*/
+int is_lease_expired(char* username);
+/*
+    checks if the user with the username is connected to the server.
+    Returns 1 if the user is connected and 0 if no
+*/
+int is_connected(char* username);
+/*
+    copies the data of the connected user with the username where p_user points.
+    Returns 1 if the user is connected and 0 if no
+*/
+int get_connected_user(char* username, user* p_user);
+/*
+    Returns a reference to the snapshot of the users which are connected to the system, its data
+    is the response to LIST_USERS after the result code: the number of the users, then the
+    username, the ip address and the port of every user. The reference has to be released with
+    release_users_snapshot(). NULL if the snapshot could not be allocated
+*/
+struct users_snapshot* get_users_snapshot();
+/*
+    Returns a new snapshot of the connected users whose usernames match the filter (see
+    sorted_names.h), ordered by the username. The usernames are kept in order, so only the
+    matching users are read. The snapshot is not cached, the reference has to be released with
+    release_users_snapshot(). NULL if the snapshot could not be allocated
+*/
+struct users_snapshot* get_filtered_users_snapshot(struct name_filter* p_filter);
+/*
+    releases the reference to the snapshot, it's deleted with the last one.
+*/
+void release_users_snapshot(struct users_snapshot* p_snapshot);
+/*
+    Returns the data of the snapshot compressed (see compression.h), it's compressed by the first
+    caller and kept till the snapshot is deleted, so the caller needs no reference of its own.
+    NULL if it could not be compressed
+*/
+struct compressed_payload* get_compressed_users_snapshot(struct users_snapshot* p_snapshot);
+/*
+    helpers for the registries which keep a snapshot of their users like this one (see replica.h).
+    new_users_snapshot allocates a snapshot with one reference, room for max_users_len bytes of
+    users and the number of the users written already. acquire_cached_snapshot returns a new
+    reference to the snapshot in the cache (NULL if it's empty), the cache must not be dropped
+    meanwhile. cache_users_snapshot puts the snapshot in the empty cache, drop_cached_snapshot
+    empties the cache.
+*/
+struct users_snapshot* new_users_snapshot(uint32_t num_of_users, size_t max_users_len);
+struct users_snapshot* acquire_cached_snapshot(struct users_snapshot** pp_cache);
+void cache_users_snapshot(struct users_snapshot** pp_cache, struct users_snapshot* p_snapshot);
+void drop_cached_snapshot(struct users_snapshot** pp_cache);
+/*
+    calls on_user for every connected user with its username, ip address, port and arg. The
+    registry can't change meanwhile, so on_user must not call other functions from this file.
+*/
+void for_each_connected_user(void (*on_user)(char* username, char* ip, char* port, void* arg),
+    void* arg);
+
+#endif
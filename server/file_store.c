@@ -0,0 +1,343 @@
+#define _GNU_SOURCE
+#include "file_store.h"
+#include "blob_store.h"
+#include "reclaimer.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <unistd.h>
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// paths
+#define CONTENT_DIR_PATH "content/"
+#define TMP_FILE_SUFFIX ".XXXXXX"
+// names lengths
+#define MAX_FILENAME_LEN 256
+// transfer
+#define SPLICE_CHUNK_SIZE (64 * 1024)
+#define SENDFILE_CHUNK_SIZE (1024 * 1024 * 1024)
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// init
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int init_file_store()
+{
+    // create the content directory if it doesn't exist
+    if (mkdir(CONTENT_DIR_PATH, S_IRWXU) != 0 && errno != EEXIST)
+        return INIT_FILE_STORE_ERR_FOLDER_CREATION;
+
+    return INIT_FILE_STORE_SUCCESS;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// store_file_content
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    moves the bytes waiting in the pipe to the file with a user-space buffer. Used only when the
+    file system does not support splice.
+    Returns 0 on success and -1 on fail.
+*/
+int drain_pipe_to_file(int pipe_fd, int fd, ssize_t len)
+{
+    char buffer[SPLICE_CHUNK_SIZE];
+
+    while (len > 0)
+    {
+        ssize_t r = read(pipe_fd, buffer, len < sizeof(buffer) ? len : sizeof(buffer));
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+
+        for (ssize_t done = 0; done < r; )
+        {
+            ssize_t w = write(fd, buffer + done, r - done);
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w < 0)
+                return -1;
+            done += w;
+        }
+
+        len -= r;
+    }
+
+    return 0;
+}
+
+
+
+/*
+    moves size bytes from the socket to the file through a pipe, so the data stays in kernel
+    space.
+    Returns 0 on success and -1 on fail.
+*/
+int splice_to_file(int socket, int fd, uint64_t size)
+{
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0)
+        return -1;
+
+    int res = 0;
+    int can_splice_file = 1;
+    uint64_t left = size;
+
+    while (left > 0 && res == 0)
+    {
+        size_t chunk = left < SPLICE_CHUNK_SIZE ? left : SPLICE_CHUNK_SIZE;
+        ssize_t in_pipe = splice(socket, NULL, pipe_fds[1], NULL, chunk, SPLICE_F_MOVE);
+
+        if (in_pipe < 0 && errno == EINTR)
+            continue;
+        if (in_pipe <= 0) // error or the client closed the connection too early
+        {
+            res = -1;
+            break;
+        }
+
+        ssize_t to_file = in_pipe;
+        while (to_file > 0 && res == 0)
+        {
+            if (!can_splice_file)
+            {
+                res = drain_pipe_to_file(pipe_fds[0], fd, to_file);
+                break;
+            }
+
+            ssize_t written = splice(pipe_fds[0], NULL, fd, NULL, to_file, SPLICE_F_MOVE);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written < 0 && errno == EINVAL) // file system does not support splice
+                can_splice_file = 0;
+            else if (written <= 0)
+                res = -1;
+            else
+                to_file -= written;
+        }
+
+        left -= in_pipe;
+    }
+
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+
+    return res;
+}
+
+
+
+int store_file_content(char* username, char* file_name, int socket, uint64_t size)
+{
+    // create user content directory path
+    char dir_path[strlen(CONTENT_DIR_PATH) + strlen(username) + 2];
+    sprintf(dir_path, "%s%s/", CONTENT_DIR_PATH, username);
+
+    if (mkdir(dir_path, S_IRWXU) != 0 && errno != EEXIST)
+    {
+        perror("ERROR store_file_content - could not create directory");
+        return STORE_FILE_CONTENT_ERR_DIRECTORY;
+    }
+
+    // the content is received into a hidden temporary file which is renamed when complete
+    char tmp_path[strlen(dir_path) + strlen(file_name) + strlen(TMP_FILE_SUFFIX) + 2];
+    sprintf(tmp_path, "%s.%s%s", dir_path, file_name, TMP_FILE_SUFFIX);
+    char file_path[strlen(dir_path) + strlen(file_name) + 1];
+    sprintf(file_path, "%s%s", dir_path, file_name);
+
+    int fd = mkstemp(tmp_path);
+    if (fd < 0)
+    {
+        perror("ERROR store_file_content - could not create temporary file");
+        return STORE_FILE_CONTENT_ERR_OPEN;
+    }
+
+    struct stat st;
+    int replaced_fd = -1;
+    int res = STORE_FILE_CONTENT_SUCCESS;
+    if (splice_to_file(socket, fd, size) != 0)
+        res = STORE_FILE_CONTENT_ERR_RECEIVE;
+    else
+    {
+        // the blob of the replaced content may not be needed anymore afterwards
+        if (stat(file_path, &st) == 0 && st.st_nlink > 1)
+            replaced_fd = open(file_path, O_RDONLY);
+        if (rename(tmp_path, file_path) != 0)
+        {
+            perror("ERROR store_file_content - could not rename temporary file");
+            res = STORE_FILE_CONTENT_ERR_RENAME;
+        }
+    }
+
+    close(fd);
+    if (res != STORE_FILE_CONTENT_SUCCESS)
+    {
+        unlink(tmp_path);
+        if (replaced_fd >= 0)
+            close(replaced_fd);
+    }
+    else
+    {
+        // the file stays unshared if it can't be linked
+        int dedup_res = dedup_file(file_path, NULL, 0);
+        if (dedup_res != DEDUP_FILE_SUCCESS && dedup_res != DEDUP_FILE_LINKED)
+            printf("ERROR store_file_content - could not share content. Code: %d\n", dedup_res);
+        if (replaced_fd >= 0)
+            reclaim_file_blob(replaced_fd);
+    }
+
+    return res;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// open_file_content
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int open_file_content(char* username, char* file_name, int* p_fd, uint64_t* p_size)
+{
+    char file_path[strlen(CONTENT_DIR_PATH) + strlen(username) + strlen(file_name) + 2];
+    sprintf(file_path, "%s%s/%s", CONTENT_DIR_PATH, username, file_name);
+
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0)
+        return OPEN_FILE_CONTENT_ERR_NO_SUCH_FILE;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return OPEN_FILE_CONTENT_ERR_STAT;
+    }
+
+    *p_fd = fd;
+    *p_size = st.st_size;
+
+    return OPEN_FILE_CONTENT_SUCCESS;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// send_file_content
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int send_file_content(int socket, int fd, uint64_t offset, uint64_t length)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0 || offset > (uint64_t) st.st_size
+        || length > (uint64_t) st.st_size - offset)
+        return SEND_FILE_CONTENT_ERR_RANGE;
+
+    off_t file_offset = offset;
+    uint64_t left = length;
+
+    while (left > 0)
+    {
+        size_t chunk = left < SENDFILE_CHUNK_SIZE ? left : SENDFILE_CHUNK_SIZE;
+        ssize_t sent = sendfile(socket, fd, &file_offset, chunk);
+
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+        {
+            perror("ERROR send_file_content - could not send");
+            return SEND_FILE_CONTENT_ERR_SEND;
+        }
+
+        left -= sent;
+    }
+
+    return SEND_FILE_CONTENT_SUCCESS;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// delete_user_content
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int delete_user_content(char* username)
+{
+    // the whole directory is deleted, the name must not lead out of it
+    if (!is_path_component_valid(username))
+        return DELETE_USER_CONTENT_ERR_REMOVE;
+
+    char dir_path[strlen(CONTENT_DIR_PATH) + strlen(username) + 1];
+    sprintf(dir_path, "%s%s", CONTENT_DIR_PATH, username);
+
+    // nothing may have been relayed for this user
+    int move_res = move_to_trash(dir_path);
+    if (move_res != MOVE_TO_TRASH_SUCCESS && move_res != MOVE_TO_TRASH_ERR_NOT_EXISTS)
+        return DELETE_USER_CONTENT_ERR_REMOVE;
+
+    return DELETE_USER_CONTENT_SUCCESS;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// dedup_content
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int dedup_content(uint32_t* p_num_of_files, uint32_t* p_num_of_linked)
+{
+    *p_num_of_files = 0;
+    *p_num_of_linked = 0;
+
+    DIR* p_content_dir = opendir(CONTENT_DIR_PATH);
+    if (p_content_dir == NULL)
+        return DEDUP_CONTENT_ERR_OPEN_DIR;
+
+    // content/<username>/<file name>
+    struct dirent* p_user;
+    while ((p_user = readdir(p_content_dir)) != NULL)
+    {
+        if (p_user->d_name[0] == '.')
+            continue;
+
+        char dir_path[strlen(CONTENT_DIR_PATH) + strlen(p_user->d_name) + 2];
+        sprintf(dir_path, "%s%s/", CONTENT_DIR_PATH, p_user->d_name);
+        DIR* p_user_dir = opendir(dir_path);
+        if (p_user_dir == NULL)
+            continue;
+
+        struct dirent* p_file;
+        char file_path[strlen(dir_path) + MAX_FILENAME_LEN + 1];
+        while ((p_file = readdir(p_user_dir)) != NULL)
+        {
+            if (p_file->d_name[0] == '.')   // also the content being received
+                continue;
+
+            sprintf(file_path, "%s%s", dir_path, p_file->d_name);
+            int dedup_res = dedup_file(file_path, NULL, 0);
+            if (dedup_res == DEDUP_FILE_LINKED)
+                (*p_num_of_linked)++;
+            else if (dedup_res != DEDUP_FILE_SUCCESS)
+                printf("ERROR dedup_content - could not share %s. Code: %d\n", file_path,
+                    dedup_res);
+            (*p_num_of_files)++;
+        }
+
+        closedir(p_user_dir);
+    }
+
+    closedir(p_content_dir);
+
+    return DEDUP_CONTENT_SUCCESS;
+}
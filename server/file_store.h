@@ -0,0 +1,95 @@
+#include <stdint.h>
+/*
+    encapsulates functions dealing with the content of the published files which is relayed through
+    the server (e.g. when the owner of the file is behind NAT). The content is kept on disk and it
+    never passes through user-space buffers: it is received with splice() and sent with sendfile().
+    The files of the same content are links to one blob (see blob_store.h).
+    IMPORTANT before any operation will be performed it is required to call the init() function.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// init
+#define INIT_FILE_STORE_SUCCESS 0
+#define INIT_FILE_STORE_ERR_FOLDER_CREATION 1
+// store file content
+#define STORE_FILE_CONTENT_SUCCESS 0
+#define STORE_FILE_CONTENT_ERR_DIRECTORY 1
+#define STORE_FILE_CONTENT_ERR_OPEN 2
+#define STORE_FILE_CONTENT_ERR_RECEIVE 3
+#define STORE_FILE_CONTENT_ERR_RENAME 4
+// open file content
+#define OPEN_FILE_CONTENT_SUCCESS 0
+#define OPEN_FILE_CONTENT_ERR_NO_SUCH_FILE 1
+#define OPEN_FILE_CONTENT_ERR_STAT 2
+// send file content
+#define SEND_FILE_CONTENT_SUCCESS 0
+#define SEND_FILE_CONTENT_ERR_RANGE 1
+#define SEND_FILE_CONTENT_ERR_SEND 2
+// delete user content
+#define DELETE_USER_CONTENT_SUCCESS 0
+#define DELETE_USER_CONTENT_ERR_REMOVE 1
+// dedup
+#define DEDUP_CONTENT_SUCCESS 0
+#define DEDUP_CONTENT_ERR_OPEN_DIR 1
+
+
+
+/*
+    must be called exactly once at the beginning, before the first call to any function
+    from this file has been done.
+    Returns:
+        INIT_FILE_STORE_SUCCESS             - success
+        INIT_FILE_STORE_ERR_FOLDER_CREATION - could not create the content folder
+*/
+int init_file_store();
+/*
+    receives size bytes from the socket and stores them as the content of the file_name file of
+    the user with the specified username. The data is moved from the socket to the file with
+    splice() and the file becomes visible only after all the bytes were received, so concurrent
+    readers always see the previous or the new content as a whole. Then it's replaced by a link to
+    the blob of the same content, if there is one. The blob of the previous content is deleted by
+    the reclaimer when nothing links to it anymore.
+    Returns:
+        STORE_FILE_CONTENT_SUCCESS          - success
+        STORE_FILE_CONTENT_ERR_DIRECTORY    - could not create the user content directory
+        STORE_FILE_CONTENT_ERR_OPEN         - could not create the temporary file
+        STORE_FILE_CONTENT_ERR_RECEIVE      - could not receive the content from the socket
+        STORE_FILE_CONTENT_ERR_RENAME       - could not publish the received content
+*/
+int store_file_content(char* username, char* file_name, int socket, uint64_t size);
+/*
+    opens the content of the file_name file of the user with the specified username for reading.
+    The descriptor is put where p_fd points and the size of the content where p_size points.
+    The descriptor has to be closed afterwards.
+    Returns:
+        OPEN_FILE_CONTENT_SUCCESS           - success
+        OPEN_FILE_CONTENT_ERR_NO_SUCH_FILE  - there is no content stored for such file
+        OPEN_FILE_CONTENT_ERR_STAT          - could not obtain the size of the content
+*/
+int open_file_content(char* username, char* file_name, int* p_fd, uint64_t* p_size);
+/*
+    sends length bytes of the content opened with open_file_content(), starting at offset,
+    directly from the page cache to the socket with sendfile().
+    Returns:
+        SEND_FILE_CONTENT_SUCCESS   - success
+        SEND_FILE_CONTENT_ERR_RANGE - the range is outside the content
+        SEND_FILE_CONTENT_ERR_SEND  - could not send the content
+*/
+int send_file_content(int socket, int fd, uint64_t offset, uint64_t length);
+/*
+    deletes the content of all files of the user with the specified username. The folder of the
+    user is moved to the trash at once, the files are deleted in the background (see reclaimer.h).
+    Returns:
+        DELETE_USER_CONTENT_SUCCESS     - success (also if the user had no content)
+        DELETE_USER_CONTENT_ERR_REMOVE  - could not remove the content
+*/
+int delete_user_content(char* username);
+/*
+    shares the content stored before the content used the blob store, see dedup_storage() in
+    user_dao.h.
+    Returns:
+        DEDUP_CONTENT_SUCCESS           - success
+        DEDUP_CONTENT_ERR_OPEN_DIR      - could not read the content directory
+*/
+int dedup_content(uint32_t* p_num_of_files, uint32_t* p_num_of_linked);
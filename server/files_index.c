@@ -0,0 +1,265 @@
+#include "files_index.h"
+#include "sorted_names.h"
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define INITIAL_NUM_OF_BUCKETS 1024
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct owner_files {
+    char* owner;
+    struct sorted_names files;
+    struct owner_files* p_next;
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// global variables
+///////////////////////////////////////////////////////////////////////////////////////////////////
+pthread_rwlock_t lock_files_index;
+// owner -> files, chained hash table
+struct owner_files** files_buckets;
+uint32_t num_of_files_buckets;
+uint32_t num_of_indexed_owners;
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t hash_files_owner(char* owner)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    while (*owner)
+    {
+        hash ^= (uint8_t) *owner++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+
+/*
+    Returns the address of the pointer to the entry of the owner, which is NULL if the owner has
+    no files. Must be called with the lock held.
+*/
+struct owner_files** find_owner_files(char* owner)
+{
+    uint32_t bucket = hash_files_owner(owner) & (num_of_files_buckets - 1);
+    struct owner_files** pp_entry = &files_buckets[bucket];
+    while (*pp_entry != NULL && strcmp((*pp_entry)->owner, owner) != 0)
+        pp_entry = &(*pp_entry)->p_next;
+
+    return pp_entry;
+}
+
+
+
+/*
+    doubles the number of buckets. Must be called with the write lock held.
+*/
+void grow_files_buckets()
+{
+    uint32_t new_num_of_buckets = num_of_files_buckets * 2;
+    struct owner_files** new_buckets = calloc(new_num_of_buckets, sizeof(struct owner_files*));
+    if (new_buckets == NULL)
+        return; // longer chains, but still correct
+
+    for (uint32_t i = 0; i < num_of_files_buckets; i++)
+    {
+        struct owner_files* p_entry = files_buckets[i];
+        while (p_entry != NULL)
+        {
+            struct owner_files* p_next = p_entry->p_next;
+            uint32_t bucket = hash_files_owner(p_entry->owner) & (new_num_of_buckets - 1);
+            p_entry->p_next = new_buckets[bucket];
+            new_buckets[bucket] = p_entry;
+            p_entry = p_next;
+        }
+    }
+
+    free(files_buckets);
+    files_buckets = new_buckets;
+    num_of_files_buckets = new_num_of_buckets;
+}
+
+
+
+void free_owner_files(struct owner_files* p_entry)
+{
+    destroy_sorted_names(&p_entry->files);
+    free(p_entry->owner);
+    free(p_entry);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// init / destroy
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int init_files_index()
+{
+    num_of_files_buckets = INITIAL_NUM_OF_BUCKETS;
+    files_buckets = calloc(num_of_files_buckets, sizeof(struct owner_files*));
+    if (files_buckets == NULL)
+        return INIT_FILES_INDEX_ERR_MEMORY;
+
+    if (pthread_rwlock_init(&lock_files_index, NULL) != 0)
+        return INIT_FILES_INDEX_ERR_LOCK_INIT;
+
+    return INIT_FILES_INDEX_SUCCESS;
+}
+
+
+
+void destroy_files_index()
+{
+    for (uint32_t i = 0; i < num_of_files_buckets; i++)
+    {
+        while (files_buckets[i] != NULL)
+        {
+            struct owner_files* p_next = files_buckets[i]->p_next;
+            free_owner_files(files_buckets[i]);
+            files_buckets[i] = p_next;
+        }
+    }
+
+    free(files_buckets);
+    pthread_rwlock_destroy(&lock_files_index);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// files_index_add
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int files_index_add(char* owner, char* file_name)
+{
+    int res = FILES_INDEX_SUCCESS;
+    pthread_rwlock_wrlock(&lock_files_index);
+
+    struct owner_files** pp_entry = find_owner_files(owner);
+    struct owner_files* p_entry = *pp_entry;
+
+    if (p_entry == NULL)    // first file of the owner
+    {
+        p_entry = calloc(1, sizeof(struct owner_files));
+        if (p_entry != NULL && (p_entry->owner = strdup(owner)) != NULL)
+        {
+            *pp_entry = p_entry;
+            if (++num_of_indexed_owners > num_of_files_buckets)
+                grow_files_buckets();
+        }
+        else
+        {
+            free(p_entry);
+            p_entry = NULL;
+            res = FILES_INDEX_ERR_MEMORY;
+        }
+    }
+
+    // a file published again is indexed already
+    if (p_entry != NULL
+        && sorted_names_insert(&p_entry->files, file_name) == SORTED_NAMES_INSERT_ERR_MEMORY)
+        res = FILES_INDEX_ERR_MEMORY;
+
+    pthread_rwlock_unlock(&lock_files_index);
+
+    return res;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// files_index_remove
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int files_index_remove(char* owner, char* file_name)
+{
+    int res = FILES_INDEX_ERR_NOT_INDEXED;
+    pthread_rwlock_wrlock(&lock_files_index);
+
+    struct owner_files** pp_entry = find_owner_files(owner);
+    struct owner_files* p_entry = *pp_entry;
+
+    if (p_entry != NULL)
+    {
+        if (sorted_names_remove(&p_entry->files, file_name) == SORTED_NAMES_REMOVE_SUCCESS)
+            res = FILES_INDEX_SUCCESS;
+
+        if (p_entry->files.num_of_names == 0)
+        {
+            *pp_entry = p_entry->p_next;
+            free_owner_files(p_entry);
+            num_of_indexed_owners--;
+        }
+    }
+
+    pthread_rwlock_unlock(&lock_files_index);
+
+    return res;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// files_index_remove_owner
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void files_index_remove_owner(char* owner)
+{
+    pthread_rwlock_wrlock(&lock_files_index);
+
+    struct owner_files** pp_entry = find_owner_files(owner);
+    struct owner_files* p_entry = *pp_entry;
+    if (p_entry != NULL)
+    {
+        *pp_entry = p_entry->p_next;
+        free_owner_files(p_entry);
+        num_of_indexed_owners--;
+    }
+
+    pthread_rwlock_unlock(&lock_files_index);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// files_index_list
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int files_index_list(char* owner, struct name_filter* p_filter, char*** p_files,
+    uint32_t* p_quantity, struct arena* p_arena)
+{
+    *p_files = NULL;
+    *p_quantity = 0;
+    int res = FILES_INDEX_SUCCESS;
+    pthread_rwlock_rdlock(&lock_files_index);
+
+    struct owner_files* p_entry = *find_owner_files(owner);
+    if (p_entry != NULL && sorted_names_list(&p_entry->files, p_filter, p_files, p_quantity,
+        p_arena) != SORTED_NAMES_LIST_SUCCESS)
+        res = FILES_INDEX_ERR_MEMORY;
+
+    pthread_rwlock_unlock(&lock_files_index);
+
+    return res;
+}
@@ -0,0 +1,69 @@
+#include <stdint.h>
+/*
+    in-memory index of the names of the published files of every owner, kept in order (see
+    sorted_names.h). It is kept in sync with the storage (see user_dao.h) like the owners index:
+    it's changed with the storage under the lock of the owner (see change_feed_lock_user). So a
+    listing filtered by a prefix, a pattern or a range of the names reads only the matching names
+    instead of the whole directory of the owner, and it's sorted without sorting.
+    IMPORTANT before any operation will be performed it is required to call the init() function and
+    if the index won't be used anymore then the destroy() function must be called.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// init
+#define INIT_FILES_INDEX_SUCCESS 0
+#define INIT_FILES_INDEX_ERR_MEMORY 1
+#define INIT_FILES_INDEX_ERR_LOCK_INIT 2
+// add / remove / list
+#define FILES_INDEX_SUCCESS 0
+#define FILES_INDEX_ERR_MEMORY 1
+#define FILES_INDEX_ERR_NOT_INDEXED 2
+
+
+
+struct arena;
+struct name_filter;
+
+
+
+/*
+    must be called exactly once at the beginning, before the first call to any function
+    from this file has been done.
+    Returns:
+        INIT_FILES_INDEX_SUCCESS        - success
+        INIT_FILES_INDEX_ERR_MEMORY     - could not allocate the index
+        INIT_FILES_INDEX_ERR_LOCK_INIT  - could not initialize the index lock
+*/
+int init_files_index();
+/*
+    must be called exactly once when the functions won't be used anymore.
+*/
+void destroy_files_index();
+/*
+    records that the owner published a file with the file_name.
+    Returns:
+        FILES_INDEX_SUCCESS         - success
+        FILES_INDEX_ERR_MEMORY      - could not allocate memory
+*/
+int files_index_add(char* owner, char* file_name);
+/*
+    records that the owner deleted the file with the file_name.
+    Returns:
+        FILES_INDEX_SUCCESS             - success
+        FILES_INDEX_ERR_NOT_INDEXED     - the owner did not publish such file
+*/
+int files_index_remove(char* owner, char* file_name);
+/*
+    forgets all the files of the owner, e.g. after the owner unregistered.
+*/
+void files_index_remove_owner(char* owner);
+/*
+    copies the names of the files of the owner which match the filter, in order, into the arena.
+    An owner without files has none.
+    Returns:
+        FILES_INDEX_SUCCESS         - success
+        FILES_INDEX_ERR_MEMORY      - could not allocate the list
+*/
+int files_index_list(char* owner, struct name_filter* p_filter, char*** p_files,
+    uint32_t* p_quantity, struct arena* p_arena);
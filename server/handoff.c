@@ -0,0 +1,423 @@
+#define _GNU_SOURCE
+#include "handoff.h"
+#include "connected_users.h"
+#include "tracker.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define HANDOFF_QUEUE_SIZE 1
+#define MAX_FILENAME_LEN 256    // same as in the requests
+#define MAX_NUMBER_LEN 20
+// records of the snapshot, each field is finished by '\0' like in the requests
+#define RECORD_USER "U"         // username, ip, port
+#define RECORD_FILE "F"         // file name, size, chunk size, number of chunks, chunk hashes
+#define RECORD_OWNER "O"        // owner which announced the last file
+#define RECORD_END "E"
+// sent back by the new process once the snapshot is restored
+#define HANDOFF_ACK 'A'
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    snapshot being written
+*/
+struct snapshot_writer {
+    FILE* p_stream;
+    char* last_file_name;       // the file the last owner record belongs to
+};
+
+/*
+    file announced in the snapshot being read
+*/
+struct snapshot_file {
+    char file_name[MAX_FILENAME_LEN + 1];
+    uint64_t size;
+    uint32_t chunk_size;
+    uint32_t num_of_chunks;
+    char (*chunk_hashes)[MAX_CHUNK_HASH_LEN + 1];
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void write_snapshot_field(FILE* p_stream, char* field)
+{
+    fputs(field, p_stream);
+    fputc('\0', p_stream);
+}
+
+
+
+void write_snapshot_number(FILE* p_stream, uint64_t number)
+{
+    fprintf(p_stream, "%lu", (unsigned long) number);
+    fputc('\0', p_stream);
+}
+
+
+
+/*
+    reads one field finished by '\0' into field of max_len characters.
+    Returns 1 on success and 0 on fail
+*/
+int read_snapshot_field(FILE* p_stream, char* field, size_t max_len)
+{
+    size_t len = 0;
+    int ch = 0;
+
+    while ((ch = fgetc(p_stream)) != EOF && ch != '\0')
+    {
+        if (len == max_len)
+            return 0;
+        field[len++] = ch;
+    }
+    field[len] = '\0';
+
+    return ch != EOF;
+}
+
+
+
+int read_snapshot_number(FILE* p_stream, uint64_t* p_number)
+{
+    char str_number[MAX_NUMBER_LEN + 1];
+    if (!read_snapshot_field(p_stream, str_number, MAX_NUMBER_LEN))
+        return 0;
+
+    char* end = NULL;
+    *p_number = strtoull(str_number, &end, 10);
+
+    return *end == '\0';
+}
+
+
+
+void write_connected_user(char* username, char* ip, char* port, void* arg)
+{
+    write_snapshot_field(arg, RECORD_USER);
+    write_snapshot_field(arg, username);
+    write_snapshot_field(arg, ip);
+    write_snapshot_field(arg, port);
+}
+
+
+
+void write_announcement(char* file_name, char* owner, uint64_t size, uint32_t chunk_size,
+    uint32_t num_of_chunks, char* chunk_hashes, void* arg)
+{
+    struct snapshot_writer* p_writer = arg;
+
+    // the owners of a file come one after another, describe the file only once
+    if (file_name != p_writer->last_file_name)
+    {
+        write_snapshot_field(p_writer->p_stream, RECORD_FILE);
+        write_snapshot_field(p_writer->p_stream, file_name);
+        write_snapshot_number(p_writer->p_stream, size);
+        write_snapshot_number(p_writer->p_stream, chunk_size);
+        write_snapshot_number(p_writer->p_stream, num_of_chunks);
+        for (uint32_t i = 0; i < num_of_chunks; i++)
+            write_snapshot_field(p_writer->p_stream,
+                chunk_hashes + i * (MAX_CHUNK_HASH_LEN + 1));
+
+        p_writer->last_file_name = file_name;
+    }
+
+    write_snapshot_field(p_writer->p_stream, RECORD_OWNER);
+    write_snapshot_field(p_writer->p_stream, owner);
+}
+
+
+
+/*
+    writes the snapshot of the connected users and of the tracker.
+    Returns 0 on success and -1 on fail
+*/
+int write_snapshot(FILE* p_stream)
+{
+    for_each_connected_user(write_connected_user, p_stream);
+
+    struct snapshot_writer writer;
+    writer.p_stream = p_stream;
+    writer.last_file_name = NULL;
+    tracker_for_each_announcement(write_announcement, &writer);
+
+    write_snapshot_field(p_stream, RECORD_END);
+
+    return fflush(p_stream) == 0 && !ferror(p_stream) ? 0 : -1;
+}
+
+
+
+/*
+    reads the description of an announced file.
+    Returns 1 on success and 0 on fail
+*/
+int read_snapshot_file(FILE* p_stream, struct snapshot_file* p_file)
+{
+    uint64_t chunk_size = 0;
+    uint64_t num_of_chunks = 0;
+
+    if (!read_snapshot_field(p_stream, p_file->file_name, MAX_FILENAME_LEN)
+        || !read_snapshot_number(p_stream, &p_file->size)
+        || !read_snapshot_number(p_stream, &chunk_size)
+        || !read_snapshot_number(p_stream, &num_of_chunks)
+        || num_of_chunks > MAX_NUMBER_OF_CHUNKS)
+        return 0;
+
+    p_file->chunk_size = chunk_size;
+    p_file->num_of_chunks = num_of_chunks;
+
+    free(p_file->chunk_hashes);
+    // an empty file has no chunks, the allocation must not be empty though
+    p_file->chunk_hashes = malloc((num_of_chunks + 1) * (MAX_CHUNK_HASH_LEN + 1));
+    if (p_file->chunk_hashes == NULL)
+        return 0;
+
+    for (uint32_t i = 0; i < num_of_chunks; i++)
+    {
+        if (!read_snapshot_field(p_stream, p_file->chunk_hashes[i], MAX_CHUNK_HASH_LEN))
+            return 0;
+    }
+
+    return 1;
+}
+
+
+
+/*
+    reads the snapshot and restores the connected users and the tracker from it.
+    Returns 0 on success and -1 on fail
+*/
+int read_snapshot(FILE* p_stream)
+{
+    char record[2];
+    user user_data;
+    char owner[MAX_USERNAME_LEN + 1];
+    struct snapshot_file file;
+    int has_file = 0;
+    int res = -1;
+
+    memset(&file, 0, sizeof(file));
+
+    while (read_snapshot_field(p_stream, record, 1))
+    {
+        if (strcmp(record, RECORD_END) == 0)
+        {
+            res = 0;
+            break;
+        }
+        else if (strcmp(record, RECORD_USER) == 0)
+        {
+            if (!read_snapshot_field(p_stream, user_data.username, MAX_USERNAME_LEN)
+                || !read_snapshot_field(p_stream, user_data.ip, MAX_IP_ADDR_LEN)
+                || !read_snapshot_field(p_stream, user_data.port, MAX_PORT_LEN)
+                || connect_user(user_data.username, user_data.ip, user_data.port)
+                    == CONNECT_USER_ERR_MEMORY)
+                break;
+        }
+        else if (strcmp(record, RECORD_FILE) == 0)
+        {
+            if (!(has_file = read_snapshot_file(p_stream, &file)))
+                break;
+        }
+        else if (strcmp(record, RECORD_OWNER) == 0)
+        {
+            if (!has_file || !read_snapshot_field(p_stream, owner, MAX_USERNAME_LEN)
+                || tracker_announce(file.file_name, owner, file.size, file.chunk_size,
+                    file.num_of_chunks, file.chunk_hashes) == TRACKER_ANNOUNCE_ERR_MEMORY)
+                break;
+        }
+        else
+            break;
+    }
+
+    free(file.chunk_hashes);
+
+    return res;
+}
+
+
+
+void init_handoff_addr(struct sockaddr_un* p_addr)
+{
+    memset(p_addr, 0, sizeof(struct sockaddr_un));
+    p_addr->sun_family = AF_UNIX;
+    strncpy(p_addr->sun_path, HANDOFF_SOCKET_PATH, sizeof(p_addr->sun_path) - 1);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// handoff_listen
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int handoff_listen(int* p_handoff_socket)
+{
+    int sd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sd < 0)
+        return HANDOFF_LISTEN_ERR_SOCKET;
+
+    struct sockaddr_un addr;
+    init_handoff_addr(&addr);
+
+    // left by the previous process
+    unlink(HANDOFF_SOCKET_PATH);
+
+    if (bind(sd, (struct sockaddr*) &addr, sizeof(addr)) != 0
+        || listen(sd, HANDOFF_QUEUE_SIZE) != 0)
+    {
+        close(sd);
+        return HANDOFF_LISTEN_ERR_BIND;
+    }
+
+    *p_handoff_socket = sd;
+
+    return HANDOFF_LISTEN_SUCCESS;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// handoff_send
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int handoff_send(int handoff_connection, int server_socket)
+{
+    // one byte of data carrying the descriptor
+    char data = 0;
+    struct iovec iov;
+    iov.iov_base = &data;
+    iov.iov_len = 1;
+
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr* p_cmsg = CMSG_FIRSTHDR(&msg);
+    p_cmsg->cmsg_level = SOL_SOCKET;
+    p_cmsg->cmsg_type = SCM_RIGHTS;
+    p_cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(p_cmsg), &server_socket, sizeof(int));
+
+    if (sendmsg(handoff_connection, &msg, 0) != 1)
+        return HANDOFF_SEND_ERR_SOCKET;
+
+    // the stream gets its own descriptor, so closing it leaves the connection to the caller
+    int fd = dup(handoff_connection);
+    FILE* p_stream = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (p_stream == NULL)
+    {
+        if (fd >= 0)
+            close(fd);
+        return HANDOFF_SEND_ERR_SNAPSHOT;
+    }
+
+    int res = write_snapshot(p_stream) == 0 ? HANDOFF_SEND_SUCCESS : HANDOFF_SEND_ERR_SNAPSHOT;
+    fclose(p_stream);
+
+    // the listening socket is given up only when the new process restored the state
+    char ack = 0;
+    if (res == HANDOFF_SEND_SUCCESS
+        && (recv(handoff_connection, &ack, 1, 0) != 1 || ack != HANDOFF_ACK))
+        res = HANDOFF_SEND_ERR_NOT_TAKEN;
+
+    return res;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// handoff_receive
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int handoff_receive(int* p_server_socket)
+{
+    int sd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sd < 0)
+        return HANDOFF_RECEIVE_ERR_CONNECT;
+
+    struct sockaddr_un addr;
+    init_handoff_addr(&addr);
+
+    if (connect(sd, (struct sockaddr*) &addr, sizeof(addr)) != 0)
+    {
+        close(sd);
+        return HANDOFF_RECEIVE_ERR_CONNECT;
+    }
+
+    // the running server drains its connections first, this blocks till it's done
+    char data = 0;
+    struct iovec iov;
+    iov.iov_base = &data;
+    iov.iov_len = 1;
+
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr* p_cmsg = NULL;
+    if (recvmsg(sd, &msg, MSG_CMSG_CLOEXEC) != 1
+        || (p_cmsg = CMSG_FIRSTHDR(&msg)) == NULL
+        || p_cmsg->cmsg_level != SOL_SOCKET || p_cmsg->cmsg_type != SCM_RIGHTS
+        || p_cmsg->cmsg_len != CMSG_LEN(sizeof(int)))
+    {
+        close(sd);
+        return HANDOFF_RECEIVE_ERR_SOCKET;
+    }
+
+    int server_socket = -1;
+    memcpy(&server_socket, CMSG_DATA(p_cmsg), sizeof(int));
+
+    FILE* p_stream = fdopen(sd, "r");
+    if (p_stream == NULL)
+    {
+        close(sd);
+        close(server_socket);
+        return HANDOFF_RECEIVE_ERR_SNAPSHOT;
+    }
+
+    // without the acknowledgement the running server keeps serving
+    char ack = HANDOFF_ACK;
+    int res = read_snapshot(p_stream);
+    if (res == 0 && write(fileno(p_stream), &ack, 1) != 1)
+        res = -1;
+    fclose(p_stream);
+
+    if (res != 0)
+    {
+        close(server_socket);
+        return HANDOFF_RECEIVE_ERR_SNAPSHOT;
+    }
+
+    *p_server_socket = server_socket;
+
+    return HANDOFF_RECEIVE_SUCCESS;
+}
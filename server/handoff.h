@@ -0,0 +1,64 @@
+/*
+    hot restart of the server. A new server process connects to the running one through a Unix
+    socket and receives the listening socket (with SCM_RIGHTS) and a snapshot of the state which
+    is kept only in memory: the connected users and the files announced to the tracker. The
+    connections waiting in the listen queue are accepted by the new process, so clients don't
+    notice the restart. The new process acknowledges the snapshot once it's restored, till then
+    the running server keeps the socket and serves on if the new process fails.
+    The state which is derived from the storage (search and owners indexes) is not sent, the new
+    process builds it from the storage after the handoff.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define HANDOFF_SOCKET_PATH "handoff.sock"
+// listen
+#define HANDOFF_LISTEN_SUCCESS 0
+#define HANDOFF_LISTEN_ERR_SOCKET 1
+#define HANDOFF_LISTEN_ERR_BIND 2
+// send
+#define HANDOFF_SEND_SUCCESS 0
+#define HANDOFF_SEND_ERR_SOCKET 1
+#define HANDOFF_SEND_ERR_SNAPSHOT 2
+#define HANDOFF_SEND_ERR_NOT_TAKEN 3
+// receive
+#define HANDOFF_RECEIVE_SUCCESS 0
+#define HANDOFF_RECEIVE_ERR_CONNECT 1
+#define HANDOFF_RECEIVE_ERR_SOCKET 2
+#define HANDOFF_RECEIVE_ERR_SNAPSHOT 3
+
+
+
+/*
+    creates the Unix socket on which a new server process can ask for the handoff and puts it
+    where p_handoff_socket points.
+    Returns:
+        HANDOFF_LISTEN_SUCCESS      - success
+        HANDOFF_LISTEN_ERR_SOCKET   - could not create the socket
+        HANDOFF_LISTEN_ERR_BIND     - could not bind it to HANDOFF_SOCKET_PATH or listen on it
+*/
+int handoff_listen(int* p_handoff_socket);
+/*
+    sends the listening server_socket and the snapshot of the connected users and of the tracker
+    through the handoff_connection accepted on the handoff socket. Nothing may change the state
+    meanwhile, i.e. no requests may be processed. Waits till the new process restores the
+    snapshot.
+    Returns:
+        HANDOFF_SEND_SUCCESS        - success
+        HANDOFF_SEND_ERR_SOCKET     - could not send the listening socket
+        HANDOFF_SEND_ERR_SNAPSHOT   - could not send the snapshot
+        HANDOFF_SEND_ERR_NOT_TAKEN  - the new process did not restore the snapshot, the caller
+                                      still serves on the listening socket
+*/
+int handoff_send(int handoff_connection, int server_socket);
+/*
+    connects to the running server, receives its listening socket, which is put where
+    p_server_socket points, and restores the connected users and the tracker from the snapshot,
+    which is acknowledged to the running server.
+    Returns:
+        HANDOFF_RECEIVE_SUCCESS         - success
+        HANDOFF_RECEIVE_ERR_CONNECT     - no server is running (or it does not accept the handoff)
+        HANDOFF_RECEIVE_ERR_SOCKET      - could not receive the listening socket
+        HANDOFF_RECEIVE_ERR_SNAPSHOT    - could not receive, restore or acknowledge the snapshot
+*/
+int handoff_receive(int* p_server_socket);
@@ -20,6 +20,33 @@ int send_msg(int socket, char *mensaje, int longitud)
 		return(0);	/* se ha enviado longitud */
 }
 
+int send_msgs(int socket, struct iovec *parts, int num_of_parts)
+{
+	ssize_t r;
+
+	while (num_of_parts > 0) {
+		r = writev(socket, parts, num_of_parts);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			return (-1);
+		}
+
+		/* skip the parts which were sent */
+		while (num_of_parts > 0 && (size_t) r >= parts->iov_len) {
+			r -= parts->iov_len;
+			parts++;
+			num_of_parts--;
+		}
+		if (num_of_parts > 0) {
+			parts->iov_base = (char *) parts->iov_base + r;
+			parts->iov_len -= r;
+		}
+	}
+
+	return (0);
+}
+
 int receive_msg(int socket, char *mensaje, int longitud)
 {
 	int r;
@@ -28,9 +55,16 @@ int receive_msg(int socket, char *mensaje, int longitud)
 
 	do {	
 		r = read(socket, mensaje, l);
+		if (r <= 0)	/* error or EOF before all the bytes arrived */
+		{
+			if (r < 0 && errno == EINTR)
+				continue;
+			r = -1;
+			break;
+		}
 		l = l -r ;
 		mensaje = mensaje + r;
-	} while ((l>0) && (r>=0));
+	} while (l>0);
 	
 	if (r < 0)
 		return (-1);   /* fallo */
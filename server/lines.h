@@ -1,6 +1,9 @@
 #include <unistd.h>
+#include <sys/uio.h>
 
 int send_msg(int socket, char *mensaje, int longitud);
+/* sends the parts with as few writes as possible, the parts are changed */
+int send_msgs(int socket, struct iovec *parts, int num_of_parts);
 int receive_msg(int socket, char *mensaje, int longitud);
 ssize_t read_line(int fd, void *buffer, size_t n);
 ssize_t write_line(int fd, void *buffer, size_t n);
\ No newline at end of file
@@ -0,0 +1,92 @@
+#include "metrics.h"
+#include "placement.h"
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// every thread adds to one of the shards, taken round-robin
+#define NUM_OF_METRIC_SHARDS 16
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// all the counters of one shard
+struct counters {
+    uint64_t values[NUM_OF_METRICS];
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// global variables
+///////////////////////////////////////////////////////////////////////////////////////////////////
+struct counters metric_shards[NUM_OF_METRIC_SHARDS];
+uint32_t num_of_shard_users __attribute__((aligned(CACHE_LINE_SIZE)));
+// shard of the thread, +1 so 0 means none yet
+__thread uint32_t thread_shard;
+// indexed by METRIC_*
+char* metric_names[NUM_OF_METRICS] = {
+    "requests",
+    "requests_busy",
+    "requests_rate_limited",
+    "connections_busy",
+    "timeouts_idle",
+    "timeouts_read",
+    "timeouts_write",
+    "arena_allocations",
+    "arena_bytes",
+    "arena_blocks",
+    "users_snapshots",
+    "leases_expired",
+    "compressions",
+    "files_reclaimed",
+    "udp_requests",
+    "subscription_events",
+    "subscription_resyncs",
+    "files_deduplicated"
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// metrics
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void metrics_add(int metric, uint64_t value)
+{
+    if (thread_shard == 0)
+        thread_shard = __atomic_fetch_add(&num_of_shard_users, 1, __ATOMIC_RELAXED)
+            % NUM_OF_METRIC_SHARDS + 1;
+
+    __atomic_add_fetch(&metric_shards[thread_shard - 1].values[metric], value, __ATOMIC_RELAXED);
+}
+
+
+
+void metrics_increment(int metric)
+{
+    metrics_add(metric, 1);
+}
+
+
+
+uint64_t metrics_get(int metric)
+{
+    uint64_t value = 0;
+    for (uint32_t i = 0; i < NUM_OF_METRIC_SHARDS; i++)
+        value += __atomic_load_n(&metric_shards[i].values[metric], __ATOMIC_RELAXED);
+
+    return value;
+}
+
+
+
+char* metrics_name(int metric)
+{
+    return metric_names[metric];
+}
@@ -0,0 +1,50 @@
+#include <stdint.h>
+/*
+    counters of what happens in the server, e.g. the number of requests or of connections closed
+    because of a timeout. They are only ever incremented, so a monitoring tool computes the rates
+    from two readings. Counting is lock-free and the counters are sharded: every thread adds to the
+    counters of its shard, which are on their own cache lines, and a reading sums the shards, so
+    the request threads do not slow each other down. The counters are static, no init is needed.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// metrics
+#define METRIC_REQUESTS 0
+#define METRIC_REQUESTS_BUSY 1
+#define METRIC_REQUESTS_RATE_LIMITED 2
+#define METRIC_CONNECTIONS_BUSY 3
+#define METRIC_TIMEOUTS_IDLE 4
+#define METRIC_TIMEOUTS_READ 5
+#define METRIC_TIMEOUTS_WRITE 6
+#define METRIC_ARENA_ALLOCATIONS 7  // allocations in the request arenas (see arena.h)
+#define METRIC_ARENA_BYTES 8
+#define METRIC_ARENA_BLOCKS 9       // blocks allocated by the arenas with malloc
+#define METRIC_USERS_SNAPSHOTS 10   // LIST_USERS snapshots built (see connected_users.h)
+#define METRIC_LEASES_EXPIRED 11    // users disconnected because of no HEARTBEAT
+#define METRIC_COMPRESSIONS 12      // listing responses compressed (see compression.h)
+#define METRIC_FILES_RECLAIMED 13   // files deleted in the background (see reclaimer.h)
+#define METRIC_UDP_REQUESTS 14      // datagrams answered (see udp_presence.h)
+#define METRIC_SUBSCRIPTION_EVENTS 15   // changes queued for subscribers (see subscriptions.h)
+#define METRIC_SUBSCRIPTION_RESYNCS 16  // subscriber queues which overflowed
+#define METRIC_FILES_DEDUPLICATED 17    // files linked to a blob (see blob_store.h)
+#define NUM_OF_METRICS 18
+
+
+
+/*
+    adds value to the metric.
+*/
+void metrics_add(int metric, uint64_t value);
+/*
+    adds 1 to the metric.
+*/
+void metrics_increment(int metric);
+/*
+    Returns the current value of the metric.
+*/
+uint64_t metrics_get(int metric);
+/*
+    Returns the name of the metric, as it's sent to the clients.
+*/
+char* metrics_name(int metric);
@@ -0,0 +1,276 @@
+#include "owners_index.h"
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define INITIAL_NUM_OF_BUCKETS 1024
+#define INITIAL_OWNERS_CAPACITY 2
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct file_owners {
+    char* file_name;
+    char** owners;
+    uint32_t num_of_owners;
+    uint32_t owners_capacity;
+    struct file_owners* p_next;
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// global variables
+///////////////////////////////////////////////////////////////////////////////////////////////////
+pthread_rwlock_t lock_owners_index;
+// file name -> owners, chained hash table
+struct file_owners** owners_buckets;
+uint32_t num_of_owners_buckets;
+uint32_t num_of_file_names;
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t hash_file_name(char* file_name)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    while (*file_name)
+    {
+        hash ^= (uint8_t) *file_name++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+
+/*
+    Returns the address of the pointer to the entry of the file_name, which is NULL if nobody
+    published such file. Must be called with the lock held.
+*/
+struct file_owners** find_file_owners(char* file_name)
+{
+    uint32_t bucket = hash_file_name(file_name) & (num_of_owners_buckets - 1);
+    struct file_owners** pp_entry = &owners_buckets[bucket];
+    while (*pp_entry != NULL && strcmp((*pp_entry)->file_name, file_name) != 0)
+        pp_entry = &(*pp_entry)->p_next;
+
+    return pp_entry;
+}
+
+
+
+/*
+    doubles the number of buckets. Must be called with the write lock held.
+*/
+void grow_owners_buckets()
+{
+    uint32_t new_num_of_buckets = num_of_owners_buckets * 2;
+    struct file_owners** new_buckets = calloc(new_num_of_buckets, sizeof(struct file_owners*));
+    if (new_buckets == NULL)
+        return; // longer chains, but still correct
+
+    for (uint32_t i = 0; i < num_of_owners_buckets; i++)
+    {
+        struct file_owners* p_entry = owners_buckets[i];
+        while (p_entry != NULL)
+        {
+            struct file_owners* p_next = p_entry->p_next;
+            uint32_t bucket = hash_file_name(p_entry->file_name) & (new_num_of_buckets - 1);
+            p_entry->p_next = new_buckets[bucket];
+            new_buckets[bucket] = p_entry;
+            p_entry = p_next;
+        }
+    }
+
+    free(owners_buckets);
+    owners_buckets = new_buckets;
+    num_of_owners_buckets = new_num_of_buckets;
+}
+
+
+
+void free_file_owners(struct file_owners* p_entry)
+{
+    for (uint32_t i = 0; i < p_entry->num_of_owners; i++)
+        free(p_entry->owners[i]);
+
+    free(p_entry->owners);
+    free(p_entry->file_name);
+    free(p_entry);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// init / destroy
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int init_owners_index()
+{
+    num_of_owners_buckets = INITIAL_NUM_OF_BUCKETS;
+    owners_buckets = calloc(num_of_owners_buckets, sizeof(struct file_owners*));
+    if (owners_buckets == NULL)
+        return INIT_OWNERS_INDEX_ERR_MEMORY;
+
+    if (pthread_rwlock_init(&lock_owners_index, NULL) != 0)
+        return INIT_OWNERS_INDEX_ERR_LOCK_INIT;
+
+    return INIT_OWNERS_INDEX_SUCCESS;
+}
+
+
+
+void destroy_owners_index()
+{
+    for (uint32_t i = 0; i < num_of_owners_buckets; i++)
+    {
+        while (owners_buckets[i] != NULL)
+        {
+            struct file_owners* p_next = owners_buckets[i]->p_next;
+            free_file_owners(owners_buckets[i]);
+            owners_buckets[i] = p_next;
+        }
+    }
+
+    free(owners_buckets);
+    pthread_rwlock_destroy(&lock_owners_index);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// owners_index_add
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int owners_index_add(char* file_name, char* owner)
+{
+    int res = OWNERS_INDEX_SUCCESS;
+    pthread_rwlock_wrlock(&lock_owners_index);
+
+    struct file_owners** pp_entry = find_file_owners(file_name);
+    struct file_owners* p_entry = *pp_entry;
+
+    if (p_entry == NULL)    // first owner of such file
+    {
+        p_entry = calloc(1, sizeof(struct file_owners));
+        if (p_entry != NULL && (p_entry->file_name = strdup(file_name)) != NULL)
+        {
+            *pp_entry = p_entry;
+            if (++num_of_file_names > num_of_owners_buckets)
+                grow_owners_buckets();
+        }
+        else
+        {
+            free(p_entry);
+            p_entry = NULL;
+            res = OWNERS_INDEX_ERR_MEMORY;
+        }
+    }
+
+    if (p_entry != NULL && p_entry->num_of_owners == p_entry->owners_capacity)
+    {
+        uint32_t new_capacity = p_entry->owners_capacity == 0 ?
+            INITIAL_OWNERS_CAPACITY : 2 * p_entry->owners_capacity;
+        char** new_owners = realloc(p_entry->owners, new_capacity * sizeof(char*));
+        if (new_owners != NULL)
+        {
+            p_entry->owners = new_owners;
+            p_entry->owners_capacity = new_capacity;
+        }
+        else
+            res = OWNERS_INDEX_ERR_MEMORY;
+    }
+
+    if (res == OWNERS_INDEX_SUCCESS)
+    {
+        char* owner_copy = strdup(owner);
+        if (owner_copy != NULL)
+            p_entry->owners[p_entry->num_of_owners++] = owner_copy;
+        else
+            res = OWNERS_INDEX_ERR_MEMORY;
+    }
+
+    pthread_rwlock_unlock(&lock_owners_index);
+
+    return res;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// owners_index_remove
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int owners_index_remove(char* file_name, char* owner)
+{
+    int res = OWNERS_INDEX_ERR_NOT_INDEXED;
+    pthread_rwlock_wrlock(&lock_owners_index);
+
+    struct file_owners** pp_entry = find_file_owners(file_name);
+    struct file_owners* p_entry = *pp_entry;
+
+    if (p_entry != NULL)
+    {
+        for (uint32_t i = 0; i < p_entry->num_of_owners; i++)
+        {
+            if (strcmp(p_entry->owners[i], owner) == 0)
+            {
+                // the order of the owners does not matter, move the last one here
+                free(p_entry->owners[i]);
+                p_entry->owners[i] = p_entry->owners[--p_entry->num_of_owners];
+                res = OWNERS_INDEX_SUCCESS;
+                break;
+            }
+        }
+
+        if (p_entry->num_of_owners == 0)
+        {
+            *pp_entry = p_entry->p_next;
+            free_file_owners(p_entry);
+            num_of_file_names--;
+        }
+    }
+
+    pthread_rwlock_unlock(&lock_owners_index);
+
+    return res;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// owners_index_for_each
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t owners_index_for_each(char* file_name, void (*on_owner)(char* owner, void* arg), void* arg)
+{
+    uint32_t num_of_owners = 0;
+    pthread_rwlock_rdlock(&lock_owners_index);
+
+    struct file_owners* p_entry = *find_file_owners(file_name);
+    if (p_entry != NULL)
+    {
+        num_of_owners = p_entry->num_of_owners;
+        for (uint32_t i = 0; i < num_of_owners; i++)
+            on_owner(p_entry->owners[i], arg);
+    }
+
+    pthread_rwlock_unlock(&lock_owners_index);
+
+    return num_of_owners;
+}
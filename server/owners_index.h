@@ -0,0 +1,55 @@
+#include <stdint.h>
+/*
+    in-memory reverse index from the name of a published file to the set of users which published
+    a file with such name. It is kept in sync with the storage (see user_dao.h), so finding the
+    owners of a file does not require listing the content of every user.
+    IMPORTANT before any operation will be performed it is required to call the init() function and
+    if the index won't be used anymore then the destroy() function must be called.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// init
+#define INIT_OWNERS_INDEX_SUCCESS 0
+#define INIT_OWNERS_INDEX_ERR_MEMORY 1
+#define INIT_OWNERS_INDEX_ERR_LOCK_INIT 2
+// add / remove
+#define OWNERS_INDEX_SUCCESS 0
+#define OWNERS_INDEX_ERR_MEMORY 1
+#define OWNERS_INDEX_ERR_NOT_INDEXED 2
+
+
+
+/*
+    must be called exactly once at the beginning, before the first call to any function
+    from this file has been done.
+    Returns:
+        INIT_OWNERS_INDEX_SUCCESS       - success
+        INIT_OWNERS_INDEX_ERR_MEMORY    - could not allocate the index
+        INIT_OWNERS_INDEX_ERR_LOCK_INIT - could not initialize the index lock
+*/
+int init_owners_index();
+/*
+    must be called exactly once when the functions won't be used anymore.
+*/
+void destroy_owners_index();
+/*
+    records that the owner published a file with the file_name.
+    Returns:
+        OWNERS_INDEX_SUCCESS        - success
+        OWNERS_INDEX_ERR_MEMORY     - could not allocate memory
+*/
+int owners_index_add(char* file_name, char* owner);
+/*
+    records that the owner deleted the file with the file_name.
+    Returns:
+        OWNERS_INDEX_SUCCESS            - success
+        OWNERS_INDEX_ERR_NOT_INDEXED    - the owner did not publish such file
+*/
+int owners_index_remove(char* file_name, char* owner);
+/*
+    calls on_owner with arg for every owner of the file with the file_name. The callback is called
+    with the index locked for reading, so it must not modify the index.
+    Returns number of owners
+*/
+uint32_t owners_index_for_each(char* file_name, void (*on_owner)(char* owner, void* arg), void* arg);
@@ -0,0 +1,123 @@
+#define _GNU_SOURCE
+#include "placement.h"
+#include <numa.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// global variables
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// cpus of the list, in the order of the list
+int cpus[CPU_SETSIZE];
+uint32_t num_of_cpus;
+int is_memory_node_local;
+// the threads placed so far, picks the next cpu
+uint32_t num_of_placed __attribute__((aligned(CACHE_LINE_SIZE)));
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    parses the cpu list (numbers and ranges separated by commas) into cpus.
+    Returns 0 on success and -1 if the list is invalid
+*/
+int parse_cpu_list(char* cpu_list)
+{
+    char* p = cpu_list;
+
+    while (*p != '\0')
+    {
+        char* p_end;
+        long first = strtol(p, &p_end, 10);
+        long last = first;
+        if (p_end == p)
+            return -1;
+
+        p = p_end;
+        if (*p == '-')
+        {
+            last = strtol(++p, &p_end, 10);
+            if (p_end == p)
+                return -1;
+            p = p_end;
+        }
+
+        if (first < 0 || last < first || last >= CPU_SETSIZE
+            || num_of_cpus + (last - first + 1) > CPU_SETSIZE)
+            return -1;
+        for (long cpu = first; cpu <= last; cpu++)
+            cpus[num_of_cpus++] = cpu;
+
+        if (*p == ',')
+            p++;
+        else if (*p != '\0')
+            return -1;
+    }
+
+    return num_of_cpus > 0 ? 0 : -1;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// init
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int init_placement(char* cpu_list, int is_node_local)
+{
+    if (cpu_list != NULL)
+    {
+        if (parse_cpu_list(cpu_list) != 0)
+            return INIT_PLACEMENT_ERR_CPU_LIST;
+
+        // every cpu must be one the process is allowed to run on
+        cpu_set_t allowed;
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+            return INIT_PLACEMENT_ERR_CPU_LIST;
+        for (uint32_t i = 0; i < num_of_cpus; i++)
+        {
+            if (!CPU_ISSET(cpus[i], &allowed))
+                return INIT_PLACEMENT_ERR_CPU_LIST;
+        }
+    }
+
+    if (is_node_local && numa_available() < 0)
+        return INIT_PLACEMENT_ERR_NUMA;
+    is_memory_node_local = is_node_local;
+
+    return INIT_PLACEMENT_SUCCESS;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// placement_place_thread
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int placement_place_thread()
+{
+    int cpu = -1;
+
+    if (num_of_cpus > 0)
+    {
+        uint32_t i = __atomic_fetch_add(&num_of_placed, 1, __ATOMIC_RELAXED);
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus[i % num_of_cpus], &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0)
+            cpu = cpus[i % num_of_cpus];
+    }
+
+    // the pages are taken from the node of the cpu the thread runs on when it touches them first
+    if (is_memory_node_local)
+        numa_set_localalloc();
+
+    return cpu;
+}
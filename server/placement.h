@@ -0,0 +1,38 @@
+#include <stdint.h>
+/*
+    placement of the server threads on the cpus. With a list of cpus every request thread (and the
+    thread accepting the connections) is pinned to one of them, taken round-robin, so the threads
+    don't wander across the cores and sockets and their caches stay warm. With node-local memory
+    (NUMA) a pinned thread allocates its memory (e.g. its arena, see arena.h) on the node of its
+    cpu. Without any of them the threads are left to the scheduler.
+    IMPORTANT init() must be called before the first thread is placed. There is nothing to destroy.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// the data written by different threads is kept on separate lines, so they don't bounce them
+#define CACHE_LINE_SIZE 64
+// init
+#define INIT_PLACEMENT_SUCCESS 0
+#define INIT_PLACEMENT_ERR_CPU_LIST 1
+#define INIT_PLACEMENT_ERR_NUMA 2
+
+
+
+/*
+    must be called exactly once at the beginning, before the first call to any function from this
+    file has been done. cpu_list is the list of the cpus to pin the threads to, e.g. "0-3,8,10"
+    (NULL not to pin them). If is_node_local is 1 the threads allocate the memory on their own
+    NUMA node.
+    Returns:
+        INIT_PLACEMENT_SUCCESS          - success
+        INIT_PLACEMENT_ERR_CPU_LIST     - the list is invalid or the process can't run on its cpus
+        INIT_PLACEMENT_ERR_NUMA         - NUMA is not available
+*/
+int init_placement(char* cpu_list, int is_node_local);
+/*
+    places the calling thread, i.e. pins it to the next cpu of the list and makes it allocate on
+    the node of the cpu. Must be called before the thread allocates its own memory.
+    Returns the cpu the thread was pinned to or -1 if it's not pinned
+*/
+int placement_place_thread();
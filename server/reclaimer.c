@@ -0,0 +1,389 @@
+#define _GNU_SOURCE
+#include "reclaimer.h"
+#include "blob_store.h"
+#include "config.h"
+#include "metrics.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define MAX_TRASH_NAME_LEN 64
+// files whose blobs wait to be checked, more of them fall back to a scan of all the blobs
+#define MAX_QUEUED_BLOB_FILES 256
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// global variables
+///////////////////////////////////////////////////////////////////////////////////////////////////
+pthread_mutex_t mutex_reclaimer = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t cond_reclaimer = PTHREAD_COND_INITIALIZER;
+// 1 if something was moved to the trash since the thread looked at it last
+int is_trash_changed;
+// the files which just lost a link, opened, see reclaim_file_blob
+int queued_blob_files[MAX_QUEUED_BLOB_FILES];
+uint32_t num_of_queued_blob_files;
+// 1 if all the blobs have to be checked, after the start or when the queue was full
+int is_blob_scan_needed;
+int is_reclaimer_running;
+pthread_t t_reclaimer;
+// makes the names in the trash unique
+uint64_t num_of_trashed;
+// files deleted since the last pause
+uint32_t num_of_unpaused;
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    Returns 1 while the thread should go on
+*/
+int is_reclaiming()
+{
+    return __atomic_load_n(&is_reclaimer_running, __ATOMIC_RELAXED);
+}
+
+
+
+/*
+    counts the deleted file and pauses after every batch of them, see config.h.
+*/
+void throttle()
+{
+    metrics_increment(METRIC_FILES_RECLAIMED);
+
+    const struct config* p_config = get_config();
+    if (++num_of_unpaused < (uint32_t) p_config->reclaim_batch_size)
+        return;
+
+    num_of_unpaused = 0;
+    struct timespec pause = { p_config->reclaim_pause_ms / 1000,
+        (p_config->reclaim_pause_ms % 1000) * 1000000L };
+    nanosleep(&pause, NULL);
+}
+
+
+
+/*
+    deletes the directory with the name in the parent directory, with everything in it.
+    Returns 0 on success and -1 on fail (or when the thread is stopped)
+*/
+int reclaim_dir(int parent_fd, char* name)
+{
+    int dir_fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+    if (dir_fd < 0)
+        return errno == ENOENT ? 0 : -1;
+
+    DIR* p_dir = fdopendir(dir_fd);
+    if (p_dir == NULL)
+    {
+        close(dir_fd);
+        return -1;
+    }
+
+    int res = 0;
+    struct dirent* p_entry;
+    while (res == 0 && is_reclaiming() && (p_entry = readdir(p_dir)) != NULL)
+    {
+        if (strcmp(p_entry->d_name, ".") == 0 || strcmp(p_entry->d_name, "..") == 0)
+            continue;
+
+        // a shared file stays open, so its blob can be checked after the link is dropped
+        struct stat st;
+        int file_fd = -1;
+        if (fstatat(dir_fd, p_entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0
+            && S_ISREG(st.st_mode) && st.st_nlink > 1)
+            file_fd = openat(dir_fd, p_entry->d_name, O_RDONLY | O_NOFOLLOW);
+
+        if (unlinkat(dir_fd, p_entry->d_name, 0) == 0)
+        {
+            throttle();
+            if (file_fd >= 0)
+                release_file_blob(file_fd);
+        }
+        else if (errno == EISDIR)
+            res = reclaim_dir(dir_fd, p_entry->d_name);
+        else if (errno != ENOENT)   // e.g. the previous process deletes it too while handing off
+            res = -1;
+
+        if (file_fd >= 0)
+            close(file_fd);
+    }
+
+    closedir(p_dir);
+
+    if (res != 0 || !is_reclaiming())
+        return -1;
+
+    return unlinkat(parent_fd, name, AT_REMOVEDIR) == 0 || errno == ENOENT ? 0 : -1;
+}
+
+
+
+/*
+    deletes all the blobs which are their only link (see blob_store.h), e.g. the ones left by the
+    previous process. A blob linked again meanwhile only loses the sharing, its content stays in
+    the file linking to it.
+*/
+void reclaim_all_blobs()
+{
+    int blobs_fd = open(BLOB_DIR_PATH, O_RDONLY | O_DIRECTORY);
+    DIR* p_blobs = blobs_fd >= 0 ? fdopendir(blobs_fd) : NULL;
+    if (p_blobs == NULL)
+    {
+        if (blobs_fd >= 0)
+            close(blobs_fd);
+        return;
+    }
+
+    // blobs/<2 hex digits>/<62 hex digits>
+    struct dirent* p_entry;
+    while (is_reclaiming() && (p_entry = readdir(p_blobs)) != NULL)
+    {
+        if (p_entry->d_name[0] == '.')
+            continue;
+
+        int dir_fd = openat(blobs_fd, p_entry->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+        DIR* p_dir = dir_fd >= 0 ? fdopendir(dir_fd) : NULL;
+        if (p_dir == NULL)
+        {
+            if (dir_fd >= 0)
+                close(dir_fd);
+            continue;
+        }
+
+        struct dirent* p_blob;
+        struct stat st;
+        while (is_reclaiming() && (p_blob = readdir(p_dir)) != NULL)
+        {
+            if (p_blob->d_name[0] != '.'
+                && fstatat(dir_fd, p_blob->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0
+                && S_ISREG(st.st_mode) && st.st_nlink == 1
+                && unlinkat(dir_fd, p_blob->d_name, 0) == 0)
+                throttle();
+        }
+
+        closedir(p_dir);
+    }
+
+    closedir(p_blobs);
+}
+
+
+
+/*
+    deletes the blobs of the queued files which nothing links to anymore, or all such blobs when
+    the queue was full. Must be called with the mutex locked, it's unlocked meanwhile.
+*/
+void reclaim_blobs()
+{
+    int blob_files[MAX_QUEUED_BLOB_FILES];
+    uint32_t num_of_blob_files = num_of_queued_blob_files;
+    memcpy(blob_files, queued_blob_files, num_of_blob_files * sizeof(int));
+    num_of_queued_blob_files = 0;
+    int is_scan_needed = is_blob_scan_needed;
+    is_blob_scan_needed = 0;
+    pthread_mutex_unlock(&mutex_reclaimer);
+
+    for (uint32_t i = 0; i < num_of_blob_files; i++)
+    {
+        release_file_blob(blob_files[i]);
+        close(blob_files[i]);
+    }
+
+    if (is_scan_needed)
+        reclaim_all_blobs();
+
+    pthread_mutex_lock(&mutex_reclaimer);
+}
+
+
+
+/*
+    deletes everything in the trash and then the blobs not needed anymore till the thread is
+    stopped, waits for more meanwhile.
+*/
+void* run_reclaimer(void* arg)
+{
+    pthread_mutex_lock(&mutex_reclaimer);
+
+    while (is_reclaimer_running)
+    {
+        if (num_of_queued_blob_files > 0 || is_blob_scan_needed)
+        {
+            reclaim_blobs();
+            continue;
+        }
+        if (!is_trash_changed)
+        {
+            pthread_cond_wait(&cond_reclaimer, &mutex_reclaimer);
+            continue;
+        }
+        is_trash_changed = 0;
+        pthread_mutex_unlock(&mutex_reclaimer);
+
+        int trash_fd = open(TRASH_DIR_PATH, O_RDONLY | O_DIRECTORY);
+        DIR* p_trash = trash_fd >= 0 ? fdopendir(dup(trash_fd)) : NULL;
+        if (p_trash != NULL)
+        {
+            struct dirent* p_entry;
+            while (is_reclaiming() && (p_entry = readdir(p_trash)) != NULL)
+            {
+                if (strcmp(p_entry->d_name, ".") != 0 && strcmp(p_entry->d_name, "..") != 0
+                    && reclaim_dir(trash_fd, p_entry->d_name) != 0 && is_reclaiming())
+                    printf("ERROR run_reclaimer - could not delete %s%s\n", TRASH_DIR_PATH, 
+                        p_entry->d_name);
+            }
+            closedir(p_trash);
+        }
+        else
+            perror("ERROR run_reclaimer - could not open the trash");
+
+        if (trash_fd >= 0)
+            close(trash_fd);
+
+        pthread_mutex_lock(&mutex_reclaimer);
+    }
+
+    // the rest is checked by the scan after the next start
+    for (uint32_t i = 0; i < num_of_queued_blob_files; i++)
+        close(queued_blob_files[i]);
+    num_of_queued_blob_files = 0;
+
+    pthread_mutex_unlock(&mutex_reclaimer);
+
+    return NULL;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// init / destroy
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int init_reclaimer()
+{
+    if (mkdir(TRASH_DIR_PATH, S_IRWXU) != 0 && errno != EEXIST)
+        return INIT_RECLAIMER_ERR_FOLDER_CREATION;
+
+    // what was left by the previous run first
+    is_trash_changed = 1;
+    is_blob_scan_needed = 1;
+    is_reclaimer_running = 1;
+    if (pthread_create(&t_reclaimer, NULL, run_reclaimer, NULL) != 0)
+    {
+        is_reclaimer_running = 0;
+        return INIT_RECLAIMER_ERR_THREAD;
+    }
+
+    return INIT_RECLAIMER_SUCCESS;
+}
+
+
+
+void destroy_reclaimer()
+{
+    pthread_mutex_lock(&mutex_reclaimer);
+    int is_started = is_reclaimer_running;
+    __atomic_store_n(&is_reclaimer_running, 0, __ATOMIC_RELAXED);
+    pthread_cond_signal(&cond_reclaimer);
+    pthread_mutex_unlock(&mutex_reclaimer);
+
+    if (is_started)
+        pthread_join(t_reclaimer, NULL);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// move_to_trash
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int move_to_trash(char* dir_path)
+{
+    // a whole tree is deleted, so the path must not lead anywhere else
+    char component[strlen(dir_path) + 1];
+    for (char* p = dir_path; ; p++)
+    {
+        size_t len = strcspn(p, "/");
+        memcpy(component, p, len);
+        component[len] = '\0';
+        if (!is_path_component_valid(component))
+            return MOVE_TO_TRASH_ERR_PATH;
+
+        p += len;
+        if (*p == '\0')
+            break;
+    }
+
+    // unique across the restarts too, unless a process with the same pid left the name there
+    char trash_path[strlen(TRASH_DIR_PATH) + MAX_TRASH_NAME_LEN + 1];
+    int rename_res;
+    do
+    {
+        sprintf(trash_path, "%s%ld.%lu", TRASH_DIR_PATH, (long) getpid(),
+            (unsigned long) __atomic_add_fetch(&num_of_trashed, 1, __ATOMIC_RELAXED));
+        rename_res = rename(dir_path, trash_path);
+    }
+    while (rename_res != 0 && (errno == EEXIST || errno == ENOTEMPTY));
+
+    if (rename_res != 0)
+        return errno == ENOENT || errno == ENOTDIR ? MOVE_TO_TRASH_ERR_NOT_EXISTS
+            : MOVE_TO_TRASH_ERR_RENAME;
+
+    pthread_mutex_lock(&mutex_reclaimer);
+    is_trash_changed = 1;
+    pthread_cond_signal(&cond_reclaimer);
+    pthread_mutex_unlock(&mutex_reclaimer);
+
+    return MOVE_TO_TRASH_SUCCESS;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// reclaim_file_blob
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void reclaim_file_blob(int fd)
+{
+    pthread_mutex_lock(&mutex_reclaimer);
+
+    if (num_of_queued_blob_files < MAX_QUEUED_BLOB_FILES)
+        queued_blob_files[num_of_queued_blob_files++] = fd;
+    else
+    {
+        close(fd);
+        is_blob_scan_needed = 1;
+    }
+    pthread_cond_signal(&cond_reclaimer);
+
+    pthread_mutex_unlock(&mutex_reclaimer);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// is_path_component_valid
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int is_path_component_valid(char* name)
+{
+    return name[0] != '\0' && strcmp(name, ".") != 0 && strcmp(name, "..") != 0
+        && strchr(name, '/') == NULL;
+}
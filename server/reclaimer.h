@@ -0,0 +1,67 @@
+/*
+    deletion of the directories which are not needed anymore (e.g. the storage of an unregistered
+    user) in the background. A directory is moved to the trash directory with one rename, so it's
+    gone at once no matter how many files it has, and a thread deletes the trash afterwards with
+    unlinkat() relative to the directory (no paths are built). It deletes a batch of files and then
+    pauses (see config.h), so it does not take the disk from the requests. What is left in the
+    trash when the server stops is deleted after the next start.
+    The thread also deletes the blobs nothing links to anymore (see blob_store.h): the blobs of
+    the files it deletes from the trash and of the files queued by reclaim_file_blob. All the
+    blobs are checked only after the start, for what the previous process left.
+    IMPORTANT before any operation will be performed it is required to call the init() function and
+    if the trash won't be used anymore then the destroy() function must be called.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// the trash must be on the same file system as the directories moved there
+#define TRASH_DIR_PATH "trash/"
+#define RECLAIM_BATCH_SIZE 256      // default
+#define RECLAIM_PAUSE_MS 10         // default
+// init
+#define INIT_RECLAIMER_SUCCESS 0
+#define INIT_RECLAIMER_ERR_FOLDER_CREATION 1
+#define INIT_RECLAIMER_ERR_THREAD 2
+// move to trash
+#define MOVE_TO_TRASH_SUCCESS 0
+#define MOVE_TO_TRASH_ERR_NOT_EXISTS 1
+#define MOVE_TO_TRASH_ERR_RENAME 2
+#define MOVE_TO_TRASH_ERR_PATH 3
+
+
+
+/*
+    must be called exactly once at the beginning, before the first call to any function
+    from this file has been done. Starts the thread deleting the trash, beginning with what was
+    left there.
+    Returns:
+        INIT_RECLAIMER_SUCCESS              - success
+        INIT_RECLAIMER_ERR_FOLDER_CREATION  - could not create the trash folder
+        INIT_RECLAIMER_ERR_THREAD           - could not start the thread
+*/
+int init_reclaimer();
+/*
+    must be called exactly once when the functions won't be used anymore. Stops the thread, the
+    rest of the trash is deleted after the next start.
+*/
+void destroy_reclaimer();
+/*
+    moves the directory to the trash, it's deleted in the background.
+    Returns:
+        MOVE_TO_TRASH_SUCCESS           - success
+        MOVE_TO_TRASH_ERR_NOT_EXISTS    - there is no such directory
+        MOVE_TO_TRASH_ERR_RENAME        - could not move the directory
+        MOVE_TO_TRASH_ERR_PATH          - the path has an empty, "." or ".." component, so it
+                                          could point outside of the data directory
+*/
+int move_to_trash(char* dir_path);
+/*
+    Returns 1 if the name is a single component of a path which stays in its directory, i.e. it
+    is not empty, "." or ".." and has no '/', 0 otherwise
+*/
+int is_path_component_valid(char* name);
+/*
+    makes the thread delete the blob of the file opened as fd if nothing links to it anymore,
+    after the caller dropped a link to the file, e.g. replaced it. The fd is closed by the thread.
+*/
+void reclaim_file_blob(int fd);
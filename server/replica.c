@@ -0,0 +1,714 @@
+#include "replica.h"
+#include "change_feed.h"
+#include "compression.h"
+#include "sorted_names.h"
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define NUM_OF_REPLICA_BUCKETS 4096     // must be a power of 2
+#define MAX_FILENAME_LEN 256            // same as in the requests
+#define MAX_NUMBER_LEN 20
+#define MAX_HOST_LEN 255
+#define REPLICA_RETRY_STEP_MS 100
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    registered user in the copy of the state
+*/
+struct replica_user {
+    user data;                  // ip and port are valid only if connected
+    int is_connected;
+    struct sorted_names files;  // in order, for the filtered listings
+    struct replica_user* p_next;
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// global variables
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/*
+    the copy of the state and the replication status, protected by lock_replica. Only the thread
+    following the feed changes them.
+*/
+pthread_rwlock_t lock_replica;
+struct replica_user** replica_users;
+uint32_t num_of_replica_connected;
+// the usernames of the connected users in order, for the filtered listings
+struct sorted_names replica_connected_names;
+// snapshot of the connected users, dropped when they change
+struct users_snapshot* p_replica_users_snapshot;
+int is_replica_connected;
+uint64_t replica_applied_seq;
+uint64_t replica_primary_seq;
+uint64_t replica_primary_time_ms;
+/*
+    the connection to the primary, protected by mutex_replica_socket, so destroy can shut it down.
+*/
+pthread_mutex_t mutex_replica_socket;
+int replica_socket;
+int is_replica_running;
+pthread_t t_replica;
+char primary_host_name[MAX_HOST_LEN + 1];
+char primary_port_name[MAX_NUMBER_LEN + 1];
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint64_t replica_time_ms()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+
+
+struct replica_user** find_replica_user(struct replica_user** users, char* username)
+{
+    uint32_t hash = 5381;
+    for (char* p = username; *p != '\0'; p++)
+        hash = hash * 33 + (unsigned char) *p;
+
+    struct replica_user** pp_user = &users[hash & (NUM_OF_REPLICA_BUCKETS - 1)];
+    while (*pp_user != NULL && strcmp((*pp_user)->data.username, username) != 0)
+        pp_user = &(*pp_user)->p_next;
+
+    return pp_user;
+}
+
+
+
+void free_replica_user(struct replica_user* p_user)
+{
+    destroy_sorted_names(&p_user->files);
+    free(p_user);
+}
+
+
+
+void free_replica_users(struct replica_user** users)
+{
+    for (uint32_t i = 0; i < NUM_OF_REPLICA_BUCKETS; i++)
+    {
+        while (users[i] != NULL)
+        {
+            struct replica_user* p_next = users[i]->p_next;
+            free_replica_user(users[i]);
+            users[i] = p_next;
+        }
+    }
+    free(users);
+}
+
+
+
+/*
+    Returns the registered user, a new one if the user is not registered yet, NULL if could not
+    allocate it.
+*/
+struct replica_user* add_replica_user(struct replica_user** users, char* username)
+{
+    struct replica_user** pp_user = find_replica_user(users, username);
+    if (*pp_user == NULL && (*pp_user = calloc(1, sizeof(struct replica_user))) != NULL)
+        strcpy((*pp_user)->data.username, username);
+
+    return *pp_user;
+}
+
+
+
+/*
+    Returns 0 on success and -1 if could not allocate memory
+*/
+int add_replica_file(struct replica_user* p_user, char* file_name)
+{
+    // a file published again is there already
+    return sorted_names_insert(&p_user->files, file_name) == SORTED_NAMES_INSERT_ERR_MEMORY
+        ? -1 : 0;
+}
+
+
+
+void remove_replica_file(struct replica_user* p_user, char* file_name)
+{
+    sorted_names_remove(&p_user->files, file_name);
+}
+
+
+
+/*
+    Returns 0 on success and -1 if could not allocate memory
+*/
+int set_replica_connected(struct replica_user* p_user, char* ip, char* port)
+{
+    if (!p_user->is_connected)
+    {
+        if (sorted_names_insert(&replica_connected_names, p_user->data.username)
+            == SORTED_NAMES_INSERT_ERR_MEMORY)
+            return -1;
+        num_of_replica_connected++;
+    }
+    drop_cached_snapshot(&p_replica_users_snapshot);
+
+    p_user->is_connected = 1;
+    strcpy(p_user->data.ip, ip);
+    strcpy(p_user->data.port, port);
+
+    return 0;
+}
+
+
+
+void set_replica_disconnected(struct replica_user* p_user)
+{
+    if (p_user->is_connected)
+    {
+        sorted_names_remove(&replica_connected_names, p_user->data.username);
+        num_of_replica_connected--;
+        drop_cached_snapshot(&p_replica_users_snapshot);
+    }
+
+    p_user->is_connected = 0;
+}
+
+
+
+/*
+    reads one field finished by '\0' into field of max_len characters.
+    Returns 1 on success and 0 on fail
+*/
+int read_feed_field(FILE* p_stream, char* field, size_t max_len)
+{
+    size_t len = 0;
+    int ch = 0;
+
+    while ((ch = fgetc(p_stream)) != EOF && ch != '\0')
+    {
+        if (len == max_len)
+            return 0;
+        field[len++] = ch;
+    }
+    field[len] = '\0';
+
+    return ch != EOF;
+}
+
+
+
+int read_feed_number(FILE* p_stream, uint64_t* p_number)
+{
+    char str_number[MAX_NUMBER_LEN + 1];
+    if (!read_feed_field(p_stream, str_number, MAX_NUMBER_LEN))
+        return 0;
+
+    char* end = NULL;
+    *p_number = strtoull(str_number, &end, 10);
+
+    return *end == '\0';
+}
+
+
+
+/*
+    reads the snapshot following the FEED_SNAPSHOT record and replaces the copy with it.
+    Returns 0 on success and -1 on fail
+*/
+int read_feed_snapshot(FILE* p_stream)
+{
+    uint64_t seq = 0;
+    uint64_t time_ms = 0;
+    if (!read_feed_number(p_stream, &seq) || !read_feed_number(p_stream, &time_ms))
+        return -1;
+
+    struct replica_user** users = calloc(NUM_OF_REPLICA_BUCKETS, sizeof(struct replica_user*));
+    if (users == NULL)
+        return -1;
+
+    uint32_t num_of_connected = 0;
+    struct sorted_names connected_names = { 0 };
+    char record[2];
+    char username[MAX_USERNAME_LEN + 1];
+    char file_name[MAX_FILENAME_LEN + 1];
+    char ip[MAX_IP_ADDR_LEN + 1];
+    char port[MAX_PORT_LEN + 1];
+    struct replica_user* p_user = NULL;
+    int res = -1;
+
+    while (read_feed_field(p_stream, record, 1))
+    {
+        if (strcmp(record, FEED_SNAPSHOT_END) == 0)
+        {
+            res = 0;
+            break;
+        }
+        else if (strcmp(record, FEED_SNAPSHOT_USER) == 0)
+        {
+            if (!read_feed_field(p_stream, username, MAX_USERNAME_LEN)
+                || add_replica_user(users, username) == NULL)
+                break;
+        }
+        else if (strcmp(record, FEED_SNAPSHOT_FILE) == 0)
+        {
+            if (!read_feed_field(p_stream, username, MAX_USERNAME_LEN)
+                || !read_feed_field(p_stream, file_name, MAX_FILENAME_LEN)
+                || (p_user = add_replica_user(users, username)) == NULL
+                || add_replica_file(p_user, file_name) != 0)
+                break;
+        }
+        else if (strcmp(record, FEED_SNAPSHOT_CONNECTED) == 0)
+        {
+            if (!read_feed_field(p_stream, username, MAX_USERNAME_LEN)
+                || !read_feed_field(p_stream, ip, MAX_IP_ADDR_LEN)
+                || !read_feed_field(p_stream, port, MAX_PORT_LEN)
+                || (p_user = add_replica_user(users, username)) == NULL
+                || sorted_names_insert(&connected_names, username)
+                    == SORTED_NAMES_INSERT_ERR_MEMORY)
+                break;
+
+            if (!p_user->is_connected)
+                num_of_connected++;
+            p_user->is_connected = 1;
+            strcpy(p_user->data.ip, ip);
+            strcpy(p_user->data.port, port);
+        }
+        else
+            break;
+    }
+
+    if (res != 0)
+    {
+        free_replica_users(users);
+        destroy_sorted_names(&connected_names);
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&lock_replica);
+    struct replica_user** old_users = replica_users;
+    struct sorted_names old_connected_names = replica_connected_names;
+    replica_users = users;
+    replica_connected_names = connected_names;
+    num_of_replica_connected = num_of_connected;
+    drop_cached_snapshot(&p_replica_users_snapshot);
+    invalidate_cached_listings();
+    replica_applied_seq = seq;
+    replica_primary_seq = seq;
+    replica_primary_time_ms = time_ms;
+    is_replica_connected = 1;
+    pthread_rwlock_unlock(&lock_replica);
+
+    free_replica_users(old_users);
+    destroy_sorted_names(&old_connected_names);
+
+    return 0;
+}
+
+
+
+/*
+    reads the fields of the change of the type and applies it to the copy, unless it was applied
+    already.
+    Returns 0 on success and -1 on fail
+*/
+int apply_feed_change(FILE* p_stream, char type)
+{
+    uint64_t seq = 0;
+    uint64_t time_ms = 0;
+    char username[MAX_USERNAME_LEN + 1];
+    char file_name[MAX_FILENAME_LEN + 1];
+    char ip[MAX_IP_ADDR_LEN + 1];
+    char port[MAX_PORT_LEN + 1];
+
+    if (!read_feed_number(p_stream, &seq) || !read_feed_number(p_stream, &time_ms)
+        || !read_feed_field(p_stream, username, MAX_USERNAME_LEN))
+        return -1;
+
+    if ((type == FEED_PUBLISH || type == FEED_DELETE)
+        && !read_feed_field(p_stream, file_name, MAX_FILENAME_LEN))
+        return -1;
+
+    if (type == FEED_CONNECT && (!read_feed_field(p_stream, ip, MAX_IP_ADDR_LEN)
+        || !read_feed_field(p_stream, port, MAX_PORT_LEN)))
+        return -1;
+
+    int res = 0;
+    pthread_rwlock_wrlock(&lock_replica);
+
+    if (seq > replica_applied_seq)
+    {
+        struct replica_user** pp_user = find_replica_user(replica_users, username);
+        struct replica_user* p_user = *pp_user;
+
+        switch (type)
+        {
+            case FEED_REGISTER :
+                if (add_replica_user(replica_users, username) == NULL)
+                    res = -1;
+                break;
+            case FEED_UNREGISTER :
+                if (p_user != NULL)
+                {
+                    set_replica_disconnected(p_user);
+                    *pp_user = p_user->p_next;
+                    free_replica_user(p_user);
+                }
+                break;
+            case FEED_PUBLISH :
+                if (p_user != NULL && add_replica_file(p_user, file_name) != 0)
+                    res = -1;
+                break;
+            case FEED_DELETE :
+                if (p_user != NULL)
+                    remove_replica_file(p_user, file_name);
+                break;
+            case FEED_CONNECT :
+                if (p_user != NULL && set_replica_connected(p_user, ip, port) != 0)
+                    res = -1;
+                break;
+            case FEED_DISCONNECT :
+                if (p_user != NULL)
+                    set_replica_disconnected(p_user);
+                break;
+            default :
+                res = -1;
+        }
+
+        if (type == FEED_UNREGISTER || type == FEED_PUBLISH || type == FEED_DELETE)
+            invalidate_cached_listing(username);
+
+        replica_applied_seq = seq;
+        if (seq > replica_primary_seq)
+            replica_primary_seq = seq;
+        replica_primary_time_ms = time_ms;
+    }
+
+    pthread_rwlock_unlock(&lock_replica);
+
+    return res;
+}
+
+
+
+/*
+    applies the records of the feed till the connection is lost or a record can't be applied.
+*/
+void follow_feed(FILE* p_stream)
+{
+    char record[2];
+    uint64_t seq = 0;
+    uint64_t time_ms = 0;
+
+    // the feed starts with a snapshot
+    if (!read_feed_field(p_stream, record, 1) || strcmp(record, FEED_SNAPSHOT) != 0
+        || read_feed_snapshot(p_stream) != 0)
+        return;
+
+    printf("replica synchronized with the primary\n");
+
+    while (read_feed_field(p_stream, record, 1))
+    {
+        if (strcmp(record, FEED_HEARTBEAT) == 0)
+        {
+            if (!read_feed_number(p_stream, &seq) || !read_feed_number(p_stream, &time_ms))
+                return;
+
+            pthread_rwlock_wrlock(&lock_replica);
+            replica_primary_seq = seq;
+            if (seq == replica_applied_seq)
+                replica_primary_time_ms = time_ms;
+            pthread_rwlock_unlock(&lock_replica);
+        }
+        else if (apply_feed_change(p_stream, record[0]) != 0)
+            return;
+    }
+}
+
+
+
+/*
+    Returns the socket connected to the primary or -1 on fail
+*/
+int connect_to_primary()
+{
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* p_addrs = NULL;
+    if (getaddrinfo(primary_host_name, primary_port_name, &hints, &p_addrs) != 0)
+        return -1;
+
+    int sd = -1;
+    for (struct addrinfo* p_addr = p_addrs; p_addr != NULL && sd < 0; p_addr = p_addr->ai_next)
+    {
+        sd = socket(p_addr->ai_family, p_addr->ai_socktype, p_addr->ai_protocol);
+        if (sd >= 0 && connect(sd, p_addr->ai_addr, p_addr->ai_addrlen) != 0)
+        {
+            close(sd);
+            sd = -1;
+        }
+    }
+    freeaddrinfo(p_addrs);
+
+    return sd;
+}
+
+
+
+void* run_replica(void* arg)
+{
+    while (__atomic_load_n(&is_replica_running, __ATOMIC_SEQ_CST))
+    {
+        int sd = connect_to_primary();
+        FILE* p_stream = NULL;
+
+        if (sd >= 0)
+        {
+            pthread_mutex_lock(&mutex_replica_socket);
+            replica_socket = sd;
+            pthread_mutex_unlock(&mutex_replica_socket);
+
+            // destroy could have missed the socket
+            if (__atomic_load_n(&is_replica_running, __ATOMIC_SEQ_CST)
+                && (p_stream = fdopen(sd, "r")) != NULL)
+                follow_feed(p_stream);
+
+            pthread_mutex_lock(&mutex_replica_socket);
+            replica_socket = -1;
+            pthread_mutex_unlock(&mutex_replica_socket);
+
+            if (p_stream != NULL)
+                fclose(p_stream);
+            else
+                close(sd);
+
+            pthread_rwlock_wrlock(&lock_replica);
+            is_replica_connected = 0;
+            pthread_rwlock_unlock(&lock_replica);
+
+            printf("replica lost the connection to the primary\n");
+        }
+
+        // in steps, so destroy does not wait for the whole retry
+        struct timespec step = {0, REPLICA_RETRY_STEP_MS * 1000000L};
+        for (int i = 0; i < REPLICA_RETRY_MS / REPLICA_RETRY_STEP_MS
+            && __atomic_load_n(&is_replica_running, __ATOMIC_SEQ_CST); i++)
+            nanosleep(&step, NULL);
+    }
+
+    return NULL;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// init / destroy
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int init_replica(char* primary_host, char* primary_port)
+{
+    replica_users = calloc(NUM_OF_REPLICA_BUCKETS, sizeof(struct replica_user*));
+    if (replica_users == NULL)
+        return INIT_REPLICA_ERR_MEMORY;
+
+    snprintf(primary_host_name, sizeof(primary_host_name), "%s", primary_host);
+    snprintf(primary_port_name, sizeof(primary_port_name), "%s", primary_port);
+    pthread_rwlock_init(&lock_replica, NULL);
+    pthread_mutex_init(&mutex_replica_socket, NULL);
+    num_of_replica_connected = 0;
+    is_replica_connected = 0;
+    replica_applied_seq = 0;
+    replica_primary_seq = 0;
+    replica_primary_time_ms = replica_time_ms();
+    replica_socket = -1;
+    is_replica_running = 1;
+
+    if (pthread_create(&t_replica, NULL, run_replica, NULL) != 0)
+    {
+        free(replica_users);
+        return INIT_REPLICA_ERR_THREAD;
+    }
+
+    return INIT_REPLICA_SUCCESS;
+}
+
+
+
+void destroy_replica()
+{
+    __atomic_store_n(&is_replica_running, 0, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_lock(&mutex_replica_socket);
+    if (replica_socket >= 0)
+        shutdown(replica_socket, SHUT_RDWR);
+    pthread_mutex_unlock(&mutex_replica_socket);
+
+    pthread_join(t_replica, NULL);
+
+    free_replica_users(replica_users);
+    destroy_sorted_names(&replica_connected_names);
+    drop_cached_snapshot(&p_replica_users_snapshot);
+    pthread_mutex_destroy(&mutex_replica_socket);
+    pthread_rwlock_destroy(&lock_replica);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// reads
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int replica_is_registered(char* username)
+{
+    pthread_rwlock_rdlock(&lock_replica);
+    int res = *find_replica_user(replica_users, username) != NULL;
+    pthread_rwlock_unlock(&lock_replica);
+
+    return res;
+}
+
+
+
+int replica_is_connected(char* username)
+{
+    pthread_rwlock_rdlock(&lock_replica);
+    struct replica_user* p_user = *find_replica_user(replica_users, username);
+    int res = p_user != NULL && p_user->is_connected;
+    pthread_rwlock_unlock(&lock_replica);
+
+    return res;
+}
+
+
+
+struct users_snapshot* replica_get_users_snapshot()
+{
+    pthread_rwlock_rdlock(&lock_replica);
+
+    struct users_snapshot* p_snapshot = acquire_cached_snapshot(&p_replica_users_snapshot);
+    if (p_snapshot == NULL)
+    {
+        p_snapshot = new_users_snapshot(num_of_replica_connected, (size_t) num_of_replica_connected
+            * (MAX_USERNAME_LEN + MAX_IP_ADDR_LEN + MAX_PORT_LEN + 3));
+        for (uint32_t i = 0; p_snapshot != NULL && i < NUM_OF_REPLICA_BUCKETS; i++)
+        {
+            for (struct replica_user* p_user = replica_users[i]; p_user != NULL;
+                p_user = p_user->p_next)
+            {
+                if (p_user->is_connected)
+                    p_snapshot->len += sprintf(p_snapshot->data + p_snapshot->len, "%s%c%s%c%s",
+                        p_user->data.username, '\0', p_user->data.ip, '\0', p_user->data.port) + 1;
+            }
+        }
+
+        if (p_snapshot != NULL)
+            cache_users_snapshot(&p_replica_users_snapshot, p_snapshot);
+    }
+
+    pthread_rwlock_unlock(&lock_replica);
+
+    return p_snapshot;
+}
+
+
+
+/*
+    appends the connected user with the username to the snapshot pointed by arg. Used with
+    sorted_names_select, with the lock held.
+*/
+void append_replica_user(char* username, void* arg)
+{
+    struct users_snapshot* p_snapshot = arg;
+    struct replica_user* p_user = *find_replica_user(replica_users, username);
+
+    p_snapshot->len += sprintf(p_snapshot->data + p_snapshot->len, "%s%c%s%c%s",
+        p_user->data.username, '\0', p_user->data.ip, '\0', p_user->data.port) + 1;
+}
+
+
+
+/*
+    counts the name in the number pointed by arg. Used with sorted_names_select.
+*/
+void count_replica_user(char* username, void* arg)
+{
+    (void) username;
+    (*(uint32_t*) arg)++;
+}
+
+
+
+struct users_snapshot* replica_get_filtered_users_snapshot(struct name_filter* p_filter)
+{
+    pthread_rwlock_rdlock(&lock_replica);
+
+    uint32_t num_of_users = 0;
+    sorted_names_select(&replica_connected_names, p_filter, count_replica_user, &num_of_users);
+    struct users_snapshot* p_snapshot = new_users_snapshot(num_of_users, (size_t) num_of_users
+        * (MAX_USERNAME_LEN + MAX_IP_ADDR_LEN + MAX_PORT_LEN + 3));
+    if (p_snapshot != NULL)
+        sorted_names_select(&replica_connected_names, p_filter, append_replica_user, p_snapshot);
+
+    pthread_rwlock_unlock(&lock_replica);
+
+    return p_snapshot;
+}
+
+
+
+int replica_get_user_files_list(char* username, struct name_filter* p_filter,
+    char*** p_user_files, uint32_t* p_quantity, struct arena* p_arena)
+{
+    int res = REPLICA_FILES_LIST_SUCCESS;
+    *p_user_files = NULL;
+    *p_quantity = 0;
+
+    pthread_rwlock_rdlock(&lock_replica);
+
+    struct replica_user* p_user = *find_replica_user(replica_users, username);
+    if (p_user == NULL)
+        res = REPLICA_FILES_LIST_ERR_NO_SUCH_USER;
+    else if (sorted_names_list(&p_user->files, p_filter, p_user_files, p_quantity, p_arena)
+        != SORTED_NAMES_LIST_SUCCESS)
+        res = REPLICA_FILES_LIST_ERR_MEMORY;
+
+    pthread_rwlock_unlock(&lock_replica);
+
+    return res;
+}
+
+
+
+void replica_get_status(struct replica_status* p_status)
+{
+    uint64_t now_ms = replica_time_ms();
+
+    pthread_rwlock_rdlock(&lock_replica);
+    p_status->is_connected = is_replica_connected;
+    p_status->applied_seq = replica_applied_seq;
+    p_status->primary_seq = replica_primary_seq;
+    p_status->lag_ms = now_ms > replica_primary_time_ms ? now_ms - replica_primary_time_ms : 0;
+    pthread_rwlock_unlock(&lock_replica);
+}
@@ -0,0 +1,92 @@
+#include <stdint.h>
+#include "connected_users.h"
+#include "arena.h"
+/*
+    read replica of the primary server. It follows the change feed of the primary (see
+    change_feed.h) and keeps its own copy of the registered users, of their published files and of
+    the connected users in memory, so LIST_USERS and LIST_CONTENT can be served by any number of
+    replicas. The copy is behind the primary by the replication lag: the time since the primary
+    sent the last change or heartbeat the replica applied. When the connection to the primary is
+    lost the replica keeps serving its copy, reconnects and starts over with a new snapshot.
+    IMPORTANT before any operation will be performed it is required to call the init() function and
+    if the replica won't be used anymore then the destroy() function must be called.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define REPLICA_RETRY_MS 1000
+// init
+#define INIT_REPLICA_SUCCESS 0
+#define INIT_REPLICA_ERR_MEMORY 1
+#define INIT_REPLICA_ERR_THREAD 2
+// get files list
+#define REPLICA_FILES_LIST_SUCCESS 0
+#define REPLICA_FILES_LIST_ERR_NO_SUCH_USER 1
+#define REPLICA_FILES_LIST_ERR_MEMORY 2
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct replica_status {
+    int is_connected;           // 1 if the replica follows the feed of the primary
+    uint64_t applied_seq;       // sequence number of the last change applied
+    uint64_t primary_seq;       // sequence number of the last change on the primary
+    uint64_t lag_ms;            // how old the copy is
+};
+
+
+
+/*
+    must be called exactly once at the beginning, before the first call to any function
+    from this file has been done. Starts following the feed on primary_host:primary_port.
+    Returns:
+        INIT_REPLICA_SUCCESS        - success
+        INIT_REPLICA_ERR_MEMORY     - could not allocate the copy
+        INIT_REPLICA_ERR_THREAD     - could not start the thread following the feed
+*/
+int init_replica(char* primary_host, char* primary_port);
+/*
+    must be called exactly once when the functions won't be used anymore.
+*/
+void destroy_replica();
+/*
+    checks if the user with the username is registered.
+    Returns 1 if the user is registered and 0 if no
+*/
+int replica_is_registered(char* username);
+/*
+    checks if the user with the username is connected.
+    Returns 1 if the user is connected and 0 if no
+*/
+int replica_is_connected(char* username);
+/*
+    Returns a reference to the snapshot of the users which are connected like get_users_snapshot
+    (see connected_users.h), it has to be released with release_users_snapshot(). NULL if the
+    snapshot could not be allocated
+*/
+struct users_snapshot* replica_get_users_snapshot();
+/*
+    Returns a new snapshot of the connected users whose usernames match the filter like
+    get_filtered_users_snapshot (see connected_users.h), it has to be released with
+    release_users_snapshot(). NULL if the snapshot could not be allocated
+*/
+struct users_snapshot* replica_get_filtered_users_snapshot(struct name_filter* p_filter);
+/*
+    collects names of the files of the user which match the filter (see sorted_names.h), in order,
+    in an array of strings allocated in the arena. When p_arena is NULL they are allocated
+    dynamically, so they have to be deleted afterwards. Number of the files will be put where
+    p_quantity points.
+    Returns:
+        REPLICA_FILES_LIST_SUCCESS          - success
+        REPLICA_FILES_LIST_ERR_NO_SUCH_USER - there is no user with such username
+        REPLICA_FILES_LIST_ERR_MEMORY       - could not allocate the list
+*/
+int replica_get_user_files_list(char* username, struct name_filter* p_filter,
+    char*** p_user_files, uint32_t* p_quantity, struct arena* p_arena);
+/*
+    puts the replication status where p_status points.
+*/
+void replica_get_status(struct replica_status* p_status);
@@ -0,0 +1,906 @@
+#include "search_index.h"
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// tokens
+#define MAX_TOKEN_LEN 32
+#define MAX_DOC_TOKENS 256
+#define MAX_QUERY_TOKENS 8
+// hash tables
+#define INITIAL_TABLE_CAPACITY 1024
+#define EMPTY_SLOT 0
+#define DELETED_SLOT UINT32_MAX
+// compaction
+#define MIN_DEAD_DOCS_FOR_COMPACTION 1024
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct document {
+    char* owner;
+    char* file_name;
+    int alive;
+    uint32_t prev_of_owner;     // doc id + 1 of the previous document of the owner, 0 if none
+};
+
+/*
+    sorted doc ids stored as varint encoded differences between consecutive ids
+*/
+struct posting_list {
+    uint8_t* data;
+    uint32_t len;
+    uint32_t capacity;
+    uint32_t last_doc;
+    uint32_t count;
+};
+
+struct term {
+    char* token;
+    struct posting_list postings;
+};
+
+struct cursor {
+    uint8_t* p;
+    uint8_t* end;
+    uint32_t doc;
+    int done;
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// global variables
+///////////////////////////////////////////////////////////////////////////////////////////////////
+static pthread_rwlock_t lock_index;
+// documents, the doc id is the position in the array
+static struct document* docs;
+static uint32_t num_of_docs;
+static uint32_t docs_capacity;
+static uint32_t num_of_dead_docs;
+// token -> posting list
+static struct term* terms;
+static uint32_t terms_capacity;
+static uint32_t num_of_terms;
+// owner/file_name -> doc id + 1, open addressing
+static uint32_t* doc_slots;
+static uint32_t doc_slots_capacity;
+static uint32_t num_of_doc_slots_used;
+// owner -> doc id + 1 of the last document of the owner, open addressing. The documents of the
+// owner are chained by prev_of_owner
+static uint32_t* owner_slots;
+static uint32_t owner_slots_capacity;
+static uint32_t num_of_owner_slots_used;
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t hash_string(char* str, uint32_t hash)
+{
+    // FNV-1a
+    while (*str)
+    {
+        hash ^= (uint8_t) *str++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+
+uint32_t hash_doc(char* owner, char* file_name)
+{
+    return hash_string(file_name, hash_string("/", hash_string(owner, 2166136261u)));
+}
+
+
+
+/*
+    splits text into lowercase alphanumeric tokens, appending the ones which are not yet in tokens.
+    Returns the new number of tokens.
+*/
+int tokenize(char* text, char tokens[][MAX_TOKEN_LEN + 1], int num_of_tokens, int max_tokens)
+{
+    char token[MAX_TOKEN_LEN + 1];
+    int len = 0;
+
+    for (char* p = text; ; p++)
+    {
+        if (*p != '\0' && isalnum((unsigned char) *p))
+        {
+            if (len < MAX_TOKEN_LEN)    // longer tokens are truncated
+                token[len++] = tolower((unsigned char) *p);
+            continue;
+        }
+
+        if (len > 0)
+        {
+            token[len] = '\0';
+            len = 0;
+
+            int is_new = 1;
+            for (int i = 0; i < num_of_tokens && is_new; i++)
+                is_new = strcmp(tokens[i], token) != 0;
+
+            if (is_new && num_of_tokens < max_tokens)
+                strcpy(tokens[num_of_tokens++], token);
+        }
+
+        if (*p == '\0')
+            break;
+    }
+
+    return num_of_tokens;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// posting lists
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int posting_list_append(struct posting_list* p_list, uint32_t doc)
+{
+    if (p_list->len + 5 > p_list->capacity)  // a varint of 32 bits takes at most 5 bytes
+    {
+        uint32_t new_capacity = p_list->capacity == 0 ? 16 : p_list->capacity * 2;
+        uint8_t* new_data = realloc(p_list->data, new_capacity);
+        if (new_data == NULL)
+            return -1;
+        p_list->data = new_data;
+        p_list->capacity = new_capacity;
+    }
+
+    uint32_t delta = doc - p_list->last_doc;
+    do
+    {
+        uint8_t byte = delta & 0x7f;
+        delta >>= 7;
+        p_list->data[p_list->len++] = byte | (delta ? 0x80 : 0);
+    } while (delta);
+
+    p_list->last_doc = doc;
+    p_list->count++;
+
+    return 0;
+}
+
+
+
+void cursor_init(struct cursor* p_cursor, struct posting_list* p_list)
+{
+    p_cursor->p = p_list->data;
+    p_cursor->end = p_list->data + p_list->len;
+    p_cursor->doc = 0;
+    p_cursor->done = 0;
+}
+
+
+
+/*
+    moves the cursor to the next doc id of its posting list.
+    Returns 1 if there was one and 0 if the end of the list was reached
+*/
+int cursor_next(struct cursor* p_cursor)
+{
+    if (p_cursor->p >= p_cursor->end)
+    {
+        p_cursor->done = 1;
+        return 0;
+    }
+
+    uint32_t delta = 0;
+    int shift = 0;
+    uint8_t byte;
+    do
+    {
+        byte = *p_cursor->p++;
+        delta |= (uint32_t) (byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    p_cursor->doc += delta;
+
+    return 1;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// hash tables
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct term* find_term(char* token)
+{
+    uint32_t mask = terms_capacity - 1;
+    for (uint32_t i = hash_string(token, 2166136261u) & mask; terms[i].token; i = (i + 1) & mask)
+    {
+        if (strcmp(terms[i].token, token) == 0)
+            return &terms[i];
+    }
+
+    return NULL;
+}
+
+
+
+/*
+    inserts the term into a table without checking for duplicates or free room.
+*/
+void put_term(struct term* table, uint32_t capacity, struct term* p_term)
+{
+    uint32_t mask = capacity - 1;
+    uint32_t i = hash_string(p_term->token, 2166136261u) & mask;
+    while (table[i].token)
+        i = (i + 1) & mask;
+
+    table[i] = *p_term;
+}
+
+
+
+struct term* find_or_add_term(char* token)
+{
+    struct term* p_term = find_term(token);
+    if (p_term != NULL)
+        return p_term;
+
+    if ((num_of_terms + 1) * 10 > terms_capacity * 7)  // keep load factor under 0.7
+    {
+        uint32_t new_capacity = terms_capacity * 2;
+        struct term* new_terms = calloc(new_capacity, sizeof(struct term));
+        if (new_terms == NULL)
+            return NULL;
+
+        for (uint32_t i = 0; i < terms_capacity; i++)
+        {
+            if (terms[i].token)
+                put_term(new_terms, new_capacity, &terms[i]);
+        }
+
+        free(terms);
+        terms = new_terms;
+        terms_capacity = new_capacity;
+    }
+
+    struct term new_term;
+    memset(&new_term, 0, sizeof(new_term));
+    new_term.token = strdup(token);
+    if (new_term.token == NULL)
+        return NULL;
+
+    put_term(terms, terms_capacity, &new_term);
+    num_of_terms++;
+
+    return find_term(token);
+}
+
+
+
+/*
+    Returns the position of the slot of the document in doc_slots or -1 if it is not indexed.
+*/
+int64_t find_doc_slot(char* owner, char* file_name)
+{
+    uint32_t mask = doc_slots_capacity - 1;
+    for (uint32_t i = hash_doc(owner, file_name) & mask; doc_slots[i] != EMPTY_SLOT;
+        i = (i + 1) & mask)
+    {
+        if (doc_slots[i] == DELETED_SLOT)
+            continue;
+
+        struct document* p_doc = &docs[doc_slots[i] - 1];
+        if (strcmp(p_doc->owner, owner) == 0 && strcmp(p_doc->file_name, file_name) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+
+
+void put_doc_slot(uint32_t* slots, uint32_t capacity, uint32_t doc)
+{
+    uint32_t mask = capacity - 1;
+    uint32_t i = hash_doc(docs[doc].owner, docs[doc].file_name) & mask;
+    while (slots[i] != EMPTY_SLOT && slots[i] != DELETED_SLOT)
+        i = (i + 1) & mask;
+
+    slots[i] = doc + 1;
+}
+
+
+
+/*
+    replaces the doc slots table with new_slots, which is zeroed and has the specified capacity,
+    filled with the alive documents.
+*/
+void fill_doc_slots(uint32_t* new_slots, uint32_t capacity)
+{
+    num_of_doc_slots_used = 0;
+    for (uint32_t doc = 0; doc < num_of_docs; doc++)
+    {
+        if (docs[doc].alive)
+        {
+            put_doc_slot(new_slots, capacity, doc);
+            num_of_doc_slots_used++;
+        }
+    }
+
+    free(doc_slots);
+    doc_slots = new_slots;
+    doc_slots_capacity = capacity;
+}
+
+
+
+/*
+    rebuilds the doc slots table with the specified capacity from the alive documents.
+    Returns 0 on success and -1 on fail.
+*/
+int rebuild_doc_slots(uint32_t capacity)
+{
+    uint32_t* new_slots = calloc(capacity, sizeof(uint32_t));
+    if (new_slots == NULL)
+        return -1;
+
+    fill_doc_slots(new_slots, capacity);
+
+    return 0;
+}
+
+
+
+/*
+    Returns the position of the slot of the owner in the slots table, which holds the last
+    document of the owner, or of the empty slot where it belongs if the owner has no documents.
+*/
+uint32_t find_owner_slot(uint32_t* slots, uint32_t capacity, char* owner)
+{
+    uint32_t mask = capacity - 1;
+    uint32_t i = hash_string(owner, 2166136261u) & mask;
+    int64_t free_slot = -1;
+    for (; slots[i] != EMPTY_SLOT; i = (i + 1) & mask)
+    {
+        if (slots[i] == DELETED_SLOT)
+        {
+            if (free_slot < 0)
+                free_slot = i;
+        }
+        else if (strcmp(docs[slots[i] - 1].owner, owner) == 0)
+            return i;
+    }
+
+    return free_slot >= 0 ? free_slot : i;
+}
+
+
+
+/*
+    chains the document to the last one of its owner in the slots table.
+    Returns 1 if the owner got a new slot and 0 if it had one
+*/
+int put_owner_doc(uint32_t* slots, uint32_t capacity, uint32_t doc)
+{
+    uint32_t i = find_owner_slot(slots, capacity, docs[doc].owner);
+    int is_new = slots[i] == EMPTY_SLOT || slots[i] == DELETED_SLOT;
+
+    docs[doc].prev_of_owner = is_new ? 0 : slots[i];
+    slots[i] = doc + 1;
+
+    return is_new;
+}
+
+
+
+/*
+    replaces the owner slots table with new_slots, which is zeroed and has the specified capacity,
+    filled with the alive documents chained in the order of their ids.
+*/
+void fill_owner_slots(uint32_t* new_slots, uint32_t capacity)
+{
+    num_of_owner_slots_used = 0;
+    for (uint32_t doc = 0; doc < num_of_docs; doc++)
+    {
+        if (docs[doc].alive)
+            num_of_owner_slots_used += put_owner_doc(new_slots, capacity, doc);
+    }
+
+    free(owner_slots);
+    owner_slots = new_slots;
+    owner_slots_capacity = capacity;
+}
+
+
+
+/*
+    rebuilds the owner slots table with the specified capacity from the alive documents.
+    Returns 0 on success and -1 on fail.
+*/
+int rebuild_owner_slots(uint32_t capacity)
+{
+    uint32_t* new_slots = calloc(capacity, sizeof(uint32_t));
+    if (new_slots == NULL)
+        return -1;
+
+    fill_owner_slots(new_slots, capacity);
+
+    return 0;
+}
+
+
+
+/*
+    marks the document of the slot as deleted. Must be called with the write lock held.
+*/
+void remove_doc_in_slot(uint32_t slot)
+{
+    docs[doc_slots[slot] - 1].alive = 0;
+    doc_slots[slot] = DELETED_SLOT;
+    num_of_dead_docs++;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// compaction
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    drops deleted documents from the posting lists and renumbers the alive ones, so the index
+    does not grow with the number of deletions. Everything is allocated before the index is
+    changed, so when the memory runs out the index stays as it was and the compaction is tried
+    again with the next deletion. Must be called with the write lock held.
+*/
+void compact_index()
+{
+    uint32_t* new_ids = malloc(num_of_docs * sizeof(uint32_t));
+    struct posting_list* new_lists = calloc(terms_capacity, sizeof(struct posting_list));
+    struct term* new_terms = calloc(terms_capacity, sizeof(struct term));
+    uint32_t* new_doc_slots = calloc(doc_slots_capacity, sizeof(uint32_t));
+    uint32_t* new_owner_slots = calloc(owner_slots_capacity, sizeof(uint32_t));
+    int is_allocated = new_ids != NULL && new_lists != NULL && new_terms != NULL
+        && new_doc_slots != NULL && new_owner_slots != NULL;
+
+    uint32_t num_of_alive = 0;
+    for (uint32_t doc = 0; is_allocated && doc < num_of_docs; doc++)
+        new_ids[doc] = docs[doc].alive ? num_of_alive++ : DELETED_SLOT;
+
+    // re-encode posting lists with the new ids aside of the old ones
+    for (uint32_t i = 0; is_allocated && i < terms_capacity; i++)
+    {
+        if (terms[i].token == NULL)
+            continue;
+
+        struct cursor cur;
+        cursor_init(&cur, &terms[i].postings);
+        while (is_allocated && cursor_next(&cur))
+        {
+            if (new_ids[cur.doc] != DELETED_SLOT)
+                is_allocated = posting_list_append(&new_lists[i], new_ids[cur.doc]) == 0;
+        }
+    }
+
+    if (!is_allocated)
+    {
+        for (uint32_t i = 0; new_lists != NULL && i < terms_capacity; i++)
+            free(new_lists[i].data);
+        free(new_ids);
+        free(new_lists);
+        free(new_terms);
+        free(new_doc_slots);
+        free(new_owner_slots);
+        return; // try next time
+    }
+
+    for (uint32_t doc = 0; doc < num_of_docs; doc++)
+    {
+        if (new_ids[doc] != DELETED_SLOT)
+            docs[new_ids[doc]] = docs[doc];
+        else
+        {
+            free(docs[doc].owner);
+            free(docs[doc].file_name);
+        }
+    }
+
+    // swap in the new posting lists, dropping the terms which have no documents left
+    for (uint32_t i = 0; i < terms_capacity; i++)
+    {
+        if (terms[i].token == NULL)
+            continue;
+
+        free(terms[i].postings.data);
+        terms[i].postings = new_lists[i];
+
+        if (terms[i].postings.count == 0)
+        {
+            free(terms[i].postings.data);
+            free(terms[i].token);
+            terms[i].token = NULL;
+            num_of_terms--;
+        }
+    }
+
+    // emptied slots break the probe sequences, so the terms are rehashed
+    for (uint32_t i = 0; i < terms_capacity; i++)
+    {
+        if (terms[i].token)
+            put_term(new_terms, terms_capacity, &terms[i]);
+    }
+    free(terms);
+    terms = new_terms;
+
+    free(new_ids);
+    free(new_lists);
+    num_of_docs = num_of_alive;
+    num_of_dead_docs = 0;
+    fill_doc_slots(new_doc_slots, doc_slots_capacity);
+    fill_owner_slots(new_owner_slots, owner_slots_capacity);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// init / destroy
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int init_search_index()
+{
+    docs_capacity = INITIAL_TABLE_CAPACITY;
+    docs = malloc(docs_capacity * sizeof(struct document));
+    terms_capacity = INITIAL_TABLE_CAPACITY;
+    terms = calloc(terms_capacity, sizeof(struct term));
+    doc_slots_capacity = INITIAL_TABLE_CAPACITY;
+    doc_slots = calloc(doc_slots_capacity, sizeof(uint32_t));
+    owner_slots_capacity = INITIAL_TABLE_CAPACITY;
+    owner_slots = calloc(owner_slots_capacity, sizeof(uint32_t));
+
+    if (docs == NULL || terms == NULL || doc_slots == NULL || owner_slots == NULL)
+        return INIT_SEARCH_INDEX_ERR_MEMORY;
+
+    if (pthread_rwlock_init(&lock_index, NULL) != 0)
+        return INIT_SEARCH_INDEX_ERR_LOCK_INIT;
+
+    return INIT_SEARCH_INDEX_SUCCESS;
+}
+
+
+
+void destroy_search_index()
+{
+    for (uint32_t doc = 0; doc < num_of_docs; doc++)
+    {
+        free(docs[doc].owner);
+        free(docs[doc].file_name);
+    }
+
+    for (uint32_t i = 0; i < terms_capacity; i++)
+    {
+        free(terms[i].token);
+        free(terms[i].postings.data);
+    }
+
+    free(docs);
+    free(terms);
+    free(doc_slots);
+    free(owner_slots);
+    pthread_rwlock_destroy(&lock_index);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// search_index_add
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int search_index_add(char* owner, char* file_name, char* description)
+{
+    // tokenize outside of the lock
+    char tokens[MAX_DOC_TOKENS][MAX_TOKEN_LEN + 1];
+    int num_of_tokens = tokenize(file_name, tokens, 0, MAX_DOC_TOKENS);
+    num_of_tokens = tokenize(description, tokens, num_of_tokens, MAX_DOC_TOKENS);
+
+    int res = SEARCH_INDEX_SUCCESS;
+    pthread_rwlock_wrlock(&lock_index);
+
+    if (find_doc_slot(owner, file_name) >= 0)
+        res = SEARCH_INDEX_ERR_INDEXED;
+
+    // make room for the document and its slots
+    if (res == SEARCH_INDEX_SUCCESS && num_of_docs == docs_capacity)
+    {
+        struct document* new_docs = realloc(docs, 2 * docs_capacity * sizeof(struct document));
+        if (new_docs == NULL)
+            res = SEARCH_INDEX_ERR_MEMORY;
+        else
+        {
+            docs = new_docs;
+            docs_capacity *= 2;
+        }
+    }
+    if (res == SEARCH_INDEX_SUCCESS && (num_of_doc_slots_used + 1) * 10 > doc_slots_capacity * 7
+        && rebuild_doc_slots(doc_slots_capacity * 2) != 0)
+        res = SEARCH_INDEX_ERR_MEMORY;
+    if (res == SEARCH_INDEX_SUCCESS
+        && (num_of_owner_slots_used + 1) * 10 > owner_slots_capacity * 7
+        && rebuild_owner_slots(owner_slots_capacity * 2) != 0)
+        res = SEARCH_INDEX_ERR_MEMORY;
+
+    if (res == SEARCH_INDEX_SUCCESS)
+    {
+        uint32_t doc = num_of_docs;
+        docs[doc].owner = strdup(owner);
+        docs[doc].file_name = strdup(file_name);
+        docs[doc].alive = 1;
+
+        if (docs[doc].owner == NULL || docs[doc].file_name == NULL)
+        {
+            free(docs[doc].owner);
+            free(docs[doc].file_name);
+            res = SEARCH_INDEX_ERR_MEMORY;
+        }
+        else
+        {
+            num_of_docs++;
+            put_doc_slot(doc_slots, doc_slots_capacity, doc);
+            num_of_doc_slots_used++;
+            num_of_owner_slots_used += put_owner_doc(owner_slots, owner_slots_capacity, doc);
+
+            // doc ids only grow, so appending keeps the posting lists sorted
+            for (int i = 0; i < num_of_tokens; i++)
+            {
+                struct term* p_term = find_or_add_term(tokens[i]);
+                if (p_term == NULL || posting_list_append(&p_term->postings, doc) != 0)
+                    res = SEARCH_INDEX_ERR_MEMORY;
+            }
+
+            // not indexed, so the file can be added again
+            if (res != SEARCH_INDEX_SUCCESS)
+                remove_doc_in_slot(find_doc_slot(owner, file_name));
+        }
+    }
+
+    pthread_rwlock_unlock(&lock_index);
+
+    return res;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// search_index_remove
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void compact_if_needed()
+{
+    if (num_of_dead_docs >= MIN_DEAD_DOCS_FOR_COMPACTION && num_of_dead_docs * 2 > num_of_docs)
+        compact_index();
+}
+
+
+
+int search_index_remove(char* owner, char* file_name)
+{
+    int res = SEARCH_INDEX_SUCCESS;
+    pthread_rwlock_wrlock(&lock_index);
+
+    int64_t slot = find_doc_slot(owner, file_name);
+    if (slot >= 0)
+    {
+        remove_doc_in_slot(slot);
+        compact_if_needed();
+    }
+    else
+        res = SEARCH_INDEX_ERR_NOT_INDEXED;
+
+    pthread_rwlock_unlock(&lock_index);
+
+    return res;
+}
+
+
+
+void search_index_remove_owner(char* owner)
+{
+    pthread_rwlock_wrlock(&lock_index);
+
+    // the chain keeps the documents removed one by one till the compaction, they are skipped
+    uint32_t owner_slot = find_owner_slot(owner_slots, owner_slots_capacity, owner);
+    uint32_t last = owner_slots[owner_slot];
+    if (last != EMPTY_SLOT && last != DELETED_SLOT)
+    {
+        for (uint32_t doc_ref = last; doc_ref != 0; doc_ref = docs[doc_ref - 1].prev_of_owner)
+        {
+            if (!docs[doc_ref - 1].alive)
+                continue;
+
+            int64_t slot = find_doc_slot(owner, docs[doc_ref - 1].file_name);
+            if (slot >= 0)
+                remove_doc_in_slot(slot);
+        }
+
+        owner_slots[owner_slot] = DELETED_SLOT;
+    }
+
+    compact_if_needed();
+    pthread_rwlock_unlock(&lock_index);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// search_index_query
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    Returns 1 if the result a is worse than the result b, i.e. has lower score or the same score
+    but was published later.
+*/
+int is_worse(uint32_t score_a, uint32_t doc_a, uint32_t score_b, uint32_t doc_b)
+{
+    return score_a < score_b || (score_a == score_b && doc_a > doc_b);
+}
+
+
+
+/*
+    restores the heap property (the worst result at the top) starting from position i.
+*/
+void sift_down(uint32_t* scores, uint32_t* doc_ids, uint32_t size, uint32_t i)
+{
+    for (;;)
+    {
+        uint32_t worst = i;
+        uint32_t left = 2 * i + 1;
+        uint32_t right = left + 1;
+
+        if (left < size && is_worse(scores[left], doc_ids[left], scores[worst], doc_ids[worst]))
+            worst = left;
+        if (right < size && is_worse(scores[right], doc_ids[right], scores[worst], doc_ids[worst]))
+            worst = right;
+        if (worst == i)
+            return;
+
+        uint32_t tmp = scores[i]; scores[i] = scores[worst]; scores[worst] = tmp;
+        tmp = doc_ids[i]; doc_ids[i] = doc_ids[worst]; doc_ids[worst] = tmp;
+        i = worst;
+    }
+}
+
+
+
+uint32_t search_index_query(char* query, uint32_t max_results, struct search_result** p_results)
+{
+    *p_results = NULL;
+    if (max_results > MAX_SEARCH_RESULTS)
+        max_results = MAX_SEARCH_RESULTS;
+
+    char tokens[MAX_QUERY_TOKENS][MAX_TOKEN_LEN + 1];
+    int num_of_tokens = tokenize(query, tokens, 0, MAX_QUERY_TOKENS);
+    if (num_of_tokens == 0 || max_results == 0)
+        return 0;
+
+    // top results are kept in a heap with the worst one at the top
+    uint32_t scores[MAX_SEARCH_RESULTS];
+    uint32_t doc_ids[MAX_SEARCH_RESULTS];
+    uint32_t num_of_results = 0;
+
+    pthread_rwlock_rdlock(&lock_index);
+
+    struct cursor cursors[MAX_QUERY_TOKENS];
+    int num_of_cursors = 0;
+    for (int i = 0; i < num_of_tokens; i++)
+    {
+        struct term* p_term = find_term(tokens[i]);
+        if (p_term == NULL)
+            continue;
+
+        cursor_init(&cursors[num_of_cursors], &p_term->postings);
+        if (cursor_next(&cursors[num_of_cursors]))
+            num_of_cursors++;
+    }
+
+    // merge the posting lists, the score of a document is the number of lists it appears in
+    for (;;)
+    {
+        uint32_t doc = UINT32_MAX;
+        for (int i = 0; i < num_of_cursors; i++)
+        {
+            if (!cursors[i].done && cursors[i].doc < doc)
+                doc = cursors[i].doc;
+        }
+        if (doc == UINT32_MAX)
+            break;
+
+        uint32_t score = 0;
+        for (int i = 0; i < num_of_cursors; i++)
+        {
+            if (!cursors[i].done && cursors[i].doc == doc)
+            {
+                score++;
+                cursor_next(&cursors[i]);
+            }
+        }
+
+        if (!docs[doc].alive)
+            continue;
+
+        if (num_of_results < max_results)
+        {
+            // append and sift up
+            uint32_t i = num_of_results++;
+            scores[i] = score;
+            doc_ids[i] = doc;
+            while (i > 0 && is_worse(scores[i], doc_ids[i], scores[(i - 1) / 2],
+                doc_ids[(i - 1) / 2]))
+            {
+                uint32_t parent = (i - 1) / 2;
+                uint32_t tmp = scores[i]; scores[i] = scores[parent]; scores[parent] = tmp;
+                tmp = doc_ids[i]; doc_ids[i] = doc_ids[parent]; doc_ids[parent] = tmp;
+                i = parent;
+            }
+        }
+        else if (score > scores[0])  // docs come in ascending order, ties keep the older one
+        {
+            scores[0] = score;
+            doc_ids[0] = doc;
+            sift_down(scores, doc_ids, num_of_results, 0);
+        }
+    }
+
+    // pop the heap from the worst to the best result
+    struct search_result* results = malloc(num_of_results * sizeof(struct search_result) + 1);
+    uint32_t copied = 0;
+    if (results != NULL)
+    {
+        for (uint32_t size = num_of_results; size > 0; size--)
+        {
+            struct search_result* p_res = &results[size - 1];
+            p_res->owner = strdup(docs[doc_ids[0]].owner);
+            p_res->file_name = strdup(docs[doc_ids[0]].file_name);
+            p_res->score = scores[0];
+            copied++;
+
+            scores[0] = scores[size - 1];
+            doc_ids[0] = doc_ids[size - 1];
+            sift_down(scores, doc_ids, size - 1, 0);
+        }
+    }
+
+    pthread_rwlock_unlock(&lock_index);
+
+    *p_results = results;
+
+    return copied;
+}
+
+
+
+void free_search_results(struct search_result* results, uint32_t num_of_results)
+{
+    if (results == NULL)
+        return;
+
+    for (uint32_t i = 0; i < num_of_results; i++)
+    {
+        free(results[i].owner);
+        free(results[i].file_name);
+    }
+
+    free(results);
+}
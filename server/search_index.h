@@ -0,0 +1,81 @@
+#include <stdint.h>
+/*
+    in-memory inverted index over the published files. Names and descriptions of the files are
+    split into lowercase alphanumeric tokens and every token maps to a posting list of the ids of
+    the files which contain it. Posting lists are kept sorted and compressed (delta + varint
+    encoding), and are updated incrementally when a file is published or deleted.
+    IMPORTANT before any operation will be performed it is required to call the init() function and
+    if the index won't be used anymore then the destroy() function must be called.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// init
+#define INIT_SEARCH_INDEX_SUCCESS 0
+#define INIT_SEARCH_INDEX_ERR_MEMORY 1
+#define INIT_SEARCH_INDEX_ERR_LOCK_INIT 2
+// add / remove
+#define SEARCH_INDEX_SUCCESS 0
+#define SEARCH_INDEX_ERR_MEMORY 1
+#define SEARCH_INDEX_ERR_NOT_INDEXED 2
+#define SEARCH_INDEX_ERR_INDEXED 3
+// search
+#define MAX_SEARCH_RESULTS 100
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct search_result {
+    char* owner;
+    char* file_name;
+    uint32_t score;
+};
+
+
+
+/*
+    must be called exactly once at the beginning, before the first call to any function
+    from this file has been done.
+    Returns:
+        INIT_SEARCH_INDEX_SUCCESS       - success
+        INIT_SEARCH_INDEX_ERR_MEMORY    - could not allocate the index
+        INIT_SEARCH_INDEX_ERR_LOCK_INIT - could not initialize the index lock
+*/
+int init_search_index();
+/*
+    must be called exactly once when the functions won't be used anymore.
+*/
+void destroy_search_index();
+/*
+    adds the file_name file of the owner with its description to the index.
+    Returns:
+        SEARCH_INDEX_SUCCESS        - success
+        SEARCH_INDEX_ERR_MEMORY     - could not allocate memory
+        SEARCH_INDEX_ERR_INDEXED    - the file is already indexed
+*/
+int search_index_add(char* owner, char* file_name, char* description);
+/*
+    removes the file_name file of the owner from the index.
+    Returns:
+        SEARCH_INDEX_SUCCESS            - success
+        SEARCH_INDEX_ERR_NOT_INDEXED    - the file was not indexed
+*/
+int search_index_remove(char* owner, char* file_name);
+/*
+    removes all files of the owner from the index.
+*/
+void search_index_remove_owner(char* owner);
+/*
+    finds at most max_results files which names or descriptions contain tokens of the query. Files
+    matching more tokens come first. Results are copied to the dynamically allocated array put
+    where p_results points, it has to be deleted afterwards with free_search_results().
+    Returns number of results.
+*/
+uint32_t search_index_query(char* query, uint32_t max_results, struct search_result** p_results);
+/*
+    deletes results returned by search_index_query().
+*/
+void free_search_results(struct search_result* results, uint32_t num_of_results);
@@ -6,13 +6,40 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
 #include <strings.h> 
 #include <pthread.h>
 #include "lines.h"
 #include <regex.h>
 #include <signal.h>
 #include <errno.h>
+#include <poll.h>
+#include <time.h>
 #include "user_dao.h"
+#include "file_store.h"
+#include "blob_store.h"
+#include "search_index.h"
+#include "connected_users.h"
+#include "owners_index.h"
+#include "files_index.h"
+#include "sorted_names.h"
+#include "tracker.h"
+#include "admission.h"
+#include "timer_wheel.h"
+#include "metrics.h"
+#include "placement.h"
+#include "compression.h"
+#include "reclaimer.h"
+#include "worker_pool.h"
+#include "subscriptions.h"
+#include "udp_presence.h"
+#include "handoff.h"
+#include "change_feed.h"
+#include "replica.h"
+#include "shard_proxy.h"
+#include "arena.h"
+#include "config.h"
 
 
 
@@ -20,13 +47,13 @@
 // constants
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // port
-#define DEFAULT_PORT 7777
 #define MAX_PORT_NUMBER 49151
 #define MIN_PORT_NUMBER 1024
-// ip address
-#define MAX_IP_ADDR_LEN 15
+// obtain_port, the options are wrong or can't be used together
+#define ERR_OPTIONS -2
+// leases of the connected users (-l), in seconds
+#define MAX_LEASE_SECONDS 86400
 // main socket
-#define REQUESTS_QUEUE_SIZE 10
 #define ERR_SOCKET_DESCRIPTOR 100
 #define ERR_SOCKET_OPTION 110
 #define ERR_SOCKET_BIND 120
@@ -37,8 +64,42 @@
 #define REQ_UNREGISTER "UNREGISTER"
 #define REQ_LIST_USERS "LIST_USERS"
 #define REQ_LIST_CONTENT "LIST_CONTENT"
+#define REQ_LIST_CONTENT_MULTI "LIST_CONTENT_MULTI"
+#define REQ_LIST_USERS_FILTER "LIST_USERS_FILTER"
+#define REQ_LIST_CONTENT_FILTER "LIST_CONTENT_FILTER"
+#define REQ_SUBSCRIBE "SUBSCRIBE"
+#define REQ_PUT_FILE "PUT_FILE"
+#define REQ_GET_FILE "GET_FILE"
+#define REQ_PUBLISH "PUBLISH"
+#define REQ_DELETE "DELETE"
+#define REQ_SEARCH "SEARCH"
+#define REQ_CONNECT "CONNECT"
+#define REQ_DISCONNECT "DISCONNECT"
+#define REQ_HEARTBEAT "HEARTBEAT"
+#define REQ_WHO_HAS "WHO_HAS"
+#define REQ_ANNOUNCE "ANNOUNCE"
+#define REQ_GET_SOURCES "GET_SOURCES"
+#define REQ_RELEASE_SOURCES "RELEASE_SOURCES"
+#define REQ_METRICS "METRICS"
+#define REQ_REPLICATION_STATUS "REPLICATION_STATUS"
+#define REQ_REGISTER_BATCH "REGISTER_BATCH"
+#define REQ_UNREGISTER_BATCH "UNREGISTER_BATCH"
+#define REQ_PUBLISH_BATCH "PUBLISH_BATCH"
+#define REQ_ACCEPT_ENCODING "ACCEPT_ENCODING"
+// between a sharding proxy and the servers behind it, see shard_proxy.h
+#define REQ_SHARD "SHARD"
+#define REQ_SHARD_FANOUT "SHARD_FANOUT"
+#define REQ_USER_STATUS "USER_STATUS"
+#define REQ_SHARD_USERS "SHARD_USERS"
+#define REQ_USER_DUMP "USER_DUMP"
+// deadlines, what the connection is waiting for when its deadline passes
+#define DEADLINE_IDLE 0
+#define DEADLINE_READ 1
+#define DEADLINE_WRITE 2
+// result of any request rejected by the admission control, the connection is closed afterwards
+#define RESULT_BUSY 255
+#define RESULT_READ_ONLY 254	// a replica got a request which is not a read
 // register
-#define MAX_USERNAME_LEN 256
 #define REGISTER_SUCCESS 0
 #define REGISTER_NON_UNIQUE_USERNAME 1
 #define REGISTER_OTHER_ERROR 2
@@ -57,32 +118,188 @@
 // send users list
 #define SEND_USERS_LIST_SUCCESS 0
 #define SEND_USERS_LIST_ERR_NUM_OF_USERS 1
-#define SEND_USERS_LIST_ERR_USERNAME 2
-#define SEND_USERS_LIST_ERR_IP 3
-#define SEND_USERS_LIST_ERR_PORT 4
+#define SEND_USERS_LIST_ERR_USERS 2
 // list content
 #define LIST_CONTENT_SUCCESS 0
 #define LIST_CONTENT_NOT_REGISTERED 1
 #define LIST_CONTENT_DISCONNECTED 2
 #define LIST_CONTENT_NO_SUCH_FILES_OWNER 3
 #define LIST_CONTENT_OTHER_ERROR 4
+// filtered listings, the type of the filter is "", "prefix", "glob" or "range". Longer than any
+// of them, so a wrong type is not cut to a valid one
+#define MAX_FILTER_TYPE_LEN 15
+// list content multi, the owners are listed in parallel by the worker pool
+#define MAX_LISTED_OWNERS 1000
+// subscribe
+#define SUBSCRIBE_SUCCESS 0
+#define SUBSCRIBE_NOT_REGISTERED 1
+#define SUBSCRIBE_DISCONNECTED 2
+#define SUBSCRIBE_OTHER_ERROR 3
+#define SUBSCRIPTION_HEARTBEAT "H"		// sent when there was no event for a while
+#define SUBSCRIPTION_HEARTBEAT_MS 10000
+// how often a subscription checks whether the client closed it or the server drains
+#define SUBSCRIPTION_POLL_MS 500
 // send content list
 #define SEND_CONTENT_LIST_SUCCESS 0
 #define SEND_CONTENT_LIST_ERR_NUM_OF_FILES 1
 #define SEND_CONTENT_LIST_ERR_FILENAME 2
+// accept encoding
+#define MAX_ENCODINGS_LEN 256
+#define ACCEPT_ENCODING_SUCCESS 0
+#define ACCEPT_ENCODING_NOT_SUPPORTED 1
+#define ACCEPT_ENCODING_OTHER_ERROR 2
+// numbers
+#define MAX_NUMBER_LEN 20
+// put file
+#define PUT_FILE_SUCCESS 0
+#define PUT_FILE_NOT_REGISTERED 1
+#define PUT_FILE_DISCONNECTED 2
+#define PUT_FILE_OTHER_ERROR 3
+#define PUT_FILE_NOT_PUBLISHED 4
+// get file
+#define GET_FILE_SUCCESS 0
+#define GET_FILE_NOT_REGISTERED 1
+#define GET_FILE_DISCONNECTED 2
+#define GET_FILE_NO_SUCH_FILE 3
+#define GET_FILE_INVALID_RANGE 4
+#define GET_FILE_OTHER_ERROR 5
+// publish
+#define PUBLISH_SUCCESS 0
+#define PUBLISH_NO_SUCH_USER 1
+#define PUBLISH_DISCONNECTED 2
+#define PUBLISH_ALREADY_PUBLISHED 3
+#define PUBLISH_OTHER_ERROR 4
+// delete
+#define DELETE_SUCCESS 0
+#define DELETE_NO_SUCH_USER 1
+#define DELETE_DISCONNECTED 2
+#define DELETE_NOT_PUBLISHED 3
+#define DELETE_OTHER_ERROR 4
+// search
+#define MAX_QUERY_LEN 256
+#define SEARCH_SUCCESS 0
+#define SEARCH_NOT_REGISTERED 1
+#define SEARCH_DISCONNECTED 2
+#define SEARCH_OTHER_ERROR 3
+// send search results
+#define SEND_SEARCH_RESULTS_SUCCESS 0
+#define SEND_SEARCH_RESULTS_ERR_NUM_OF_RESULTS 1
+#define SEND_SEARCH_RESULTS_ERR_OWNER 2
+#define SEND_SEARCH_RESULTS_ERR_FILENAME 3
+// connect
+#define CONNECT_SUCCESS 0
+#define CONNECT_NO_SUCH_USER 1
+#define CONNECT_ALREADY_CONNECTED 2
+#define CONNECT_OTHER_ERROR 3
+// disconnect
+#define DISCONNECT_SUCCESS 0
+#define DISCONNECT_NO_SUCH_USER 1
+#define DISCONNECT_NOT_CONNECTED 2
+#define DISCONNECT_OTHER_ERROR 3
+// heartbeat
+#define HEARTBEAT_SUCCESS 0
+#define HEARTBEAT_NO_SUCH_USER 1
+#define HEARTBEAT_DISCONNECTED 2
+#define HEARTBEAT_OTHER_ERROR 3
+// who has
+#define WHO_HAS_SUCCESS 0
+#define WHO_HAS_NOT_REGISTERED 1
+#define WHO_HAS_DISCONNECTED 2
+#define WHO_HAS_OTHER_ERROR 3
+// announce
+#define ANNOUNCE_SUCCESS 0
+#define ANNOUNCE_NOT_REGISTERED 1
+#define ANNOUNCE_DISCONNECTED 2
+#define ANNOUNCE_NOT_PUBLISHED 3
+#define ANNOUNCE_CONTENT_MISMATCH 4
+#define ANNOUNCE_OTHER_ERROR 5
+// get sources
+#define GET_SOURCES_SUCCESS 0
+#define GET_SOURCES_NOT_REGISTERED 1
+#define GET_SOURCES_DISCONNECTED 2
+#define GET_SOURCES_NO_SUCH_FILE 3
+#define GET_SOURCES_OTHER_ERROR 4
+// send sources
+#define SEND_SOURCES_SUCCESS 0
+#define SEND_SOURCES_ERR_FILE_INFO 1
+#define SEND_SOURCES_ERR_CHUNK_HASH 2
+#define SEND_SOURCES_ERR_NUM_OF_SOURCES 3
+#define SEND_SOURCES_ERR_SOURCE 4
+// release sources
+#define RELEASE_SOURCES_SUCCESS 0
+#define RELEASE_SOURCES_NOT_REGISTERED 1
+#define RELEASE_SOURCES_OTHER_ERROR 2
+// metrics
+#define METRICS_SUCCESS 0
+
+#define REPLICATION_STATUS_SUCCESS 0
+#define REPLICATION_STATUS_NOT_REPLICA 1
+
+#define USER_STATUS_SUCCESS 0
+#define USER_STATUS_NOT_REGISTERED 1
+#define USER_STATUS_DISCONNECTED 2
+#define USER_STATUS_OTHER_ERROR 3
+
+#define SHARD_USERS_SUCCESS 0
+#define SHARD_USERS_OTHER_ERROR 1
+
+#define USER_DUMP_SUCCESS 0
+#define USER_DUMP_NO_SUCH_USER 1
+#define USER_DUMP_OTHER_ERROR 2
+// content of PUT_FILE is buffered by a sharding proxy
+#define MAX_PROXIED_CONTENT (64 * 1024 * 1024)
+// batches, the result of every item is the one of the single request
+#define MAX_BATCH_SIZE 10000
+#define BATCH_SUCCESS 0
+#define BATCH_OTHER_ERROR 1
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // structs
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-struct user_data {
-	char username[MAX_USERNAME_LEN + 1];
-	char ip[MAX_IP_ADDR_LEN + 1];
-	char port[6];
+/*
+	what the main thread hands over to a request thread
+*/
+struct request_data {
+	int socket;
+	struct sockaddr_in client_addr;
+};
+
+/*
+	connection served by a request thread. A slow or stalled client can't keep the thread
+	forever: when the deadline passes the connection is shut down, which makes the blocked read
+	or write fail.
+*/
+struct connection {
+	int socket;
+	struct sockaddr_in client_addr;
+	int deadline_kind;		// DEADLINE_*
+	struct timer deadline;
+	int is_compressing;		// 1 after ACCEPT_ENCODING, see send_listing
+	struct subscriber* p_subscriber;	// after SUBSCRIBE, see stream_events
+	struct connection* p_prev;
+	struct connection* p_next;
+};
+
+/*
+	registered users collected by SHARD_USERS
+*/
+struct usernames_list {
+	char** usernames;
+	uint32_t num_of_usernames;
+	uint32_t capacity;
 };
 
-typedef struct user_data user;
+/*
+	connected owners collected by WHO_HAS, serialized like in LIST_USERS
+*/
+struct owners_list {
+	char* users;
+	size_t len;
+	size_t capacity;
+	uint32_t num_of_users;
+};
 
 
 
@@ -92,7 +309,8 @@ typedef struct user_data user;
 /*
 	Obtains the port number to be used for listening. The port is obtained from the command line
 	arguments.
-	Returns port number if success, -1 if no port specified or the port is invalid
+	Returns port number if success, -1 if no port specified or the port is invalid, ERR_OPTIONS if
+	another option is invalid or the options can't be used together
 */
 int obtain_port();
 /*
@@ -105,10 +323,61 @@ int process_obtain_port_result(int port);
 	Returns 1 on success and 0 on fail
 */
 int start_listening_sigint();
+/*
+	Obtains the socket listening on the port, either a new one or (with -u) the socket of the
+	running server together with its state, see handoff.h. If no server is running a new
+	socket is created.
+	Returns 0 on success and -1 on fail
+*/
+int obtain_server_socket(int port, int* p_server_socket);
+/*
+	adds the connection to the list of the open connections.
+*/
+void register_connection(struct connection* p_conn);
+/*
+	removes the connection from the list of the open connections.
+*/
+void unregister_connection(struct connection* p_conn);
+/*
+	Stops processing of requests: idle connections are closed immediately, the other ones after
+	their current request, or after drain_timeout_ms at the latest. Returns when all the
+	connections are closed.
+*/
+void drain_connections();
+/*
+	lets the connections be processed again after drain_connections().
+*/
+void resume_connections();
+/*
+	drains the connections and hands off the listening server_socket and the state to the new
+	server process which connected through the handoff_connection, see handoff.h. If the new
+	process does not take over, the connections are resumed and the server keeps serving.
+	Returns 0 on success and -1 on fail
+*/
+int hand_off(int handoff_connection, int server_socket);
+/*
+	moves the deadline drain_timeout_ms later.
+*/
+void add_drain_timeout(struct timespec* p_deadline);
 /*
 	Prints a cmd template for starting the server
 */
 void print_usage();
+/*
+	Shares the equal descriptions and content of the data directory (-D), offline.
+	Returns 0 on success and -1 on fail
+*/
+int dedup_data();
+/*
+	Sets the socket options of the configuration (TCP_NODELAY, keepalive, buffer sizes) to the
+	accepted connection.
+*/
+void set_connection_options(int socket, const struct config* p_config);
+/*
+	Applies the reloaded configuration which is not just read on every use, i.e. the backlog of
+	the listening socket. Called from the thread of the configuration, see config.h.
+*/
+void apply_config(const struct config* p_config);
 /*
 	Creates a socket to listen on the specified port and assigns the socket descriptor to p_socket.
 	Returns:
@@ -145,16 +414,67 @@ int clean_up(int server_socket, pthread_attr_t* p_attr);
 	Once a request arrives to the server through the general socket (the socket bound to the
 	port specified in cmd) the server will create a new thread for processing the request and
 	this is the function which will be runnig in the newly created thread. The function will lock 
-	mutex_csd while copying the client socket to a local variable and when it is finish it will
-	signal on cond_csd.
+	mutex_csd while copying the request data (client socket and address) to a local variable and
+	when it is finish it will signal on cond_csd. The connection stays open for the following
+	requests of the client (so requests can be pipelined) until the client closes it.
 */
-void* manage_request(void* p_socket);
+void* manage_request(void* p_request_data);
 /*
 	Reads from the socket in order to identify request type, i.e. register, unregister, connect....
 	If the request could be identified then a request specific function is called. If the request
 	could not be identified an approporiate message will be send back to the socket. 
+	Returns 1 if the connection can be used for the next request and 0 if it has to be closed
+*/
+int identify_and_process_request(struct connection* p_conn);
+/*
+	Calls the function processing the request of the req_type type.
+	Returns 1 if the connection can be used for the next request and 0 if it has to be closed
+*/
+int process_request(char* req_type, struct connection* p_conn, 
+	struct sockaddr_in* p_client_addr);
+/*
+	Closes the connection for writing, after the response was sent, and reads the rest of the
+	request till the client closes it (or the deadline passes). Closing it with unread data would
+	reset it and the response could be lost.
+*/
+void discard_rest_of_request(int socket);
+/*
+	Reads the rest of the request of the req_type type and forwards it to the shards, see
+	shard_proxy.h. The response of the shards is sent back to the client.
+	Returns 1 if the connection can be used for the next request and 0 if it has to be closed
+*/
+int proxy_request(char* req_type, struct connection* p_conn);
+/*
+	Returns the number of fields of the request of the req_type type which the sharding proxy
+	forwards and -1 if the request is not forwarded. When the fields are followed by items 
+	(ANNOUNCE and the batches), their number is the last field and the number of fields of every
+	item is put where p_fields_per_item points, 0 if there are none. The content of PUT_FILE is
+	not counted.
 */
-void identify_and_process_request(int socket);
+int get_proxied_request_format(char* req_type, uint32_t* p_fields_per_item);
+/*
+	Sends the response of the shards (the result code, the fields and the content) to the client.
+	Returns 0 on success and -1 on fail
+*/
+int send_proxied_response(struct connection* p_conn, struct client_response* p_response);
+/*
+	(Re)schedules the deadline of the connection to pass in timeout_ms milliseconds. The kind
+	says what the connection waits for, so the timeout is counted in the right metric.
+*/
+void set_deadline(struct connection* p_conn, int kind, uint64_t timeout_ms);
+/*
+	Called from the timer wheel when the deadline of the connection passes. Shuts the connection
+	down, the request thread closes it.
+*/
+void expire_connection(void* p_connection);
+/*
+	Returns the deadline for transferring size bytes of file content.
+*/
+uint64_t transfer_timeout_ms(uint64_t size);
+/*
+	Sends the RESULT_BUSY result code through the socket.
+*/
+void send_busy(int socket);
 
 void register_user(int socket);
 
@@ -172,31 +492,88 @@ int is_username_valid(char* username);
 
 void unregister(int socket);
 /*
-	checks if the user with the username is connected to the server.
-	Returns 1 if the user is connected and 0 if no
+	Removes the unregistered user from the indexes, the tracker, the connected users and the
+	relayed content and appends the change to the feed. files are the num_of_files files the user
+	had published. The user must be locked in the feed.
+*/
+void forget_unregistered_user(char* username, char** files, uint32_t num_of_files);
+/*
+	Registers a batch of users with one acquisition of the storage lock. The request is: number of
+	users and the username of each. The response is the result code and a string with the result
+	of every user as a digit (REGISTER_*).
+	Returns 1 if the whole request was read and 0 if no, so the connection can't be used anymore
+*/
+int register_batch(int socket);
+/*
+	Unregisters a batch of users with one acquisition of the storage lock. The request is: number
+	of users and the username of each. The response is the result code and a string with the
+	result of every user as a digit (UNREGISTER_*).
+	Returns 1 if the whole request was read and 0 if no, so the connection can't be used anymore
 */
-int is_connected(char* username);
+int unregister_batch(int socket);
+/*
+	Publishes a batch of files of the requesting user with one acquisition of the storage lock.
+	The request is: username, number of files and the name and the description of each. The 
+	response is the result code and a string with the result of every file as a digit
+	(PUBLISH_*).
+	Returns 1 if the whole request was read and 0 if no, so the connection can't be used anymore
+*/
+int publish_batch(int socket);
+/*
+	Sends the result code of a batch and, on success, the results of its num_of_items items.
+*/
+void send_batch_results(int socket, uint8_t res, uint8_t* results, uint32_t num_of_items);
+/*
+	Marks the requesting user as connected. The request is: username and the port on which the
+	user listens for file transfers. The ip address is the one the request came from.
+*/
+void connect_request(int socket, struct sockaddr_in* p_client_addr);
+/*
+	Marks the requesting user as disconnected. The request is: username.
+*/
+void disconnect_request(int socket);
+/*
+	Renews the lease of the connected requesting user (see init_leases). The request is: username.
+*/
+void heartbeat(int socket);
+/*
+	Disconnects the user whose lease expired, unless it was renewed meanwhile. Called by the
+	connected users registry.
+*/
+void expire_lease(char* username);
 
-void list_users(int socket);
+void list_users(struct connection* p_conn);
 /*
-	dynamically allocates an array of users which are connected to the system, so
-	it has to be deleted afterwards.
-	Returns number of connected users
+	Sends the connected users whose usernames match a filter, sorted by the username. The request
+	is: username, type of the filter ("" for all, "prefix", "glob" or "range") and its two
+	arguments (see sorted_names.h). The response is like for LIST_USERS.
 */
-uint32_t get_connected_users_list(user** p_users_list);
+void list_users_filter(struct connection* p_conn);
+/*
+	Sends the result code and, on success, the snapshot of the users (compressed when the
+	connection accepts it).
+*/
+void send_users_snapshot(struct connection* p_conn, uint8_t res,
+	struct users_snapshot* p_snapshot);
 
 /*
-	Sends list of users through the socket. First username is send, then ip and finally port.
+	Sends list of users through the socket: the number of users and the serialized users (for 
+	every user first username, then ip and finally port), see serialize_connected_users.
 	Returns:
 	SEND_USERS_LIST_SUCCESS 			- success
 	SEND_USERS_LIST_ERR_NUM_OF_USERS 	- could not send number of users
-	SEND_USERS_LIST_ERR_USERNAME 		- could not send username
-	SEND_USERS_LIST_ERR_IP 				- could not send ip
-	SEND_USERS_LIST_ERR_PORT 			- could not send port
+	SEND_USERS_LIST_ERR_USERS 			- could not send the users
 */
-int send_users_list(int socket, user* users_list, uint32_t num_of_users);
+int send_users_list(int socket, char* users, size_t users_len, uint32_t num_of_users);
 
-void list_content(int socket);
+void list_content(struct connection* p_conn);
+/*
+	Sends the files of an owner whose names match a filter, sorted by the name. The request is:
+	username, owner, type of the filter and its two arguments, like for LIST_USERS_FILTER. The
+	files are read from the files index, not from the storage. The response is like for
+	LIST_CONTENT.
+*/
+void list_content_filter(struct connection* p_conn);
 /*
 	Sends list of content (names of files) through the socket.
 	Returns:
@@ -205,6 +582,240 @@ void list_content(int socket);
 	SEND_CONTENT_LIST_ERR_FILENAME 		- could not send filename
 */
 int send_content_list(int socket, char** content_list, uint32_t num_of_files);
+/*
+	Serializes the list of content like send_content_list sends it, in the arena.
+	Returns the serialized list, its length is put where p_len points. NULL if there is no memory
+*/
+char* serialize_content_list(char** content_list, uint32_t num_of_files, size_t* p_len,
+	struct arena* p_arena);
+/*
+	Sends the lists of content of many owners. The request is: username, number of owners and the
+	username of each. The response is the result code (LIST_CONTENT_*) and, on success, the number
+	of owners and for each owner, in the order in which the listings are done: owner, the result
+	of the owner as a digit (LIST_CONTENT_*) and, on success, the list like for LIST_CONTENT. The
+	owners are listed in parallel by the worker pool and every listing is sent as soon as it's
+	done. The listings are not compressed.
+	Returns 1 if the whole request was read and 0 if no, so the connection can't be used anymore
+*/
+int list_content_multi(struct connection* p_conn);
+/*
+	The work of the worker pool for list_content_multi: lists the content of the owner.
+	Returns the response part of the owner allocated with malloc(), its length is put where p_len
+	points. NULL if there is no memory
+*/
+char* list_owner_content(char* owner, struct arena* p_arena, size_t* p_len);
+/*
+	Subscribes the connection to the changes of the files of the owners, see subscriptions.h. The
+	request is: username, number of owners and the username of each. The response is the result
+	code, on success the connection is then used only for the events, see stream_events.
+	Returns 1 if the whole request was read and 0 if no, so the connection can't be used anymore
+*/
+int subscribe_request(struct connection* p_conn);
+/*
+	Sends the events of the subscription of the connection till the client closes it or the
+	server drains. Every event is its type followed by its fields (SUBSCRIPTION_EVENT_*), each
+	finished by '\0', and SUBSCRIPTION_HEARTBEAT is sent when there was no event for
+	SUBSCRIPTION_HEARTBEAT_MS. The subscription is removed at the end.
+	Returns 0, the connection is closed afterwards
+*/
+int stream_events(struct connection* p_conn);
+/*
+	Turns on the compression of the listings for the connection. The request is: the encodings
+	the client accepts, separated by commas. The response is the encoding the server chose.
+*/
+void accept_encoding(struct connection* p_conn);
+/*
+	Sends the successful response to a listing (LIST_USERS, LIST_CONTENT) to the connection which
+	accepts the compression: the result code, then COMPRESSION_ENCODING_RAW and the payload if it's
+	shorter than compression_threshold, otherwise COMPRESSION_ENCODING, the length of the payload,
+	the length of the compressed payload and the compressed payload. p_compressed is the payload
+	compressed already, NULL if the payload is short or could not be compressed.
+	Returns 0 on success and -1 on fail
+*/
+int send_listing(int socket, char* payload, size_t len, struct compressed_payload* p_compressed);
+/*
+	Receives the content of a file owned by the requesting user and stores it on the server, so
+	it can be relayed to other users with GET_FILE. The request is: username, file name, size
+	and then exactly size bytes of raw content.
+	Returns 1 if all the content was consumed and 0 if no, so the connection can't be used anymore
+*/
+int put_file(struct connection* p_conn);
+/*
+	Reads and throws away size bytes of content from the socket.
+	Returns 0 on success and -1 on fail
+*/
+int skip_content(int socket, uint64_t size);
+/*
+	Sends the content (or a range of it, to resume an interrupted transfer) of a file stored on the
+	server. The request is: username, owner, file name, offset and length (0 means till the end).
+	The response is the result code, the total size of the file, the number of bytes which follow
+	and the raw bytes.
+*/
+void get_file(struct connection* p_conn);
+/*
+	Publishes a file of the requesting user. The request is: username, file name and description.
+	The file is added to the search index.
+*/
+void publish(int socket);
+/*
+	adds a published file to the search, owners and files indexes. When one of them can't take it
+	the file is removed from the others, so the caller can roll the storage back.
+	Returns 0 on success and -1 on fail
+*/
+int index_published_file(char* username, char* file_name, char* description);
+/*
+	Deletes a published file of the requesting user. The request is: username and file name.
+	The file is removed from the search index.
+*/
+void delete(int socket);
+/*
+	Finds published files which names or descriptions match the query using the search index. 
+	The request is: username, query and maximum number of results.
+*/
+void search(int socket);
+/*
+	Sends search results through the socket. First the number of results, then owner and
+	file name of each result.
+	Returns:
+	SEND_SEARCH_RESULTS_SUCCESS 			- success
+	SEND_SEARCH_RESULTS_ERR_NUM_OF_RESULTS 	- could not send number of results
+	SEND_SEARCH_RESULTS_ERR_OWNER 			- could not send owner
+	SEND_SEARCH_RESULTS_ERR_FILENAME 		- could not send file name
+*/
+int send_search_results(int socket, struct search_result* results, uint32_t num_of_results);
+/*
+	Finds connected users which published a file with the name using the owners index. The request
+	is: username and file name. The response is the result code followed by the same list as for
+	LIST_USERS.
+*/
+void who_has(int socket);
+/*
+	Announces that the requesting user serves chunks of a published file. The request is: 
+	username, file name, size, chunk size, number of chunks and the hash of every chunk.
+*/
+void announce(int socket);
+/*
+	Chooses connected peers to download the chunks of an announced file from, the least loaded
+	first. The request is: username, file name and maximum number of sources. The response is the
+	result code, size, chunk size, number of chunks, the hash of every chunk, the number of
+	sources and for each source: username, ip, port and the number of its active downloads.
+*/
+void get_sources(int socket);
+/*
+	Sends the description of the file and its sources through the socket.
+	Returns:
+	SEND_SOURCES_SUCCESS 			- success
+	SEND_SOURCES_ERR_FILE_INFO 		- could not send size, chunk size or number of chunks
+	SEND_SOURCES_ERR_CHUNK_HASH 	- could not send chunk hash
+	SEND_SOURCES_ERR_NUM_OF_SOURCES - could not send number of sources
+	SEND_SOURCES_ERR_SOURCE 		- could not send source
+*/
+int send_sources(int socket, struct file_sources* p_sources);
+/*
+	Sends the values of the server metrics. The request has no fields. The response is the
+	result code, the number of metrics and the name and the value of each metric.
+*/
+void send_metrics(int socket);
+/*
+	Sends the replication status of a replica. The request has no fields. The response is the
+	result code, 1 if the replica follows the primary and 0 if no, the sequence number of the
+	last change applied, the sequence number of the last change on the primary and the
+	replication lag in milliseconds.
+*/
+void send_replication_status(int socket);
+/*
+	Sends RESULT_READ_ONLY, the result of the requests a replica does not serve.
+*/
+void send_read_only(int socket);
+/*
+	Checks the requesting user for a sharding proxy. The request is: username. The result code is
+	USER_STATUS_NOT_REGISTERED or USER_STATUS_DISCONNECTED like the one of the other requests.
+*/
+void user_status(int socket);
+/*
+	Sends the usernames of all the registered users, so a sharding proxy can move the ones which
+	belong to another shard. The request has no fields. The response is the result code, the
+	number of users and the username of each.
+*/
+void shard_users(int socket);
+/*
+	adds a username to the usernames_list pointed by arg. Used with scan_users.
+*/
+void collect_username(char* username, void* arg);
+/*
+	Sends everything a sharding proxy needs to move the user to another shard. The request is:
+	username. The response is the result code, the ip and the port of the user (empty if it's not
+	connected), the number of its published files and the name and the description of each.
+*/
+void user_dump(int socket);
+/*
+	checks if the requesting user is registered, in the copy of the state when the server is a
+	replica. A user forwarded in SHARD_FANOUT was checked by the proxy already.
+	Returns 1 if the user is registered and 0 if no
+*/
+int lookup_registered(char* username);
+/*
+	checks if the requesting user is connected, in the copy of the state when the server is a
+	replica. A user forwarded in SHARD_FANOUT was checked by the proxy already.
+	Returns 1 if the user is connected and 0 if no
+*/
+int lookup_connected(char* username);
+/*
+	get_users_snapshot, from the copy of the state when the server is a replica.
+*/
+struct users_snapshot* lookup_users_snapshot();
+/*
+	get_user_files_list, from the copy of the state when the server is a replica. The list is
+	allocated in the arena.
+*/
+int lookup_user_files(char* username, char*** p_user_files, uint32_t* p_quantity,
+	struct arena* p_arena);
+/*
+	get_filtered_users_snapshot, from the copy of the state when the server is a replica.
+*/
+struct users_snapshot* lookup_filtered_users(struct name_filter* p_filter);
+/*
+	lists the files of the owner which match the filter in order, from the files index or from the
+	copy of the state when the server is a replica. The list is allocated in the arena.
+	Returns GET_USER_FILES_LIST_SUCCESS, GET_USER_FILES_LIST_ERR_NO_SUCH_USER or another
+	GET_USER_FILES_LIST_ERR_* code on fail
+*/
+int lookup_filtered_files(char* owner, struct name_filter* p_filter, char*** p_files,
+	uint32_t* p_quantity, struct arena* p_arena);
+/*
+	Ends the download of a file, so the sources chosen for it are not counted as loaded anymore.
+	The request is: username and file name.
+*/
+void release_sources(int socket);
+/*
+	Sends a number as a string through the socket.
+	Returns 0 on success and -1 on fail.
+*/
+int send_number(int socket, uint64_t number);
+/*
+	adds a connected owner to the owners_list pointed by arg. Used with owners_index_for_each.
+*/
+void collect_connected_owner(char* owner, void* arg);
+/*
+	adds a file found in the storage to the search and owners indexes. Used with scan_storage at
+	start up.
+*/
+void index_stored_file(char* username, char* file_name, char* description, void* arg);
+/*
+	checks if the file name can be used as a name of a file in the storage.
+	Returns 1 if yes 0 if no
+*/
+int is_filename_valid(char* file_name);
+/*
+	Reads a decimal number from the socket and puts its value where p_number points.
+	Returns 1 if a valid number was read and 0 if no
+*/
+int read_number(int socket, uint64_t* p_number);
+/*
+	Parses the decimal number in the string and puts its value where p_number points.
+	Returns 1 if the string is a valid number and 0 if no
+*/
+int parse_number(char* str_number, uint64_t* p_number);
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -212,22 +823,101 @@ int send_content_list(int socket, char** content_list, uint32_t num_of_files);
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 /*
 	mutex for preventing race condition during copying client socket description to a new thread.
+	It's written by the main thread and the new thread only, so it (like cond_csd and is_copied)
+	has its own cache line and the other request threads don't read it in the meantime.
 */
-pthread_mutex_t mutex_csd;
+pthread_mutex_t mutex_csd __attribute__((aligned(CACHE_LINE_SIZE)));
 /*
 	condition for waiting until the cliend socket descriptor is copied to a new thread
 */
-pthread_cond_t cond_csd;
+pthread_cond_t cond_csd __attribute__((aligned(CACHE_LINE_SIZE)));
 /*
 	used to check whether main thread should still wait for request thread (client socket not
 	yet copied)
 */
-int is_copied;
+int is_copied __attribute__((aligned(CACHE_LINE_SIZE)));
 /*
 	flat to mark if the programm should continue. if 1 then continue, if 0 then the main loop
 	should stop. It is set to 1 after pressing ctrl + c
 */
 int is_running = 1;
+/*
+	1 if the server was started with -u to take over from the running server.
+*/
+int is_upgrade;
+/*
+	port of the change feed when the server is a primary (-f), 0 if it's not.
+*/
+int feed_port;
+/*
+	1 if the server is a replica (-r) of the primary on primary_host:primary_port.
+*/
+int is_replica;
+char primary_host[256];
+char primary_port[MAX_NUMBER_LEN + 1];
+/*
+	length of the leases of the connected users in seconds (-l), 0 if they don't expire.
+*/
+int lease_seconds;
+/*
+	cpus to pin the threads to (-a), NULL if they are not pinned, and 1 if the threads allocate
+	their memory on their own NUMA node (-N), see placement.h.
+*/
+char* cpu_list;
+int is_node_local;
+/*
+	path of the configuration file (-c), NULL for the defaults, see config.h. listening_socket is
+	the socket accepting the connections, -1 till it's obtained.
+*/
+char* config_file_path;
+int listening_socket = -1;
+/*
+	port of the UDP fast path of HEARTBEAT and PRESENCE (-U), 0 if there is none.
+*/
+int udp_port;
+/*
+	1 if the server was started with -M to convert the storage to the fan-out layout and exit.
+*/
+int is_migration;
+/*
+	1 if the server was started with -D to share the equal descriptions and content written
+	before the blob store (see blob_store.h) and exit.
+*/
+int is_dedup;
+/*
+	1 if the server is a sharding proxy (-s) in front of the shards in the comma separated
+	shards_list. With -m the users are moved to their shards before the requests are accepted.
+*/
+int is_proxy;
+int is_rebalance;
+char* shards_list;
+/*
+	1 while the request of the thread was forwarded in SHARD_FANOUT, so the requesting user is not
+	checked again.
+*/
+__thread int is_requester_checked;
+/*
+	1 while the request of the thread was forwarded by a sharding proxy (SHARD or SHARD_FANOUT).
+*/
+__thread int is_forwarded;
+/*
+	memory of the request of the thread, e.g. the lists sent in the response. It's reset after
+	every request and freed when the connection is closed.
+*/
+__thread struct arena request_arena;
+/*
+	1 when the request of the thread could not be parsed, so its fields which were not read can't
+	be told from the next request and the connection is closed after the response.
+*/
+__thread int is_request_malformed;
+/*
+	open connections, protected by mutex_connections. cond_connections is signaled when the last
+	one is closed. After is_draining is set no new request is read.
+*/
+pthread_mutex_t mutex_connections = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t cond_connections = PTHREAD_COND_INITIALIZER;
+struct connection* connections;
+int is_draining;
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -237,19 +927,60 @@ int is_running = 1;
 int main(int argc, char* argv[]) 
 {
 	int port = obtain_port(argc, argv);
-	port = process_obtain_port_result(port);
 
-	// TODO obtain local ip address
-	char addr[] = "192.168.0.102";	// just temporary, needs to be changed
+	// the server would not be the one which was asked for
+	if (port == ERR_OPTIONS)
+	{
+		print_usage();
+		return -1;
+	}
 
-	printf("init server %s:%d\n", addr, port);
+	int init_config_res = init_config(config_file_path, apply_config);
+	if (init_config_res != INIT_CONFIG_SUCCESS)
+	{
+		printf("ERROR main - could not initialize configuration. Code: %d\n", init_config_res);
+		return -1;
+	}
 
-	// initialize the main socket
-	int server_socket = -1;
-	int init_socket_res = init_socket(port, &server_socket);
-	if (init_socket_res != 0)
+	// the storage, the content, the blobs, the trash and the handoff socket are relative to it
+	const struct config* p_config = get_config();
+	if (p_config->data_dir[0] != '\0' && chdir(p_config->data_dir) != 0)
+	{
+		perror("ERROR main - could not change to the data directory");
+		return -1;
+	}
+
+	// offline, no server may use the storage meanwhile
+	if (is_migration)
+	{
+		uint32_t num_of_moved = 0;
+		int migrate_storage_res = migrate_storage(&num_of_moved);
+		if (migrate_storage_res != MIGRATE_STORAGE_SUCCESS)
+		{
+			printf("ERROR main - could not migrate the storage. Code: %d\n", 
+				migrate_storage_res);
+			return -1;
+		}
+		printf("moved %u users to the fan-out storage layout\n", num_of_moved);
+		return 0;
+	}
+
+	if (is_dedup)
+		return dedup_data();
+
+	// without -p the port of the configuration
+	if (port == 0)
+		port = p_config->port;
+	port = process_obtain_port_result(port);
+
+	printf("init server %s:%d\n", p_config->address[0] != '\0' ? p_config->address : "0.0.0.0",
+		port);
+
+	int init_placement_res = init_placement(cpu_list, is_node_local);
+	if (init_placement_res != INIT_PLACEMENT_SUCCESS)
 	{
-		process_init_socket_error(init_socket_res, server_socket);
+		printf("ERROR main - could not initialize thread placement. Code: %d\n", 
+			init_placement_res);
 		return -1;
 	}
 
@@ -270,38 +1001,283 @@ int main(int argc, char* argv[])
 		printf("ERROR main - could not initialize user dao. Code: %d\n", init_user_dao_res);
 		return -1;
 	}
-	
-	// start waiting for requests
-	struct sockaddr_in client_addr;
-	int client_socket;
-    socklen_t clinet_addr_size = sizeof(struct sockaddr_in);
 
-	// start detecting ctrl + c
-	if (!start_listening_sigint())
+	int init_blob_store_res = init_blob_store();
+	if (init_blob_store_res != INIT_BLOB_STORE_SUCCESS)
+	{
+		printf("ERROR main - could not initialize blob store. Code: %d\n", init_blob_store_res);
 		return -1;
+	}
 
-    while (is_running)
-    {
-        // accept connection from a client
-        client_socket = accept(server_socket, (struct sockaddr*) &client_addr, &clinet_addr_size);
-
-		if (client_socket >= 0)
-		{
-			if (pthread_create(&t_request, &attr_req_thread, manage_request, (void*) &client_socket) != 0)
-				perror("ERROR main - could not create request thread");
-
-			if (wait_till_socket_copying_is_done() != 0)
-				return -1;
-		}
-		else if (errno != EINTR) // if EINTR then ctrl+c was pressed, finish
-		{
-			perror("ERROR main - could not accept request from socket");
-			return -1;
-		}
-    }
-	
-	return clean_up(server_socket, &attr_req_thread);
-}
+	int init_reclaimer_res = init_reclaimer();
+	if (init_reclaimer_res != INIT_RECLAIMER_SUCCESS)
+	{
+		printf("ERROR main - could not initialize reclaimer. Code: %d\n", init_reclaimer_res);
+		return -1;
+	}
+
+	int init_file_store_res = init_file_store();
+	if (init_file_store_res != INIT_FILE_STORE_SUCCESS)
+	{
+		printf("ERROR main - could not initialize file store. Code: %d\n", init_file_store_res);
+		return -1;
+	}
+
+	int init_connected_users_res = init_connected_users();
+	if (init_connected_users_res != INIT_CONNECTED_USERS_SUCCESS)
+	{
+		printf("ERROR main - could not initialize connected users. Code: %d\n", 
+			init_connected_users_res);
+		return -1;
+	}
+
+	int init_owners_index_res = init_owners_index();
+	if (init_owners_index_res != INIT_OWNERS_INDEX_SUCCESS)
+	{
+		printf("ERROR main - could not initialize owners index. Code: %d\n", init_owners_index_res);
+		return -1;
+	}
+
+	int init_files_index_res = init_files_index();
+	if (init_files_index_res != INIT_FILES_INDEX_SUCCESS)
+	{
+		printf("ERROR main - could not initialize files index. Code: %d\n", init_files_index_res);
+		return -1;
+	}
+
+	int init_tracker_res = init_tracker();
+	if (init_tracker_res != INIT_TRACKER_SUCCESS)
+	{
+		printf("ERROR main - could not initialize tracker. Code: %d\n", init_tracker_res);
+		return -1;
+	}
+
+	int init_compression_res = init_compression(p_config->cached_listings);
+	if (init_compression_res != INIT_COMPRESSION_SUCCESS)
+	{
+		printf("ERROR main - could not initialize compression. Code: %d\n", init_compression_res);
+		return -1;
+	}
+
+	int init_worker_pool_res = init_worker_pool(p_config->workers);
+	if (init_worker_pool_res != INIT_WORKER_POOL_SUCCESS)
+	{
+		printf("ERROR main - could not initialize worker pool. Code: %d\n", init_worker_pool_res);
+		return -1;
+	}
+
+	int init_subscriptions_res = init_subscriptions();
+	if (init_subscriptions_res != INIT_SUBSCRIPTIONS_SUCCESS)
+	{
+		printf("ERROR main - could not initialize subscriptions. Code: %d\n", 
+			init_subscriptions_res);
+		return -1;
+	}
+
+	int init_search_index_res = init_search_index();
+	if (init_search_index_res != INIT_SEARCH_INDEX_SUCCESS)
+	{
+		printf("ERROR main - could not initialize search index. Code: %d\n", init_search_index_res);
+		return -1;
+	}
+
+	int init_timer_wheel_res = init_timer_wheel();
+	if (init_timer_wheel_res != INIT_TIMER_WHEEL_SUCCESS)
+	{
+		printf("ERROR main - could not initialize timer wheel. Code: %d\n", init_timer_wheel_res);
+		return -1;
+	}
+
+	int init_admission_res = init_admission();
+	if (init_admission_res != INIT_ADMISSION_SUCCESS)
+	{
+		printf("ERROR main - could not initialize admission control. Code: %d\n", 
+			init_admission_res);
+		return -1;
+	}
+
+	// obtain the main socket, when taking over it waits till the running server is drained
+	int server_socket = -1;
+	if (obtain_server_socket(port, &server_socket) != 0)
+		return -1;
+	__atomic_store_n(&listening_socket, server_socket, __ATOMIC_RELEASE);
+
+	// a replica serves only the copy of the state it gets from the primary
+	int handoff_socket = -1;
+	if (is_replica)
+	{
+		int init_replica_res = init_replica(primary_host, primary_port);
+		if (init_replica_res != INIT_REPLICA_SUCCESS)
+		{
+			printf("ERROR main - could not initialize replica. Code: %d\n", init_replica_res);
+			return -1;
+		}
+		printf("replica of %s:%s\n", primary_host, primary_port);
+	}
+	else
+	{
+		if (is_proxy)
+		{
+			// a proxy keeps no users, they are on the shards
+			int init_shard_proxy_res = init_shard_proxy(shards_list);
+			if (init_shard_proxy_res != INIT_SHARD_PROXY_SUCCESS)
+			{
+				printf("ERROR main - could not initialize sharding proxy. Code: %d\n", 
+					init_shard_proxy_res);
+				return -1;
+			}
+			printf("sharding proxy of %s\n", shards_list);
+
+			if (is_rebalance)
+			{
+				uint32_t num_of_moved = 0;
+				int rebalance_res = shard_proxy_rebalance(&num_of_moved);
+				if (rebalance_res != SHARD_PROXY_REBALANCE_SUCCESS)
+				{
+					printf("ERROR main - could not rebalance shards. Code: %d\n", rebalance_res);
+					return -1;
+				}
+				printf("moved %u users to their shards\n", num_of_moved);
+			}
+		}
+		else
+		{
+			// build the indexes from the files already published
+			int scan_storage_res = scan_storage(index_stored_file, NULL);
+			if (scan_storage_res != SCAN_STORAGE_SUCCESS)
+			{
+				printf("ERROR main - could not index the storage. Code: %d\n", scan_storage_res);
+				return -1;
+			}
+
+			// the users taken over from the previous process get a full lease
+			int init_leases_res = init_leases((uint64_t) lease_seconds * 1000, expire_lease);
+			if (init_leases_res != INIT_LEASES_SUCCESS)
+			{
+				printf("ERROR main - could not initialize leases. Code: %d\n", init_leases_res);
+				return -1;
+			}
+		}
+
+		// after the handoff, the previous process does not use the port anymore
+		if (feed_port != 0)
+		{
+			int init_change_feed_res = init_change_feed(feed_port);
+			if (init_change_feed_res != INIT_CHANGE_FEED_SUCCESS)
+			{
+				printf("ERROR main - could not initialize change feed. Code: %d\n", 
+					init_change_feed_res);
+				return -1;
+			}
+			printf("change feed on port %d\n", feed_port);
+		}
+
+		// the same as for the change feed
+		if (udp_port != 0)
+		{
+			int init_udp_presence_res = init_udp_presence(udp_port);
+			if (init_udp_presence_res != INIT_UDP_PRESENCE_SUCCESS)
+			{
+				printf("ERROR main - could not initialize UDP presence. Code: %d\n", 
+					init_udp_presence_res);
+				return -1;
+			}
+			printf("heartbeats and presence on UDP port %d\n", udp_port);
+		}
+	
+		// the next server process can take over through the handoff socket
+		int handoff_listen_res = handoff_listen(&handoff_socket);
+		if (handoff_listen_res != HANDOFF_LISTEN_SUCCESS)
+			printf("ERROR main - could not listen for handoff, restarts will drop connections. "
+				"Code: %d\n", handoff_listen_res);
+	}
+
+	// the threads started so far are left to the scheduler, the accepting one is placed like the
+	// request threads
+	placement_place_thread();
+
+	// start waiting for requests
+	struct request_data req_data;
+    socklen_t clinet_addr_size = sizeof(struct sockaddr_in);
+	struct pollfd poll_fds[2];
+	poll_fds[0].fd = server_socket;
+	poll_fds[0].events = POLLIN;
+	poll_fds[1].fd = handoff_socket;
+	poll_fds[1].events = POLLIN;
+	int handoff_connection = -1;
+
+	// start detecting ctrl + c
+	if (!start_listening_sigint())
+		return -1;
+
+	// writing to a connection which was shut down (by the client or a deadline) must only fail
+	signal(SIGPIPE, SIG_IGN);
+
+    while (is_running)
+    {
+		if (poll(poll_fds, handoff_socket >= 0 ? 2 : 1, -1) < 0)
+		{
+			if (errno == EINTR)	// ctrl+c was pressed, finish
+				continue;
+			perror("ERROR main - could not poll sockets");
+			return -1;
+		}
+
+		// a new server process takes over, stop accepting connections
+		if (handoff_socket >= 0 && (poll_fds[1].revents & POLLIN) 
+			&& (handoff_connection = accept(handoff_socket, NULL, NULL)) >= 0)
+		{
+			if (hand_off(handoff_connection, server_socket) == 0)
+				break;
+
+			// the new process failed, keep serving
+			handoff_connection = -1;
+			continue;
+		}
+
+		if (!(poll_fds[0].revents & POLLIN))
+			continue;
+
+        // accept connection from a client
+		clinet_addr_size = sizeof(struct sockaddr_in);
+        req_data.socket = accept(server_socket, (struct sockaddr*) &req_data.client_addr, 
+			&clinet_addr_size);
+
+		if (req_data.socket >= 0)
+		{
+			// too many connections, reject without creating a thread
+			if (admission_enter_connection() != ADMISSION_SUCCESS)
+			{
+				metrics_increment(METRIC_CONNECTIONS_BUSY);
+				send_busy(req_data.socket);
+				close(req_data.socket);
+			}
+			else if (pthread_create(&t_request, &attr_req_thread, manage_request, 
+				(void*) &req_data) != 0)
+			{
+				perror("ERROR main - could not create request thread");
+				admission_leave_connection();
+				send_busy(req_data.socket);
+				close(req_data.socket);
+			}
+			else if (wait_till_socket_copying_is_done() != 0)
+				return -1;
+		}
+		else if (errno != EINTR) // if EINTR then ctrl+c was pressed, finish
+		{
+			perror("ERROR main - could not accept request from socket");
+			return -1;
+		}
+    }
+
+	if (handoff_socket >= 0)
+		close(handoff_socket);
+
+	if (handoff_connection < 0 && handoff_socket >= 0)
+		unlink(HANDOFF_SOCKET_PATH);	// the new process creates its own
+	
+	return clean_up(server_socket, &attr_req_thread);
+}
 
 
 
@@ -310,21 +1286,87 @@ int obtain_port(int argc, char* argv[])
 	int  option = 0;
 	char port[256]= "";
 
-	while ((option = getopt(argc, argv,"p:")) != -1) 
+	while ((option = getopt(argc, argv,"p:uf:r:s:ml:a:NMDc:U:")) != -1) 
 	{
 		switch (option) 
 		{
 			case 'p' : 
 				strcpy(port, optarg);
 				break;
+			case 'u' :
+				is_upgrade = 1;
+				break;
+			case 'f' :
+				if (sscanf(optarg, "%d", &feed_port) != 1 || feed_port < MIN_PORT_NUMBER 
+					|| feed_port > MAX_PORT_NUMBER)
+					return ERR_OPTIONS;
+				break;
+			case 'r' :
+				// host:port of the primary's change feed
+				if (sscanf(optarg, "%255[^:]:%20s", primary_host, primary_port) != 2)
+					return ERR_OPTIONS;
+				is_replica = 1;
+				break;
+			case 's' :
+				// host:port,host:port... of the shards
+				shards_list = optarg;
+				is_proxy = 1;
+				break;
+			case 'm' :
+				is_rebalance = 1;
+				break;
+			case 'l' :
+				if (sscanf(optarg, "%d", &lease_seconds) != 1 || lease_seconds < 0
+					|| lease_seconds > MAX_LEASE_SECONDS)
+					return ERR_OPTIONS;
+				break;
+			case 'a' :
+				cpu_list = optarg;
+				break;
+			case 'N' :
+				is_node_local = 1;
+				break;
+			case 'M' :
+				is_migration = 1;
+				break;
+			case 'D' :
+				is_dedup = 1;
+				break;
+			case 'c' :
+				config_file_path = optarg;
+				break;
+			case 'U' :
+				if (sscanf(optarg, "%d", &udp_port) != 1 || udp_port < MIN_PORT_NUMBER 
+					|| udp_port > MAX_PORT_NUMBER)
+					return ERR_OPTIONS;
+				break;
 			default: 
-				return -1;
+				return ERR_OPTIONS;
 		    }
 	}
-	if (strcmp(port,"")==0){
+	// the configuration file may have the port
+	if (strcmp(port,"")==0 && config_file_path == NULL){
 		return -1;
 	}
 
+	// a replica has its own state, there is nothing to take over or to feed
+	if (is_replica && (is_upgrade || feed_port != 0))
+		return ERR_OPTIONS;
+
+	// a proxy has no state of its own, neither to feed nor to replicate
+	if (is_proxy && (is_replica || feed_port != 0))
+		return ERR_OPTIONS;
+
+	if (is_rebalance && !is_proxy)
+		return ERR_OPTIONS;
+
+	// only the server keeping the connected users gives leases and answers about them
+	if ((lease_seconds != 0 || udp_port != 0) && (is_replica || is_proxy))
+		return ERR_OPTIONS;
+
+	if (strcmp(port,"")==0)
+		return 0;
+
 	int res = -1;
 
 	// cast to int
@@ -352,7 +1394,85 @@ int process_obtain_port_result(int port)
 
 void print_usage() 
 {
-	printf("Usage: server -p <port [1024 - 49151]> \n");
+	printf("Usage: server [-c <configuration file>] -M (convert the storage to the fan-out layout "
+		"and exit) | -D (share the equal descriptions and content and exit)\n");
+	printf("Usage: server -p <port [1024 - 49151]> [-c <configuration file>] "
+		"[-u (take over from the running server)] "
+		"[-l <lease seconds> (disconnect users without HEARTBEAT)] "
+		"[-U <UDP port> (HEARTBEAT and PRESENCE over UDP)] "
+		"[-a <cpu>,<first cpu>-<last cpu>,... (pin the threads)] [-N (NUMA node-local memory)] "
+		"[-f <change feed port> (primary) | -r <primary host>:<change feed port> (replica) | "
+		"-s <shard host>:<shard port>,... (sharding proxy) [-m (move users to their shards)]]\n");
+}
+
+
+
+int dedup_data()
+{
+	// the layout must be the fan-out one, the storage is not used as a server meanwhile
+	int init_user_dao_res = init_user_dao();
+	int init_blob_store_res = init_blob_store();
+	int init_file_store_res = init_file_store();
+	if (init_user_dao_res != INIT_USER_DAO_SUCCESS || init_blob_store_res != INIT_BLOB_STORE_SUCCESS
+		|| init_file_store_res != INIT_FILE_STORE_SUCCESS)
+	{
+		printf("ERROR dedup_data - could not initialize the storage. Codes: %d, %d, %d\n",
+			init_user_dao_res, init_blob_store_res, init_file_store_res);
+		return -1;
+	}
+
+	uint32_t num_of_descriptions = 0;
+	uint32_t num_of_linked_descriptions = 0;
+	uint32_t num_of_contents = 0;
+	uint32_t num_of_linked_contents = 0;
+	int dedup_storage_res = dedup_storage(&num_of_descriptions, &num_of_linked_descriptions);
+	int dedup_content_res = dedup_content(&num_of_contents, &num_of_linked_contents);
+	destroy_user_dao();
+
+	if (dedup_storage_res != DEDUP_STORAGE_SUCCESS || dedup_content_res != DEDUP_CONTENT_SUCCESS)
+	{
+		printf("ERROR dedup_data - could not read the data. Codes: %d, %d\n", dedup_storage_res,
+			dedup_content_res);
+		return -1;
+	}
+
+	printf("linked %u of %u descriptions and %u of %u contents to shared blobs\n",
+		num_of_linked_descriptions, num_of_descriptions, num_of_linked_contents, num_of_contents);
+
+	return 0;
+}
+
+
+
+int obtain_server_socket(int port, int* p_server_socket)
+{
+	if (is_upgrade)
+	{
+		int handoff_receive_res = handoff_receive(p_server_socket);
+		if (handoff_receive_res == HANDOFF_RECEIVE_SUCCESS)
+		{
+			printf("took over from the running server\n");
+			return 0;
+		}
+
+		if (handoff_receive_res != HANDOFF_RECEIVE_ERR_CONNECT)
+		{
+			printf("ERROR obtain_server_socket - could not take over. Code: %d\n", 
+				handoff_receive_res);
+			return -1;
+		}
+
+		printf("no running server to take over from, starting a new one\n");
+	}
+
+	int init_socket_res = init_socket(port, p_server_socket);
+	if (init_socket_res != 0)
+	{
+		process_init_socket_error(init_socket_res, *p_server_socket);
+		return -1;
+	}
+
+	return 0;
 }
 
 
@@ -381,13 +1501,15 @@ int init_socket(int port, int* p_socket)
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = INADDR_ANY;
     server_addr.sin_port = htons(port);
+	if (get_config()->address[0] != '\0')
+		inet_pton(AF_INET, get_config()->address, &server_addr.sin_addr);
 
     // bind the socket to the address
     if (bind(sd, (struct sockaddr*) &server_addr, sizeof(server_addr)) == -1)
 		return ERR_SOCKET_BIND;
 
     // start listening on the socket
-    if (listen(sd, REQUESTS_QUEUE_SIZE) == -1)
+    if (listen(sd, get_config()->backlog) == -1)
 		return ERR_SOCKET_LISTEN;
 
 	return 0;
@@ -481,6 +1603,47 @@ int start_listening_sigint()
 
 
 
+void set_connection_options(int socket, const struct config* p_config)
+{
+	int no_delay = p_config->tcp_nodelay;
+	setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+	if (p_config->tcp_keepalive)
+	{
+		int keepalive = 1;
+		setsockopt(socket, SOL_SOCKET, SO_KEEPALIVE, &keepalive, sizeof(keepalive));
+
+		// 0 keeps the system default
+		if (p_config->tcp_keepalive_idle > 0)
+			setsockopt(socket, IPPROTO_TCP, TCP_KEEPIDLE, &p_config->tcp_keepalive_idle,
+				sizeof(int32_t));
+		if (p_config->tcp_keepalive_interval > 0)
+			setsockopt(socket, IPPROTO_TCP, TCP_KEEPINTVL, &p_config->tcp_keepalive_interval,
+				sizeof(int32_t));
+		if (p_config->tcp_keepalive_count > 0)
+			setsockopt(socket, IPPROTO_TCP, TCP_KEEPCNT, &p_config->tcp_keepalive_count,
+				sizeof(int32_t));
+	}
+
+	if (p_config->send_buffer_size > 0)
+		setsockopt(socket, SOL_SOCKET, SO_SNDBUF, &p_config->send_buffer_size, sizeof(int32_t));
+	if (p_config->receive_buffer_size > 0)
+		setsockopt(socket, SOL_SOCKET, SO_RCVBUF, &p_config->receive_buffer_size,
+			sizeof(int32_t));
+}
+
+
+
+void apply_config(const struct config* p_config)
+{
+	// listening again on a listening socket only changes its backlog
+	int server_socket = __atomic_load_n(&listening_socket, __ATOMIC_ACQUIRE);
+	if (server_socket >= 0 && listen(server_socket, p_config->backlog) != 0)
+		perror("ERROR apply_config - could not change the backlog");
+}
+
+
+
 int wait_till_socket_copying_is_done()
 {
 	if (pthread_mutex_lock(&mutex_csd) != 0)
@@ -513,6 +1676,9 @@ int wait_till_socket_copying_is_done()
 
 int clean_up(int server_socket, pthread_attr_t* p_attr)
 {
+	// no reload may touch the socket anymore
+	__atomic_store_n(&listening_socket, -1, __ATOMIC_RELEASE);
+
 	if (close(server_socket) != 0)
 	{
 		perror("ERROR clean up - could not close server_socket");
@@ -544,6 +1710,26 @@ int clean_up(int server_socket, pthread_attr_t* p_attr)
 		return -1;
 	}
 
+	destroy_reclaimer();
+	destroy_worker_pool();
+	destroy_subscriptions();
+	if (is_replica)
+		destroy_replica();
+	if (is_proxy)
+		destroy_shard_proxy();
+	destroy_change_feed();
+	destroy_udp_presence();
+	destroy_search_index();
+	destroy_owners_index();
+	destroy_files_index();
+	destroy_tracker();
+	destroy_leases();
+	destroy_connected_users();
+	destroy_compression();
+	destroy_admission();
+	destroy_timer_wheel();
+	destroy_config();
+
 	return 0;
 }
 
@@ -553,9 +1739,9 @@ int clean_up(int server_socket, pthread_attr_t* p_attr)
 // manage_request
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-void* manage_request(void* p_socket)
+void* manage_request(void* p_request_data)
 {
-	int socket = -1;
+	struct request_data req_data;
 
 	// lock the main thread until the socket is copied
 	if (pthread_mutex_lock(&mutex_csd) != 0)
@@ -564,7 +1750,20 @@ void* manage_request(void* p_socket)
 		return NULL;
 	}
 
-	memcpy(&socket, p_socket, sizeof(int));
+	memcpy(&req_data, p_request_data, sizeof(struct request_data));
+	int socket = req_data.socket;
+
+	// registered before the main thread goes on, so a drain started right after the accept
+	// sees this connection too
+	struct connection conn;
+	conn.socket = socket;
+	conn.client_addr = req_data.client_addr;
+	conn.deadline_kind = DEADLINE_IDLE;
+	conn.is_compressing = 0;
+	conn.p_subscriber = NULL;
+	init_timer(&conn.deadline, expire_connection, &conn);
+	register_connection(&conn);
+
 	is_copied = 1;
 	
 	// notify that socket was copied
@@ -574,58 +1773,407 @@ void* manage_request(void* p_socket)
 	if (pthread_mutex_unlock(&mutex_csd) != 0)
 		printf("ERROR manage_request - could not unlock mutex\n");
 
-	// process the request
+	// before the thread allocates anything, e.g. its arena
+	placement_place_thread();
+
+	set_connection_options(socket, get_config());
+
+	// process the requests till the client closes the connection
 	if (socket > 0)
-		identify_and_process_request(socket);
+		while (identify_and_process_request(&conn));
+
+	// the socket must not be shut down by the timer or the drain after it's closed
+	timer_wheel_cancel(&conn.deadline);
+	unregister_connection(&conn);
+	destroy_arena(&request_arena);
 
 	// close the client socket
 	if (close(socket) != 0)
 		perror("ERROR manage request - could not close client socket");
+	admission_leave_connection();
 
 	pthread_exit(NULL);
 }
 
 
 
-void identify_and_process_request(int socket)
+int identify_and_process_request(struct connection* p_conn)
 {
+	int socket = p_conn->socket;
+
+	set_deadline(p_conn, DEADLINE_IDLE, get_config()->idle_timeout_ms);
+
+	// the drain shuts down the idle connections after setting the flag, so either it sees this
+	// one as idle or this one sees the flag
+	if (__atomic_load_n(&is_draining, __ATOMIC_SEQ_CST))
+		return 0;
+
 	char req_type[MAX_REQ_TYPE_LEN + 1];
-	read_line(socket, req_type, MAX_REQ_TYPE_LEN);
+	if (read_line(socket, req_type, MAX_REQ_TYPE_LEN) <= 0)
+		return 0;	// connection closed by the client (or the deadline passed)
 	req_type[MAX_REQ_TYPE_LEN] = '\0'; // just in case if the request type is in wrong format
 
+	set_deadline(p_conn, DEADLINE_READ, get_config()->request_timeout_ms);
+	metrics_increment(METRIC_REQUESTS);
+
+	// a request forwarded by a sharding proxy is processed as if it came from the client
+	struct sockaddr_in client_addr = p_conn->client_addr;
+	is_forwarded = !is_proxy 
+		&& (strcmp(req_type, REQ_SHARD) == 0 || strcmp(req_type, REQ_SHARD_FANOUT) == 0);
+	is_requester_checked = 0;
+	if (is_forwarded)
+	{
+		is_requester_checked = strcmp(req_type, REQ_SHARD_FANOUT) == 0;
+
+		char client_ip[INET_ADDRSTRLEN];
+		if (read_line(socket, client_ip, INET_ADDRSTRLEN) <= 0
+			|| inet_pton(AF_INET, client_ip, &client_addr.sin_addr) != 1
+			|| read_line(socket, req_type, MAX_REQ_TYPE_LEN) <= 0)
+		{
+			printf("ERROR identify_and_process_request - wrong forwarded request format\n");
+			return 0;
+		}
+		req_type[MAX_REQ_TYPE_LEN] = '\0';
+	}
+
+	// reject before reading the rest of the request, the connection is closed so it does not
+	// have to be consumed
+	int admission_res = admission_enter_request(client_addr.sin_addr.s_addr);
+	if (admission_res != ADMISSION_SUCCESS)
+	{
+		metrics_increment(admission_res == ADMISSION_ERR_RATE_LIMITED ? 
+			METRIC_REQUESTS_RATE_LIMITED : METRIC_REQUESTS_BUSY);
+		send_busy(socket);
+		return 0;
+	}
+
+	is_request_malformed = 0;
+	int res = process_request(req_type, p_conn, &client_addr);
+	admission_leave_request();
+	arena_reset(&request_arena);
+
+	if (is_request_malformed)
+	{
+		discard_rest_of_request(socket);
+		return 0;
+	}
+
+	// a subscription keeps the connection, but it's not counted as a request in flight
+	if (p_conn->p_subscriber != NULL)
+		return stream_events(p_conn);
+
+	return res;
+}
+
+
+
+int process_request(char* req_type, struct connection* p_conn, 
+	struct sockaddr_in* p_client_addr)
+{
+	int socket = p_conn->socket;
+
+	if (is_proxy && strcmp(req_type, REQ_METRICS) != 0 
+		&& strcmp(req_type, REQ_REPLICATION_STATUS) != 0 
+		&& strcmp(req_type, REQ_ACCEPT_ENCODING) != 0)
+		return proxy_request(req_type, p_conn);
+
+	// the rest of the request is not read, so the connection is closed
+	if (is_replica && strcmp(req_type, REQ_LIST_USERS) != 0 
+		&& strcmp(req_type, REQ_LIST_CONTENT) != 0 && strcmp(req_type, REQ_METRICS) != 0
+		&& strcmp(req_type, REQ_LIST_CONTENT_MULTI) != 0
+		&& strcmp(req_type, REQ_LIST_USERS_FILTER) != 0
+		&& strcmp(req_type, REQ_LIST_CONTENT_FILTER) != 0
+		&& strcmp(req_type, REQ_REPLICATION_STATUS) != 0 
+		&& strcmp(req_type, REQ_ACCEPT_ENCODING) != 0)
+	{
+		send_read_only(socket);
+		discard_rest_of_request(socket);
+		return 0;
+	}
+
 	// process request type
 	if (strcmp(req_type, REQ_REGISTER) == 0)
 		register_user(socket);
 	else if (strcmp(req_type, REQ_UNREGISTER) == 0)
 		unregister(socket);
 	else if (strcmp(req_type, REQ_LIST_USERS) == 0)
-		list_users(socket);
+		list_users(p_conn);
 	else if (strcmp(req_type, REQ_LIST_CONTENT) == 0)
-		list_content(socket);
+		list_content(p_conn);
+	else if (strcmp(req_type, REQ_LIST_CONTENT_MULTI) == 0)
+		return list_content_multi(p_conn);
+	else if (strcmp(req_type, REQ_LIST_USERS_FILTER) == 0)
+		list_users_filter(p_conn);
+	else if (strcmp(req_type, REQ_LIST_CONTENT_FILTER) == 0)
+		list_content_filter(p_conn);
+	else if (strcmp(req_type, REQ_SUBSCRIBE) == 0)
+		return subscribe_request(p_conn);
+	else if (strcmp(req_type, REQ_PUT_FILE) == 0)
+		return put_file(p_conn);
+	else if (strcmp(req_type, REQ_GET_FILE) == 0)
+		get_file(p_conn);
+	else if (strcmp(req_type, REQ_PUBLISH) == 0)
+		publish(socket);
+	else if (strcmp(req_type, REQ_DELETE) == 0)
+		delete(socket);
+	else if (strcmp(req_type, REQ_SEARCH) == 0)
+		search(socket);
+	else if (strcmp(req_type, REQ_CONNECT) == 0)
+		connect_request(socket, p_client_addr);
+	else if (strcmp(req_type, REQ_DISCONNECT) == 0)
+		disconnect_request(socket);
+	else if (strcmp(req_type, REQ_HEARTBEAT) == 0)
+		heartbeat(socket);
+	else if (strcmp(req_type, REQ_WHO_HAS) == 0)
+		who_has(socket);
+	else if (strcmp(req_type, REQ_ANNOUNCE) == 0)
+		announce(socket);
+	else if (strcmp(req_type, REQ_GET_SOURCES) == 0)
+		get_sources(socket);
+	else if (strcmp(req_type, REQ_RELEASE_SOURCES) == 0)
+		release_sources(socket);
+	else if (strcmp(req_type, REQ_METRICS) == 0)
+		send_metrics(socket);
+	else if (strcmp(req_type, REQ_REPLICATION_STATUS) == 0)
+		send_replication_status(socket);
+	else if (strcmp(req_type, REQ_USER_STATUS) == 0)
+		user_status(socket);
+	else if (strcmp(req_type, REQ_SHARD_USERS) == 0)
+		shard_users(socket);
+	else if (strcmp(req_type, REQ_USER_DUMP) == 0)
+		user_dump(socket);
+	else if (strcmp(req_type, REQ_REGISTER_BATCH) == 0)
+		return register_batch(socket);
+	else if (strcmp(req_type, REQ_UNREGISTER_BATCH) == 0)
+		return unregister_batch(socket);
+	else if (strcmp(req_type, REQ_PUBLISH_BATCH) == 0)
+		return publish_batch(socket);
+	else if (strcmp(req_type, REQ_ACCEPT_ENCODING) == 0)
+		accept_encoding(p_conn);
 	else
-		printf("ERROR identify_and_process_request - no such request type\n");
-}
+	{
+		printf("ERROR process_request - no such request type\n");
+		return 0;
+	}
 
+	return 1;
+}
 
 
-///////////////////////////////////////////////////////////////////////////////////////////////////
-// register
-///////////////////////////////////////////////////////////////////////////////////////////////////
 
-void register_user(int socket)
+void discard_rest_of_request(int socket)
 {
-	uint8_t result = REGISTER_SUCCESS;
-	
-	char username[MAX_USERNAME_LEN + 1];
-	if (read_username(socket, username) > 0)	// username specified
-	{
-		if (is_username_valid(username))
-		{
-			int create_user_res = create_user(username);
+	shutdown(socket, SHUT_WR);
 
-			switch (create_user_res)
-			{
-				case CREATE_USER_SUCCESS 	: result = REGISTER_SUCCESS; break;
+	char rest[1024];
+	while (read(socket, rest, sizeof(rest)) > 0);
+}
+
+
+
+void set_deadline(struct connection* p_conn, int kind, uint64_t timeout_ms)
+{
+	__atomic_store_n(&p_conn->deadline_kind, kind, __ATOMIC_SEQ_CST);
+	timer_wheel_schedule(&p_conn->deadline, timeout_ms);
+}
+
+
+
+void expire_connection(void* p_connection)
+{
+	struct connection* p_conn = p_connection;
+
+	switch (__atomic_load_n(&p_conn->deadline_kind, __ATOMIC_SEQ_CST))
+	{
+		case DEADLINE_IDLE	: metrics_increment(METRIC_TIMEOUTS_IDLE); break;
+		case DEADLINE_READ	: metrics_increment(METRIC_TIMEOUTS_READ); break;
+		default				: metrics_increment(METRIC_TIMEOUTS_WRITE);
+	}
+
+	// don't close it here, the descriptor could be reused before the request thread notices
+	shutdown(p_conn->socket, SHUT_RDWR);
+}
+
+
+
+void register_connection(struct connection* p_conn)
+{
+	pthread_mutex_lock(&mutex_connections);
+
+	p_conn->p_prev = NULL;
+	p_conn->p_next = connections;
+	if (connections != NULL)
+		connections->p_prev = p_conn;
+	connections = p_conn;
+
+	pthread_mutex_unlock(&mutex_connections);
+}
+
+
+
+void unregister_connection(struct connection* p_conn)
+{
+	pthread_mutex_lock(&mutex_connections);
+
+	if (p_conn->p_prev != NULL)
+		p_conn->p_prev->p_next = p_conn->p_next;
+	else
+		connections = p_conn->p_next;
+	if (p_conn->p_next != NULL)
+		p_conn->p_next->p_prev = p_conn->p_prev;
+
+	if (connections == NULL)
+		pthread_cond_broadcast(&cond_connections);
+
+	pthread_mutex_unlock(&mutex_connections);
+}
+
+
+
+void add_drain_timeout(struct timespec* p_deadline)
+{
+	// the timeout is in milliseconds, a part of a second must not be dropped
+	int32_t timeout_ms = get_config()->drain_timeout_ms;
+	p_deadline->tv_sec += timeout_ms / 1000;
+	p_deadline->tv_nsec += (long) (timeout_ms % 1000) * 1000000L;
+	if (p_deadline->tv_nsec >= 1000000000L)
+	{
+		p_deadline->tv_sec++;
+		p_deadline->tv_nsec -= 1000000000L;
+	}
+}
+
+
+
+void drain_connections()
+{
+	pthread_mutex_lock(&mutex_connections);
+
+	__atomic_store_n(&is_draining, 1, __ATOMIC_SEQ_CST);
+
+	// nobody waits for a response on the idle connections
+	for (struct connection* p_conn = connections; p_conn != NULL; p_conn = p_conn->p_next)
+	{
+		if (__atomic_load_n(&p_conn->deadline_kind, __ATOMIC_SEQ_CST) == DEADLINE_IDLE)
+			shutdown(p_conn->socket, SHUT_RDWR);
+	}
+
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	add_drain_timeout(&deadline);
+
+	while (connections != NULL)
+	{
+		if (pthread_cond_timedwait(&cond_connections, &mutex_connections, &deadline) != ETIMEDOUT)
+			continue;
+
+		// the requests which are still in flight (e.g. long transfers) are interrupted
+		for (struct connection* p_conn = connections; p_conn != NULL; p_conn = p_conn->p_next)
+			shutdown(p_conn->socket, SHUT_RDWR);
+		add_drain_timeout(&deadline);
+	}
+
+	pthread_mutex_unlock(&mutex_connections);
+}
+
+
+
+void resume_connections()
+{
+	pthread_mutex_lock(&mutex_connections);
+	__atomic_store_n(&is_draining, 0, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&mutex_connections);
+}
+
+
+
+int hand_off(int handoff_connection, int server_socket)
+{
+	printf("handing off to the new server process\n");
+	drain_connections();
+	// the replicas start over with the new process, which needs the ports
+	destroy_change_feed();
+	destroy_udp_presence();
+
+	int handoff_send_res = handoff_send(handoff_connection, server_socket);
+	close(handoff_connection);
+	if (handoff_send_res == HANDOFF_SEND_SUCCESS)
+		return 0;
+
+	printf("ERROR hand_off - could not hand off, serving on. Code: %d\n", handoff_send_res);
+	resume_connections();
+
+	int init_change_feed_res = feed_port != 0 ? init_change_feed(feed_port) 
+		: INIT_CHANGE_FEED_SUCCESS;
+	if (init_change_feed_res != INIT_CHANGE_FEED_SUCCESS)
+		printf("ERROR hand_off - could not restart change feed. Code: %d\n", 
+			init_change_feed_res);
+
+	int init_udp_presence_res = udp_port != 0 ? init_udp_presence(udp_port) 
+		: INIT_UDP_PRESENCE_SUCCESS;
+	if (init_udp_presence_res != INIT_UDP_PRESENCE_SUCCESS)
+		printf("ERROR hand_off - could not restart UDP presence. Code: %d\n", 
+			init_udp_presence_res);
+
+	return -1;
+}
+
+
+
+uint64_t transfer_timeout_ms(uint64_t size)
+{
+	const struct config* p_config = get_config();
+
+	// a size whose time does not fit gets the longest deadline rather than a wrapped one
+	uint64_t seconds = size / p_config->min_transfer_rate;
+	if (seconds > (UINT64_MAX - p_config->request_timeout_ms) / 1000 - 1)
+		return UINT64_MAX;
+
+	return p_config->request_timeout_ms + seconds * 1000 
+		+ size % p_config->min_transfer_rate * 1000 / p_config->min_transfer_rate;
+}
+
+
+
+void send_busy(int socket)
+{
+	char response[2];
+	response[0] = RESULT_BUSY;
+	response[1] = '\0';
+
+	if (send_msg(socket, response, 2) != 0)
+		printf("ERROR send_busy - could not send message\n");
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// register
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void register_user(int socket)
+{
+	uint8_t result = REGISTER_SUCCESS;
+	
+	char username[MAX_USERNAME_LEN + 1];
+	if (read_username(socket, username) > 0)	// username specified
+	{
+		if (is_username_valid(username))
+		{
+			change_feed_lock_user(username);
+
+			int create_user_res = create_user(username);
+			if (create_user_res == CREATE_USER_SUCCESS)
+			{
+				char* fields[] = {username};
+				change_feed_append(FEED_REGISTER, fields, 1);
+			}
+
+			change_feed_unlock_user(username);
+
+			switch (create_user_res)
+			{
+				case CREATE_USER_SUCCESS 	: result = REGISTER_SUCCESS; break;
 				case CREATE_USER_ERR_EXISTS : result = REGISTER_NON_UNIQUE_USERNAME; break;
 				default : 
 					result = REGISTER_OTHER_ERROR;
@@ -681,21 +2229,37 @@ void unregister(int socket)
 	uint8_t res = UNREGISTER_SUCCESS;
 
 	char username[MAX_USERNAME_LEN + 1];
-	if (read_username(socket, username) > 0)	// username specified
+	if (read_username(socket, username) <= 0)
+	{
+		printf("ERROR unregister - no username specified\n");
+		res = UNREGISTER_OTHER_ERROR;
+	}
+	else if (!is_username_valid(username))	// no such user can be registered
+		res = UNREGISTER_NO_SUCH_USER;
+	else
 	{
+		change_feed_lock_user(username);
+
+		// the names of the files are needed to clean the owners index
+		char** files = NULL;
+		uint32_t num_of_files = 0;
+		if (get_user_files_list(username, &files, &num_of_files, &request_arena) 
+			!= GET_USER_FILES_LIST_SUCCESS)
+			num_of_files = 0;
+
 		int delete_res = delete_user(username);
 
 		switch (delete_res)
 		{
-			case DELETE_USER_SUCCESS 		: res = UNREGISTER_SUCCESS; break;
+			case DELETE_USER_SUCCESS 		: 
+				res = UNREGISTER_SUCCESS;
+				forget_unregistered_user(username, files, num_of_files);
+				break;
 			case DELETE_USER_ERR_NOT_EXISTS : res = UNREGISTER_NO_SUCH_USER; break;
 			default							: res = UNREGISTER_OTHER_ERROR; 
 		}
-	}
-	else
-	{
-		printf("ERROR unregister - no username specified\n");
-		res = UNREGISTER_OTHER_ERROR;
+
+		change_feed_unlock_user(username);
 	}
 	
 	char response[2];
@@ -708,16 +2272,171 @@ void unregister(int socket)
 
 
 
-//////////////////////////////////////////////////////////////////////////////////////////////////
-// is_connected
+void forget_unregistered_user(char* username, char** files, uint32_t num_of_files)
+{
+	search_index_remove_owner(username);
+	files_index_remove_owner(username);
+	for (uint32_t i = 0; i < num_of_files; i++)
+	{
+		owners_index_remove(files[i], username);
+		tracker_remove_peer(files[i], username);
+		notify_subscribers(SUBSCRIPTION_EVENT_DELETE, username, files[i]);
+	}
+	disconnect_user(username);
+	if (delete_user_content(username) != DELETE_USER_CONTENT_SUCCESS)
+		printf("ERROR forget_unregistered_user - could not delete relayed content\n");
+
+	char* fields[] = {username};
+	change_feed_append(FEED_UNREGISTER, fields, 1);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// connect
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-int is_connected(char* username)
+void connect_request(int socket, struct sockaddr_in* p_client_addr)
 {
-	// TODO IMPLEMENT
-	printf("NOT YET IMPLEMENTED is_connected\n");
+	uint8_t res = CONNECT_SUCCESS;
+	char username[MAX_USERNAME_LEN + 1];
+	uint64_t port = 0;
 
-	return 1;
+	if (read_username(socket, username) > 0 && read_number(socket, &port) && port <= 65535)
+	{
+		char ip[MAX_IP_ADDR_LEN + 1];
+		char str_port[MAX_PORT_LEN + 1];
+		inet_ntop(AF_INET, &p_client_addr->sin_addr, ip, sizeof(ip));
+		sprintf(str_port, "%u", (unsigned int) port);
+
+		// checked under the lock, so UNREGISTER can't come between the check and the connect
+		change_feed_lock_user(username);
+
+		if (!is_registered(username))
+			res = CONNECT_NO_SUCH_USER;
+		else
+		{
+			switch (connect_user(username, ip, str_port))
+			{
+				case CONNECT_USER_SUCCESS 				: res = CONNECT_SUCCESS; break;
+				case CONNECT_USER_ERR_ALREADY_CONNECTED : res = CONNECT_ALREADY_CONNECTED; break;
+				default 								: res = CONNECT_OTHER_ERROR;
+			}
+		}
+
+		if (res == CONNECT_SUCCESS)
+		{
+			char* fields[] = {username, ip, str_port};
+			change_feed_append(FEED_CONNECT, fields, 3);
+		}
+
+		change_feed_unlock_user(username);
+	}
+	else
+	{
+		printf("ERROR connect_request - wrong request format\n");
+		res = CONNECT_OTHER_ERROR;
+		is_request_malformed = 1;
+	}
+
+	char response[2];
+	response[0] = res;
+	response[1] = '\0';
+
+	if (send_msg(socket, response, 2) != 0)
+		printf("ERROR connect_request - could not send response\n");
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// disconnect
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void disconnect_request(int socket)
+{
+	uint8_t res = DISCONNECT_SUCCESS;
+	char username[MAX_USERNAME_LEN + 1];
+
+	if (read_username(socket, username) > 0)
+	{
+		change_feed_lock_user(username);
+
+		if (!is_registered(username))
+			res = DISCONNECT_NO_SUCH_USER;
+		else if (disconnect_user(username) != DISCONNECT_USER_SUCCESS)
+			res = DISCONNECT_NOT_CONNECTED;
+		else
+		{
+			char* fields[] = {username};
+			change_feed_append(FEED_DISCONNECT, fields, 1);
+		}
+
+		change_feed_unlock_user(username);
+	}
+	else
+	{
+		printf("ERROR disconnect_request - no username specified\n");
+		res = DISCONNECT_OTHER_ERROR;
+	}
+
+	char response[2];
+	response[0] = res;
+	response[1] = '\0';
+
+	if (send_msg(socket, response, 2) != 0)
+		printf("ERROR disconnect_request - could not send response\n");
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// heartbeat
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void heartbeat(int socket)
+{
+	uint8_t res = HEARTBEAT_SUCCESS;
+	char username[MAX_USERNAME_LEN + 1];
+
+	if (read_username(socket, username) > 0)
+	{
+		if (renew_lease(username) != RENEW_LEASE_SUCCESS)
+			res = is_registered(username) ? HEARTBEAT_DISCONNECTED : HEARTBEAT_NO_SUCH_USER;
+	}
+	else
+	{
+		printf("ERROR heartbeat - no username specified\n");
+		res = HEARTBEAT_OTHER_ERROR;
+	}
+
+	char response[2];
+	response[0] = res;
+	response[1] = '\0';
+
+	if (send_msg(socket, response, 2) != 0)
+		printf("ERROR heartbeat - could not send response\n");
+}
+
+
+
+void expire_lease(char* username)
+{
+	change_feed_lock_user(username);
+
+	if (is_lease_expired(username) && disconnect_user(username) == DISCONNECT_USER_SUCCESS)
+	{
+		metrics_increment(METRIC_LEASES_EXPIRED);
+
+		// the feed dropped a user which is not registered anymore with its UNREGISTER
+		if (is_registered(username))
+		{
+			char* fields[] = {username};
+			change_feed_append(FEED_DISCONNECT, fields, 1);
+		}
+	}
+
+	change_feed_unlock_user(username);
 }
 
 
@@ -726,19 +2445,23 @@ int is_connected(char* username)
 // list_users
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-void list_users(int socket)
+void list_users(struct connection* p_conn)
 {
+	int socket = p_conn->socket;
 	uint8_t res = LIST_USERS_SUCCESS;
-	user* users_list = NULL;
-	uint32_t num_of_users = 0;
+	struct users_snapshot* p_snapshot = NULL;
 
 	char username[MAX_USERNAME_LEN + 1];
 	if (read_username(socket, username) > 0) // if user specified
 	{
-		if (is_registered(username))
+		if (lookup_registered(username))
 		{
-			if (is_connected(username))
-				num_of_users = get_connected_users_list(&users_list);
+			if (lookup_connected(username))
+			{
+				p_snapshot = lookup_users_snapshot();
+				if (p_snapshot == NULL)
+					res = LIST_USERS_OTHER_ERROR;
+			}
 			else
 				res = LIST_USERS_DISCONNECTED;
 		}
@@ -751,57 +2474,81 @@ void list_users(int socket)
 		res = LIST_USERS_OTHER_ERROR;
 	}
 
-	// send result
-	char response_res_code[2];
-	response_res_code[0] = res;
-	response_res_code[1] = '\0';
+	send_users_snapshot(p_conn, res, p_snapshot);
+	release_users_snapshot(p_snapshot);
+}
 
-	if (send_msg(socket, response_res_code, 2) == 0)
-	{
-		if (res == LIST_USERS_SUCCESS)
-		{
-			int send_res = send_users_list(socket, users_list, num_of_users);
 
-			if (send_res != SEND_USERS_LIST_SUCCESS)
-				printf("ERROR list_users - could not send users. Code: %d\n", send_res);
-		}
+
+void list_users_filter(struct connection* p_conn)
+{
+	int socket = p_conn->socket;
+	uint8_t res = LIST_USERS_SUCCESS;
+	struct users_snapshot* p_snapshot = NULL;
+	struct name_filter filter;
+
+	// all the fields are read first, so a wrong request does not leave them in the connection
+	char username[MAX_USERNAME_LEN + 1];
+	char filter_type[MAX_FILTER_TYPE_LEN + 1];
+	char first[MAX_USERNAME_LEN + 1];
+	char second[MAX_USERNAME_LEN + 1];
+	int is_read = read_username(socket, username) >= 0 
+		&& read_line(socket, filter_type, MAX_FILTER_TYPE_LEN + 1) >= 0
+		&& read_line(socket, first, MAX_USERNAME_LEN + 1) >= 0 
+		&& read_line(socket, second, MAX_USERNAME_LEN + 1) >= 0;
+
+	if (!is_read || username[0] == '\0' 
+		|| parse_name_filter(filter_type, first, second, &filter) != PARSE_NAME_FILTER_SUCCESS)
+	{
+		printf("ERROR list_users_filter - wrong request format\n");
+		res = LIST_USERS_OTHER_ERROR;
+		is_request_malformed = !is_read;
 	}
-	else
-		printf("ERROR list_users - could not send response\n");
+	else if (!lookup_registered(username))
+		res = LIST_USERS_NO_SUCH_USER;
+	else if (!lookup_connected(username))
+		res = LIST_USERS_DISCONNECTED;
+	else if ((p_snapshot = lookup_filtered_users(&filter)) == NULL)
+		res = LIST_USERS_OTHER_ERROR;
 
-	if (users_list != NULL)
-		free(users_list);
+	send_users_snapshot(p_conn, res, p_snapshot);
+	release_users_snapshot(p_snapshot);
 }
 
 
 
-uint32_t get_connected_users_list(user** p_users_list)
+void send_users_snapshot(struct connection* p_conn, uint8_t res, 
+	struct users_snapshot* p_snapshot)
 {
-	// TODO do real implementation
-	printf("NOT YET IMPLEMENTED get_connected_users_list\n");
-	
-	user* users = malloc(3 * sizeof(user));
-
-	strcpy(users[0].username, "user1");
-	strcpy(users[0].ip, "87.43.21.1");
-	strcpy(users[0].port, "59000");
+	int socket = p_conn->socket;
 
-	strcpy(users[1].username, "user2");
-	strcpy(users[1].ip, "87.43.21.2");
-	strcpy(users[1].port, "59001");
-
-	strcpy(users[2].username, "user3");
-	strcpy(users[2].ip, "87.43.21.3");
-	strcpy(users[2].port, "59003");
+	// send result, a cached snapshot is shared with the other readers and sent as it is
+	char response_res_code[2];
+	response_res_code[0] = res;
+	response_res_code[1] = '\0';
 
-	*p_users_list = users;
+	struct iovec response[2];
+	response[0].iov_base = response_res_code;
+	response[0].iov_len = 2;
+	response[1].iov_base = p_snapshot != NULL ? p_snapshot->data : NULL;
+	response[1].iov_len = p_snapshot != NULL ? p_snapshot->len : 0;
 
-	return 3;
+	if (res == LIST_USERS_SUCCESS && p_conn->is_compressing)
+	{
+		// compressed once for all the readers of the snapshot
+		size_t threshold = get_config()->compression_threshold;
+		struct compressed_payload* p_compressed = p_snapshot->len >= threshold 
+			? get_compressed_users_snapshot(p_snapshot) : NULL;
+		if (send_listing(socket, p_snapshot->data, p_snapshot->len, p_compressed) != 0)
+			printf("ERROR send_users_snapshot - could not send response\n");
+	}
+	else if (send_msgs(socket, response, res == LIST_USERS_SUCCESS ? 2 : 1) != 0)
+		printf("ERROR send_users_snapshot - could not send response\n");
 }
 
 
 
-int send_users_list(int socket, user* users_list, uint32_t num_of_users)
+int send_users_list(int socket, char* users, size_t users_len, uint32_t num_of_users)
 {
 	// send number of users
 	char str_num_of_users[8]; // max number of users is 4 000 000
@@ -809,16 +2556,9 @@ int send_users_list(int socket, user* users_list, uint32_t num_of_users)
 	if (send_msg(socket, str_num_of_users, strlen(str_num_of_users) + 1) != 0)
 		return SEND_USERS_LIST_ERR_NUM_OF_USERS;
 
-	// send users' data
-	for (uint32_t i = 0; i < num_of_users; i++)
-	{
-		if (send_msg(socket, users_list[i].username, strlen(users_list[i].username) + 1) != 0)
-			return SEND_USERS_LIST_ERR_USERNAME;
-		if (send_msg(socket, users_list[i].ip, strlen(users_list[i].ip) + 1) != 0)
-			return SEND_USERS_LIST_ERR_IP;
-		if (send_msg(socket, users_list[i].port, strlen(users_list[i].port) + 1) != 0)
-			return SEND_USERS_LIST_ERR_PORT;
-	}
+	// send users' data, already serialized
+	if (users_len > 0 && send_msg(socket, users, users_len) != 0)
+		return SEND_USERS_LIST_ERR_USERS;
 
 	return SEND_USERS_LIST_SUCCESS;
 }
@@ -829,24 +2569,37 @@ int send_users_list(int socket, user* users_list, uint32_t num_of_users)
 // list_content
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-void list_content(int socket)
+void list_content(struct connection* p_conn)
 {
+	int socket = p_conn->socket;
 	uint8_t res = LIST_CONTENT_SUCCESS;
 	char** content_list = NULL;
 	uint32_t num_of_files = 0;
+	char content_owner[MAX_USERNAME_LEN + 1];
+	struct compressed_payload* p_compressed = NULL;
+	uint64_t generation = 0;
 
+	// both fields are read first, so a rejected request does not leave the owner in the connection
 	char username[MAX_USERNAME_LEN + 1];
-	if (read_username(socket, username) > 0) // if requesting user specified
+	int username_len = read_username(socket, username);
+	int content_owner_len = username_len >= 0 ? read_username(socket, content_owner) : -1;
+	if (username_len > 0) // if requesting user specified
 	{
-		if (is_registered(username))
+		if (lookup_registered(username))
 		{
-			if (is_connected(username))
+			if (lookup_connected(username))
 			{
-				char content_owner[MAX_USERNAME_LEN + 1];
-				if (read_username(socket, content_owner) > 0) // content owner specified
+				if (content_owner_len > 0) // content owner specified
 				{
-					int get_f_res = get_user_files_list(content_owner, &content_list, 
-						&num_of_files);
+					// the cached listing is compressed already, otherwise the files listed after
+					// reading the generation can be cached
+					if (p_conn->is_compressing 
+						&& (p_compressed = get_cached_listing(content_owner)) == NULL)
+						generation = get_listing_generation(content_owner);
+
+					int get_f_res = p_compressed != NULL ? GET_USER_FILES_LIST_SUCCESS
+						: lookup_user_files(content_owner, &content_list, &num_of_files, 
+							&request_arena);
 
 					if (get_f_res == GET_USER_FILES_LIST_ERR_NO_SUCH_USER)
 						res = LIST_CONTENT_NO_SUCH_FILES_OWNER;
@@ -868,9 +2621,32 @@ void list_content(int socket)
 		res = LIST_CONTENT_OTHER_ERROR;
 	}
 
-	// send result
-	char response_res_code[2];
-	response_res_code[0] = res;
+	if (res == LIST_CONTENT_SUCCESS && p_conn->is_compressing)
+	{
+		char* payload = NULL;
+		size_t len = 0;
+		if (p_compressed == NULL)
+		{
+			payload = serialize_content_list(content_list, num_of_files, &len, &request_arena);
+			if (payload != NULL && len >= (size_t) get_config()->compression_threshold 
+				&& compress_payload(payload, len, &p_compressed) == COMPRESS_PAYLOAD_SUCCESS)
+				cache_listing(content_owner, generation, p_compressed);
+		}
+
+		if (payload != NULL || p_compressed != NULL)
+		{
+			if (send_listing(socket, payload, len, p_compressed) != 0)
+				printf("ERROR list_content - could not send response\n");
+			release_compressed_payload(p_compressed);
+			return;
+		}
+
+		res = LIST_CONTENT_OTHER_ERROR;
+	}
+
+	// send result
+	char response_res_code[2];
+	response_res_code[0] = res;
 	response_res_code[1] = '\0';
 
 	if (send_msg(socket, response_res_code, 2) == 0)
@@ -885,13 +2661,88 @@ void list_content(int socket)
 	}
 	else
 		printf("ERROR list_content - could not send response\n");
+}
+
+
+
+void list_content_filter(struct connection* p_conn)
+{
+	int socket = p_conn->socket;
+	uint8_t res = LIST_CONTENT_SUCCESS;
+	char** content_list = NULL;
+	uint32_t num_of_files = 0;
+	struct name_filter filter;
+
+	// all the fields are read first, so a wrong request does not leave them in the connection
+	char username[MAX_USERNAME_LEN + 1];
+	char content_owner[MAX_USERNAME_LEN + 1];
+	char filter_type[MAX_FILTER_TYPE_LEN + 1];
+	char first[MAX_FILENAME_LEN + 1];
+	char second[MAX_FILENAME_LEN + 1];
+	int is_read = read_username(socket, username) >= 0 
+		&& read_username(socket, content_owner) >= 0
+		&& read_line(socket, filter_type, MAX_FILTER_TYPE_LEN + 1) >= 0
+		&& read_line(socket, first, MAX_FILENAME_LEN + 1) >= 0 
+		&& read_line(socket, second, MAX_FILENAME_LEN + 1) >= 0;
+
+	if (!is_read || username[0] == '\0' 
+		|| parse_name_filter(filter_type, first, second, &filter) != PARSE_NAME_FILTER_SUCCESS)
+	{
+		printf("ERROR list_content_filter - wrong request format\n");
+		res = LIST_CONTENT_OTHER_ERROR;
+		is_request_malformed = !is_read;
+	}
+	else if (!lookup_registered(username))
+		res = LIST_CONTENT_NOT_REGISTERED;
+	else if (!lookup_connected(username))
+		res = LIST_CONTENT_DISCONNECTED;
+	else if (content_owner[0] == '\0')
+		res = LIST_CONTENT_NO_SUCH_FILES_OWNER;
+	else
+	{
+		int get_f_res = lookup_filtered_files(content_owner, &filter, &content_list, 
+			&num_of_files, &request_arena);
+		if (get_f_res == GET_USER_FILES_LIST_ERR_NO_SUCH_USER)
+			res = LIST_CONTENT_NO_SUCH_FILES_OWNER;
+		else if (get_f_res != GET_USER_FILES_LIST_SUCCESS)
+			res = LIST_CONTENT_OTHER_ERROR;
+	}
+
+	// the filtered listings are not cached, only compressed when they are big enough
+	if (res == LIST_CONTENT_SUCCESS && p_conn->is_compressing)
+	{
+		size_t len = 0;
+		struct compressed_payload* p_compressed = NULL;
+		char* payload = serialize_content_list(content_list, num_of_files, &len, &request_arena);
+		if (payload != NULL)
+		{
+			if (len >= (size_t) get_config()->compression_threshold)
+				compress_payload(payload, len, &p_compressed);
+			if (send_listing(socket, payload, len, p_compressed) != 0)
+				printf("ERROR list_content_filter - could not send response\n");
+			release_compressed_payload(p_compressed);
+			return;
+		}
+
+		res = LIST_CONTENT_OTHER_ERROR;
+	}
+
+	char response_res_code[2];
+	response_res_code[0] = res;
+	response_res_code[1] = '\0';
 
-	if (content_list != NULL)
+	if (send_msg(socket, response_res_code, 2) == 0)
 	{
-		for (uint32_t i = 0; i < num_of_files; i++)
-			free(content_list[i]);
-		free(content_list);
+		if (res == LIST_CONTENT_SUCCESS)
+		{
+			int send_res = send_content_list(socket, content_list, num_of_files);
+
+			if (send_res != SEND_CONTENT_LIST_SUCCESS)
+				printf("ERROR list_content_filter - could not send content. Code: %d\n", send_res);
+		}
 	}
+	else
+		printf("ERROR list_content_filter - could not send response\n");
 }
 
 
@@ -917,6 +2768,1869 @@ int send_content_list(int socket, char** content_list, uint32_t num_of_files)
 
 
 
+char* serialize_content_list(char** content_list, uint32_t num_of_files, size_t* p_len,
+	struct arena* p_arena)
+{
+	char str_num_of_files[7];	// max number of files is 100000
+	size_t len = sprintf(str_num_of_files, "%u", num_of_files) + 1;
+	for (uint32_t i = 0; i < num_of_files; i++)
+		len += strlen(content_list[i]) + 1;
+
+	char* list = arena_alloc(p_arena, len);
+	if (list == NULL)
+		return NULL;
+
+	char* p = stpcpy(list, str_num_of_files) + 1;
+	for (uint32_t i = 0; i < num_of_files; i++)
+		p = stpcpy(p, content_list[i]) + 1;
+
+	*p_len = len;
+
+	return list;
+}
+
+
+
+int list_content_multi(struct connection* p_conn)
+{
+	int socket = p_conn->socket;
+	char response_res_code[2];
+	response_res_code[0] = LIST_CONTENT_SUCCESS;
+	response_res_code[1] = '\0';
+
+	char username[MAX_USERNAME_LEN + 1];
+	uint64_t num_of_owners = 0;
+	if (read_username(socket, username) < 0 || !read_number(socket, &num_of_owners)
+		|| num_of_owners > MAX_LISTED_OWNERS)
+	{
+		printf("ERROR list_content_multi - wrong request format\n");
+		response_res_code[0] = LIST_CONTENT_OTHER_ERROR;
+		if (send_msg(socket, response_res_code, 2) != 0)
+			printf("ERROR list_content_multi - could not send response\n");
+		return 0;
+	}
+
+	char (*owners)[MAX_USERNAME_LEN + 1] = 
+		arena_alloc(&request_arena, (num_of_owners + 1) * (MAX_USERNAME_LEN + 1));
+	char** inputs = arena_alloc(&request_arena, (num_of_owners + 1) * sizeof(char*));
+	int is_read = owners != NULL && inputs != NULL;
+	for (uint32_t i = 0; i < num_of_owners && is_read; i++)
+	{
+		is_read = read_username(socket, owners[i]) >= 0;
+		inputs[i] = owners[i];
+	}
+
+	// the requesting user is checked once for all the owners
+	if (!is_read)
+	{
+		printf("ERROR list_content_multi - could not read the owners\n");
+		response_res_code[0] = LIST_CONTENT_OTHER_ERROR;
+	}
+	else if (username[0] == '\0')
+	{
+		printf("ERROR list_content_multi - no requesting user specified\n");
+		response_res_code[0] = LIST_CONTENT_OTHER_ERROR;
+	}
+	else if (!lookup_registered(username))
+		response_res_code[0] = LIST_CONTENT_NOT_REGISTERED;
+	else if (!lookup_connected(username))
+		response_res_code[0] = LIST_CONTENT_DISCONNECTED;
+
+	struct pool_job job;
+	int start_res = START_POOL_JOB_ERR_STOPPED;
+	if (response_res_code[0] == LIST_CONTENT_SUCCESS)
+	{
+		start_res = start_pool_job(&job, inputs, num_of_owners, list_owner_content);
+		if (start_res != START_POOL_JOB_SUCCESS)
+		{
+			printf("ERROR list_content_multi - could not start the listings. Code: %d\n", 
+				start_res);
+			response_res_code[0] = LIST_CONTENT_OTHER_ERROR;
+		}
+	}
+
+	char str_num_of_owners[7];
+	sprintf(str_num_of_owners, "%u", (uint32_t) num_of_owners);
+	int is_sent = send_msg(socket, response_res_code, 2) == 0 
+		&& (start_res != START_POOL_JOB_SUCCESS 
+			|| send_msg(socket, str_num_of_owners, strlen(str_num_of_owners) + 1) == 0);
+
+	// the listings are sent in the order they are done in
+	struct pool_item* p_item;
+	while (start_res == START_POOL_JOB_SUCCESS && is_sent 
+		&& (p_item = next_done_item(&job)) != NULL)
+	{
+		if (p_item->output != NULL)
+			is_sent = send_msg(socket, p_item->output, p_item->output_len) == 0;
+		else
+		{
+			char owner_res_code[2] = { '0' + LIST_CONTENT_OTHER_ERROR, '\0' };
+			is_sent = send_msg(socket, p_item->input, strlen(p_item->input) + 1) == 0
+				&& send_msg(socket, owner_res_code, 2) == 0;
+		}
+	}
+
+	if (start_res == START_POOL_JOB_SUCCESS)
+		finish_pool_job(&job);
+
+	if (!is_sent)
+		printf("ERROR list_content_multi - could not send response\n");
+
+	return is_read && is_sent;
+}
+
+
+
+char* list_owner_content(char* owner, struct arena* p_arena, size_t* p_len)
+{
+	uint8_t res = LIST_CONTENT_SUCCESS;
+	char** content_list = NULL;
+	uint32_t num_of_files = 0;
+
+	int get_f_res = owner[0] == '\0' ? GET_USER_FILES_LIST_ERR_NO_SUCH_USER
+		: lookup_user_files(owner, &content_list, &num_of_files, p_arena);
+	if (get_f_res == GET_USER_FILES_LIST_ERR_NO_SUCH_USER)
+		res = LIST_CONTENT_NO_SUCH_FILES_OWNER;
+	else if (get_f_res != GET_USER_FILES_LIST_SUCCESS)
+		res = LIST_CONTENT_OTHER_ERROR;
+
+	size_t list_len = 0;
+	char* list = NULL;
+	if (res == LIST_CONTENT_SUCCESS 
+		&& (list = serialize_content_list(content_list, num_of_files, &list_len, p_arena)) == NULL)
+		res = LIST_CONTENT_OTHER_ERROR;
+
+	// owner, result code and the list
+	size_t owner_len = strlen(owner) + 1;
+	char* response = malloc(owner_len + 2 + list_len);
+	if (response == NULL)
+		return NULL;
+
+	memcpy(response, owner, owner_len);
+	response[owner_len] = '0' + res;
+	response[owner_len + 1] = '\0';
+	if (list != NULL)
+		memcpy(response + owner_len + 2, list, list_len);
+	*p_len = owner_len + 2 + list_len;
+
+	return response;
+}
+
+
+
+int subscribe_request(struct connection* p_conn)
+{
+	int socket = p_conn->socket;
+	char response[2];
+	response[0] = SUBSCRIBE_SUCCESS;
+	response[1] = '\0';
+
+	char username[MAX_USERNAME_LEN + 1];
+	uint64_t num_of_owners = 0;
+	if (read_username(socket, username) < 0 || !read_number(socket, &num_of_owners)
+		|| num_of_owners > MAX_SUBSCRIBED_OWNERS)
+	{
+		printf("ERROR subscribe_request - wrong request format\n");
+		response[0] = SUBSCRIBE_OTHER_ERROR;
+		if (send_msg(socket, response, 2) != 0)
+			printf("ERROR subscribe_request - could not send response\n");
+		return 0;
+	}
+
+	char (*owners)[MAX_USERNAME_LEN + 1] = 
+		arena_alloc(&request_arena, (num_of_owners + 1) * (MAX_USERNAME_LEN + 1));
+	char** p_owners = arena_alloc(&request_arena, (num_of_owners + 1) * sizeof(char*));
+	int is_read = owners != NULL && p_owners != NULL;
+	for (uint32_t i = 0; i < num_of_owners && is_read; i++)
+	{
+		is_read = read_username(socket, owners[i]) >= 0;
+		p_owners[i] = owners[i];
+	}
+
+	if (!is_read || username[0] == '\0')
+	{
+		printf("ERROR subscribe_request - wrong request format\n");
+		response[0] = SUBSCRIBE_OTHER_ERROR;
+	}
+	else if (!is_registered(username))
+		response[0] = SUBSCRIBE_NOT_REGISTERED;
+	else if (!is_connected(username))
+		response[0] = SUBSCRIBE_DISCONNECTED;
+	else
+	{
+		int add_subscriber_res = add_subscriber(p_owners, num_of_owners, &p_conn->p_subscriber);
+		if (add_subscriber_res != ADD_SUBSCRIBER_SUCCESS)
+		{
+			printf("ERROR subscribe_request - could not subscribe. Code: %d\n", 
+				add_subscriber_res);
+			response[0] = SUBSCRIBE_OTHER_ERROR;
+		}
+	}
+
+	if (send_msg(socket, response, 2) != 0)
+	{
+		printf("ERROR subscribe_request - could not send response\n");
+		if (p_conn->p_subscriber != NULL)
+		{
+			remove_subscriber(p_conn->p_subscriber);
+			p_conn->p_subscriber = NULL;
+		}
+		return 0;
+	}
+
+	return is_read;
+}
+
+
+
+int stream_events(struct connection* p_conn)
+{
+	int socket = p_conn->socket;
+	// an event is at most its type and two fields
+	size_t max_event_len = 2 + 2 * (MAX_SUBSCRIPTION_FIELD_LEN + 1);
+	struct subscription_event* events = 
+		arena_alloc(&request_arena, SUBSCRIBER_QUEUE_SIZE * sizeof(struct subscription_event));
+	char* buffer = arena_alloc(&request_arena, SUBSCRIBER_QUEUE_SIZE * max_event_len);
+	uint32_t num_of_idle_polls = 0;
+
+	// the connection waits for the server now, so it's idle for the drain and has no deadline
+	__atomic_store_n(&p_conn->deadline_kind, DEADLINE_IDLE, __ATOMIC_SEQ_CST);
+	timer_wheel_cancel(&p_conn->deadline);
+
+	while (events != NULL && buffer != NULL && !__atomic_load_n(&is_draining, __ATOMIC_SEQ_CST))
+	{
+		// the client sends nothing more, so a readable socket means it's closed (or shut down
+		// by the drain)
+		struct pollfd poll_fd = { socket, POLLIN, 0 };
+		if (poll(&poll_fd, 1, 0) != 0)
+			break;
+
+		uint32_t num_of_events = next_subscription_events(p_conn->p_subscriber, events, 
+			SUBSCRIBER_QUEUE_SIZE, SUBSCRIPTION_POLL_MS);
+
+		size_t len = 0;
+		for (uint32_t i = 0; i < num_of_events; i++)
+		{
+			buffer[len++] = events[i].type;
+			buffer[len++] = '\0';
+			if (events[i].type != SUBSCRIPTION_EVENT_RESYNC)
+			{
+				len = stpcpy(buffer + len, events[i].owner) + 1 - buffer;
+				len = stpcpy(buffer + len, events[i].file_name) + 1 - buffer;
+			}
+		}
+
+		num_of_idle_polls = num_of_events > 0 ? 0 : num_of_idle_polls + 1;
+		if (num_of_idle_polls * SUBSCRIPTION_POLL_MS >= SUBSCRIPTION_HEARTBEAT_MS)
+		{
+			len = stpcpy(buffer, SUBSCRIPTION_HEARTBEAT) + 1 - buffer;
+			num_of_idle_polls = 0;
+		}
+
+		if (len == 0)
+			continue;
+
+		set_deadline(p_conn, DEADLINE_WRITE, get_config()->request_timeout_ms);
+		int send_res = send_msg(socket, buffer, len);
+		__atomic_store_n(&p_conn->deadline_kind, DEADLINE_IDLE, __ATOMIC_SEQ_CST);
+		timer_wheel_cancel(&p_conn->deadline);
+		if (send_res != 0)
+			break;
+	}
+
+	remove_subscriber(p_conn->p_subscriber);
+	p_conn->p_subscriber = NULL;
+
+	return 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// compression
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void accept_encoding(struct connection* p_conn)
+{
+	int socket = p_conn->socket;
+	uint8_t res = ACCEPT_ENCODING_NOT_SUPPORTED;
+	char encodings[MAX_ENCODINGS_LEN + 1];
+
+	if (read_line(socket, encodings, MAX_ENCODINGS_LEN) > 0)
+	{
+		encodings[MAX_ENCODINGS_LEN] = '\0';
+
+		// a proxy only forwards the listings of the shards, it does not compress them
+		char* p_save = NULL;
+		for (char* encoding = strtok_r(encodings, ",", &p_save); encoding != NULL && !is_proxy;
+			encoding = strtok_r(NULL, ",", &p_save))
+		{
+			if (strcmp(encoding, COMPRESSION_ENCODING) == 0)
+			{
+				p_conn->is_compressing = 1;
+				res = ACCEPT_ENCODING_SUCCESS;
+				break;
+			}
+		}
+	}
+	else
+	{
+		printf("ERROR accept_encoding - no encodings specified\n");
+		res = ACCEPT_ENCODING_OTHER_ERROR;
+	}
+
+	char response[2 + sizeof(COMPRESSION_ENCODING)];
+	response[0] = res;
+	response[1] = '\0';
+	strcpy(response + 2, COMPRESSION_ENCODING);
+
+	if (send_msg(socket, response, res == ACCEPT_ENCODING_SUCCESS ? sizeof(response) : 2) != 0)
+		printf("ERROR accept_encoding - could not send response\n");
+}
+
+
+
+int send_listing(int socket, char* payload, size_t len, struct compressed_payload* p_compressed)
+{
+	char header[2 + sizeof(COMPRESSION_ENCODING) + 2 * (MAX_NUMBER_LEN + 1)];
+	header[0] = 0;	// the result codes of the successful listings
+	header[1] = '\0';
+	size_t header_len = 2;
+
+	struct iovec response[2];
+	if (p_compressed != NULL)
+	{
+		header_len += sprintf(header + header_len, "%s", COMPRESSION_ENCODING) + 1;
+		header_len += sprintf(header + header_len, "%lu", (unsigned long) p_compressed->raw_len)
+			+ 1;
+		header_len += sprintf(header + header_len, "%lu", (unsigned long) p_compressed->len) + 1;
+		response[1].iov_base = p_compressed->data;
+		response[1].iov_len = p_compressed->len;
+	}
+	else
+	{
+		header_len += sprintf(header + header_len, "%s", COMPRESSION_ENCODING_RAW) + 1;
+		response[1].iov_base = payload;
+		response[1].iov_len = len;
+	}
+	response[0].iov_base = header;
+	response[0].iov_len = header_len;
+
+	return send_msgs(socket, response, 2);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// put_file
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int put_file(struct connection* p_conn)
+{
+	int socket = p_conn->socket;
+	uint8_t res = PUT_FILE_SUCCESS;
+	char username[MAX_USERNAME_LEN + 1];
+	char file_name[MAX_FILENAME_LEN + 1];
+	uint64_t size = 0;
+	int is_consumed = 0;
+
+	if (read_username(socket, username) > 0 
+		&& read_line(socket, file_name, MAX_FILENAME_LEN) > 0 
+		&& read_number(socket, &size))
+	{
+		if (!is_registered(username))
+			res = PUT_FILE_NOT_REGISTERED;
+		else if (!is_connected(username))
+			res = PUT_FILE_DISCONNECTED;
+		else if (!is_filename_valid(file_name))
+			res = PUT_FILE_OTHER_ERROR;
+		else if (!is_published(username, file_name))
+			res = PUT_FILE_NOT_PUBLISHED;
+		else
+		{
+			set_deadline(p_conn, DEADLINE_READ, transfer_timeout_ms(size));
+			int store_res = store_file_content(username, file_name, socket, size);
+			if (store_res != STORE_FILE_CONTENT_SUCCESS)
+			{
+				printf("ERROR put_file - could not store content. Code: %d\n", store_res);
+				res = PUT_FILE_OTHER_ERROR;
+			}
+			else
+				is_consumed = 1;
+		}
+
+		// the content of a rejected request is skipped, so the client reads the response and can
+		// go on with the connection (a sharding proxy sends the requests of other clients through
+		// it, never more content than it buffers)
+		if (res != PUT_FILE_SUCCESS && !is_consumed 
+			&& (!is_forwarded || size <= MAX_PROXIED_CONTENT))
+		{
+			set_deadline(p_conn, DEADLINE_READ, transfer_timeout_ms(size));
+			is_consumed = skip_content(socket, size) == 0;
+		}
+	}
+	else
+	{
+		printf("ERROR put_file - wrong request format\n");
+		res = PUT_FILE_OTHER_ERROR;
+	}
+
+	char response[2];
+	response[0] = res;
+	response[1] = '\0';
+
+	if (send_msg(socket, response, 2) != 0)
+		printf("ERROR put_file - could not send response\n");
+
+	// the content which was not consumed makes the connection unusable, it's read till the client
+	// closes it so the response is not reset
+	if (!is_consumed)
+		discard_rest_of_request(socket);
+
+	return is_consumed;
+}
+
+
+
+int skip_content(int socket, uint64_t size)
+{
+	char buffer[4096];
+
+	for (uint64_t skipped = 0; skipped < size; skipped += sizeof(buffer))
+	{
+		uint64_t length = size - skipped < sizeof(buffer) ? size - skipped : sizeof(buffer);
+		if (receive_msg(socket, buffer, length) != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// get_file
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void get_file(struct connection* p_conn)
+{
+	int socket = p_conn->socket;
+	uint8_t res = GET_FILE_SUCCESS;
+	char username[MAX_USERNAME_LEN + 1];
+	char owner[MAX_USERNAME_LEN + 1];
+	char file_name[MAX_FILENAME_LEN + 1];
+	uint64_t offset = 0;
+	uint64_t length = 0;
+	uint64_t size = 0;
+	int fd = -1;
+
+	if (read_username(socket, username) > 0 
+		&& read_username(socket, owner) > 0
+		&& read_line(socket, file_name, MAX_FILENAME_LEN) > 0
+		&& read_number(socket, &offset)
+		&& read_number(socket, &length))
+	{
+		if (!lookup_registered(username))
+			res = GET_FILE_NOT_REGISTERED;
+		else if (!lookup_connected(username))
+			res = GET_FILE_DISCONNECTED;
+		else if (!is_filename_valid(file_name) || !is_username_valid(owner))
+			res = GET_FILE_NO_SUCH_FILE;
+		else if (open_file_content(owner, file_name, &fd, &size) != OPEN_FILE_CONTENT_SUCCESS)
+			res = GET_FILE_NO_SUCH_FILE;
+		else if (offset > size || length > size - offset)
+			res = GET_FILE_INVALID_RANGE;
+		else if (length == 0)
+			length = size - offset;
+	}
+	else
+	{
+		printf("ERROR get_file - wrong request format\n");
+		res = GET_FILE_OTHER_ERROR;
+		is_request_malformed = 1;
+	}
+
+	char response_res_code[2];
+	response_res_code[0] = res;
+	response_res_code[1] = '\0';
+
+	if (send_msg(socket, response_res_code, 2) == 0)
+	{
+		if (res == GET_FILE_SUCCESS)
+		{
+			// send total size and the length of the range, then the content itself
+			char str_size[MAX_NUMBER_LEN + 1];
+			char str_length[MAX_NUMBER_LEN + 1];
+			sprintf(str_size, "%lu", (unsigned long) size);
+			sprintf(str_length, "%lu", (unsigned long) length);
+
+			if (send_msg(socket, str_size, strlen(str_size) + 1) != 0 
+				|| send_msg(socket, str_length, strlen(str_length) + 1) != 0)
+				printf("ERROR get_file - could not send size\n");
+			else
+			{
+				set_deadline(p_conn, DEADLINE_WRITE, transfer_timeout_ms(length));
+				int send_res = send_file_content(socket, fd, offset, length);
+				if (send_res != SEND_FILE_CONTENT_SUCCESS)
+					printf("ERROR get_file - could not send content. Code: %d\n", send_res);
+			}
+		}
+	}
+	else
+		printf("ERROR get_file - could not send response\n");
+
+	if (fd >= 0)
+		close(fd);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// publish
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void publish(int socket)
+{
+	uint8_t res = PUBLISH_SUCCESS;
+	char username[MAX_USERNAME_LEN + 1];
+	char file_name[MAX_FILENAME_LEN + 1];
+	char description[MAX_DESCRIPTION_LEN + 1];
+
+	if (read_username(socket, username) > 0 
+		&& read_line(socket, file_name, MAX_FILENAME_LEN) > 0
+		&& read_line(socket, description, MAX_DESCRIPTION_LEN) >= 0)
+	{
+		if (!is_registered(username))
+			res = PUBLISH_NO_SUCH_USER;
+		else if (!is_connected(username))
+			res = PUBLISH_DISCONNECTED;
+		else if (!is_filename_valid(file_name))
+			res = PUBLISH_OTHER_ERROR;
+		else
+		{
+			change_feed_lock_user(username);
+
+			switch (publish_file(username, file_name, description))
+			{
+				case PUBLISH_FILE_SUCCESS 			: res = PUBLISH_SUCCESS; break;
+				case PUBLISH_FILE_ERR_NO_SUCH_USER 	: res = PUBLISH_NO_SUCH_USER; break;
+				case PUBLISH_FILE_ERR_EXISTS 		: res = PUBLISH_ALREADY_PUBLISHED; break;
+				default 							: res = PUBLISH_OTHER_ERROR;
+			}
+
+			// indexed under the lock, so a DELETE of the same file can't come in between. A file
+			// which can't be indexed is not published, the storage is rolled back
+			if (res == PUBLISH_SUCCESS 
+				&& index_published_file(username, file_name, description) != 0)
+			{
+				printf("ERROR publish - could not index the file\n");
+				delete_file(username, file_name);
+				res = PUBLISH_OTHER_ERROR;
+			}
+
+			if (res == PUBLISH_SUCCESS)
+			{
+				char* fields[] = {username, file_name};
+				change_feed_append(FEED_PUBLISH, fields, 2);
+				notify_subscribers(SUBSCRIPTION_EVENT_PUBLISH, username, file_name);
+			}
+
+			change_feed_unlock_user(username);
+		}
+	}
+	else
+	{
+		printf("ERROR publish - wrong request format\n");
+		res = PUBLISH_OTHER_ERROR;
+		is_request_malformed = 1;
+	}
+
+	char response[2];
+	response[0] = res;
+	response[1] = '\0';
+
+	if (send_msg(socket, response, 2) != 0)
+		printf("ERROR publish - could not send response\n");
+}
+
+
+
+int index_published_file(char* username, char* file_name, char* description)
+{
+	if (search_index_add(username, file_name, description) != SEARCH_INDEX_SUCCESS)
+		return -1;
+
+	if (owners_index_add(file_name, username) != OWNERS_INDEX_SUCCESS)
+	{
+		search_index_remove(username, file_name);
+		return -1;
+	}
+
+	if (files_index_add(username, file_name) != FILES_INDEX_SUCCESS)
+	{
+		owners_index_remove(file_name, username);
+		search_index_remove(username, file_name);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// delete
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void delete(int socket)
+{
+	uint8_t res = DELETE_SUCCESS;
+	char username[MAX_USERNAME_LEN + 1];
+	char file_name[MAX_FILENAME_LEN + 1];
+
+	if (read_username(socket, username) > 0 
+		&& read_line(socket, file_name, MAX_FILENAME_LEN) > 0)
+	{
+		if (!is_registered(username))
+			res = DELETE_NO_SUCH_USER;
+		else if (!is_connected(username))
+			res = DELETE_DISCONNECTED;
+		else if (!is_filename_valid(file_name))
+			res = DELETE_NOT_PUBLISHED;
+		else
+		{
+			change_feed_lock_user(username);
+
+			switch (delete_file(username, file_name))
+			{
+				case DELETE_FILE_SUCCESS 			: res = DELETE_SUCCESS; break;
+				case DELETE_FILE_ERR_NO_SUCH_USER 	: res = DELETE_NO_SUCH_USER; break;
+				case DELETE_FILE_ERR_NOT_EXISTS 	: res = DELETE_NOT_PUBLISHED; break;
+				default 							: res = DELETE_OTHER_ERROR;
+			}
+
+			// the same as for publish
+			if (res == DELETE_SUCCESS)
+			{
+				search_index_remove(username, file_name);
+				owners_index_remove(file_name, username);
+				files_index_remove(username, file_name);
+				tracker_remove_peer(file_name, username);
+
+				char* fields[] = {username, file_name};
+				change_feed_append(FEED_DELETE, fields, 2);
+				notify_subscribers(SUBSCRIPTION_EVENT_DELETE, username, file_name);
+			}
+
+			change_feed_unlock_user(username);
+		}
+	}
+	else
+	{
+		printf("ERROR delete - wrong request format\n");
+		res = DELETE_OTHER_ERROR;
+		is_request_malformed = 1;
+	}
+
+	char response[2];
+	response[0] = res;
+	response[1] = '\0';
+
+	if (send_msg(socket, response, 2) != 0)
+		printf("ERROR delete - could not send response\n");
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// search
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void search(int socket)
+{
+	uint8_t res = SEARCH_SUCCESS;
+	struct search_result* results = NULL;
+	uint32_t num_of_results = 0;
+	char username[MAX_USERNAME_LEN + 1];
+	char query[MAX_QUERY_LEN + 1];
+	uint64_t max_results = 0;
+
+	if (read_username(socket, username) > 0 
+		&& read_line(socket, query, MAX_QUERY_LEN) > 0
+		&& read_number(socket, &max_results))
+	{
+		if (!lookup_registered(username))
+			res = SEARCH_NOT_REGISTERED;
+		else if (!lookup_connected(username))
+			res = SEARCH_DISCONNECTED;
+		else
+		{
+			if (max_results > MAX_SEARCH_RESULTS)
+				max_results = MAX_SEARCH_RESULTS;
+			num_of_results = search_index_query(query, max_results, &results);
+		}
+	}
+	else
+	{
+		printf("ERROR search - wrong request format\n");
+		res = SEARCH_OTHER_ERROR;
+		is_request_malformed = 1;
+	}
+
+	char response_res_code[2];
+	response_res_code[0] = res;
+	response_res_code[1] = '\0';
+
+	if (send_msg(socket, response_res_code, 2) == 0)
+	{
+		if (res == SEARCH_SUCCESS)
+		{
+			int send_res = send_search_results(socket, results, num_of_results);
+
+			if (send_res != SEND_SEARCH_RESULTS_SUCCESS)
+				printf("ERROR search - could not send results. Code: %d\n", send_res);
+		}
+	}
+	else
+		printf("ERROR search - could not send response\n");
+
+	free_search_results(results, num_of_results);
+}
+
+
+
+int send_search_results(int socket, struct search_result* results, uint32_t num_of_results)
+{
+	char str_num_of_results[MAX_NUMBER_LEN + 1];
+	sprintf(str_num_of_results, "%u", num_of_results);
+	if (send_msg(socket, str_num_of_results, strlen(str_num_of_results) + 1) != 0)
+		return SEND_SEARCH_RESULTS_ERR_NUM_OF_RESULTS;
+
+	for (uint32_t i = 0; i < num_of_results; i++)
+	{
+		if (send_msg(socket, results[i].owner, strlen(results[i].owner) + 1) != 0)
+			return SEND_SEARCH_RESULTS_ERR_OWNER;
+		if (send_msg(socket, results[i].file_name, strlen(results[i].file_name) + 1) != 0)
+			return SEND_SEARCH_RESULTS_ERR_FILENAME;
+	}
+
+	return SEND_SEARCH_RESULTS_SUCCESS;
+}
+
+
+
+void index_stored_file(char* username, char* file_name, char* description, void* arg)
+{
+	if (index_published_file(username, file_name, description) != 0)
+		printf("ERROR index_stored_file - could not index %s/%s\n", username, file_name);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// who_has
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void who_has(int socket)
+{
+	uint8_t res = WHO_HAS_SUCCESS;
+	char username[MAX_USERNAME_LEN + 1];
+	char file_name[MAX_FILENAME_LEN + 1];
+	struct owners_list owners;
+	memset(&owners, 0, sizeof(owners));
+
+	if (read_username(socket, username) > 0 
+		&& read_line(socket, file_name, MAX_FILENAME_LEN) > 0)
+	{
+		if (!lookup_registered(username))
+			res = WHO_HAS_NOT_REGISTERED;
+		else if (!lookup_connected(username))
+			res = WHO_HAS_DISCONNECTED;
+		else
+			owners_index_for_each(file_name, collect_connected_owner, &owners);
+	}
+	else
+	{
+		printf("ERROR who_has - wrong request format\n");
+		res = WHO_HAS_OTHER_ERROR;
+		is_request_malformed = 1;
+	}
+
+	char response_res_code[2];
+	response_res_code[0] = res;
+	response_res_code[1] = '\0';
+
+	if (send_msg(socket, response_res_code, 2) == 0)
+	{
+		if (res == WHO_HAS_SUCCESS)
+		{
+			int send_res = send_users_list(socket, owners.users, owners.len, 
+				owners.num_of_users);
+
+			if (send_res != SEND_USERS_LIST_SUCCESS)
+				printf("ERROR who_has - could not send owners. Code: %d\n", send_res);
+		}
+	}
+	else
+		printf("ERROR who_has - could not send response\n");
+
+	free(owners.users);
+}
+
+
+
+void collect_connected_owner(char* owner, void* arg)
+{
+	struct owners_list* p_owners = arg;
+
+	user owner_data;
+	if (!get_connected_user(owner, &owner_data))
+		return;
+
+	size_t username_len = strlen(owner_data.username) + 1;
+	size_t ip_len = strlen(owner_data.ip) + 1;
+	size_t port_len = strlen(owner_data.port) + 1;
+	size_t len = username_len + ip_len + port_len;
+	if (p_owners->len + len > p_owners->capacity)
+	{
+		size_t new_capacity = p_owners->capacity == 0 ? 1024 : 2 * p_owners->capacity;
+		char* new_users = realloc(p_owners->users, new_capacity);
+		if (new_users == NULL)
+			return;
+		p_owners->users = new_users;
+		p_owners->capacity = new_capacity;
+	}
+
+	char* p_next = p_owners->users + p_owners->len;
+	memcpy(p_next, owner_data.username, username_len);
+	memcpy(p_next + username_len, owner_data.ip, ip_len);
+	memcpy(p_next + username_len + ip_len, owner_data.port, port_len);
+	p_owners->len += len;
+	p_owners->num_of_users++;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// announce
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void announce(int socket)
+{
+	uint8_t res = ANNOUNCE_SUCCESS;
+	char username[MAX_USERNAME_LEN + 1];
+	char file_name[MAX_FILENAME_LEN + 1];
+	uint64_t size = 0;
+	uint64_t chunk_size = 0;
+	uint64_t num_of_chunks = 0;
+	char (*chunk_hashes)[MAX_CHUNK_HASH_LEN + 1] = NULL;
+
+	if (read_username(socket, username) > 0 
+		&& read_line(socket, file_name, MAX_FILENAME_LEN) > 0
+		&& read_number(socket, &size)
+		&& read_number(socket, &chunk_size) && chunk_size > 0 && chunk_size <= UINT32_MAX
+		&& read_number(socket, &num_of_chunks) && num_of_chunks <= MAX_NUMBER_OF_CHUNKS
+		&& num_of_chunks == (size + chunk_size - 1) / chunk_size)
+	{
+		// the hashes are compared byte by byte, so the unused characters are cleared
+		chunk_hashes = calloc(num_of_chunks + 1, MAX_CHUNK_HASH_LEN + 1);
+		for (uint64_t i = 0; i < num_of_chunks && chunk_hashes != NULL; i++)
+		{
+			if (read_line(socket, chunk_hashes[i], MAX_CHUNK_HASH_LEN + 1) <= 0)
+				res = ANNOUNCE_OTHER_ERROR;
+		}
+
+		// the hashes which were not read are left in the connection
+		if (chunk_hashes == NULL)
+		{
+			res = ANNOUNCE_OTHER_ERROR;
+			is_request_malformed = 1;
+		}
+		else if (res != ANNOUNCE_SUCCESS)
+			printf("ERROR announce - missing chunk hashes\n");
+		else if (!is_registered(username))
+			res = ANNOUNCE_NOT_REGISTERED;
+		else if (!is_connected(username))
+			res = ANNOUNCE_DISCONNECTED;
+		else if (!is_filename_valid(file_name) || !is_published(username, file_name))
+			res = ANNOUNCE_NOT_PUBLISHED;
+		else
+		{
+			switch (tracker_announce(file_name, username, size, chunk_size, num_of_chunks, 
+				chunk_hashes))
+			{
+				case TRACKER_ANNOUNCE_SUCCESS 		: res = ANNOUNCE_SUCCESS; break;
+				case TRACKER_ANNOUNCE_ERR_MISMATCH 	: res = ANNOUNCE_CONTENT_MISMATCH; break;
+				default 							: res = ANNOUNCE_OTHER_ERROR;
+			}
+		}
+	}
+	else
+	{
+		printf("ERROR announce - wrong request format\n");
+		res = ANNOUNCE_OTHER_ERROR;
+		is_request_malformed = 1;
+	}
+
+	free(chunk_hashes);
+
+	char response[2];
+	response[0] = res;
+	response[1] = '\0';
+
+	if (send_msg(socket, response, 2) != 0)
+		printf("ERROR announce - could not send response\n");
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// get_sources
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void get_sources(int socket)
+{
+	uint8_t res = GET_SOURCES_SUCCESS;
+	char username[MAX_USERNAME_LEN + 1];
+	char file_name[MAX_FILENAME_LEN + 1];
+	uint64_t max_sources = 0;
+	struct file_sources sources;
+	memset(&sources, 0, sizeof(sources));
+
+	if (read_username(socket, username) > 0 
+		&& read_line(socket, file_name, MAX_FILENAME_LEN) > 0
+		&& read_number(socket, &max_sources))
+	{
+		if (!lookup_registered(username))
+			res = GET_SOURCES_NOT_REGISTERED;
+		else if (!lookup_connected(username))
+			res = GET_SOURCES_DISCONNECTED;
+		else
+		{
+			if (max_sources > MAX_NUMBER_OF_SOURCES)
+				max_sources = MAX_NUMBER_OF_SOURCES;
+
+			switch (tracker_get_sources(file_name, username, max_sources, &sources))
+			{
+				case TRACKER_GET_SOURCES_SUCCESS 			: res = GET_SOURCES_SUCCESS; break;
+				case TRACKER_GET_SOURCES_ERR_NO_SUCH_FILE 	: res = GET_SOURCES_NO_SUCH_FILE; break;
+				default 									: res = GET_SOURCES_OTHER_ERROR;
+			}
+		}
+	}
+	else
+	{
+		printf("ERROR get_sources - wrong request format\n");
+		res = GET_SOURCES_OTHER_ERROR;
+		is_request_malformed = 1;
+	}
+
+	char response_res_code[2];
+	response_res_code[0] = res;
+	response_res_code[1] = '\0';
+
+	if (send_msg(socket, response_res_code, 2) == 0)
+	{
+		if (res == GET_SOURCES_SUCCESS)
+		{
+			int send_res = send_sources(socket, &sources);
+
+			if (send_res != SEND_SOURCES_SUCCESS)
+				printf("ERROR get_sources - could not send sources. Code: %d\n", send_res);
+		}
+	}
+	else
+		printf("ERROR get_sources - could not send response\n");
+
+	free_file_sources(&sources);
+}
+
+
+
+int send_sources(int socket, struct file_sources* p_sources)
+{
+	if (send_number(socket, p_sources->size) != 0
+		|| send_number(socket, p_sources->chunk_size) != 0
+		|| send_number(socket, p_sources->num_of_chunks) != 0)
+		return SEND_SOURCES_ERR_FILE_INFO;
+
+	for (uint32_t i = 0; i < p_sources->num_of_chunks; i++)
+	{
+		char* hash = p_sources->chunk_hashes + i * (MAX_CHUNK_HASH_LEN + 1);
+		if (send_msg(socket, hash, strlen(hash) + 1) != 0)
+			return SEND_SOURCES_ERR_CHUNK_HASH;
+	}
+
+	if (send_number(socket, p_sources->num_of_sources) != 0)
+		return SEND_SOURCES_ERR_NUM_OF_SOURCES;
+
+	for (uint32_t i = 0; i < p_sources->num_of_sources; i++)
+	{
+		user* p_peer = &p_sources->sources[i].peer;
+		if (send_msg(socket, p_peer->username, strlen(p_peer->username) + 1) != 0
+			|| send_msg(socket, p_peer->ip, strlen(p_peer->ip) + 1) != 0
+			|| send_msg(socket, p_peer->port, strlen(p_peer->port) + 1) != 0
+			|| send_number(socket, p_sources->sources[i].active_downloads) != 0)
+			return SEND_SOURCES_ERR_SOURCE;
+	}
+
+	return SEND_SOURCES_SUCCESS;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// release_sources
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void release_sources(int socket)
+{
+	uint8_t res = RELEASE_SOURCES_SUCCESS;
+	char username[MAX_USERNAME_LEN + 1];
+	char file_name[MAX_FILENAME_LEN + 1];
+
+	if (read_username(socket, username) > 0 
+		&& read_line(socket, file_name, MAX_FILENAME_LEN) > 0)
+	{
+		// a disconnected user can still end the downloads it started
+		if (lookup_registered(username))
+			tracker_release_sources(file_name, username);
+		else
+			res = RELEASE_SOURCES_NOT_REGISTERED;
+	}
+	else
+	{
+		printf("ERROR release_sources - wrong request format\n");
+		res = RELEASE_SOURCES_OTHER_ERROR;
+		is_request_malformed = 1;
+	}
+
+	char response[2];
+	response[0] = res;
+	response[1] = '\0';
+
+	if (send_msg(socket, response, 2) != 0)
+		printf("ERROR release_sources - could not send response\n");
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// batches
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int register_batch(int socket)
+{
+	uint64_t num_of_users = 0;
+	if (!read_number(socket, &num_of_users) || num_of_users > MAX_BATCH_SIZE)
+	{
+		printf("ERROR register_batch - wrong request format\n");
+		send_batch_results(socket, BATCH_OTHER_ERROR, NULL, 0);
+		return 0;
+	}
+
+	char (*usernames)[MAX_USERNAME_LEN + 1] = 
+		arena_alloc(&request_arena, (num_of_users + 1) * (MAX_USERNAME_LEN + 1));
+	char** valid_usernames = arena_alloc(&request_arena, (num_of_users + 1) * sizeof(char*));
+	uint32_t* valid_idxs = arena_alloc(&request_arena, (num_of_users + 1) * sizeof(uint32_t));
+	int* create_results = arena_alloc(&request_arena, (num_of_users + 1) * sizeof(int));
+	uint8_t* results = arena_alloc(&request_arena, num_of_users + 1);
+	uint8_t res = usernames != NULL && valid_usernames != NULL && valid_idxs != NULL 
+		&& create_results != NULL && results != NULL ? BATCH_SUCCESS : BATCH_OTHER_ERROR;
+
+	// the users with invalid names are not created
+	uint32_t num_of_valid = 0;
+	for (uint32_t i = 0; i < num_of_users && res == BATCH_SUCCESS; i++)
+	{
+		results[i] = REGISTER_OTHER_ERROR;
+		if (read_username(socket, usernames[i]) > 0 && is_username_valid(usernames[i]))
+		{
+			valid_usernames[num_of_valid] = usernames[i];
+			valid_idxs[num_of_valid++] = i;
+		}
+	}
+
+	if (res == BATCH_SUCCESS)
+	{
+		change_feed_lock_users(valid_usernames, num_of_valid);
+
+		int create_users_res = create_users(valid_usernames, num_of_valid, create_results);
+		for (uint32_t i = 0; i < num_of_valid; i++)
+		{
+			if (create_users_res == CREATE_USERS_ERR_MUTEX_LOCK)
+				continue;
+
+			switch (create_results[i])
+			{
+				case CREATE_USER_SUCCESS 	: results[valid_idxs[i]] = REGISTER_SUCCESS; break;
+				case CREATE_USER_ERR_EXISTS : 
+					results[valid_idxs[i]] = REGISTER_NON_UNIQUE_USERNAME; break;
+				default 					: results[valid_idxs[i]] = REGISTER_OTHER_ERROR;
+			}
+
+			if (create_results[i] == CREATE_USER_SUCCESS)
+			{
+				char* fields[] = {valid_usernames[i]};
+				change_feed_append(FEED_REGISTER, fields, 1);
+			}
+		}
+
+		change_feed_unlock_users(valid_usernames, num_of_valid);
+	}
+	else
+		printf("ERROR register_batch - could not allocate the batch\n");
+
+	send_batch_results(socket, res, results, num_of_users);
+
+
+	// the usernames were not read if the batch could not be allocated
+	return res == BATCH_SUCCESS;
+}
+
+
+
+int unregister_batch(int socket)
+{
+	uint64_t num_of_users = 0;
+	if (!read_number(socket, &num_of_users) || num_of_users > MAX_BATCH_SIZE)
+	{
+		printf("ERROR unregister_batch - wrong request format\n");
+		send_batch_results(socket, BATCH_OTHER_ERROR, NULL, 0);
+		return 0;
+	}
+
+	char (*usernames)[MAX_USERNAME_LEN + 1] = 
+		arena_alloc(&request_arena, (num_of_users + 1) * (MAX_USERNAME_LEN + 1));
+	char** valid_usernames = arena_alloc(&request_arena, (num_of_users + 1) * sizeof(char*));
+	uint32_t* valid_idxs = arena_alloc(&request_arena, (num_of_users + 1) * sizeof(uint32_t));
+	int* delete_results = arena_alloc(&request_arena, (num_of_users + 1) * sizeof(int));
+	char*** files = arena_alloc(&request_arena, (num_of_users + 1) * sizeof(char**));
+	uint32_t* nums_of_files = arena_alloc(&request_arena, (num_of_users + 1) * sizeof(uint32_t));
+	uint8_t* results = arena_alloc(&request_arena, num_of_users + 1);
+	uint8_t res = usernames != NULL && valid_usernames != NULL && valid_idxs != NULL 
+		&& delete_results != NULL && files != NULL && nums_of_files != NULL && results != NULL 
+		? BATCH_SUCCESS : BATCH_OTHER_ERROR;
+
+	uint32_t num_of_valid = 0;
+	for (uint32_t i = 0; i < num_of_users && res == BATCH_SUCCESS; i++)
+	{
+		results[i] = UNREGISTER_OTHER_ERROR;
+		if (read_username(socket, usernames[i]) <= 0)
+			continue;
+
+		// no such user can be registered, its name is not even used in a path
+		if (!is_username_valid(usernames[i]))
+			results[i] = UNREGISTER_NO_SUCH_USER;
+		else
+		{
+			valid_usernames[num_of_valid] = usernames[i];
+			valid_idxs[num_of_valid++] = i;
+		}
+	}
+
+	if (res == BATCH_SUCCESS)
+	{
+		change_feed_lock_users(valid_usernames, num_of_valid);
+
+		// the names of the files are needed to clean the owners index
+		for (uint32_t i = 0; i < num_of_valid; i++)
+		{
+			if (get_user_files_list(valid_usernames[i], &files[i], &nums_of_files[i], 
+				&request_arena) != GET_USER_FILES_LIST_SUCCESS)
+				nums_of_files[i] = 0;
+		}
+
+		int delete_users_res = delete_users(valid_usernames, num_of_valid, delete_results);
+		for (uint32_t i = 0; i < num_of_valid; i++)
+		{
+			if (delete_users_res == DELETE_USERS_ERR_MUTEX_LOCK)
+				continue;
+
+			switch (delete_results[i])
+			{
+				case DELETE_USER_SUCCESS 		: 
+					results[valid_idxs[i]] = UNREGISTER_SUCCESS;
+					forget_unregistered_user(valid_usernames[i], files[i], nums_of_files[i]);
+					break;
+				case DELETE_USER_ERR_NOT_EXISTS : 
+					results[valid_idxs[i]] = UNREGISTER_NO_SUCH_USER; break;
+				default 						: 
+					results[valid_idxs[i]] = UNREGISTER_OTHER_ERROR;
+			}
+		}
+
+		change_feed_unlock_users(valid_usernames, num_of_valid);
+	}
+	else
+		printf("ERROR unregister_batch - could not allocate the batch\n");
+
+	send_batch_results(socket, res, results, num_of_users);
+
+
+	return res == BATCH_SUCCESS;
+}
+
+
+
+int publish_batch(int socket)
+{
+	char username[MAX_USERNAME_LEN + 1];
+	uint64_t num_of_files = 0;
+	if (read_username(socket, username) < 0 || !read_number(socket, &num_of_files) 
+		|| num_of_files > MAX_BATCH_SIZE)
+	{
+		printf("ERROR publish_batch - wrong request format\n");
+		send_batch_results(socket, BATCH_OTHER_ERROR, NULL, 0);
+		return 0;
+	}
+
+	char (*file_names)[MAX_FILENAME_LEN + 1] = 
+		arena_alloc(&request_arena, (num_of_files + 1) * (MAX_FILENAME_LEN + 1));
+	char (*descriptions)[MAX_DESCRIPTION_LEN + 1] = 
+		arena_alloc(&request_arena, (num_of_files + 1) * (MAX_DESCRIPTION_LEN + 1));
+	char** valid_file_names = arena_alloc(&request_arena, (num_of_files + 1) * sizeof(char*));
+	char** valid_descriptions = arena_alloc(&request_arena, (num_of_files + 1) * sizeof(char*));
+	uint32_t* valid_idxs = arena_alloc(&request_arena, (num_of_files + 1) * sizeof(uint32_t));
+	int* publish_results = arena_alloc(&request_arena, (num_of_files + 1) * sizeof(int));
+	uint8_t* results = arena_alloc(&request_arena, num_of_files + 1);
+	uint8_t res = file_names != NULL && descriptions != NULL && valid_file_names != NULL 
+		&& valid_descriptions != NULL && valid_idxs != NULL && publish_results != NULL 
+		&& results != NULL ? BATCH_SUCCESS : BATCH_OTHER_ERROR;
+
+	uint32_t num_of_valid = 0;
+	for (uint32_t i = 0; i < num_of_files && res == BATCH_SUCCESS; i++)
+	{
+		results[i] = PUBLISH_OTHER_ERROR;
+		if (read_line(socket, file_names[i], MAX_FILENAME_LEN) > 0
+			&& read_line(socket, descriptions[i], MAX_DESCRIPTION_LEN) >= 0 
+			&& is_filename_valid(file_names[i]))
+		{
+			valid_file_names[num_of_valid] = file_names[i];
+			valid_descriptions[num_of_valid] = descriptions[i];
+			valid_idxs[num_of_valid++] = i;
+		}
+	}
+
+	// the user is checked once for the whole batch
+	uint8_t user_res = PUBLISH_SUCCESS;
+	if (res != BATCH_SUCCESS)
+		printf("ERROR publish_batch - could not allocate the batch\n");
+	else if (username[0] == '\0' || !is_registered(username))
+		user_res = PUBLISH_NO_SUCH_USER;
+	else if (!is_connected(username))
+		user_res = PUBLISH_DISCONNECTED;
+	else
+	{
+		change_feed_lock_user(username);
+
+		int publish_files_res = publish_files(username, valid_file_names, valid_descriptions, 
+			num_of_valid, publish_results);
+		for (uint32_t i = 0; i < num_of_valid; i++)
+		{
+			if (publish_files_res == PUBLISH_FILES_ERR_MUTEX_LOCK)
+				publish_results[i] = PUBLISH_FILE_ERR_MUTEX_LOCK;
+
+			switch (publish_results[i])
+			{
+				case PUBLISH_FILE_SUCCESS 			: 
+					results[valid_idxs[i]] = PUBLISH_SUCCESS; break;
+				case PUBLISH_FILE_ERR_NO_SUCH_USER 	: 
+					results[valid_idxs[i]] = PUBLISH_NO_SUCH_USER; break;
+				case PUBLISH_FILE_ERR_EXISTS 		: 
+					results[valid_idxs[i]] = PUBLISH_ALREADY_PUBLISHED; break;
+				default 							: results[valid_idxs[i]] = PUBLISH_OTHER_ERROR;
+			}
+
+			// the same as for publish
+			if (results[valid_idxs[i]] == PUBLISH_SUCCESS && index_published_file(username, 
+				valid_file_names[i], valid_descriptions[i]) != 0)
+			{
+				printf("ERROR publish_batch - could not index the file\n");
+				delete_file(username, valid_file_names[i]);
+				results[valid_idxs[i]] = PUBLISH_OTHER_ERROR;
+			}
+
+			if (results[valid_idxs[i]] == PUBLISH_SUCCESS)
+			{
+				char* fields[] = {username, valid_file_names[i]};
+				change_feed_append(FEED_PUBLISH, fields, 2);
+				notify_subscribers(SUBSCRIPTION_EVENT_PUBLISH, username, valid_file_names[i]);
+			}
+		}
+
+		change_feed_unlock_user(username);
+	}
+
+	for (uint32_t i = 0; i < num_of_files && res == BATCH_SUCCESS && user_res != PUBLISH_SUCCESS; 
+		i++)
+		results[i] = user_res;
+
+	send_batch_results(socket, res, results, num_of_files);
+
+
+	return res == BATCH_SUCCESS;
+}
+
+
+
+void send_batch_results(int socket, uint8_t res, uint8_t* results, uint32_t num_of_items)
+{
+	char response_res_code[2];
+	response_res_code[0] = res;
+	response_res_code[1] = '\0';
+
+	if (send_msg(socket, response_res_code, 2) != 0)
+	{
+		printf("ERROR send_batch_results - could not send response\n");
+		return;
+	}
+
+	if (res != BATCH_SUCCESS)
+		return;
+
+	// one digit for every item
+	char* str_results = arena_alloc(&request_arena, num_of_items + 1);
+	if (str_results == NULL)
+	{
+		printf("ERROR send_batch_results - could not allocate results\n");
+		return;
+	}
+
+	for (uint32_t i = 0; i < num_of_items; i++)
+		str_results[i] = '0' + results[i];
+	str_results[num_of_items] = '\0';
+
+	if (send_msg(socket, str_results, num_of_items + 1) != 0)
+		printf("ERROR send_batch_results - could not send results\n");
+
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// send_metrics
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void send_metrics(int socket)
+{
+	char response[2];
+	response[0] = METRICS_SUCCESS;
+	response[1] = '\0';
+
+	if (send_msg(socket, response, 2) != 0 || send_number(socket, NUM_OF_METRICS) != 0)
+	{
+		printf("ERROR send_metrics - could not send response\n");
+		return;
+	}
+
+	for (int i = 0; i < NUM_OF_METRICS; i++)
+	{
+		char* name = metrics_name(i);
+		if (send_msg(socket, name, strlen(name) + 1) != 0 
+			|| send_number(socket, metrics_get(i)) != 0)
+		{
+			printf("ERROR send_metrics - could not send metric\n");
+			return;
+		}
+	}
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// replication
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void send_replication_status(int socket)
+{
+	char response[2];
+	response[0] = is_replica ? REPLICATION_STATUS_SUCCESS : REPLICATION_STATUS_NOT_REPLICA;
+	response[1] = '\0';
+
+	if (send_msg(socket, response, 2) != 0)
+	{
+		printf("ERROR send_replication_status - could not send response\n");
+		return;
+	}
+
+	if (!is_replica)
+		return;
+
+	struct replica_status status;
+	replica_get_status(&status);
+
+	if (send_number(socket, status.is_connected) != 0
+		|| send_number(socket, status.applied_seq) != 0
+		|| send_number(socket, status.primary_seq) != 0
+		|| send_number(socket, status.lag_ms) != 0)
+		printf("ERROR send_replication_status - could not send status\n");
+}
+
+
+
+void send_read_only(int socket)
+{
+	char response[2];
+	response[0] = RESULT_READ_ONLY;
+	response[1] = '\0';
+
+	if (send_msg(socket, response, 2) != 0)
+		printf("ERROR send_read_only - could not send message\n");
+}
+
+
+
+int lookup_registered(char* username)
+{
+	if (is_requester_checked)
+		return 1;
+
+	return is_replica ? replica_is_registered(username) : is_registered(username);
+}
+
+
+
+int lookup_connected(char* username)
+{
+	if (is_requester_checked)
+		return 1;
+
+	return is_replica ? replica_is_connected(username) : is_connected(username);
+}
+
+
+
+struct users_snapshot* lookup_users_snapshot()
+{
+	return is_replica ? replica_get_users_snapshot() : get_users_snapshot();
+}
+
+
+
+int lookup_user_files(char* username, char*** p_user_files, uint32_t* p_quantity,
+	struct arena* p_arena)
+{
+	if (!is_replica)
+		return get_user_files_list(username, p_user_files, p_quantity, p_arena);
+
+	struct name_filter filter = { NAME_FILTER_ALL, "", "" };
+	return lookup_filtered_files(username, &filter, p_user_files, p_quantity, p_arena);
+}
+
+
+
+struct users_snapshot* lookup_filtered_users(struct name_filter* p_filter)
+{
+	return is_replica ? replica_get_filtered_users_snapshot(p_filter)
+		: get_filtered_users_snapshot(p_filter);
+}
+
+
+
+int lookup_filtered_files(char* owner, struct name_filter* p_filter, char*** p_files,
+	uint32_t* p_quantity, struct arena* p_arena)
+{
+	if (!is_replica)
+	{
+		// the index has no entry for an owner without files
+		if (!is_registered(owner))
+			return GET_USER_FILES_LIST_ERR_NO_SUCH_USER;
+		return files_index_list(owner, p_filter, p_files, p_quantity, p_arena) 
+			== FILES_INDEX_SUCCESS ? GET_USER_FILES_LIST_SUCCESS 
+			: GET_USER_FILES_LIST_ERR_MEMORY;
+	}
+
+	switch (replica_get_user_files_list(owner, p_filter, p_files, p_quantity, p_arena))
+	{
+		case REPLICA_FILES_LIST_SUCCESS 		: return GET_USER_FILES_LIST_SUCCESS;
+		case REPLICA_FILES_LIST_ERR_NO_SUCH_USER : return GET_USER_FILES_LIST_ERR_NO_SUCH_USER;
+		default 								: return GET_USER_FILES_LIST_ERR_MEMORY;
+	}
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// sharding
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int proxy_request(char* req_type, struct connection* p_conn)
+{
+	int socket = p_conn->socket;
+	uint32_t fields_per_item = 0;
+	int num_of_fields = get_proxied_request_format(req_type, &fields_per_item);
+	if (num_of_fields < 0)
+	{
+		printf("ERROR proxy_request - no such request type\n");
+		return 0;
+	}
+
+	int is_put_file = strcmp(req_type, REQ_PUT_FILE) == 0;
+	int is_announce = strcmp(req_type, REQ_ANNOUNCE) == 0;
+	char values[num_of_fields][MAX_FILENAME_LEN + 1];
+	for (int i = 0; i < num_of_fields; i++)
+	{
+		if (read_line(socket, values[i], MAX_FILENAME_LEN) < 0)
+			return 0;
+	}
+
+	// the size of the content of PUT_FILE or the number of the items which follow the fields
+	uint64_t number = 0;
+	uint64_t max_number = is_put_file ? MAX_PROXIED_CONTENT 
+		: is_announce ? MAX_NUMBER_OF_CHUNKS : MAX_BATCH_SIZE;
+	if ((is_put_file || fields_per_item > 0) && (!parse_number(values[num_of_fields - 1], &number)
+		|| number > max_number))
+	{
+		printf("ERROR proxy_request - wrong request format\n");
+
+		char response[2];
+		response[0] = is_put_file ? PUT_FILE_OTHER_ERROR 
+			: is_announce ? ANNOUNCE_OTHER_ERROR : BATCH_OTHER_ERROR;
+		response[1] = '\0';
+		if (send_msg(socket, response, 2) != 0)
+			printf("ERROR proxy_request - could not send response\n");
+		return 0;	// the rest of the request was not read
+	}
+
+	uint64_t num_of_item_fields = fields_per_item * number;
+	struct client_request request;
+	memset(&request, 0, sizeof(request));
+	request.type = req_type;
+	request.num_of_fields = num_of_fields + num_of_item_fields;
+	request.fields = malloc(request.num_of_fields * sizeof(char*));
+	char (*items)[MAX_FILENAME_LEN + 1] = num_of_item_fields > 0
+		? malloc(num_of_item_fields * (MAX_FILENAME_LEN + 1)) : NULL;
+	if (is_put_file)
+		request.data = malloc(number + 1);
+
+	int res = request.fields != NULL && (num_of_item_fields == 0 || items != NULL) 
+		&& (!is_put_file || request.data != NULL);
+	for (int i = 0; res && i < num_of_fields; i++)
+		request.fields[i] = values[i];
+	for (uint64_t i = 0; res && i < num_of_item_fields; i++)
+	{
+		res = read_line(socket, items[i], MAX_FILENAME_LEN) >= 0;
+		request.fields[num_of_fields + i] = items[i];
+	}
+	if (res && is_put_file && number > 0)
+	{
+		set_deadline(p_conn, DEADLINE_READ, transfer_timeout_ms(number));
+		res = receive_msg(socket, request.data, number) == 0;
+		request.data_len = number;
+	}
+
+	if (res)
+	{
+		char client_ip[INET_ADDRSTRLEN];
+		inet_ntop(AF_INET, &p_conn->client_addr.sin_addr, client_ip, sizeof(client_ip));
+
+		struct client_response response;
+		int forward_res = shard_proxy_forward(&request, client_ip, &response);
+		if (forward_res == SHARD_PROXY_SUCCESS)
+		{
+			res = send_proxied_response(p_conn, &response) == 0;
+			client_free_response(&response);
+		}
+		else
+		{
+			// the client can retry like when the server is overloaded
+			printf("ERROR proxy_request - could not forward request. Code: %d\n", forward_res);
+			send_busy(socket);
+			res = 0;
+		}
+	}
+	else
+		printf("ERROR proxy_request - could not read request\n");
+
+	free(request.data);
+	free(items);
+	free(request.fields);
+
+	return res;
+}
+
+
+
+int get_proxied_request_format(char* req_type, uint32_t* p_fields_per_item)
+{
+	*p_fields_per_item = 0;
+
+	if (strcmp(req_type, REQ_REGISTER) == 0 || strcmp(req_type, REQ_UNREGISTER) == 0
+		|| strcmp(req_type, REQ_DISCONNECT) == 0 || strcmp(req_type, REQ_LIST_USERS) == 0
+		|| strcmp(req_type, REQ_HEARTBEAT) == 0)
+		return 1;
+
+	if (strcmp(req_type, REQ_CONNECT) == 0 || strcmp(req_type, REQ_DELETE) == 0
+		|| strcmp(req_type, REQ_LIST_CONTENT) == 0 || strcmp(req_type, REQ_WHO_HAS) == 0
+		|| strcmp(req_type, REQ_RELEASE_SOURCES) == 0)
+		return 2;
+
+	if (strcmp(req_type, REQ_PUBLISH) == 0 || strcmp(req_type, REQ_SEARCH) == 0
+		|| strcmp(req_type, REQ_GET_SOURCES) == 0 || strcmp(req_type, REQ_PUT_FILE) == 0)
+		return 3;
+
+	if (strcmp(req_type, REQ_LIST_USERS_FILTER) == 0)
+		return 4;
+
+	if (strcmp(req_type, REQ_GET_FILE) == 0 || strcmp(req_type, REQ_LIST_CONTENT_FILTER) == 0)
+		return 5;
+
+	// the chunk hashes
+	if (strcmp(req_type, REQ_ANNOUNCE) == 0)
+	{
+		*p_fields_per_item = 1;
+		return 5;
+	}
+
+	// the usernames
+	if (strcmp(req_type, REQ_REGISTER_BATCH) == 0 || strcmp(req_type, REQ_UNREGISTER_BATCH) == 0)
+	{
+		*p_fields_per_item = 1;
+		return 1;
+	}
+
+	// the names and the descriptions of the files
+	if (strcmp(req_type, REQ_PUBLISH_BATCH) == 0)
+	{
+		*p_fields_per_item = 2;
+		return 2;
+	}
+
+	return -1;
+}
+
+
+
+int send_proxied_response(struct connection* p_conn, struct client_response* p_response)
+{
+	int socket = p_conn->socket;
+
+	char response_res_code[2];
+	response_res_code[0] = p_response->result;
+	response_res_code[1] = '\0';
+
+	if (send_msg(socket, response_res_code, 2) != 0)
+		return -1;
+
+	for (uint32_t i = 0; i < p_response->num_of_fields; i++)
+	{
+		if (send_msg(socket, p_response->fields[i], strlen(p_response->fields[i]) + 1) != 0)
+			return -1;
+	}
+
+	// the content of GET_FILE
+	set_deadline(p_conn, DEADLINE_WRITE, transfer_timeout_ms(p_response->data_len));
+	for (uint64_t sent = 0; sent < p_response->data_len; sent += MAX_PROXIED_CONTENT)
+	{
+		uint64_t length = p_response->data_len - sent < MAX_PROXIED_CONTENT 
+			? p_response->data_len - sent : MAX_PROXIED_CONTENT;
+		if (send_msg(socket, p_response->data + sent, length) != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+
+
+void user_status(int socket)
+{
+	uint8_t res = USER_STATUS_SUCCESS;
+	char username[MAX_USERNAME_LEN + 1];
+
+	if (read_username(socket, username) > 0)
+	{
+		if (!lookup_registered(username))
+			res = USER_STATUS_NOT_REGISTERED;
+		else if (!lookup_connected(username))
+			res = USER_STATUS_DISCONNECTED;
+	}
+	else
+	{
+		printf("ERROR user_status - wrong request format\n");
+		res = USER_STATUS_OTHER_ERROR;
+	}
+
+	char response[2];
+	response[0] = res;
+	response[1] = '\0';
+
+	if (send_msg(socket, response, 2) != 0)
+		printf("ERROR user_status - could not send response\n");
+}
+
+
+
+void shard_users(int socket)
+{
+	uint8_t res = SHARD_USERS_SUCCESS;
+	struct usernames_list users;
+	memset(&users, 0, sizeof(users));
+
+	int scan_users_res = scan_users(collect_username, &users);
+	if (scan_users_res != SCAN_USERS_SUCCESS)
+	{
+		printf("ERROR shard_users - could not scan users. Code: %d\n", scan_users_res);
+		res = SHARD_USERS_OTHER_ERROR;
+	}
+
+	char response_res_code[2];
+	response_res_code[0] = res;
+	response_res_code[1] = '\0';
+
+	if (send_msg(socket, response_res_code, 2) == 0)
+	{
+		if (res == SHARD_USERS_SUCCESS)
+		{
+			int send_res = send_content_list(socket, users.usernames, users.num_of_usernames);
+
+			if (send_res != SEND_CONTENT_LIST_SUCCESS)
+				printf("ERROR shard_users - could not send users. Code: %d\n", send_res);
+		}
+	}
+	else
+		printf("ERROR shard_users - could not send response\n");
+
+	for (uint32_t i = 0; i < users.num_of_usernames; i++)
+		free(users.usernames[i]);
+	free(users.usernames);
+}
+
+
+
+void collect_username(char* username, void* arg)
+{
+	struct usernames_list* p_users = arg;
+
+	if (p_users->num_of_usernames == p_users->capacity)
+	{
+		uint32_t new_capacity = p_users->capacity == 0 ? 64 : 2 * p_users->capacity;
+		char** new_usernames = realloc(p_users->usernames, new_capacity * sizeof(char*));
+		if (new_usernames == NULL)
+			return;
+		p_users->usernames = new_usernames;
+		p_users->capacity = new_capacity;
+	}
+
+	char* copy = strdup(username);
+	if (copy != NULL)
+		p_users->usernames[p_users->num_of_usernames++] = copy;
+}
+
+
+
+void user_dump(int socket)
+{
+	uint8_t res = USER_DUMP_SUCCESS;
+	char username[MAX_USERNAME_LEN + 1];
+	char** user_files = NULL;
+	uint32_t num_of_files = 0;
+	user connected_user;
+	memset(&connected_user, 0, sizeof(connected_user));
+
+	if (read_username(socket, username) > 0)
+	{
+		switch (get_user_files_list(username, &user_files, &num_of_files, &request_arena))
+		{
+			case GET_USER_FILES_LIST_SUCCESS 			: res = USER_DUMP_SUCCESS; break;
+			case GET_USER_FILES_LIST_ERR_NO_SUCH_USER 	: res = USER_DUMP_NO_SUCH_USER; break;
+			default 									: res = USER_DUMP_OTHER_ERROR;
+		}
+
+		if (res == USER_DUMP_SUCCESS)
+			get_connected_user(username, &connected_user);
+	}
+	else
+	{
+		printf("ERROR user_dump - wrong request format\n");
+		res = USER_DUMP_OTHER_ERROR;
+	}
+
+	char response_res_code[2];
+	response_res_code[0] = res;
+	response_res_code[1] = '\0';
+
+	if (send_msg(socket, response_res_code, 2) != 0)
+		printf("ERROR user_dump - could not send response\n");
+	else if (res == USER_DUMP_SUCCESS)
+	{
+		int send_res = send_msg(socket, connected_user.ip, strlen(connected_user.ip) + 1) != 0
+			|| send_msg(socket, connected_user.port, strlen(connected_user.port) + 1) != 0
+			|| send_number(socket, num_of_files) != 0;
+
+		for (uint32_t i = 0; i < num_of_files && send_res == 0; i++)
+		{
+			// a file deleted meanwhile is sent without description
+			char description[MAX_DESCRIPTION_LEN + 1] = "";
+			get_file_description(username, user_files[i], description);
+
+			send_res = send_msg(socket, user_files[i], strlen(user_files[i]) + 1) != 0
+				|| send_msg(socket, description, strlen(description) + 1) != 0;
+		}
+
+		if (send_res != 0)
+			printf("ERROR user_dump - could not send user\n");
+	}
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// send_number
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int send_number(int socket, uint64_t number)
+{
+	char str_number[MAX_NUMBER_LEN + 1];
+	sprintf(str_number, "%lu", (unsigned long) number);
+
+	return send_msg(socket, str_number, strlen(str_number) + 1) == 0 ? 0 : -1;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// is_filename_valid
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int is_filename_valid(char* file_name)
+{
+	// no hidden files (used internally by the storage) and no paths
+	return file_name[0] != '\0' && file_name[0] != '.' && strchr(file_name, '/') == NULL;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// read_number
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int read_number(int socket, uint64_t* p_number)
+{
+	char str_number[MAX_NUMBER_LEN + 1];
+	if (read_line(socket, str_number, MAX_NUMBER_LEN + 1) <= 0)
+		return 0;
+
+	return parse_number(str_number, p_number);
+}
+
+
+
+int parse_number(char* str_number, uint64_t* p_number)
+{
+	char* end = NULL;
+	errno = 0;
+	unsigned long long number = strtoull(str_number, &end, 10);
+	if (errno != 0 || *end != '\0' || str_number[0] == '-' || str_number[0] == '\0')
+		return 0;
+
+	*p_number = number;
+
+	return 1;
+}
+
+
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // read_user_name
 ///////////////////////////////////////////////////////////////////////////////////////////////////
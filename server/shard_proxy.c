@@ -0,0 +1,1031 @@
+#include "shard_proxy.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define MAX_HOST_LEN 255
+#define MAX_NUMBER_LEN 20
+// result codes of the forwarded requests
+#define RESULT_SUCCESS 0
+#define RESULT_NOT_REGISTERED 1             // the requesting user, same for all the requests
+#define RESULT_DISCONNECTED 2               // the requesting user, same for all the requests
+#define RESULT_GET_SOURCES_NO_SUCH_FILE 3
+#define RESULT_BUSY 255
+// wrappers
+#define REQ_SHARD "SHARD"
+#define REQ_SHARD_FANOUT "SHARD_FANOUT"
+// how the request is routed
+#define ROUTE_NONE 0
+#define ROUTE_USER 1        // to the shard of the user (the first field)
+#define ROUTE_OWNER 2       // to the shard of the owner (the second field)
+#define ROUTE_ALL 3         // to all the shards
+#define ROUTE_SPLIT 4       // every user of the batch to its shard
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct shard {
+    char host[MAX_HOST_LEN + 1];
+    int port;
+    struct client_pool* p_pool;
+};
+
+struct ring_point {
+    uint64_t hash;
+    uint32_t shard;
+};
+
+/*
+    requests sent to the shards in parallel, num_of_pending is protected by the mutex and cond is
+    signaled when it drops to 0
+*/
+struct fanout {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    uint32_t num_of_pending;
+};
+
+/*
+    request sent to one shard as a part of a fanout
+*/
+struct shard_leg {
+    uint32_t shard;
+    struct client_request request;      // already wrapped
+    int status;                         // CLIENT_SUCCESS or CLIENT_ERR_*
+    struct client_response response;
+    struct fanout* p_fanout;
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// global variables
+///////////////////////////////////////////////////////////////////////////////////////////////////
+struct shard shards[MAX_NUMBER_OF_SHARDS];
+uint32_t num_of_shards;
+struct ring_point* ring;
+uint32_t num_of_ring_points;
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// hash ring
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    FNV-1a followed by a finalizer, so that similar usernames spread over the whole ring
+*/
+uint64_t ring_hash(char* key)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (char* p = key; *p != '\0'; p++)
+    {
+        hash ^= (unsigned char) *p;
+        hash *= 1099511628211ull;
+    }
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+
+
+int compare_ring_points(const void* p_a, const void* p_b)
+{
+    const struct ring_point* p_point_a = p_a;
+    const struct ring_point* p_point_b = p_b;
+
+    if (p_point_a->hash != p_point_b->hash)
+        return p_point_a->hash < p_point_b->hash ? -1 : 1;
+
+    return (int) p_point_a->shard - (int) p_point_b->shard;
+}
+
+
+
+uint32_t shard_of(char* username)
+{
+    uint64_t hash = ring_hash(username);
+
+    // the first point not before the hash, the ring wraps around
+    uint32_t low = 0;
+    uint32_t high = num_of_ring_points;
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        if (ring[middle].hash < hash)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return ring[low == num_of_ring_points ? 0 : low].shard;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// calls to the shards
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void complete_shard_leg(int status, struct client_response* p_response, void* arg)
+{
+    struct shard_leg* p_leg = arg;
+    struct fanout* p_fanout = p_leg->p_fanout;
+
+    pthread_mutex_lock(&p_fanout->mutex);
+    p_leg->status = status;
+    p_leg->response = *p_response;
+    memset(p_response, 0, sizeof(struct client_response));  // the leg owns it now
+    if (--p_fanout->num_of_pending == 0)
+        pthread_cond_signal(&p_fanout->cond);
+    pthread_mutex_unlock(&p_fanout->mutex);
+}
+
+
+
+/*
+    fills in the leg with the request wrapped in the wrapper (REQ_SHARD or REQ_SHARD_FANOUT).
+    wrapped_fields must have room for 2 more fields than the request.
+*/
+void init_shard_leg(struct shard_leg* p_leg, uint32_t shard, char* wrapper, char* client_ip,
+    struct client_request* p_request, char** wrapped_fields)
+{
+    wrapped_fields[0] = client_ip;
+    wrapped_fields[1] = p_request->type;
+    for (uint32_t i = 0; i < p_request->num_of_fields; i++)
+        wrapped_fields[i + 2] = p_request->fields[i];
+
+    memset(p_leg, 0, sizeof(struct shard_leg));
+    p_leg->shard = shard;
+    p_leg->request.type = wrapper;
+    p_leg->request.fields = wrapped_fields;
+    p_leg->request.num_of_fields = p_request->num_of_fields + 2;
+    p_leg->request.data = p_request->data;
+    p_leg->request.data_len = p_request->data_len;
+}
+
+
+
+/*
+    sends the requests of the legs to their shards in parallel and waits for all the responses.
+    Returns 0 if all the shards answered and -1 if no
+*/
+int run_shard_legs(struct shard_leg* legs, uint32_t num_of_legs)
+{
+    struct fanout fanout;
+    pthread_mutex_init(&fanout.mutex, NULL);
+    pthread_cond_init(&fanout.cond, NULL);
+    fanout.num_of_pending = num_of_legs;
+
+    for (uint32_t i = 0; i < num_of_legs; i++)
+    {
+        legs[i].p_fanout = &fanout;
+        int submit_res = client_submit(shards[legs[i].shard].p_pool, &legs[i].request,
+            complete_shard_leg, &legs[i]);
+        if (submit_res != CLIENT_SUCCESS)
+        {
+            pthread_mutex_lock(&fanout.mutex);
+            legs[i].status = submit_res;
+            fanout.num_of_pending--;
+            pthread_mutex_unlock(&fanout.mutex);
+        }
+    }
+
+    pthread_mutex_lock(&fanout.mutex);
+    while (fanout.num_of_pending > 0)
+        pthread_cond_wait(&fanout.cond, &fanout.mutex);
+    pthread_mutex_unlock(&fanout.mutex);
+
+    pthread_cond_destroy(&fanout.cond);
+    pthread_mutex_destroy(&fanout.mutex);
+
+    int res = 0;
+    for (uint32_t i = 0; i < num_of_legs; i++)
+    {
+        // an overloaded shard closes the connection, let the client retry
+        if (legs[i].status != CLIENT_SUCCESS || legs[i].response.result == RESULT_BUSY)
+            res = -1;
+    }
+
+    return res;
+}
+
+
+
+void free_shard_legs(struct shard_leg* legs, uint32_t num_of_legs)
+{
+    for (uint32_t i = 0; i < num_of_legs; i++)
+        client_free_response(&legs[i].response);
+}
+
+
+
+/*
+    sends the request of the proxy itself to the shard.
+    Returns CLIENT_SUCCESS or one of CLIENT_ERR_*
+*/
+int call_shard(uint32_t shard, char* type, char** fields, uint32_t num_of_fields, char* data,
+    uint64_t data_len, struct client_response* p_response)
+{
+    struct client_request request;
+    request.type = type;
+    request.fields = fields;
+    request.num_of_fields = num_of_fields;
+    request.data = data;
+    request.data_len = data_len;
+
+    char* wrapped_fields[num_of_fields + 2];
+    struct shard_leg leg;
+    init_shard_leg(&leg, shard, REQ_SHARD, PROXY_OWN_IP, &request, wrapped_fields);
+
+    int res = client_call(shards[shard].p_pool, &leg.request, p_response);
+    if (res == CLIENT_SUCCESS && p_response->result == RESULT_BUSY)
+        res = CLIENT_ERR_RECEIVE;
+
+    return res;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// merging the responses
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    moves the response of the leg to p_response.
+*/
+void take_response(struct shard_leg* p_leg, struct client_response* p_response)
+{
+    *p_response = p_leg->response;
+    memset(&p_leg->response, 0, sizeof(struct client_response));
+}
+
+
+
+/*
+    adds the field to the response, the response owns it afterwards.
+    Returns 0 on success and -1 on fail
+*/
+int add_response_field(struct client_response* p_response, uint32_t* p_capacity, char* field)
+{
+    if (field == NULL)
+        return -1;
+
+    if (p_response->num_of_fields == *p_capacity)
+    {
+        uint32_t capacity = *p_capacity == 0 ? 16 : 2 * *p_capacity;
+        char** fields = realloc(p_response->fields, capacity * sizeof(char*));
+        if (fields == NULL)
+        {
+            free(field);
+            return -1;
+        }
+        p_response->fields = fields;
+        *p_capacity = capacity;
+    }
+
+    p_response->fields[p_response->num_of_fields++] = field;
+
+    return 0;
+}
+
+
+
+/*
+    moves count fields starting at first from the leg's response to p_response.
+    Returns 0 on success and -1 on fail
+*/
+int move_response_fields(struct shard_leg* p_leg, uint32_t first, uint32_t count,
+    struct client_response* p_response, uint32_t* p_capacity)
+{
+    for (uint32_t i = first; i < first + count && i < p_leg->response.num_of_fields; i++)
+    {
+        if (add_response_field(p_response, p_capacity, p_leg->response.fields[i]) != 0)
+            return -1;
+        p_leg->response.fields[i] = NULL;
+    }
+
+    return 0;
+}
+
+
+
+char* number_field(uint64_t number)
+{
+    char* field = malloc(MAX_NUMBER_LEN + 1);
+    if (field != NULL)
+        sprintf(field, "%lu", (unsigned long) number);
+
+    return field;
+}
+
+
+
+uint64_t leg_number(struct shard_leg* p_leg, uint32_t idx)
+{
+    return idx < p_leg->response.num_of_fields ? strtoull(p_leg->response.fields[idx], NULL, 10)
+        : 0;
+}
+
+
+
+/*
+    merges lists of records of fields_per_record fields preceded by their number (LIST_USERS,
+    WHO_HAS, SEARCH). The lists are interleaved, so the best results of every shard come first.
+    At most max_records are kept.
+*/
+int merge_lists(struct shard_leg* legs, uint32_t num_of_legs, uint32_t fields_per_record,
+    uint64_t max_records, struct client_response* p_response)
+{
+    uint32_t capacity = 0;
+    uint64_t num_of_records = 0;
+    uint64_t taken[MAX_NUMBER_OF_SHARDS];
+
+    memset(p_response, 0, sizeof(struct client_response));
+    if (add_response_field(p_response, &capacity, number_field(0)) != 0)
+        return -1;
+
+    for (uint32_t i = 0; i < num_of_legs; i++)
+        taken[i] = 0;
+
+    int is_taken = 1;
+    while (is_taken && num_of_records < max_records)
+    {
+        is_taken = 0;
+        for (uint32_t i = 0; i < num_of_legs && num_of_records < max_records; i++)
+        {
+            if (taken[i] < leg_number(&legs[i], 0))
+            {
+                if (move_response_fields(&legs[i], 1 + taken[i] * fields_per_record,
+                    fields_per_record, p_response, &capacity) != 0)
+                    return -1;
+                taken[i]++;
+                num_of_records++;
+                is_taken = 1;
+            }
+        }
+    }
+
+    sprintf(p_response->fields[0], "%lu", (unsigned long) num_of_records);
+
+    return 0;
+}
+
+
+
+/*
+    merges lists of records of fields_per_record fields preceded by their number which are sorted
+    by their first field (LIST_USERS_FILTER), so the merged list is sorted too.
+*/
+int merge_sorted_lists(struct shard_leg* legs, uint32_t num_of_legs, uint32_t fields_per_record,
+    struct client_response* p_response)
+{
+    uint32_t capacity = 0;
+    uint64_t num_of_records = 0;
+    uint64_t taken[MAX_NUMBER_OF_SHARDS];
+    uint64_t numbers[MAX_NUMBER_OF_SHARDS];
+
+    memset(p_response, 0, sizeof(struct client_response));
+    if (add_response_field(p_response, &capacity, number_field(0)) != 0)
+        return -1;
+
+    for (uint32_t i = 0; i < num_of_legs; i++)
+    {
+        taken[i] = 0;
+        numbers[i] = leg_number(&legs[i], 0);
+    }
+
+    while (1)
+    {
+        // the leg whose next record is the smallest
+        char* p_smallest = NULL;
+        uint32_t smallest = 0;
+        for (uint32_t i = 0; i < num_of_legs; i++)
+        {
+            uint64_t first = 1 + taken[i] * fields_per_record;
+            if (taken[i] < numbers[i] && first < legs[i].response.num_of_fields
+                && (p_smallest == NULL || strcmp(legs[i].response.fields[first], p_smallest) < 0))
+            {
+                p_smallest = legs[i].response.fields[first];
+                smallest = i;
+            }
+        }
+
+        if (p_smallest == NULL)
+            break;
+
+        if (move_response_fields(&legs[smallest], 1 + taken[smallest] * fields_per_record,
+            fields_per_record, p_response, &capacity) != 0)
+            return -1;
+        taken[smallest]++;
+        num_of_records++;
+    }
+
+    sprintf(p_response->fields[0], "%lu", (unsigned long) num_of_records);
+
+    return 0;
+}
+
+
+
+struct source_ref {
+    struct shard_leg* p_leg;
+    uint32_t first_field;
+    uint64_t num_of_downloads;
+};
+
+
+
+int compare_sources(const void* p_a, const void* p_b)
+{
+    const struct source_ref* p_source_a = p_a;
+    const struct source_ref* p_source_b = p_b;
+
+    if (p_source_a->num_of_downloads != p_source_b->num_of_downloads)
+        return p_source_a->num_of_downloads < p_source_b->num_of_downloads ? -1 : 1;
+
+    return 0;
+}
+
+
+
+/*
+    merges the responses of GET_SOURCES: the description of the file from the first shard which
+    knows it and the least loaded sources of all the shards.
+*/
+int merge_sources(struct shard_leg* legs, uint32_t num_of_legs, uint64_t max_sources,
+    struct client_response* p_response)
+{
+    struct shard_leg* p_first = NULL;
+    uint64_t num_of_sources = 0;
+
+    for (uint32_t i = 0; i < num_of_legs; i++)
+    {
+        if (legs[i].response.result != RESULT_SUCCESS)
+            continue;
+
+        if (p_first == NULL)
+            p_first = &legs[i];
+        num_of_sources += leg_number(&legs[i], 3 + leg_number(&legs[i], 2));
+    }
+
+    memset(p_response, 0, sizeof(struct client_response));
+    p_response->result = RESULT_GET_SOURCES_NO_SUCH_FILE;
+    if (p_first == NULL)
+        return 0;
+
+    struct source_ref* sources = malloc((num_of_sources + 1) * sizeof(struct source_ref));
+    if (sources == NULL)
+        return -1;
+
+    uint64_t n = 0;
+    for (uint32_t i = 0; i < num_of_legs; i++)
+    {
+        if (legs[i].response.result != RESULT_SUCCESS)
+            continue;
+
+        uint32_t sources_field = 3 + leg_number(&legs[i], 2);
+        uint64_t leg_sources = leg_number(&legs[i], sources_field);
+        for (uint64_t j = 0; j < leg_sources && n < num_of_sources; j++)
+        {
+            sources[n].p_leg = &legs[i];
+            sources[n].first_field = sources_field + 1 + 4 * j;
+            sources[n].num_of_downloads = leg_number(&legs[i], sources[n].first_field + 3);
+            n++;
+        }
+    }
+    qsort(sources, n, sizeof(struct source_ref), compare_sources);
+    if (n > max_sources)
+        n = max_sources;
+
+    // size, chunk size, number of chunks and the hashes, then the sources
+    uint32_t capacity = 0;
+    p_response->result = RESULT_SUCCESS;
+    int res = move_response_fields(p_first, 0, 3 + leg_number(p_first, 2), p_response, &capacity);
+    if (res == 0)
+        res = add_response_field(p_response, &capacity, number_field(n));
+    for (uint64_t i = 0; res == 0 && i < n; i++)
+        res = move_response_fields(sources[i].p_leg, sources[i].first_field, 4, p_response,
+            &capacity);
+
+    free(sources);
+
+    return res;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// init / destroy
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int init_shard_proxy(char* shards_list)
+{
+    num_of_shards = 0;
+
+    char list[strlen(shards_list) + 1];
+    strcpy(list, shards_list);
+
+    char* save = NULL;
+    for (char* p_shard = strtok_r(list, ",", &save); p_shard != NULL;
+        p_shard = strtok_r(NULL, ",", &save))
+    {
+        struct shard* p = &shards[num_of_shards];
+        if (num_of_shards == MAX_NUMBER_OF_SHARDS
+            || sscanf(p_shard, "%255[^:]:%d", p->host, &p->port) != 2)
+            return INIT_SHARD_PROXY_ERR_SHARDS;
+        num_of_shards++;
+    }
+
+    if (num_of_shards == 0)
+        return INIT_SHARD_PROXY_ERR_SHARDS;
+
+    num_of_ring_points = num_of_shards * NUM_OF_VIRTUAL_NODES;
+    ring = malloc(num_of_ring_points * sizeof(struct ring_point));
+    if (ring == NULL)
+        return INIT_SHARD_PROXY_ERR_MEMORY;
+
+    // the points of a shard depend only on its address, so they stay when shards are added
+    char key[MAX_HOST_LEN + 2 * MAX_NUMBER_LEN + 3];
+    for (uint32_t i = 0; i < num_of_shards; i++)
+    {
+        for (uint32_t j = 0; j < NUM_OF_VIRTUAL_NODES; j++)
+        {
+            sprintf(key, "%s:%d#%u", shards[i].host, shards[i].port, j);
+            ring[i * NUM_OF_VIRTUAL_NODES + j].hash = ring_hash(key);
+            ring[i * NUM_OF_VIRTUAL_NODES + j].shard = i;
+        }
+    }
+    qsort(ring, num_of_ring_points, sizeof(struct ring_point), compare_ring_points);
+
+    for (uint32_t i = 0; i < num_of_shards; i++)
+    {
+        if (client_pool_create(shards[i].host, shards[i].port, SHARD_CONNECTIONS, SHARD_WINDOW,
+            &shards[i].p_pool) != CLIENT_SUCCESS)
+        {
+            while (i-- > 0)
+                client_pool_destroy(shards[i].p_pool);
+            free(ring);
+            return INIT_SHARD_PROXY_ERR_POOL;
+        }
+    }
+
+    return INIT_SHARD_PROXY_SUCCESS;
+}
+
+
+
+void destroy_shard_proxy()
+{
+    for (uint32_t i = 0; i < num_of_shards; i++)
+        client_pool_destroy(shards[i].p_pool);
+
+    free(ring);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// shard_proxy_forward
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int get_route(char* type)
+{
+    if (strcmp(type, CLIENT_REQ_REGISTER) == 0 || strcmp(type, CLIENT_REQ_UNREGISTER) == 0
+        || strcmp(type, CLIENT_REQ_CONNECT) == 0 || strcmp(type, CLIENT_REQ_DISCONNECT) == 0
+        || strcmp(type, CLIENT_REQ_PUBLISH) == 0 || strcmp(type, CLIENT_REQ_DELETE) == 0
+        || strcmp(type, CLIENT_REQ_PUT_FILE) == 0 || strcmp(type, CLIENT_REQ_ANNOUNCE) == 0
+        || strcmp(type, CLIENT_REQ_PUBLISH_BATCH) == 0 || strcmp(type, CLIENT_REQ_HEARTBEAT) == 0)
+        return ROUTE_USER;
+
+    if (strcmp(type, CLIENT_REQ_REGISTER_BATCH) == 0
+        || strcmp(type, CLIENT_REQ_UNREGISTER_BATCH) == 0)
+        return ROUTE_SPLIT;
+
+    if (strcmp(type, CLIENT_REQ_LIST_CONTENT) == 0 || strcmp(type, CLIENT_REQ_GET_FILE) == 0
+        || strcmp(type, CLIENT_REQ_LIST_CONTENT_FILTER) == 0)
+        return ROUTE_OWNER;
+
+    if (strcmp(type, CLIENT_REQ_LIST_USERS) == 0 || strcmp(type, CLIENT_REQ_SEARCH) == 0
+        || strcmp(type, CLIENT_REQ_LIST_USERS_FILTER) == 0
+        || strcmp(type, CLIENT_REQ_WHO_HAS) == 0 || strcmp(type, CLIENT_REQ_GET_SOURCES) == 0
+        || strcmp(type, CLIENT_REQ_RELEASE_SOURCES) == 0)
+        return ROUTE_ALL;
+
+    return ROUTE_NONE;
+}
+
+
+
+/*
+    merges the responses of the request sent to all the shards, the first leg is the one sent to
+    the shard of the requesting user.
+*/
+int merge_all(struct client_request* p_request, struct shard_leg* legs, uint32_t num_of_legs,
+    struct client_response* p_response)
+{
+    char* type = p_request->type;
+    int is_get_sources = strcmp(type, CLIENT_REQ_GET_SOURCES) == 0;
+
+    // the requesting user could not be checked, or the request is wrong
+    if (legs[0].response.result != RESULT_SUCCESS && (!is_get_sources
+        || legs[0].response.result == RESULT_NOT_REGISTERED
+        || legs[0].response.result == RESULT_DISCONNECTED))
+    {
+        take_response(&legs[0], p_response);
+        return 0;
+    }
+
+    for (uint32_t i = 1; i < num_of_legs; i++)
+    {
+        if (legs[i].response.result != RESULT_SUCCESS && (!is_get_sources
+            || legs[i].response.result != RESULT_GET_SOURCES_NO_SUCH_FILE))
+        {
+            take_response(&legs[i], p_response);
+            return 0;
+        }
+    }
+
+    if (strcmp(type, CLIENT_REQ_RELEASE_SOURCES) == 0)
+    {
+        memset(p_response, 0, sizeof(struct client_response));
+        return 0;
+    }
+
+    if (is_get_sources)
+        return merge_sources(legs, num_of_legs, strtoull(p_request->fields[2], NULL, 10),
+            p_response);
+
+    if (strcmp(type, CLIENT_REQ_SEARCH) == 0)
+        return merge_lists(legs, num_of_legs, 2, strtoull(p_request->fields[2], NULL, 10),
+            p_response);
+
+    if (strcmp(type, CLIENT_REQ_LIST_USERS_FILTER) == 0)
+        return merge_sorted_lists(legs, num_of_legs, 3, p_response);
+
+    return merge_lists(legs, num_of_legs, 3, UINT64_MAX, p_response);
+}
+
+
+
+/*
+    forwards the batch of users (the number of the users and the usernames) to the shards of the
+    users, every shard gets the batch of its users. The results of the shards are put together in
+    the order of the request.
+*/
+int forward_batch(struct client_request* p_request, char* client_ip,
+    struct client_response* p_response)
+{
+    uint32_t num_of_items = p_request->num_of_fields - 1;
+    char** items = p_request->fields + 1;
+
+    uint32_t num_of_shard_items[MAX_NUMBER_OF_SHARDS];
+    memset(num_of_shard_items, 0, sizeof(num_of_shard_items));
+    uint32_t* item_shards = malloc((num_of_items + 1) * sizeof(uint32_t));
+    // for every shard: the number of the items and the items, then the wrapped request
+    char** shard_fields = malloc((2 * num_of_items + 4 * num_of_shards) * sizeof(char*));
+    char* results = malloc(num_of_items + 1);
+    if (item_shards == NULL || shard_fields == NULL || results == NULL)
+    {
+        free(results);
+        free(shard_fields);
+        free(item_shards);
+        return SHARD_PROXY_ERR_MEMORY;
+    }
+
+    for (uint32_t i = 0; i < num_of_items; i++)
+    {
+        item_shards[i] = shard_of(items[i]);
+        num_of_shard_items[item_shards[i]]++;
+    }
+
+    struct shard_leg legs[MAX_NUMBER_OF_SHARDS];
+    uint32_t leg_of_shard[MAX_NUMBER_OF_SHARDS];
+    char str_num_of_items[MAX_NUMBER_OF_SHARDS][MAX_NUMBER_LEN + 1];
+    uint32_t num_of_legs = 0;
+    char** p_next_fields = shard_fields;
+    for (uint32_t i = 0; i < num_of_shards; i++)
+    {
+        if (num_of_shard_items[i] == 0)
+            continue;
+
+        sprintf(str_num_of_items[i], "%u", num_of_shard_items[i]);
+        struct client_request shard_request;
+        memset(&shard_request, 0, sizeof(shard_request));
+        shard_request.type = p_request->type;
+        shard_request.fields = p_next_fields;
+        shard_request.num_of_fields = 1;
+        shard_request.fields[0] = str_num_of_items[i];
+        for (uint32_t j = 0; j < num_of_items; j++)
+        {
+            if (item_shards[j] == i)
+                shard_request.fields[shard_request.num_of_fields++] = items[j];
+        }
+        p_next_fields += shard_request.num_of_fields;
+
+        // init_shard_leg copies the fields, the request can go away
+        init_shard_leg(&legs[num_of_legs], i, REQ_SHARD, client_ip, &shard_request,
+            p_next_fields);
+        p_next_fields += shard_request.num_of_fields + 2;
+        leg_of_shard[i] = num_of_legs++;
+    }
+
+    int res = SHARD_PROXY_SUCCESS;
+    if (run_shard_legs(legs, num_of_legs) != 0)
+        res = SHARD_PROXY_ERR_SHARD;
+    for (uint32_t i = 0; i < num_of_legs && res == SHARD_PROXY_SUCCESS; i++)
+    {
+        // the batch itself failed, e.g. a shard could not allocate it
+        if (legs[i].response.result != RESULT_SUCCESS)
+        {
+            take_response(&legs[i], p_response);
+            break;
+        }
+        if (legs[i].response.num_of_fields != 1
+            || strlen(legs[i].response.fields[0]) != num_of_shard_items[legs[i].shard])
+            res = SHARD_PROXY_ERR_SHARD;
+    }
+
+    if (res == SHARD_PROXY_SUCCESS && p_response->result == RESULT_SUCCESS)
+    {
+        uint32_t taken[MAX_NUMBER_OF_SHARDS];
+        memset(taken, 0, sizeof(taken));
+        for (uint32_t i = 0; i < num_of_items; i++)
+        {
+            struct shard_leg* p_leg = &legs[leg_of_shard[item_shards[i]]];
+            results[i] = p_leg->response.fields[0][taken[item_shards[i]]++];
+        }
+        results[num_of_items] = '\0';
+
+        p_response->fields = malloc(sizeof(char*));
+        if (p_response->fields == NULL)
+            res = SHARD_PROXY_ERR_MEMORY;
+        else
+        {
+            p_response->fields[0] = results;
+            p_response->num_of_fields = 1;
+            results = NULL;
+        }
+    }
+
+    free_shard_legs(legs, num_of_legs);
+    free(results);
+    free(shard_fields);
+    free(item_shards);
+
+    return res;
+}
+
+
+
+int shard_proxy_forward(struct client_request* p_request, char* client_ip,
+    struct client_response* p_response)
+{
+    memset(p_response, 0, sizeof(struct client_response));
+
+    int route = get_route(p_request->type);
+    if (route == ROUTE_NONE || p_request->num_of_fields < 1
+        || (route == ROUTE_OWNER && p_request->num_of_fields < 2)
+        || ((strcmp(p_request->type, CLIENT_REQ_SEARCH) == 0
+            || strcmp(p_request->type, CLIENT_REQ_GET_SOURCES) == 0)
+            && p_request->num_of_fields < 3))
+        return SHARD_PROXY_ERR_REQUEST;
+
+    if (route == ROUTE_SPLIT)
+        return forward_batch(p_request, client_ip, p_response);
+
+    // every leg has its own copy of the wrapped fields
+    uint32_t num_of_wrapped_fields = p_request->num_of_fields + 2;
+    uint32_t max_legs = route == ROUTE_ALL ? num_of_shards : route == ROUTE_OWNER ? 2 : 1;
+    char** wrapped_fields = malloc(max_legs * num_of_wrapped_fields * sizeof(char*));
+    if (wrapped_fields == NULL)
+        return SHARD_PROXY_ERR_MEMORY;
+
+    uint32_t home = shard_of(p_request->fields[0]);
+    struct shard_leg legs[MAX_NUMBER_OF_SHARDS];
+    uint32_t num_of_legs = 0;
+    int res = SHARD_PROXY_SUCCESS;
+
+    if (route == ROUTE_USER
+        || (route == ROUTE_OWNER && shard_of(p_request->fields[1]) == home)
+        || (route == ROUTE_ALL && num_of_shards == 1))
+    {
+        init_shard_leg(&legs[0], home, REQ_SHARD, client_ip, p_request, wrapped_fields);
+        num_of_legs = 1;
+
+        if (run_shard_legs(legs, num_of_legs) != 0)
+            res = SHARD_PROXY_ERR_SHARD;
+        else
+            take_response(&legs[0], p_response);
+    }
+    else if (route == ROUTE_OWNER)
+    {
+        // the requesting user is checked on its shard, the owner's data come from the other one
+        struct client_request status_request;
+        memset(&status_request, 0, sizeof(status_request));
+        status_request.type = CLIENT_REQ_USER_STATUS;
+        status_request.fields = p_request->fields;
+        status_request.num_of_fields = 1;
+
+        init_shard_leg(&legs[0], home, REQ_SHARD, client_ip, &status_request, wrapped_fields);
+        init_shard_leg(&legs[1], shard_of(p_request->fields[1]), REQ_SHARD_FANOUT, client_ip,
+            p_request, wrapped_fields + num_of_wrapped_fields);
+        num_of_legs = 2;
+
+        if (run_shard_legs(legs, num_of_legs) != 0 || (legs[0].response.result != RESULT_SUCCESS
+            && legs[0].response.result != RESULT_NOT_REGISTERED
+            && legs[0].response.result != RESULT_DISCONNECTED))
+            res = SHARD_PROXY_ERR_SHARD;
+        else
+            take_response(&legs[legs[0].response.result != RESULT_SUCCESS ? 0 : 1], p_response);
+    }
+    else
+    {
+        // the shard of the requesting user checks it, the other ones trust the proxy
+        init_shard_leg(&legs[0], home, REQ_SHARD, client_ip, p_request, wrapped_fields);
+        num_of_legs = 1;
+        for (uint32_t i = 0; i < num_of_shards; i++)
+        {
+            if (i != home)
+            {
+                init_shard_leg(&legs[num_of_legs], i, REQ_SHARD_FANOUT, client_ip, p_request,
+                    wrapped_fields + num_of_legs * num_of_wrapped_fields);
+                num_of_legs++;
+            }
+        }
+
+        if (run_shard_legs(legs, num_of_legs) != 0)
+            res = SHARD_PROXY_ERR_SHARD;
+        else if (merge_all(p_request, legs, num_of_legs, p_response) != 0)
+        {
+            client_free_response(p_response);
+            memset(p_response, 0, sizeof(struct client_response));
+            res = SHARD_PROXY_ERR_MEMORY;
+        }
+    }
+
+    free_shard_legs(legs, num_of_legs);
+    free(wrapped_fields);
+
+    return res;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// shard_proxy_rebalance
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    moves the user from the shard from to the shard to.
+    Returns 0 on success and -1 on fail
+*/
+int move_user(char* username, uint32_t from, uint32_t to)
+{
+    struct client_response dump;
+    struct client_response response;
+    memset(&response, 0, sizeof(response));
+    char* user_fields[] = { username };
+
+    // ip, port (empty if disconnected), number of files, name and description of each
+    if (call_shard(from, CLIENT_REQ_USER_DUMP, user_fields, 1, NULL, 0, &dump)
+        != CLIENT_SUCCESS || dump.result != RESULT_SUCCESS || dump.num_of_fields < 3)
+    {
+        client_free_response(&dump);
+        return -1;
+    }
+
+    int is_connected = dump.fields[0][0] != '\0';
+    uint64_t num_of_files = strtoull(dump.fields[2], NULL, 10);
+    int res = num_of_files * 2 + 3 <= dump.num_of_fields ? 0 : -1;
+
+    // registered already if a previous rebalance failed
+    if (res == 0 && call_shard(to, CLIENT_REQ_REGISTER, user_fields, 1, NULL, 0, &response)
+        != CLIENT_SUCCESS)
+        res = -1;
+    client_free_response(&response);
+
+    // publishing and uploading need a connected user, a disconnected one is connected only
+    // meanwhile. The connection is made from the user's ip, see REQ_SHARD
+    char* connect_fields[] = { REQ_SHARD, is_connected ? dump.fields[0] : PROXY_OWN_IP,
+        CLIENT_REQ_CONNECT, username, is_connected ? dump.fields[1] : "0" };
+    if (res == 0)
+    {
+        struct client_request connect_request;
+        memset(&connect_request, 0, sizeof(connect_request));
+        connect_request.type = connect_fields[0];
+        connect_request.fields = connect_fields + 1;
+        connect_request.num_of_fields = 4;
+
+        if (client_call(shards[to].p_pool, &connect_request, &response) != CLIENT_SUCCESS)
+            res = -1;
+        client_free_response(&response);
+    }
+
+    for (uint64_t i = 0; res == 0 && i < num_of_files; i++)
+    {
+        char* file_name = dump.fields[3 + 2 * i];
+        char* publish_fields[] = { username, file_name, dump.fields[4 + 2 * i] };
+        if (call_shard(to, CLIENT_REQ_PUBLISH, publish_fields, 3, NULL, 0, &response)
+            != CLIENT_SUCCESS)
+            res = -1;
+        client_free_response(&response);
+
+        // the relayed content, if it was uploaded
+        struct client_response content;
+        memset(&content, 0, sizeof(content));
+        char* get_fields[] = { REQ_SHARD_FANOUT, PROXY_OWN_IP, CLIENT_REQ_GET_FILE, username,
+            username, file_name, "0", "0" };
+        struct client_request get_request;
+        memset(&get_request, 0, sizeof(get_request));
+        get_request.type = get_fields[0];
+        get_request.fields = get_fields + 1;
+        get_request.num_of_fields = 7;
+
+        if (res == 0 && client_call(shards[from].p_pool, &get_request, &content)
+            != CLIENT_SUCCESS)
+            res = -1;
+        else if (res == 0 && content.result == RESULT_SUCCESS)
+        {
+            char str_size[MAX_NUMBER_LEN + 1];
+            sprintf(str_size, "%lu", (unsigned long) content.data_len);
+            char* put_fields[] = { username, file_name, str_size };
+
+            if (call_shard(to, CLIENT_REQ_PUT_FILE, put_fields, 3, content.data,
+                content.data_len, &response) != CLIENT_SUCCESS
+                || response.result != RESULT_SUCCESS)
+                res = -1;
+            client_free_response(&response);
+        }
+        client_free_response(&content);
+    }
+
+    if (res == 0 && !is_connected)
+    {
+        if (call_shard(to, CLIENT_REQ_DISCONNECT, user_fields, 1, NULL, 0, &response)
+            != CLIENT_SUCCESS)
+            res = -1;
+        client_free_response(&response);
+    }
+
+    if (res == 0 && (call_shard(from, CLIENT_REQ_UNREGISTER, user_fields, 1, NULL, 0, &response)
+        != CLIENT_SUCCESS || response.result != RESULT_SUCCESS))
+        res = -1;
+    client_free_response(&response);
+
+    client_free_response(&dump);
+
+    return res;
+}
+
+
+
+int shard_proxy_rebalance(uint32_t* p_num_of_moved)
+{
+    *p_num_of_moved = 0;
+
+    for (uint32_t i = 0; i < num_of_shards; i++)
+    {
+        struct client_response users;
+        if (call_shard(i, CLIENT_REQ_SHARD_USERS, NULL, 0, NULL, 0, &users) != CLIENT_SUCCESS
+            || users.result != RESULT_SUCCESS)
+        {
+            client_free_response(&users);
+            return SHARD_PROXY_REBALANCE_ERR_SHARD;
+        }
+
+        for (uint32_t j = 1; j < users.num_of_fields; j++)
+        {
+            uint32_t owner = shard_of(users.fields[j]);
+            if (owner == i)
+                continue;
+
+            if (move_user(users.fields[j], i, owner) != 0)
+            {
+                printf("ERROR shard_proxy_rebalance - could not move %s from %s:%d to %s:%d\n",
+                    users.fields[j], shards[i].host, shards[i].port, shards[owner].host,
+                    shards[owner].port);
+                client_free_response(&users);
+                return SHARD_PROXY_REBALANCE_ERR_MOVE;
+            }
+            (*p_num_of_moved)++;
+        }
+
+        client_free_response(&users);
+    }
+
+    return SHARD_PROXY_REBALANCE_SUCCESS;
+}
@@ -0,0 +1,77 @@
+#include <stdint.h>
+#include "p2p_client.h"
+/*
+    sharding proxy. The users are partitioned across a set of servers (shards) by consistent
+    hashing of the username: every shard owns NUM_OF_VIRTUAL_NODES points on a hash ring and a user
+    belongs to the shard of the first point following the hash of the username. Adding a shard
+    moves only the users which now fall on its points, see shard_proxy_rebalance.
+    The requests of a single user are forwarded to its shard. The requests which need the data
+    of other users are checked on the shard of the requesting user and sent to the other shards
+    in parallel, the responses are merged. All the requests are sent wrapped in SHARD (or
+    SHARD_FANOUT, when the requesting user was checked already) with the ip address of the
+    client, so the shards see the client and not the proxy.
+    IMPORTANT before any operation will be performed it is required to call the init() function and
+    if the proxy won't be used anymore then the destroy() function must be called.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define MAX_NUMBER_OF_SHARDS 64
+#define NUM_OF_VIRTUAL_NODES 128
+#define SHARD_CONNECTIONS 8         // connections to every shard
+#define SHARD_WINDOW 64             // pipelined requests on every connection
+#define PROXY_OWN_IP "127.0.0.1"    // client ip of the requests of the proxy itself
+// init
+#define INIT_SHARD_PROXY_SUCCESS 0
+#define INIT_SHARD_PROXY_ERR_SHARDS 1
+#define INIT_SHARD_PROXY_ERR_MEMORY 2
+#define INIT_SHARD_PROXY_ERR_POOL 3
+// forward
+#define SHARD_PROXY_SUCCESS 0
+#define SHARD_PROXY_ERR_REQUEST 1
+#define SHARD_PROXY_ERR_SHARD 2
+#define SHARD_PROXY_ERR_MEMORY 3
+// rebalance
+#define SHARD_PROXY_REBALANCE_SUCCESS 0
+#define SHARD_PROXY_REBALANCE_ERR_SHARD 1
+#define SHARD_PROXY_REBALANCE_ERR_MOVE 2
+
+
+
+/*
+    must be called exactly once at the beginning, before the first call to any function
+    from this file has been done. shards is the comma separated list of host:port of the shards.
+    Returns:
+        INIT_SHARD_PROXY_SUCCESS        - success
+        INIT_SHARD_PROXY_ERR_SHARDS     - the list of the shards is invalid
+        INIT_SHARD_PROXY_ERR_MEMORY     - could not allocate the hash ring
+        INIT_SHARD_PROXY_ERR_POOL       - could not create the connection pool of a shard
+*/
+int init_shard_proxy(char* shards);
+/*
+    must be called exactly once when the functions won't be used anymore.
+*/
+void destroy_shard_proxy();
+/*
+    forwards the request of the client with the client_ip to the shards and puts the (merged)
+    response where p_response points. It has to be deleted afterwards with client_free_response().
+    Returns:
+        SHARD_PROXY_SUCCESS         - success
+        SHARD_PROXY_ERR_REQUEST     - the request can't be forwarded (unknown type or no user)
+        SHARD_PROXY_ERR_SHARD       - a shard did not answer or it's overloaded
+        SHARD_PROXY_ERR_MEMORY      - could not allocate the response
+*/
+int shard_proxy_forward(struct client_request* p_request, char* client_ip,
+    struct client_response* p_response);
+/*
+    moves the users which are not on their shard (because shards were added) to it: the user is
+    registered on the new shard with its published files, relayed content and connection, then
+    unregistered from the old one. The number of the moved users is put where p_num_of_moved
+    points. Must be called before the requests are forwarded. Every step can be repeated, so a
+    failed rebalance is finished by calling it again.
+    Returns:
+        SHARD_PROXY_REBALANCE_SUCCESS       - success
+        SHARD_PROXY_REBALANCE_ERR_SHARD     - could not list the users of a shard
+        SHARD_PROXY_REBALANCE_ERR_MOVE      - could not move a user
+*/
+int shard_proxy_rebalance(uint32_t* p_num_of_moved);
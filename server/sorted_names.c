@@ -0,0 +1,388 @@
+#include "sorted_names.h"
+#include "arena.h"
+#include <fnmatch.h>
+#include <string.h>
+#include <stdlib.h>
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define INITIAL_BLOCKS_CAPACITY 4
+// the characters after which a glob pattern is not literal anymore
+#define GLOB_SPECIAL_CHARS "*?[\\"
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    a list of names being copied into an arena, see sorted_names_list.
+*/
+struct names_copy {
+    char** names;
+    uint32_t num_of_names;
+    struct arena* p_arena;
+    int is_complete;
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    Returns the position of the first block whose last name is not less than the name, which is
+    num_of_blocks if there is no such block
+*/
+uint32_t find_block(struct sorted_names* p_set, char* name)
+{
+    uint32_t low = 0, high = p_set->num_of_blocks;
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        struct name_block* p_block = p_set->blocks[middle];
+        if (strcmp(p_block->names[p_block->num_of_names - 1], name) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+
+
+/*
+    Returns the position of the first name of the block which is not less than the name, which is
+    num_of_names if there is no such name
+*/
+uint32_t find_in_block(struct name_block* p_block, char* name)
+{
+    uint32_t low = 0, high = p_block->num_of_names;
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        if (strcmp(p_block->names[middle], name) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+
+
+/*
+    puts a new empty block at the position of the blocks.
+    Returns the block, NULL if there is no memory
+*/
+struct name_block* insert_block(struct sorted_names* p_set, uint32_t position)
+{
+    if (p_set->num_of_blocks == p_set->blocks_capacity)
+    {
+        uint32_t new_capacity = p_set->blocks_capacity == 0 ?
+            INITIAL_BLOCKS_CAPACITY : 2 * p_set->blocks_capacity;
+        struct name_block** new_blocks = realloc(p_set->blocks,
+            new_capacity * sizeof(struct name_block*));
+        if (new_blocks == NULL)
+            return NULL;
+
+        p_set->blocks = new_blocks;
+        p_set->blocks_capacity = new_capacity;
+    }
+
+    struct name_block* p_block = malloc(sizeof(struct name_block));
+    if (p_block == NULL)
+        return NULL;
+    p_block->num_of_names = 0;
+
+    memmove(&p_set->blocks[position + 1], &p_set->blocks[position],
+        (p_set->num_of_blocks - position) * sizeof(struct name_block*));
+    p_set->blocks[position] = p_block;
+    p_set->num_of_blocks++;
+
+    return p_block;
+}
+
+
+
+/*
+    frees the block at the position of the blocks, which must be empty or moved elsewhere.
+*/
+void remove_block(struct sorted_names* p_set, uint32_t position)
+{
+    free(p_set->blocks[position]);
+    p_set->num_of_blocks--;
+    memmove(&p_set->blocks[position], &p_set->blocks[position + 1],
+        (p_set->num_of_blocks - position) * sizeof(struct name_block*));
+}
+
+
+
+/*
+    moves the names of the block after the block at the position to it, when both fit in half a
+    block, so the blocks of a set which shrinks stay filled.
+*/
+void merge_with_next(struct sorted_names* p_set, uint32_t position)
+{
+    if (position + 1 >= p_set->num_of_blocks)
+        return;
+
+    struct name_block* p_block = p_set->blocks[position];
+    struct name_block* p_next = p_set->blocks[position + 1];
+    if (p_block->num_of_names + p_next->num_of_names > SORTED_NAMES_BLOCK_SIZE / 2)
+        return;
+
+    memcpy(&p_block->names[p_block->num_of_names], p_next->names,
+        p_next->num_of_names * sizeof(char*));
+    p_block->num_of_names += p_next->num_of_names;
+    remove_block(p_set, position + 1);
+}
+
+
+
+/*
+    copies the name to the list pointed by arg. Used with sorted_names_select.
+*/
+void copy_name(char* name, void* arg)
+{
+    struct names_copy* p_copy = arg;
+    char* copy = p_copy->is_complete ? arena_strdup(p_copy->p_arena, name) : NULL;
+    if (copy != NULL)
+        p_copy->names[p_copy->num_of_names++] = copy;
+    else
+        p_copy->is_complete = 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// parse_name_filter
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int parse_name_filter(char* type, char* first, char* second, struct name_filter* p_filter)
+{
+    if (type[0] == '\0')
+        p_filter->type = NAME_FILTER_ALL;
+    else if (strcmp(type, "prefix") == 0)
+        p_filter->type = NAME_FILTER_PREFIX;
+    else if (strcmp(type, "glob") == 0)
+        p_filter->type = NAME_FILTER_GLOB;
+    else if (strcmp(type, "range") == 0)
+        p_filter->type = NAME_FILTER_RANGE;
+    else
+        return PARSE_NAME_FILTER_ERR_TYPE;
+
+    p_filter->first = first;
+    p_filter->second = second;
+
+    return PARSE_NAME_FILTER_SUCCESS;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// sorted_names_insert
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int sorted_names_insert(struct sorted_names* p_set, char* name)
+{
+    // a name greater than all goes to the last block
+    uint32_t position = find_block(p_set, name);
+    if (position == p_set->num_of_blocks && position > 0)
+        position--;
+
+    struct name_block* p_block = position < p_set->num_of_blocks ? p_set->blocks[position]
+        : insert_block(p_set, position);
+    if (p_block == NULL)
+        return SORTED_NAMES_INSERT_ERR_MEMORY;
+
+    uint32_t index = find_in_block(p_block, name);
+    if (index < p_block->num_of_names && strcmp(p_block->names[index], name) == 0)
+        return SORTED_NAMES_INSERT_ERR_EXISTS;
+
+    char* name_copy = strdup(name);
+    if (name_copy == NULL)
+    {
+        if (p_block->num_of_names == 0)
+            remove_block(p_set, position);
+        return SORTED_NAMES_INSERT_ERR_MEMORY;
+    }
+
+    // a full block is split in halves
+    if (p_block->num_of_names == SORTED_NAMES_BLOCK_SIZE)
+    {
+        struct name_block* p_upper = insert_block(p_set, position + 1);
+        if (p_upper == NULL)
+        {
+            free(name_copy);
+            return SORTED_NAMES_INSERT_ERR_MEMORY;
+        }
+
+        uint32_t half = SORTED_NAMES_BLOCK_SIZE / 2;
+        memcpy(p_upper->names, &p_block->names[half], half * sizeof(char*));
+        p_upper->num_of_names = half;
+        p_block->num_of_names = half;
+
+        if (index > half)
+        {
+            p_block = p_upper;
+            index -= half;
+        }
+    }
+
+    memmove(&p_block->names[index + 1], &p_block->names[index],
+        (p_block->num_of_names - index) * sizeof(char*));
+    p_block->names[index] = name_copy;
+    p_block->num_of_names++;
+    p_set->num_of_names++;
+
+    return SORTED_NAMES_INSERT_SUCCESS;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// sorted_names_remove
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int sorted_names_remove(struct sorted_names* p_set, char* name)
+{
+    uint32_t position = find_block(p_set, name);
+    if (position == p_set->num_of_blocks)
+        return SORTED_NAMES_REMOVE_ERR_NOT_FOUND;
+
+    struct name_block* p_block = p_set->blocks[position];
+    uint32_t index = find_in_block(p_block, name);
+    if (index == p_block->num_of_names || strcmp(p_block->names[index], name) != 0)
+        return SORTED_NAMES_REMOVE_ERR_NOT_FOUND;
+
+    free(p_block->names[index]);
+    p_block->num_of_names--;
+    memmove(&p_block->names[index], &p_block->names[index + 1],
+        (p_block->num_of_names - index) * sizeof(char*));
+    p_set->num_of_names--;
+
+    if (p_block->num_of_names == 0)
+        remove_block(p_set, position);
+    else
+    {
+        merge_with_next(p_set, position);
+        if (position > 0)
+            merge_with_next(p_set, position - 1);
+    }
+
+    return SORTED_NAMES_REMOVE_SUCCESS;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// sorted_names_select
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t sorted_names_select(struct sorted_names* p_set, struct name_filter* p_filter,
+    void (*on_name)(char* name, void* arg), void* arg)
+{
+    // the matching names start with the prefix (the literal start of a glob pattern)
+    char* start = p_filter->type == NAME_FILTER_ALL ? "" : p_filter->first;
+    char prefix[strlen(start) + 1];
+    size_t prefix_len = 0;
+    prefix[0] = '\0';
+    if (p_filter->type == NAME_FILTER_PREFIX || p_filter->type == NAME_FILTER_GLOB)
+    {
+        prefix_len = p_filter->type == NAME_FILTER_PREFIX ? strlen(start)
+            : strcspn(start, GLOB_SPECIAL_CHARS);
+        memcpy(prefix, start, prefix_len);
+        prefix[prefix_len] = '\0';
+        start = prefix;
+    }
+    char* end = p_filter->type == NAME_FILTER_RANGE && p_filter->second[0] != '\0' ?
+        p_filter->second : NULL;
+
+    uint32_t num_of_matching = 0;
+    uint32_t position = find_block(p_set, start);
+    uint32_t index = position < p_set->num_of_blocks ?
+        find_in_block(p_set->blocks[position], start) : 0;
+
+    for (; position < p_set->num_of_blocks; position++, index = 0)
+    {
+        struct name_block* p_block = p_set->blocks[position];
+        for (; index < p_block->num_of_names; index++)
+        {
+            char* name = p_block->names[index];
+            if (strncmp(name, prefix, prefix_len) != 0 || (end != NULL && strcmp(name, end) >= 0))
+                return num_of_matching;
+
+            if (p_filter->type == NAME_FILTER_GLOB && fnmatch(p_filter->first, name, 0) != 0)
+                continue;
+
+            on_name(name, arg);
+            num_of_matching++;
+        }
+    }
+
+    return num_of_matching;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// sorted_names_list
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int sorted_names_list(struct sorted_names* p_set, struct name_filter* p_filter, char*** p_names,
+    uint32_t* p_quantity, struct arena* p_arena)
+{
+    *p_names = NULL;
+    *p_quantity = 0;
+    if (p_set->num_of_names == 0)
+        return SORTED_NAMES_LIST_SUCCESS;
+
+    // at most all the names match
+    struct names_copy copy = { NULL, 0, p_arena, 1 };
+    copy.names = arena_alloc(p_arena, p_set->num_of_names * sizeof(char*));
+    if (copy.names == NULL)
+        return SORTED_NAMES_LIST_ERR_MEMORY;
+
+    sorted_names_select(p_set, p_filter, copy_name, &copy);
+    if (!copy.is_complete)
+    {
+        // the arena releases its allocations by itself
+        for (uint32_t i = 0; p_arena == NULL && i < copy.num_of_names; i++)
+            free(copy.names[i]);
+        if (p_arena == NULL)
+            free(copy.names);
+        return SORTED_NAMES_LIST_ERR_MEMORY;
+    }
+
+    *p_names = copy.names;
+    *p_quantity = copy.num_of_names;
+
+    return SORTED_NAMES_LIST_SUCCESS;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// destroy_sorted_names
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void destroy_sorted_names(struct sorted_names* p_set)
+{
+    for (uint32_t i = 0; i < p_set->num_of_blocks; i++)
+    {
+        for (uint32_t j = 0; j < p_set->blocks[i]->num_of_names; j++)
+            free(p_set->blocks[i]->names[j]);
+        free(p_set->blocks[i]);
+    }
+
+    free(p_set->blocks);
+    memset(p_set, 0, sizeof(struct sorted_names));
+}
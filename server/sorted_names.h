@@ -0,0 +1,116 @@
+#include <stdint.h>
+/*
+    ordered set of names, kept as a two-level B-tree: a sorted array of blocks of at most
+    SORTED_NAMES_BLOCK_SIZE sorted names. A name is found with a binary search of the blocks and
+    then of the names of its block, and a change moves at most one block of pointers, so a set of
+    millions of names is still changed in microseconds. The names are visited in strcmp() order,
+    and a filter (see struct name_filter) starts at the first name which can match and stops
+    after the last one, so selecting a prefix or a range reads only the matching names.
+    The set owns copies of its names. It is not locked, the callers lock it with their own data.
+    A zeroed struct sorted_names is an empty set.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define SORTED_NAMES_BLOCK_SIZE 64
+// filter types
+#define NAME_FILTER_ALL 0
+#define NAME_FILTER_PREFIX 1
+#define NAME_FILTER_GLOB 2
+#define NAME_FILTER_RANGE 3
+// insert
+#define SORTED_NAMES_INSERT_SUCCESS 0
+#define SORTED_NAMES_INSERT_ERR_EXISTS 1
+#define SORTED_NAMES_INSERT_ERR_MEMORY 2
+// remove
+#define SORTED_NAMES_REMOVE_SUCCESS 0
+#define SORTED_NAMES_REMOVE_ERR_NOT_FOUND 1
+// list
+#define SORTED_NAMES_LIST_SUCCESS 0
+#define SORTED_NAMES_LIST_ERR_MEMORY 1
+// parse name filter
+#define PARSE_NAME_FILTER_SUCCESS 0
+#define PARSE_NAME_FILTER_ERR_TYPE 1
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct arena;
+
+struct name_block
+{
+    uint32_t num_of_names;
+    char* names[SORTED_NAMES_BLOCK_SIZE];
+};
+
+struct sorted_names
+{
+    struct name_block** blocks;
+    uint32_t num_of_blocks;
+    uint32_t blocks_capacity;
+    uint32_t num_of_names;
+};
+
+/*
+    selects the names of a set:
+        all     - every name
+        prefix  - the names which start with first
+        glob    - the names which match the shell pattern first (see fnmatch())
+        range   - the names from first (included) to second (excluded), an empty bound is open
+*/
+struct name_filter
+{
+    int type;       // NAME_FILTER_*
+    char* first;
+    char* second;
+};
+
+
+
+/*
+    parses the filter of a request: its type ("" for all, "prefix", "glob" or "range") and its two
+    arguments, which are kept by pointer in the filter.
+    Returns:
+        PARSE_NAME_FILTER_SUCCESS   - success
+        PARSE_NAME_FILTER_ERR_TYPE  - unknown type of the filter
+*/
+int parse_name_filter(char* type, char* first, char* second, struct name_filter* p_filter);
+/*
+    adds a copy of the name to the set.
+    Returns:
+        SORTED_NAMES_INSERT_SUCCESS     - success
+        SORTED_NAMES_INSERT_ERR_EXISTS  - the set has the name already
+        SORTED_NAMES_INSERT_ERR_MEMORY  - could not allocate memory
+*/
+int sorted_names_insert(struct sorted_names* p_set, char* name);
+/*
+    removes the name from the set.
+    Returns:
+        SORTED_NAMES_REMOVE_SUCCESS         - success
+        SORTED_NAMES_REMOVE_ERR_NOT_FOUND   - the set does not have the name
+*/
+int sorted_names_remove(struct sorted_names* p_set, char* name);
+/*
+    calls on_name with arg for every name of the set which matches the filter, in order. The
+    callback must not change the set.
+    Returns number of the matching names
+*/
+uint32_t sorted_names_select(struct sorted_names* p_set, struct name_filter* p_filter,
+    void (*on_name)(char* name, void* arg), void* arg);
+/*
+    copies the names of the set which match the filter, in order, into an array of strings
+    allocated in the arena (with malloc() when p_arena is NULL, so they have to be freed). Number
+    of the names will be put where p_quantity points.
+    Returns:
+        SORTED_NAMES_LIST_SUCCESS       - success
+        SORTED_NAMES_LIST_ERR_MEMORY    - could not allocate the list
+*/
+int sorted_names_list(struct sorted_names* p_set, struct name_filter* p_filter, char*** p_names,
+    uint32_t* p_quantity, struct arena* p_arena);
+/*
+    frees the names and the blocks of the set, which is empty afterwards.
+*/
+void destroy_sorted_names(struct sorted_names* p_set);
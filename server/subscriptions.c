@@ -0,0 +1,417 @@
+#include "subscriptions.h"
+#include "metrics.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define INITIAL_NUM_OF_BUCKETS 1024
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct subscriber {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    // ring of the queued events
+    struct subscription_event events[SUBSCRIBER_QUEUE_SIZE];
+    uint32_t first_event;
+    uint32_t num_of_events;
+    int is_resync;                  // the queue overflowed, the next event is RESYNC
+    char** owners;
+    uint32_t num_of_owners;
+};
+
+struct owner_subscribers {
+    char* owner;
+    struct subscriber** subscribers;
+    uint32_t num_of_subscribers;
+    uint32_t subscribers_capacity;
+    struct owner_subscribers* p_next;
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// global variables
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// read by the notifications, written by add_subscriber and remove_subscriber
+pthread_rwlock_t lock_subscriptions;
+// owner -> subscribers, chained hash table
+struct owner_subscribers** subscribers_buckets;
+uint32_t num_of_subscribers_buckets;
+uint32_t num_of_subscribed_owners;
+// the changes skip the table while it's 0
+uint32_t num_of_subscribers;
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t hash_owner(char* owner)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    while (*owner)
+    {
+        hash ^= (uint8_t) *owner++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+
+/*
+    Returns the address of the pointer to the entry of the owner, which is NULL if nobody
+    subscribed to it. Must be called with the lock held.
+*/
+struct owner_subscribers** find_owner_subscribers(char* owner)
+{
+    uint32_t bucket = hash_owner(owner) & (num_of_subscribers_buckets - 1);
+    struct owner_subscribers** pp_entry = &subscribers_buckets[bucket];
+    while (*pp_entry != NULL && strcmp((*pp_entry)->owner, owner) != 0)
+        pp_entry = &(*pp_entry)->p_next;
+
+    return pp_entry;
+}
+
+
+
+/*
+    doubles the number of buckets. Must be called with the write lock held.
+*/
+void grow_subscribers_buckets()
+{
+    uint32_t new_num_of_buckets = num_of_subscribers_buckets * 2;
+    struct owner_subscribers** new_buckets =
+        calloc(new_num_of_buckets, sizeof(struct owner_subscribers*));
+    if (new_buckets == NULL)
+        return; // longer chains, but still correct
+
+    for (uint32_t i = 0; i < num_of_subscribers_buckets; i++)
+    {
+        struct owner_subscribers* p_entry = subscribers_buckets[i];
+        while (p_entry != NULL)
+        {
+            struct owner_subscribers* p_next = p_entry->p_next;
+            uint32_t bucket = hash_owner(p_entry->owner) & (new_num_of_buckets - 1);
+            p_entry->p_next = new_buckets[bucket];
+            new_buckets[bucket] = p_entry;
+            p_entry = p_next;
+        }
+    }
+
+    free(subscribers_buckets);
+    subscribers_buckets = new_buckets;
+    num_of_subscribers_buckets = new_num_of_buckets;
+}
+
+
+
+/*
+    adds the subscriber to the subscribers of the owner. Must be called with the write lock held.
+    Returns 0 on success and -1 if there is no memory
+*/
+int add_owner_subscriber(char* owner, struct subscriber* p_subscriber)
+{
+    struct owner_subscribers** pp_entry = find_owner_subscribers(owner);
+    struct owner_subscribers* p_entry = *pp_entry;
+
+    if (p_entry == NULL)
+    {
+        p_entry = calloc(1, sizeof(struct owner_subscribers));
+        if (p_entry == NULL || (p_entry->owner = strdup(owner)) == NULL)
+        {
+            free(p_entry);
+            return -1;
+        }
+        *pp_entry = p_entry;
+
+        if (++num_of_subscribed_owners > num_of_subscribers_buckets)
+            grow_subscribers_buckets();
+    }
+
+    if (p_entry->num_of_subscribers == p_entry->subscribers_capacity)
+    {
+        uint32_t new_capacity = p_entry->subscribers_capacity == 0 ? 4
+            : 2 * p_entry->subscribers_capacity;
+        struct subscriber** new_subscribers =
+            realloc(p_entry->subscribers, new_capacity * sizeof(struct subscriber*));
+        if (new_subscribers == NULL)
+            return -1;
+
+        p_entry->subscribers = new_subscribers;
+        p_entry->subscribers_capacity = new_capacity;
+    }
+
+    p_entry->subscribers[p_entry->num_of_subscribers++] = p_subscriber;
+
+    return 0;
+}
+
+
+
+/*
+    removes the subscriber from the subscribers of the owner, the entry of the owner is deleted
+    with its last subscriber. Must be called with the write lock held.
+*/
+void remove_owner_subscriber(char* owner, struct subscriber* p_subscriber)
+{
+    struct owner_subscribers** pp_entry = find_owner_subscribers(owner);
+    struct owner_subscribers* p_entry = *pp_entry;
+    if (p_entry == NULL)
+        return;
+
+    for (uint32_t i = 0; i < p_entry->num_of_subscribers; i++)
+    {
+        if (p_entry->subscribers[i] == p_subscriber)
+        {
+            p_entry->subscribers[i] = p_entry->subscribers[--p_entry->num_of_subscribers];
+            break;
+        }
+    }
+
+    if (p_entry->num_of_subscribers == 0)
+    {
+        *pp_entry = p_entry->p_next;
+        num_of_subscribed_owners--;
+        free(p_entry->subscribers);
+        free(p_entry->owner);
+        free(p_entry);
+    }
+}
+
+
+
+/*
+    queues the event for the subscriber, a full queue is replaced by the RESYNC event.
+*/
+void queue_event(struct subscriber* p_subscriber, char type, char* owner, char* file_name)
+{
+    pthread_mutex_lock(&p_subscriber->mutex);
+
+    // till the RESYNC is taken the changes are dropped, the subscriber lists its owners again
+    // after it, so these changes are in the listing
+    if (!p_subscriber->is_resync && p_subscriber->num_of_events == SUBSCRIBER_QUEUE_SIZE)
+    {
+        p_subscriber->num_of_events = 0;
+        p_subscriber->is_resync = 1;
+        metrics_increment(METRIC_SUBSCRIPTION_RESYNCS);
+    }
+    else if (!p_subscriber->is_resync)
+    {
+        uint32_t idx = (p_subscriber->first_event + p_subscriber->num_of_events)
+            % SUBSCRIBER_QUEUE_SIZE;
+        struct subscription_event* p_event = &p_subscriber->events[idx];
+        p_event->type = type;
+        strncpy(p_event->owner, owner, MAX_SUBSCRIPTION_FIELD_LEN);
+        p_event->owner[MAX_SUBSCRIPTION_FIELD_LEN] = '\0';
+        strncpy(p_event->file_name, file_name, MAX_SUBSCRIPTION_FIELD_LEN);
+        p_event->file_name[MAX_SUBSCRIPTION_FIELD_LEN] = '\0';
+        p_subscriber->num_of_events++;
+        metrics_increment(METRIC_SUBSCRIPTION_EVENTS);
+    }
+
+    pthread_cond_signal(&p_subscriber->cond);
+    pthread_mutex_unlock(&p_subscriber->mutex);
+}
+
+
+
+void free_subscriber(struct subscriber* p_subscriber)
+{
+    for (uint32_t i = 0; i < p_subscriber->num_of_owners; i++)
+        free(p_subscriber->owners[i]);
+
+    free(p_subscriber->owners);
+    pthread_cond_destroy(&p_subscriber->cond);
+    pthread_mutex_destroy(&p_subscriber->mutex);
+    free(p_subscriber);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// init / destroy
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int init_subscriptions()
+{
+    num_of_subscribers_buckets = INITIAL_NUM_OF_BUCKETS;
+    subscribers_buckets = calloc(num_of_subscribers_buckets, sizeof(struct owner_subscribers*));
+    if (subscribers_buckets == NULL)
+        return INIT_SUBSCRIPTIONS_ERR_MEMORY;
+
+    if (pthread_rwlock_init(&lock_subscriptions, NULL) != 0)
+        return INIT_SUBSCRIPTIONS_ERR_LOCK_INIT;
+
+    return INIT_SUBSCRIPTIONS_SUCCESS;
+}
+
+
+
+void destroy_subscriptions()
+{
+    // the entries are deleted by remove_subscriber()
+    free(subscribers_buckets);
+    pthread_rwlock_destroy(&lock_subscriptions);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// add / remove
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int add_subscriber(char** owners, uint32_t num_of_owners, struct subscriber** pp_subscriber)
+{
+    if (num_of_owners > MAX_SUBSCRIBED_OWNERS)
+        num_of_owners = MAX_SUBSCRIBED_OWNERS;
+
+    struct subscriber* p_subscriber = calloc(1, sizeof(struct subscriber));
+    if (p_subscriber == NULL)
+        return ADD_SUBSCRIBER_ERR_MEMORY;
+
+    p_subscriber->owners = calloc(num_of_owners + 1, sizeof(char*));
+    if (p_subscriber->owners == NULL || pthread_mutex_init(&p_subscriber->mutex, NULL) != 0)
+    {
+        free(p_subscriber->owners);
+        free(p_subscriber);
+        return ADD_SUBSCRIBER_ERR_MEMORY;
+    }
+    pthread_cond_init(&p_subscriber->cond, NULL);
+
+    pthread_rwlock_wrlock(&lock_subscriptions);
+
+    int res = ADD_SUBSCRIBER_SUCCESS;
+    for (uint32_t i = 0; i < num_of_owners && res == ADD_SUBSCRIBER_SUCCESS; i++)
+    {
+        // an owner given twice gets one event per change
+        uint32_t j = 0;
+        while (j < p_subscriber->num_of_owners && strcmp(p_subscriber->owners[j], owners[i]) != 0)
+            j++;
+        if (j < p_subscriber->num_of_owners)
+            continue;
+
+        if ((p_subscriber->owners[j] = strdup(owners[i])) == NULL)
+            res = ADD_SUBSCRIBER_ERR_MEMORY;
+        else if (add_owner_subscriber(owners[i], p_subscriber) != 0)
+        {
+            free(p_subscriber->owners[j]);
+            res = ADD_SUBSCRIBER_ERR_MEMORY;
+        }
+        else
+            p_subscriber->num_of_owners++;
+    }
+
+    if (res != ADD_SUBSCRIBER_SUCCESS)
+    {
+        for (uint32_t i = 0; i < p_subscriber->num_of_owners; i++)
+            remove_owner_subscriber(p_subscriber->owners[i], p_subscriber);
+    }
+    else
+        __atomic_add_fetch(&num_of_subscribers, 1, __ATOMIC_RELAXED);
+
+    pthread_rwlock_unlock(&lock_subscriptions);
+
+    if (res != ADD_SUBSCRIBER_SUCCESS)
+        free_subscriber(p_subscriber);
+    else
+        *pp_subscriber = p_subscriber;
+
+    return res;
+}
+
+
+
+void remove_subscriber(struct subscriber* p_subscriber)
+{
+    pthread_rwlock_wrlock(&lock_subscriptions);
+
+    for (uint32_t i = 0; i < p_subscriber->num_of_owners; i++)
+        remove_owner_subscriber(p_subscriber->owners[i], p_subscriber);
+    __atomic_sub_fetch(&num_of_subscribers, 1, __ATOMIC_RELAXED);
+
+    pthread_rwlock_unlock(&lock_subscriptions);
+
+    // no change can reach it anymore
+    free_subscriber(p_subscriber);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// events
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void notify_subscribers(char type, char* owner, char* file_name)
+{
+    if (__atomic_load_n(&num_of_subscribers, __ATOMIC_RELAXED) == 0)
+        return;
+
+    pthread_rwlock_rdlock(&lock_subscriptions);
+
+    struct owner_subscribers* p_entry = *find_owner_subscribers(owner);
+    for (uint32_t i = 0; p_entry != NULL && i < p_entry->num_of_subscribers; i++)
+        queue_event(p_entry->subscribers[i], type, owner, file_name);
+
+    pthread_rwlock_unlock(&lock_subscriptions);
+}
+
+
+
+uint32_t next_subscription_events(struct subscriber* p_subscriber,
+    struct subscription_event* events, uint32_t max_events, uint32_t timeout_ms)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&p_subscriber->mutex);
+
+    while (!p_subscriber->is_resync && p_subscriber->num_of_events == 0)
+    {
+        if (pthread_cond_timedwait(&p_subscriber->cond, &p_subscriber->mutex, &deadline)
+            == ETIMEDOUT)
+            break;
+    }
+
+    uint32_t num_of_taken = 0;
+    if (p_subscriber->is_resync && max_events > 0)
+    {
+        events[num_of_taken].type = SUBSCRIPTION_EVENT_RESYNC;
+        events[num_of_taken].owner[0] = '\0';
+        events[num_of_taken++].file_name[0] = '\0';
+        p_subscriber->is_resync = 0;
+    }
+
+    while (num_of_taken < max_events && p_subscriber->num_of_events > 0)
+    {
+        events[num_of_taken++] = p_subscriber->events[p_subscriber->first_event];
+        p_subscriber->first_event = (p_subscriber->first_event + 1) % SUBSCRIBER_QUEUE_SIZE;
+        p_subscriber->num_of_events--;
+    }
+
+    pthread_mutex_unlock(&p_subscriber->mutex);
+
+    return num_of_taken;
+}
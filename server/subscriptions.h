@@ -0,0 +1,90 @@
+#include <stdint.h>
+/*
+    push notifications of the changes of the published files. A subscriber (a connection which
+    sent SUBSCRIBE) follows a list of owners and gets an event for every file they publish or
+    delete, instead of polling LIST_CONTENT. The subscribers are found from the owner through a
+    hash table owner -> subscribers, so a change costs one lookup and one copy per subscriber of
+    its owner, and nothing when nobody subscribed.
+    Every subscriber has a queue of at most SUBSCRIBER_QUEUE_SIZE events. A subscriber which does
+    not take its events fast enough loses them: when the queue is full it's emptied and the
+    subscriber gets a single RESYNC event instead, after which it should list the content of its
+    owners again. The changes which happen before the RESYNC is taken are part of that listing,
+    so they are dropped too.
+    IMPORTANT before any operation will be performed it is required to call the init() function and
+    if the subscriptions won't be used anymore then the destroy() function must be called.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define SUBSCRIBER_QUEUE_SIZE 64
+#define MAX_SUBSCRIBED_OWNERS 1000
+#define MAX_SUBSCRIPTION_FIELD_LEN 256  // of the owner and the file name, as in the requests
+// events, sent as a string followed by the fields
+#define SUBSCRIPTION_EVENT_PUBLISH 'P'  // owner, file name
+#define SUBSCRIPTION_EVENT_DELETE 'X'   // owner, file name
+#define SUBSCRIPTION_EVENT_RESYNC 'R'   // events were dropped, no fields
+// init
+#define INIT_SUBSCRIPTIONS_SUCCESS 0
+#define INIT_SUBSCRIPTIONS_ERR_MEMORY 1
+#define INIT_SUBSCRIPTIONS_ERR_LOCK_INIT 2
+// add subscriber
+#define ADD_SUBSCRIBER_SUCCESS 0
+#define ADD_SUBSCRIBER_ERR_MEMORY 1
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct subscriber;
+
+struct subscription_event
+{
+    char type;                                          // SUBSCRIPTION_EVENT_*
+    char owner[MAX_SUBSCRIPTION_FIELD_LEN + 1];
+    char file_name[MAX_SUBSCRIPTION_FIELD_LEN + 1];
+};
+
+
+
+/*
+    must be called exactly once at the beginning, before the first call to any function
+    from this file has been done.
+    Returns:
+        INIT_SUBSCRIPTIONS_SUCCESS          - success
+        INIT_SUBSCRIPTIONS_ERR_MEMORY       - could not allocate the table
+        INIT_SUBSCRIPTIONS_ERR_LOCK_INIT    - could not initialize the lock of the table
+*/
+int init_subscriptions();
+/*
+    must be called exactly once when the functions won't be used anymore, after all the
+    subscribers have been removed.
+*/
+void destroy_subscriptions();
+/*
+    subscribes to the changes of the num_of_owners (at most MAX_SUBSCRIBED_OWNERS) owners. The
+    new subscriber is put where pp_subscriber points, remove_subscriber() must be called when
+    it's done.
+    Returns:
+        ADD_SUBSCRIBER_SUCCESS      - success
+        ADD_SUBSCRIBER_ERR_MEMORY   - could not allocate the subscriber
+*/
+int add_subscriber(char** owners, uint32_t num_of_owners, struct subscriber** pp_subscriber);
+/*
+    removes the subscriber from all its owners and deletes it.
+*/
+void remove_subscriber(struct subscriber* p_subscriber);
+/*
+    queues the event (SUBSCRIPTION_EVENT_PUBLISH or _DELETE) of the file of the owner for every
+    subscriber of the owner. Called after the change, with the user locked in the change feed, so
+    the events of an owner come in the order of the feed.
+*/
+void notify_subscribers(char type, char* owner, char* file_name);
+/*
+    takes at most max_events queued events of the subscriber, waiting at most timeout_ms for the
+    first one.
+    Returns the number of the events put where events points, 0 if there was none
+*/
+uint32_t next_subscription_events(struct subscriber* p_subscriber,
+    struct subscription_event* events, uint32_t max_events, uint32_t timeout_ms);
@@ -0,0 +1,185 @@
+#include "timer_wheel.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// global variables
+///////////////////////////////////////////////////////////////////////////////////////////////////
+pthread_mutex_t mutex_timer_wheel;
+struct timer* timer_slots[NUM_OF_TIMER_SLOTS];
+uint32_t current_slot;
+int is_wheel_running;
+pthread_t t_timer_wheel;
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    unlinks the timer from its slot. Must be called with the mutex locked.
+*/
+void unlink_timer(struct timer* p_timer)
+{
+    if (p_timer->p_prev != NULL)
+        p_timer->p_prev->p_next = p_timer->p_next;
+    else
+        timer_slots[p_timer->slot] = p_timer->p_next;
+
+    if (p_timer->p_next != NULL)
+        p_timer->p_next->p_prev = p_timer->p_prev;
+
+    p_timer->p_prev = NULL;
+    p_timer->p_next = NULL;
+    p_timer->is_scheduled = 0;
+}
+
+
+
+/*
+    moves the wheel by one tick and expires the timers of the new current slot. Must be called
+    with the mutex locked.
+*/
+void advance_wheel()
+{
+    current_slot = (current_slot + 1) & (NUM_OF_TIMER_SLOTS - 1);
+
+    struct timer* p_timer = timer_slots[current_slot];
+    while (p_timer != NULL)
+    {
+        struct timer* p_next = p_timer->p_next;
+
+        if (p_timer->rounds > 0)
+            p_timer->rounds--;
+        else
+        {
+            unlink_timer(p_timer);
+            p_timer->on_expire(p_timer->arg);
+        }
+
+        p_timer = p_next;
+    }
+}
+
+
+
+void* run_timer_wheel(void* arg)
+{
+    struct timespec next_tick;
+    clock_gettime(CLOCK_MONOTONIC, &next_tick);
+
+    pthread_mutex_lock(&mutex_timer_wheel);
+    while (is_wheel_running)
+    {
+        pthread_mutex_unlock(&mutex_timer_wheel);
+
+        next_tick.tv_nsec += TIMER_TICK_MS * 1000000L;
+        if (next_tick.tv_nsec >= 1000000000L)
+        {
+            next_tick.tv_sec++;
+            next_tick.tv_nsec -= 1000000000L;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_tick, NULL) == EINTR);
+
+        pthread_mutex_lock(&mutex_timer_wheel);
+        advance_wheel();
+    }
+    pthread_mutex_unlock(&mutex_timer_wheel);
+
+    return NULL;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// init / destroy
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int init_timer_wheel()
+{
+    if (pthread_mutex_init(&mutex_timer_wheel, NULL) != 0)
+        return INIT_TIMER_WHEEL_ERR_MUTEX_INIT;
+
+    is_wheel_running = 1;
+    if (pthread_create(&t_timer_wheel, NULL, run_timer_wheel, NULL) != 0)
+    {
+        pthread_mutex_destroy(&mutex_timer_wheel);
+        return INIT_TIMER_WHEEL_ERR_THREAD;
+    }
+
+    return INIT_TIMER_WHEEL_SUCCESS;
+}
+
+
+
+void destroy_timer_wheel()
+{
+    pthread_mutex_lock(&mutex_timer_wheel);
+    is_wheel_running = 0;
+    pthread_mutex_unlock(&mutex_timer_wheel);
+
+    pthread_join(t_timer_wheel, NULL);
+    pthread_mutex_destroy(&mutex_timer_wheel);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// timers
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void init_timer(struct timer* p_timer, void (*on_expire)(void* arg), void* arg)
+{
+    p_timer->p_prev = NULL;
+    p_timer->p_next = NULL;
+    p_timer->slot = 0;
+    p_timer->rounds = 0;
+    p_timer->is_scheduled = 0;
+    p_timer->on_expire = on_expire;
+    p_timer->arg = arg;
+}
+
+
+
+void timer_wheel_schedule(struct timer* p_timer, uint64_t timeout_ms)
+{
+    uint64_t ticks = timeout_ms / TIMER_TICK_MS + (timeout_ms % TIMER_TICK_MS != 0);
+    if (ticks == 0)
+        ticks = 1;
+    else if (ticks > MAX_TIMER_TICKS)
+        ticks = MAX_TIMER_TICKS;
+
+    pthread_mutex_lock(&mutex_timer_wheel);
+
+    if (p_timer->is_scheduled)
+        unlink_timer(p_timer);
+
+    // the slot is visited for the first time after (ticks - 1) % NUM_OF_TIMER_SLOTS + 1 ticks
+    p_timer->slot = (current_slot + ticks) & (NUM_OF_TIMER_SLOTS - 1);
+    p_timer->rounds = (ticks - 1) / NUM_OF_TIMER_SLOTS;
+    p_timer->p_prev = NULL;
+    p_timer->p_next = timer_slots[p_timer->slot];
+    if (p_timer->p_next != NULL)
+        p_timer->p_next->p_prev = p_timer;
+    timer_slots[p_timer->slot] = p_timer;
+    p_timer->is_scheduled = 1;
+
+    pthread_mutex_unlock(&mutex_timer_wheel);
+}
+
+
+
+void timer_wheel_cancel(struct timer* p_timer)
+{
+    pthread_mutex_lock(&mutex_timer_wheel);
+
+    if (p_timer->is_scheduled)
+        unlink_timer(p_timer);
+
+    pthread_mutex_unlock(&mutex_timer_wheel);
+}
@@ -0,0 +1,73 @@
+#include <stdint.h>
+/*
+    hashed timing wheel: timers are put in one of NUM_OF_TIMER_SLOTS lists by their expiration tick
+    modulo the number of slots, so scheduling and cancelling a timer is O(1) no matter how many
+    timers there are. One thread advances the wheel every TIMER_TICK_MS milliseconds and calls the
+    callbacks of the expired timers, so timers are precise to one tick.
+    IMPORTANT before any operation will be performed it is required to call the init() function and
+    if the wheel won't be used anymore then the destroy() function must be called.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// wheel
+#define TIMER_TICK_MS 100
+#define NUM_OF_TIMER_SLOTS 1024
+// the longest timeout which fits in the rounds of a timer, about 13000 years
+#define MAX_TIMER_TICKS ((uint64_t) UINT32_MAX * NUM_OF_TIMER_SLOTS)
+// init
+#define INIT_TIMER_WHEEL_SUCCESS 0
+#define INIT_TIMER_WHEEL_ERR_MUTEX_INIT 1
+#define INIT_TIMER_WHEEL_ERR_THREAD 2
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    timer owned by the caller (usually a part of a bigger struct), the wheel only links it. It has
+    to be initialized with init_timer() and cancelled before its memory is released.
+*/
+struct timer {
+    struct timer* p_prev;
+    struct timer* p_next;
+    uint32_t slot;
+    uint32_t rounds;            // full turns of the wheel left before it expires
+    int is_scheduled;
+    void (*on_expire)(void* arg);
+    void* arg;
+};
+
+
+
+/*
+    must be called exactly once at the beginning, before the first call to any function
+    from this file has been done. Starts the thread advancing the wheel.
+    Returns:
+        INIT_TIMER_WHEEL_SUCCESS            - success
+        INIT_TIMER_WHEEL_ERR_MUTEX_INIT     - could not initialize the wheel mutex
+        INIT_TIMER_WHEEL_ERR_THREAD         - could not start the thread
+*/
+int init_timer_wheel();
+/*
+    must be called exactly once when the functions won't be used anymore. Stops the thread, the
+    timers which are still scheduled won't expire.
+*/
+void destroy_timer_wheel();
+/*
+    initializes the timer, on_expire will be called with arg from the wheel thread when it expires.
+    The callback is called with the wheel locked, so it must be short and must not use the wheel.
+*/
+void init_timer(struct timer* p_timer, void (*on_expire)(void* arg), void* arg);
+/*
+    schedules the timer to expire in timeout_ms milliseconds, if it's already scheduled it's moved.
+    A timeout longer than MAX_TIMER_TICKS ticks is cut to it, so it never wraps to a short one.
+*/
+void timer_wheel_schedule(struct timer* p_timer, uint64_t timeout_ms);
+/*
+    cancels the timer if it's scheduled. When it returns the callback of the timer is not running
+    and won't be called.
+*/
+void timer_wheel_cancel(struct timer* p_timer);
@@ -0,0 +1,529 @@
+#include "tracker.h"
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define INITIAL_NUM_OF_BUCKETS 1024
+#define INITIAL_PEERS_CAPACITY 4
+// downloads which were not released in this time are considered finished (e.g. client crashed)
+#define ASSIGNMENT_TIMEOUT_SECONDS 600
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct peer {
+    char owner[MAX_USERNAME_LEN + 1];
+    uint32_t active_downloads;
+};
+
+/*
+    sources chosen for one downloader
+*/
+struct assignment {
+    char downloader[MAX_USERNAME_LEN + 1];
+    char (*owners)[MAX_USERNAME_LEN + 1];
+    uint32_t num_of_owners;
+    time_t started;
+    struct assignment* p_next;
+};
+
+struct swarm {
+    char* file_name;
+    uint64_t size;
+    uint32_t chunk_size;
+    uint32_t num_of_chunks;
+    char* chunk_hashes;
+    struct peer* peers;
+    uint32_t num_of_peers;
+    uint32_t peers_capacity;
+    uint32_t next_rotation;     // spreads downloads over equally loaded peers
+    struct assignment* assignments;
+    struct swarm* p_next;
+};
+
+struct candidate {
+    uint32_t peer_idx;
+    uint32_t rank;
+    user data;
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// global variables
+///////////////////////////////////////////////////////////////////////////////////////////////////
+pthread_mutex_t mutex_tracker;
+// file name -> swarm, chained hash table
+struct swarm** swarm_buckets;
+uint32_t num_of_swarm_buckets;
+uint32_t num_of_swarms;
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t hash_swarm_name(char* file_name)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    while (*file_name)
+    {
+        hash ^= (uint8_t) *file_name++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+
+/*
+    Returns the address of the pointer to the swarm of the file_name, which is NULL if the file was
+    not announced. Must be called with the mutex locked.
+*/
+struct swarm** find_swarm(char* file_name)
+{
+    uint32_t bucket = hash_swarm_name(file_name) & (num_of_swarm_buckets - 1);
+    struct swarm** pp_swarm = &swarm_buckets[bucket];
+    while (*pp_swarm != NULL && strcmp((*pp_swarm)->file_name, file_name) != 0)
+        pp_swarm = &(*pp_swarm)->p_next;
+
+    return pp_swarm;
+}
+
+
+
+void grow_swarm_buckets()
+{
+    uint32_t new_num_of_buckets = num_of_swarm_buckets * 2;
+    struct swarm** new_buckets = calloc(new_num_of_buckets, sizeof(struct swarm*));
+    if (new_buckets == NULL)
+        return; // longer chains, but still correct
+
+    for (uint32_t i = 0; i < num_of_swarm_buckets; i++)
+    {
+        struct swarm* p_swarm = swarm_buckets[i];
+        while (p_swarm != NULL)
+        {
+            struct swarm* p_next = p_swarm->p_next;
+            uint32_t bucket = hash_swarm_name(p_swarm->file_name) & (new_num_of_buckets - 1);
+            p_swarm->p_next = new_buckets[bucket];
+            new_buckets[bucket] = p_swarm;
+            p_swarm = p_next;
+        }
+    }
+
+    free(swarm_buckets);
+    swarm_buckets = new_buckets;
+    num_of_swarm_buckets = new_num_of_buckets;
+}
+
+
+
+struct peer* find_peer(struct swarm* p_swarm, char* owner)
+{
+    for (uint32_t i = 0; i < p_swarm->num_of_peers; i++)
+    {
+        if (strcmp(p_swarm->peers[i].owner, owner) == 0)
+            return &p_swarm->peers[i];
+    }
+
+    return NULL;
+}
+
+
+
+/*
+    removes the assignment from the swarm and decrements the load of its peers.
+*/
+void release_assignment(struct swarm* p_swarm, struct assignment** pp_assignment)
+{
+    struct assignment* p_assignment = *pp_assignment;
+
+    for (uint32_t i = 0; i < p_assignment->num_of_owners; i++)
+    {
+        struct peer* p_peer = find_peer(p_swarm, p_assignment->owners[i]);
+        if (p_peer != NULL && p_peer->active_downloads > 0)
+            p_peer->active_downloads--;
+    }
+
+    *pp_assignment = p_assignment->p_next;
+    free(p_assignment->owners);
+    free(p_assignment);
+}
+
+
+
+/*
+    releases the assignment of the downloader (if any) and the ones which timed out.
+*/
+void release_finished_assignments(struct swarm* p_swarm, char* downloader)
+{
+    time_t now = time(NULL);
+    struct assignment** pp_assignment = &p_swarm->assignments;
+
+    while (*pp_assignment != NULL)
+    {
+        if ((downloader != NULL && strcmp((*pp_assignment)->downloader, downloader) == 0)
+            || now - (*pp_assignment)->started > ASSIGNMENT_TIMEOUT_SECONDS)
+            release_assignment(p_swarm, pp_assignment);
+        else
+            pp_assignment = &(*pp_assignment)->p_next;
+    }
+}
+
+
+
+void free_swarm(struct swarm* p_swarm)
+{
+    while (p_swarm->assignments != NULL)
+    {
+        struct assignment* p_next = p_swarm->assignments->p_next;
+        free(p_swarm->assignments->owners);
+        free(p_swarm->assignments);
+        p_swarm->assignments = p_next;
+    }
+
+    free(p_swarm->peers);
+    free(p_swarm->chunk_hashes);
+    free(p_swarm->file_name);
+    free(p_swarm);
+}
+
+
+
+int compare_candidates(const void* p_a, const void* p_b)
+{
+    const struct candidate* p_cand_a = p_a;
+    const struct candidate* p_cand_b = p_b;
+
+    return p_cand_a->rank < p_cand_b->rank ? -1 : p_cand_a->rank > p_cand_b->rank;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// init / destroy
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int init_tracker()
+{
+    num_of_swarm_buckets = INITIAL_NUM_OF_BUCKETS;
+    swarm_buckets = calloc(num_of_swarm_buckets, sizeof(struct swarm*));
+    if (swarm_buckets == NULL)
+        return INIT_TRACKER_ERR_MEMORY;
+
+    if (pthread_mutex_init(&mutex_tracker, NULL) != 0)
+        return INIT_TRACKER_ERR_MUTEX_INIT;
+
+    return INIT_TRACKER_SUCCESS;
+}
+
+
+
+void destroy_tracker()
+{
+    for (uint32_t i = 0; i < num_of_swarm_buckets; i++)
+    {
+        while (swarm_buckets[i] != NULL)
+        {
+            struct swarm* p_next = swarm_buckets[i]->p_next;
+            free_swarm(swarm_buckets[i]);
+            swarm_buckets[i] = p_next;
+        }
+    }
+
+    free(swarm_buckets);
+    pthread_mutex_destroy(&mutex_tracker);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// tracker_announce
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    creates the swarm of the file with its content description.
+    Returns the swarm or NULL if the memory could not be allocated.
+*/
+struct swarm* create_swarm(char* file_name, uint64_t size, uint32_t chunk_size,
+    uint32_t num_of_chunks, char chunk_hashes[][MAX_CHUNK_HASH_LEN + 1])
+{
+    struct swarm* p_swarm = calloc(1, sizeof(struct swarm));
+    if (p_swarm == NULL)
+        return NULL;
+
+    size_t hashes_size = num_of_chunks * (MAX_CHUNK_HASH_LEN + 1);
+    p_swarm->file_name = strdup(file_name);
+    p_swarm->chunk_hashes = malloc(hashes_size + 1);
+    if (p_swarm->file_name == NULL || p_swarm->chunk_hashes == NULL)
+    {
+        free_swarm(p_swarm);
+        return NULL;
+    }
+
+    memcpy(p_swarm->chunk_hashes, chunk_hashes, hashes_size);
+    p_swarm->size = size;
+    p_swarm->chunk_size = chunk_size;
+    p_swarm->num_of_chunks = num_of_chunks;
+
+    return p_swarm;
+}
+
+
+
+int tracker_announce(char* file_name, char* owner, uint64_t size, uint32_t chunk_size,
+    uint32_t num_of_chunks, char chunk_hashes[][MAX_CHUNK_HASH_LEN + 1])
+{
+    int res = TRACKER_ANNOUNCE_SUCCESS;
+    pthread_mutex_lock(&mutex_tracker);
+
+    struct swarm** pp_swarm = find_swarm(file_name);
+    struct swarm* p_swarm = *pp_swarm;
+
+    if (p_swarm == NULL)
+    {
+        p_swarm = create_swarm(file_name, size, chunk_size, num_of_chunks, chunk_hashes);
+        if (p_swarm != NULL)
+        {
+            *pp_swarm = p_swarm;
+            if (++num_of_swarms > num_of_swarm_buckets)
+                grow_swarm_buckets();
+        }
+        else
+            res = TRACKER_ANNOUNCE_ERR_MEMORY;
+    }
+    else if (p_swarm->size != size || p_swarm->chunk_size != chunk_size
+        || p_swarm->num_of_chunks != num_of_chunks
+        || memcmp(p_swarm->chunk_hashes, chunk_hashes, num_of_chunks * (MAX_CHUNK_HASH_LEN + 1)))
+        res = TRACKER_ANNOUNCE_ERR_MISMATCH;
+
+    if (res == TRACKER_ANNOUNCE_SUCCESS && find_peer(p_swarm, owner) == NULL)
+    {
+        if (p_swarm->num_of_peers == p_swarm->peers_capacity)
+        {
+            uint32_t new_capacity = p_swarm->peers_capacity == 0 ?
+                INITIAL_PEERS_CAPACITY : 2 * p_swarm->peers_capacity;
+            struct peer* new_peers = realloc(p_swarm->peers, new_capacity * sizeof(struct peer));
+            if (new_peers != NULL)
+            {
+                p_swarm->peers = new_peers;
+                p_swarm->peers_capacity = new_capacity;
+            }
+            else
+                res = TRACKER_ANNOUNCE_ERR_MEMORY;
+        }
+
+        if (res == TRACKER_ANNOUNCE_SUCCESS)
+        {
+            struct peer* p_peer = &p_swarm->peers[p_swarm->num_of_peers++];
+            strncpy(p_peer->owner, owner, MAX_USERNAME_LEN);
+            p_peer->owner[MAX_USERNAME_LEN] = '\0';
+            p_peer->active_downloads = 0;
+        }
+    }
+
+    pthread_mutex_unlock(&mutex_tracker);
+
+    return res;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// tracker_remove_peer
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void tracker_remove_peer(char* file_name, char* owner)
+{
+    pthread_mutex_lock(&mutex_tracker);
+
+    struct swarm** pp_swarm = find_swarm(file_name);
+    struct swarm* p_swarm = *pp_swarm;
+
+    if (p_swarm != NULL)
+    {
+        struct peer* p_peer = find_peer(p_swarm, owner);
+        if (p_peer != NULL)
+            *p_peer = p_swarm->peers[--p_swarm->num_of_peers];
+
+        if (p_swarm->num_of_peers == 0)    // nobody serves the file anymore
+        {
+            *pp_swarm = p_swarm->p_next;
+            free_swarm(p_swarm);
+            num_of_swarms--;
+        }
+    }
+
+    pthread_mutex_unlock(&mutex_tracker);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// tracker_get_sources
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int tracker_get_sources(char* file_name, char* downloader, uint32_t max_sources,
+    struct file_sources* p_sources)
+{
+    memset(p_sources, 0, sizeof(struct file_sources));
+    if (max_sources > MAX_NUMBER_OF_SOURCES)
+        max_sources = MAX_NUMBER_OF_SOURCES;
+
+    int res = TRACKER_GET_SOURCES_SUCCESS;
+    pthread_mutex_lock(&mutex_tracker);
+
+    struct swarm* p_swarm = *find_swarm(file_name);
+    struct candidate* candidates = NULL;
+
+    if (p_swarm == NULL)
+        res = TRACKER_GET_SOURCES_ERR_NO_SUCH_FILE;
+    else
+    {
+        release_finished_assignments(p_swarm, downloader);
+
+        size_t hashes_size = p_swarm->num_of_chunks * (MAX_CHUNK_HASH_LEN + 1);
+        candidates = malloc((p_swarm->num_of_peers + 1) * sizeof(struct candidate));
+        p_sources->chunk_hashes = malloc(hashes_size + 1);
+        p_sources->sources = malloc((max_sources + 1) * sizeof(struct source));
+        if (candidates == NULL || p_sources->chunk_hashes == NULL || p_sources->sources == NULL)
+            res = TRACKER_GET_SOURCES_ERR_MEMORY;
+        else
+        {
+            memcpy(p_sources->chunk_hashes, p_swarm->chunk_hashes, hashes_size);
+            p_sources->size = p_swarm->size;
+            p_sources->chunk_size = p_swarm->chunk_size;
+            p_sources->num_of_chunks = p_swarm->num_of_chunks;
+        }
+    }
+
+    struct assignment* p_assignment = NULL;
+    if (res == TRACKER_GET_SOURCES_SUCCESS)
+    {
+        // only connected peers can serve, the least loaded first, rotating among equally loaded
+        uint32_t num_of_candidates = 0;
+        for (uint32_t i = 0; i < p_swarm->num_of_peers; i++)
+        {
+            struct peer* p_peer = &p_swarm->peers[i];
+            struct candidate* p_cand = &candidates[num_of_candidates];
+
+            if (strcmp(p_peer->owner, downloader) != 0
+                && get_connected_user(p_peer->owner, &p_cand->data))
+            {
+                uint32_t rotated = (i + p_swarm->num_of_peers -
+                    p_swarm->next_rotation % p_swarm->num_of_peers) % p_swarm->num_of_peers;
+                p_cand->peer_idx = i;
+                p_cand->rank = p_peer->active_downloads * (MAX_NUMBER_OF_SOURCES +
+                    p_swarm->num_of_peers) + rotated;
+                num_of_candidates++;
+            }
+        }
+
+        qsort(candidates, num_of_candidates, sizeof(struct candidate), compare_candidates);
+        p_swarm->next_rotation++;
+
+        uint32_t num_of_sources = num_of_candidates < max_sources ? num_of_candidates : max_sources;
+        p_assignment = calloc(1, sizeof(struct assignment));
+        if (p_assignment != NULL)
+            p_assignment->owners = malloc((num_of_sources + 1) * (MAX_USERNAME_LEN + 1));
+
+        if (p_assignment == NULL || p_assignment->owners == NULL)
+        {
+            free(p_assignment);
+            res = TRACKER_GET_SOURCES_ERR_MEMORY;
+        }
+        else
+        {
+            strncpy(p_assignment->downloader, downloader, MAX_USERNAME_LEN);
+            p_assignment->started = time(NULL);
+
+            for (uint32_t i = 0; i < num_of_sources; i++)
+            {
+                struct peer* p_peer = &p_swarm->peers[candidates[i].peer_idx];
+                p_peer->active_downloads++;
+                strcpy(p_assignment->owners[i], p_peer->owner);
+
+                memcpy(&p_sources->sources[i].peer, &candidates[i].data, sizeof(user));
+                p_sources->sources[i].active_downloads = p_peer->active_downloads;
+            }
+
+            p_assignment->num_of_owners = num_of_sources;
+            p_assignment->p_next = p_swarm->assignments;
+            p_swarm->assignments = p_assignment;
+            p_sources->num_of_sources = num_of_sources;
+        }
+    }
+
+    pthread_mutex_unlock(&mutex_tracker);
+
+    free(candidates);
+    if (res != TRACKER_GET_SOURCES_SUCCESS)
+        free_file_sources(p_sources);
+
+    return res;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// tracker_release_sources
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void tracker_release_sources(char* file_name, char* downloader)
+{
+    pthread_mutex_lock(&mutex_tracker);
+
+    struct swarm* p_swarm = *find_swarm(file_name);
+    if (p_swarm != NULL)
+        release_finished_assignments(p_swarm, downloader);
+
+    pthread_mutex_unlock(&mutex_tracker);
+}
+
+
+
+void free_file_sources(struct file_sources* p_sources)
+{
+    free(p_sources->chunk_hashes);
+    free(p_sources->sources);
+    memset(p_sources, 0, sizeof(struct file_sources));
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// tracker_for_each_announcement
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void tracker_for_each_announcement(void (*on_announcement)(char* file_name, char* owner,
+    uint64_t size, uint32_t chunk_size, uint32_t num_of_chunks, char* chunk_hashes, void* arg),
+    void* arg)
+{
+    pthread_mutex_lock(&mutex_tracker);
+
+    for (uint32_t i = 0; i < num_of_swarm_buckets; i++)
+    {
+        for (struct swarm* p_swarm = swarm_buckets[i]; p_swarm != NULL; p_swarm = p_swarm->p_next)
+        {
+            for (uint32_t j = 0; j < p_swarm->num_of_peers; j++)
+                on_announcement(p_swarm->file_name, p_swarm->peers[j].owner, p_swarm->size,
+                    p_swarm->chunk_size, p_swarm->num_of_chunks, p_swarm->chunk_hashes, arg);
+        }
+    }
+
+    pthread_mutex_unlock(&mutex_tracker);
+}
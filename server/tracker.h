@@ -0,0 +1,111 @@
+#include <stdint.h>
+#include "connected_users.h"
+/*
+    tracker of the files which are downloaded in chunks from several peers in parallel. Owners of a
+    file announce its size and the hashes of its chunks, downloaders ask for a set of sources which
+    is ranked by the number of downloads each source currently serves, so the load is spread over
+    all connected owners instead of hitting the first one.
+    IMPORTANT before any operation will be performed it is required to call the init() function and
+    if the tracker won't be used anymore then the destroy() function must be called.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// chunks
+#define MAX_CHUNK_HASH_LEN 64
+#define MAX_NUMBER_OF_CHUNKS 65536
+// sources
+#define MAX_NUMBER_OF_SOURCES 32
+// init
+#define INIT_TRACKER_SUCCESS 0
+#define INIT_TRACKER_ERR_MEMORY 1
+#define INIT_TRACKER_ERR_MUTEX_INIT 2
+// announce
+#define TRACKER_ANNOUNCE_SUCCESS 0
+#define TRACKER_ANNOUNCE_ERR_MISMATCH 1
+#define TRACKER_ANNOUNCE_ERR_MEMORY 2
+// get sources
+#define TRACKER_GET_SOURCES_SUCCESS 0
+#define TRACKER_GET_SOURCES_ERR_NO_SUCH_FILE 1
+#define TRACKER_GET_SOURCES_ERR_MEMORY 2
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct source {
+    user peer;
+    uint32_t active_downloads;
+};
+
+struct file_sources {
+    uint64_t size;
+    uint32_t chunk_size;
+    uint32_t num_of_chunks;
+    char* chunk_hashes;         // num_of_chunks strings of MAX_CHUNK_HASH_LEN + 1 characters
+    uint32_t num_of_sources;
+    struct source* sources;
+};
+
+
+
+/*
+    must be called exactly once at the beginning, before the first call to any function
+    from this file has been done.
+    Returns:
+        INIT_TRACKER_SUCCESS            - success
+        INIT_TRACKER_ERR_MEMORY         - could not allocate the tracker
+        INIT_TRACKER_ERR_MUTEX_INIT     - could not initialize the tracker mutex
+*/
+int init_tracker();
+/*
+    must be called exactly once when the functions won't be used anymore.
+*/
+void destroy_tracker();
+/*
+    records that the owner serves chunks of the file_name file. The first announcement of a file
+    defines its size, chunk size and chunk hashes, the following ones must describe the same
+    content.
+    Returns:
+        TRACKER_ANNOUNCE_SUCCESS        - success
+        TRACKER_ANNOUNCE_ERR_MISMATCH   - the file was announced with different content
+        TRACKER_ANNOUNCE_ERR_MEMORY     - could not allocate memory
+*/
+int tracker_announce(char* file_name, char* owner, uint64_t size, uint32_t chunk_size,
+    uint32_t num_of_chunks, char chunk_hashes[][MAX_CHUNK_HASH_LEN + 1]);
+/*
+    records that the owner does not serve the file_name file anymore.
+*/
+void tracker_remove_peer(char* file_name, char* owner);
+/*
+    chooses at most max_sources connected owners of the file_name file for the downloader, the
+    least loaded first, and counts the download as active on each of them until the downloader
+    releases them (or asks for sources of the file again). The result is put where p_sources
+    points and it has to be deleted afterwards with free_file_sources().
+    Returns:
+        TRACKER_GET_SOURCES_SUCCESS             - success
+        TRACKER_GET_SOURCES_ERR_NO_SUCH_FILE    - nobody announced such file
+        TRACKER_GET_SOURCES_ERR_MEMORY          - could not allocate memory
+*/
+int tracker_get_sources(char* file_name, char* downloader, uint32_t max_sources,
+    struct file_sources* p_sources);
+/*
+    ends the download of the file_name file by the downloader, so the sources chosen for it are
+    not counted as loaded by it anymore.
+*/
+void tracker_release_sources(char* file_name, char* downloader);
+/*
+    deletes the result of tracker_get_sources().
+*/
+void free_file_sources(struct file_sources* p_sources);
+/*
+    calls on_announcement for every owner of every announced file, the owners of one file one
+    after another with the same file_name pointer. chunk_hashes are num_of_chunks strings of
+    MAX_CHUNK_HASH_LEN + 1 characters. The tracker is locked meanwhile, so on_announcement must
+    not use it.
+*/
+void tracker_for_each_announcement(void (*on_announcement)(char* file_name, char* owner,
+    uint64_t size, uint32_t chunk_size, uint32_t num_of_chunks, char* chunk_hashes, void* arg),
+    void* arg);
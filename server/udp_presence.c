@@ -0,0 +1,282 @@
+#define _GNU_SOURCE
+#include "udp_presence.h"
+#include "admission.h"
+#include "config.h"
+#include "connected_users.h"
+#include "metrics.h"
+#include "user_dao.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    the datagrams of one recvmmsg() and their responses
+*/
+struct datagram_batch {
+    struct mmsghdr requests[UDP_BATCH_SIZE];
+    struct mmsghdr responses[UDP_BATCH_SIZE];
+    struct iovec request_iovs[UDP_BATCH_SIZE];
+    struct iovec response_iovs[UDP_BATCH_SIZE];
+    struct sockaddr_in addrs[UDP_BATCH_SIZE];
+    char request_data[UDP_BATCH_SIZE][MAX_DATAGRAM_LEN];
+    char response_data[UDP_BATCH_SIZE][MAX_DATAGRAM_LEN];
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// global variables
+///////////////////////////////////////////////////////////////////////////////////////////////////
+int udp_socket = -1;
+pthread_t t_udp;
+int is_udp_running;
+// the buffers of the thread, about 100 KiB
+struct datagram_batch udp_batch;
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    Returns the field at *p_pos, finished by '\0' before end, and moves *p_pos behind it, or NULL
+    if there is no such field
+*/
+char* next_datagram_field(char** p_pos, char* end)
+{
+    char* field = *p_pos;
+    char* field_end = field < end ? memchr(field, '\0', end - field) : NULL;
+    if (field_end == NULL)
+        return NULL;
+
+    *p_pos = field_end + 1;
+
+    return field;
+}
+
+
+
+/*
+    appends the field with its '\0' to the response.
+    Returns the new length of the response
+*/
+size_t append_datagram_field(char* response, size_t len, char* field)
+{
+    size_t field_len = strlen(field) + 1;
+    if (len + field_len > MAX_DATAGRAM_LEN)
+        return len;
+
+    memcpy(response + len, field, field_len);
+
+    return len + field_len;
+}
+
+
+
+/*
+    answers the request of len bytes from the ip into the response.
+    Returns the length of the response, 0 if the request is dropped
+*/
+size_t answer_datagram(char* request, size_t len, uint32_t ip, char* response)
+{
+    char* pos = request;
+    char* end = request + len;
+    char* tag = next_datagram_field(&pos, end);
+    char* type = next_datagram_field(&pos, end);
+    char* username = next_datagram_field(&pos, end);
+    if (tag == NULL || type == NULL || username == NULL || strlen(tag) > MAX_UDP_TAG_LEN)
+        return 0;
+
+    metrics_increment(METRIC_UDP_REQUESTS);
+
+    user connected_user;
+    int is_presence = 0;
+    char res[2] = { UDP_SUCCESS, '\0' };
+    int admission_res = admission_enter_request(ip);
+
+    if (admission_res != ADMISSION_SUCCESS)
+    {
+        metrics_increment(admission_res == ADMISSION_ERR_RATE_LIMITED ?
+            METRIC_REQUESTS_RATE_LIMITED : METRIC_REQUESTS_BUSY);
+        res[0] = (char) UDP_BUSY;
+    }
+    else
+    {
+        if (*username == '\0' || strlen(username) > MAX_USERNAME_LEN)
+            res[0] = UDP_OTHER_ERROR;
+        else if (strcmp(type, UDP_REQ_HEARTBEAT) == 0)
+        {
+            // the storage is looked at only when the heartbeat fails
+            if (renew_lease(username) != RENEW_LEASE_SUCCESS)
+                res[0] = is_registered(username) ? UDP_DISCONNECTED : UDP_NO_SUCH_USER;
+        }
+        else if (strcmp(type, UDP_REQ_PRESENCE) == 0)
+        {
+            is_presence = get_connected_user(username, &connected_user);
+            if (!is_presence)
+                res[0] = UDP_DISCONNECTED;
+        }
+        else
+            res[0] = UDP_OTHER_ERROR;
+
+        admission_leave_request();
+    }
+
+    size_t response_len = append_datagram_field(response, 0, tag);
+    memcpy(response + response_len, res, 2);
+    response_len += 2;
+    if (is_presence)
+    {
+        response_len = append_datagram_field(response, response_len, connected_user.ip);
+        response_len = append_datagram_field(response, response_len, connected_user.port);
+    }
+
+    return response_len;
+}
+
+
+
+/*
+    sends the num_of_responses responses of the batch, sendmmsg() may send only some of them.
+*/
+void send_responses(struct datagram_batch* p_batch, int num_of_responses)
+{
+    int num_of_sent = 0;
+    while (num_of_sent < num_of_responses)
+    {
+        int res = sendmmsg(udp_socket, p_batch->responses + num_of_sent,
+            num_of_responses - num_of_sent, 0);
+        if (res > 0)
+            num_of_sent += res;
+        else if (res < 0 && errno == EINTR)
+            continue;
+        else
+        {
+            // e.g. the client's port is unreachable, skip its response
+            num_of_sent++;
+        }
+    }
+}
+
+
+
+/*
+    receives the datagrams in batches and answers them till destroy() is called
+*/
+void* serve_datagrams(void* arg)
+{
+    struct datagram_batch* p_batch = arg;
+
+    for (int i = 0; i < UDP_BATCH_SIZE; i++)
+    {
+        p_batch->request_iovs[i].iov_base = p_batch->request_data[i];
+        p_batch->request_iovs[i].iov_len = MAX_DATAGRAM_LEN;
+        p_batch->response_iovs[i].iov_base = p_batch->response_data[i];
+    }
+
+    while (__atomic_load_n(&is_udp_running, __ATOMIC_ACQUIRE))
+    {
+        memset(p_batch->requests, 0, sizeof(p_batch->requests));
+        for (int i = 0; i < UDP_BATCH_SIZE; i++)
+        {
+            p_batch->requests[i].msg_hdr.msg_name = &p_batch->addrs[i];
+            p_batch->requests[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            p_batch->requests[i].msg_hdr.msg_iov = &p_batch->request_iovs[i];
+            p_batch->requests[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        // waits for the first datagram only, then takes what has arrived
+        int num_of_requests = recvmmsg(udp_socket, p_batch->requests, UDP_BATCH_SIZE,
+            MSG_WAITFORONE, NULL);
+        if (num_of_requests <= 0)
+            continue;   // interrupted, or shut down by destroy()
+
+        int num_of_responses = 0;
+        memset(p_batch->responses, 0, sizeof(p_batch->responses));
+        for (int i = 0; i < num_of_requests; i++)
+        {
+            size_t len = answer_datagram(p_batch->request_data[i], p_batch->requests[i].msg_len,
+                p_batch->addrs[i].sin_addr.s_addr, p_batch->response_data[num_of_responses]);
+            if (len == 0)
+                continue;
+
+            struct msghdr* p_hdr = &p_batch->responses[num_of_responses].msg_hdr;
+            p_batch->response_iovs[num_of_responses].iov_len = len;
+            p_hdr->msg_name = &p_batch->addrs[i];
+            p_hdr->msg_namelen = sizeof(struct sockaddr_in);
+            p_hdr->msg_iov = &p_batch->response_iovs[num_of_responses];
+            p_hdr->msg_iovlen = 1;
+            num_of_responses++;
+        }
+
+        send_responses(p_batch, num_of_responses);
+    }
+
+    return NULL;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// init / destroy
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int init_udp_presence(int port)
+{
+    udp_socket = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (udp_socket < 0)
+        return INIT_UDP_PRESENCE_ERR_SOCKET;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    if (get_config()->address[0] != '\0')
+        inet_pton(AF_INET, get_config()->address, &addr.sin_addr);
+
+    if (bind(udp_socket, (struct sockaddr*) &addr, sizeof(addr)) != 0)
+    {
+        close(udp_socket);
+        udp_socket = -1;
+        return INIT_UDP_PRESENCE_ERR_SOCKET;
+    }
+
+    is_udp_running = 1;
+    if (pthread_create(&t_udp, NULL, serve_datagrams, &udp_batch) != 0)
+    {
+        close(udp_socket);
+        udp_socket = -1;
+        return INIT_UDP_PRESENCE_ERR_THREAD;
+    }
+
+    return INIT_UDP_PRESENCE_SUCCESS;
+}
+
+
+
+void destroy_udp_presence()
+{
+    if (udp_socket < 0)
+        return;
+
+    // wakes up the thread waiting in recvmmsg()
+    __atomic_store_n(&is_udp_running, 0, __ATOMIC_RELEASE);
+    shutdown(udp_socket, SHUT_RDWR);
+    pthread_join(t_udp, NULL);
+
+    close(udp_socket);
+    udp_socket = -1;
+}
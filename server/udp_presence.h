@@ -0,0 +1,53 @@
+#include <stdint.h>
+/*
+    UDP fast path of the presence requests. A heartbeat (see init_leases in connected_users.h)
+    and the question whether a user is connected are tiny, over TCP most of their cost is the
+    connection. On the UDP port they take one datagram each way, without a connection and without
+    a thread of their own: a single thread receives up to UDP_BATCH_SIZE datagrams with one
+    recvmmsg(), answers them from the registry of the connected users (the same one the TCP
+    requests use) and sends the responses with one sendmmsg().
+    A request is a tag chosen by the client (echoed in the response, so the client can match the
+    responses to the requests), the type and the username, each finished by '\0'. The response is
+    the tag, the result code and '\0', PRESENCE of a connected user is followed by its ip address
+    and port. Datagrams which can't be parsed are dropped, so the client retries after a timeout.
+    The requests go through the admission control like the TCP ones (result code 255 - BUSY).
+    IMPORTANT before any operation will be performed it is required to call the init() function and
+    if the UDP port won't be used anymore then the destroy() function must be called.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define UDP_BATCH_SIZE 64
+#define MAX_DATAGRAM_LEN 512
+#define MAX_UDP_TAG_LEN 20
+// requests
+#define UDP_REQ_HEARTBEAT "HEARTBEAT"   // like the TCP one
+#define UDP_REQ_PRESENCE "PRESENCE"     // result code, then ip and port if the user is connected
+// results
+#define UDP_SUCCESS 0
+#define UDP_NO_SUCH_USER 1              // HEARTBEAT only, PRESENCE does not look at the storage
+#define UDP_DISCONNECTED 2
+#define UDP_OTHER_ERROR 3
+#define UDP_BUSY 255
+// init
+#define INIT_UDP_PRESENCE_SUCCESS 0
+#define INIT_UDP_PRESENCE_ERR_SOCKET 1
+#define INIT_UDP_PRESENCE_ERR_THREAD 2
+
+
+
+/*
+    must be called exactly once at the beginning, before the first call to any function
+    from this file has been done, after the connected users and the leases are initialized.
+    Starts answering the datagrams on the port of the address of the configuration (see config.h).
+    Returns:
+        INIT_UDP_PRESENCE_SUCCESS       - success
+        INIT_UDP_PRESENCE_ERR_SOCKET    - could not bind the port
+        INIT_UDP_PRESENCE_ERR_THREAD    - could not start the thread
+*/
+int init_udp_presence(int port);
+/*
+    stops answering the datagrams and closes the port. Must be called before the connected users
+    and the leases are destroyed, calling it again does nothing.
+*/
+void destroy_udp_presence();
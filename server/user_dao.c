@@ -1,4 +1,8 @@
 #include "user_dao.h"
+#include "blob_store.h"
+#include "compression.h"
+#include "placement.h"
+#include "reclaimer.h"
 #include <errno.h>
 #include <sys/stat.h>
 #include <pthread.h>
@@ -6,6 +10,8 @@
 #include <stdio.h>
 #include <dirent.h>
 #include <stdlib.h> 
+#include <fcntl.h>
+#include <unistd.h>
 
 
 
@@ -14,20 +20,185 @@
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // paths
 #define STORAGE_DIR_PATH "storage/"
+#define FANOUT_MARKER_PATH "storage/.fanout"
+#define MIGRATION_DIR_PATH "storage.fanout/"
+#define MIGRATED_DIR_PATH "storage.flat/"
+// the users are in storage/<2 hex digits>/<2 hex digits>/, by the hash of their names
+#define FANOUT_PREFIX_LEN 6
+#define USER_DIR_PATH_LEN(username) (strlen(STORAGE_DIR_PATH) + FANOUT_PREFIX_LEN + strlen(username))
 // names lengths
 #define MAX_FILENAME_LEN 256
-// delete_all_user_files
-#define DELETE_ALL_USER_FILES_SUCCESS 0
-#define DELETE_ALL_USER_FILES_ERR_NO_SUCH_USER 1
-#define DELETE_ALL_USER_FILES_ERR_REMOVE 2
-#define DELETE_ALL_USER_FILES_ERR_CLOSE_DIR 3
 
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // global variables
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-pthread_mutex_t mutex_storage;
+// taken by every request thread, it shares its cache line with nothing else. The listings and the
+// scans only read the storage, so they run in parallel
+pthread_rwlock_t rwlock_storage __attribute__((aligned(CACHE_LINE_SIZE)));
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// paths
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    puts the path of the user's directory in the storage_path storage, <2 hex digits>/<2 hex
+    digits>/<username> after the storage path, into path. It must have room for
+    USER_DIR_PATH_LEN(username) + 1 characters. A username which is not a single component of a
+    path (see is_path_component_valid) would lead out of its directory, so it has no path.
+    Returns 0 on success and -1 if the username can't have a directory
+*/
+int get_user_dir_path_in(char* storage_path, char* username, char* path)
+{
+    path[0] = '\0';
+    if (!is_path_component_valid(username))
+        return -1;
+
+    // FNV-1a, the first two bytes are the directories
+    uint32_t hash = 2166136261u;
+    for (char* p = username; *p != '\0'; p++)
+        hash = (hash ^ (uint8_t) *p) * 16777619u;
+
+    sprintf(path, "%s%02x/%02x/%s", storage_path, (unsigned int) (hash >> 24),
+        (unsigned int) ((hash >> 16) & 0xff), username);
+
+    return 0;
+}
+
+
+
+/*
+    puts the path of the user's directory into path, see get_user_dir_path_in.
+    Returns 0 on success and -1 if the username can't have a directory
+*/
+int get_user_dir_path(char* username, char* path)
+{
+    return get_user_dir_path_in(STORAGE_DIR_PATH, username, path);
+}
+
+
+
+/*
+    puts the path of the user's file into path. It must have room for
+    USER_DIR_PATH_LEN(username) + strlen(file_name) + 2 characters.
+    Returns 0 on success and -1 if the username can't have a directory
+*/
+int get_user_file_path(char* username, char* file_name, char* path)
+{
+    if (get_user_dir_path(username, path) != 0)
+        return -1;
+
+    strcat(path, "/");
+    strcat(path, file_name);
+
+    return 0;
+}
+
+
+
+/*
+    creates the directories of the path up to its last '/', the ones existing already are skipped.
+    Returns 0 on success and -1 on fail
+*/
+int make_parent_dirs(char* path)
+{
+    char dir_path[strlen(path) + 1];
+    strcpy(dir_path, path);
+
+    for (char* p = strchr(dir_path, '/'); p != NULL; p = strchr(p + 1, '/'))
+    {
+        *p = '\0';
+        if (mkdir(dir_path, S_IRWXU) != 0 && errno != EEXIST)
+            return -1;
+        *p = '/';
+    }
+
+    return 0;
+}
+
+
+
+/*
+    Returns 1 if the directory has an entry which is not hidden (its name starts with '.'), 0 if it
+    has none and -1 if it could not be read
+*/
+int has_visible_entries(char* dir_path)
+{
+    DIR* p_dir = opendir(dir_path);
+    if (p_dir == NULL)
+        return -1;
+
+    struct dirent* p_entry;
+    int res = 0;
+    while (res == 0 && (p_entry = readdir(p_dir)) != NULL)
+        res = p_entry->d_name[0] != '.';
+    closedir(p_dir);
+
+    return res;
+}
+
+
+
+/*
+    calls on_user_dir for every user in the storage, with its name and the path of its directory.
+    Returns 0 on success and -1 if the storage could not be read
+*/
+int for_each_user_dir(void (*on_user_dir)(char* username, char* user_dir_path, void* arg),
+    void* arg)
+{
+    DIR* p_storage_dir = opendir(STORAGE_DIR_PATH);
+    if (p_storage_dir == NULL)
+        return -1;
+
+    // storage/<2 hex digits>/<2 hex digits>/<username>
+    struct dirent* p_first;
+    while ((p_first = readdir(p_storage_dir)) != NULL)
+    {
+        if (p_first->d_name[0] == '.')
+            continue;
+
+        char first_path[strlen(STORAGE_DIR_PATH) + strlen(p_first->d_name) + 2];
+        sprintf(first_path, "%s%s/", STORAGE_DIR_PATH, p_first->d_name);
+        DIR* p_first_dir = opendir(first_path);
+        if (p_first_dir == NULL)
+            continue;
+
+        struct dirent* p_second;
+        while ((p_second = readdir(p_first_dir)) != NULL)
+        {
+            if (p_second->d_name[0] == '.')
+                continue;
+
+            char second_path[strlen(first_path) + strlen(p_second->d_name) + 2];
+            sprintf(second_path, "%s%s/", first_path, p_second->d_name);
+            DIR* p_second_dir = opendir(second_path);
+            if (p_second_dir == NULL)
+                continue;
+
+            struct dirent* p_user;
+            while ((p_user = readdir(p_second_dir)) != NULL)
+            {
+                if (p_user->d_name[0] == '.')
+                    continue;
+
+                char user_dir_path[strlen(second_path) + strlen(p_user->d_name) + 2];
+                sprintf(user_dir_path, "%s%s/", second_path, p_user->d_name);
+                on_user_dir(p_user->d_name, user_dir_path, arg);
+            }
+
+            closedir(p_second_dir);
+        }
+
+        closedir(p_first_dir);
+    }
+
+    closedir(p_storage_dir);
+
+    return 0;
+}
 
 
 
@@ -43,8 +214,20 @@ int init_user_dao()
         return INIT_USER_DAO_ERR_FOLDER_CREATION;                   // already existed
     }
 
-    // initialize mutex
-    if (pthread_mutex_init(&mutex_storage, NULL) != 0)
+    // the users of a storage without the marker are right in it, it has to be migrated first
+    struct stat st = {0};
+    if (stat(FANOUT_MARKER_PATH, &st) != 0)
+    {
+        int fd = -1;
+        if (has_visible_entries(STORAGE_DIR_PATH) != 0)
+            return INIT_USER_DAO_ERR_LAYOUT;
+        if ((fd = open(FANOUT_MARKER_PATH, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR)) < 0)
+            return INIT_USER_DAO_ERR_FOLDER_CREATION;
+        close(fd);
+    }
+
+    // initialize lock
+    if (pthread_rwlock_init(&rwlock_storage, NULL) != 0)
     {
         return INIT_USER_DAO_ERR_MUTEX_INIT;
     }
@@ -60,7 +243,7 @@ int init_user_dao()
 
 int destroy_user_dao()
 {
-    if (pthread_mutex_destroy(&mutex_storage) != 0)
+    if (pthread_rwlock_destroy(&rwlock_storage) != 0)
     {
         return DESTROY_USER_DAO_ERR_MUTEX;
     }
@@ -77,12 +260,12 @@ int destroy_user_dao()
 int create_user(char* name)
 {
     // create user directory path
-    char dir_path[strlen(STORAGE_DIR_PATH) + strlen(name) + 1];
-    strcpy(dir_path, STORAGE_DIR_PATH);
-    strcat(dir_path, name);
+    char dir_path[USER_DIR_PATH_LEN(name) + 1];
+    if (get_user_dir_path(name, dir_path) != 0)
+        return CREATE_USER_ERR_DIRECTORY;
 
-    // create user directory
-    if (mkdir(dir_path, S_IRWXU) != 0)
+    // create user directory, its parents are created by the first user in them and never removed
+    if (make_parent_dirs(dir_path) != 0 || mkdir(dir_path, S_IRWXU) != 0)
     {          
         if (errno == EEXIST)     
             return CREATE_USER_ERR_EXISTS;    
@@ -98,43 +281,52 @@ int create_user(char* name)
 
 
 
+int create_users(char** usernames, uint32_t num_of_users, int* results)
+{
+    if (pthread_rwlock_wrlock(&rwlock_storage) != 0)
+    {
+        printf("ERROR create_users - could not lock mutex\n");
+        return CREATE_USERS_ERR_MUTEX_LOCK;
+    }
+
+    for (uint32_t i = 0; i < num_of_users; i++)
+        results[i] = create_user(usernames[i]);
+
+    if (pthread_rwlock_unlock(&rwlock_storage) != 0)
+    {
+        printf("ERROR create_users - could not unlock mutex\n");
+        return CREATE_USERS_ERR_MUTEX_UNLOCK;
+    }
+
+    return CREATE_USERS_SUCCESS;
+}
+
+
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // delete_user
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-int delete_all_user_files(char* user_dir_path, int file_path_len)
+/*
+    deletes the user with the specified name, the storage mutex must be locked.
+*/
+int delete_locked_user(char* name)
 {
-    int res = DELETE_ALL_USER_FILES_SUCCESS;
+    int res = DELETE_USER_SUCCESS;
 
-    // delete user files
-    DIR* p_user_dir = opendir(user_dir_path);
-    if (p_user_dir != NULL)
-    {
-        struct dirent* p_next_file;
-        char filepath[file_path_len + 1];
+    // the files are deleted in the background, the user is gone as soon as its directory is. The
+    // whole directory is deleted, so a name leading out of it has none
+    char dir_path[USER_DIR_PATH_LEN(name) + 1];
+    if (get_user_dir_path(name, dir_path) != 0)
+        return DELETE_USER_ERR_NOT_EXISTS;
 
-        while ((p_next_file = readdir(p_user_dir)) != NULL )
-        {
-            if (p_next_file->d_name[0] != '.') // ignore 'non files'
-            {
-                // build the path for each file in the folder
-                sprintf(filepath, "%s%s", user_dir_path, p_next_file->d_name);
-                if (remove(filepath) != 0)
-                {
-                    perror("ERROR delete_all_user_files - could not remove file");
-                    return DELETE_ALL_USER_FILES_ERR_REMOVE;
-                }
-            }
-        }
-        
-        if (closedir(p_user_dir) != 0)
-        {
-            perror("ERROR delete_all_user_files - could not close dir");
-            return DELETE_ALL_USER_FILES_ERR_CLOSE_DIR;
-        }
-    }
-    else // no such user
-        res = DELETE_ALL_USER_FILES_ERR_NO_SUCH_USER;
+    int move_res = move_to_trash(dir_path);
+    if (move_res == MOVE_TO_TRASH_ERR_NOT_EXISTS)
+        res = DELETE_USER_ERR_NOT_EXISTS;
+    else if (move_res != MOVE_TO_TRASH_SUCCESS)
+        res = DELETE_USER_ERR_REMOVE_FOLDER;
+    else
+        invalidate_cached_listing(name);
 
     return res;
 }
@@ -146,31 +338,12 @@ int delete_user(char* name)
     int res = DELETE_USER_SUCCESS;
 
     // acquire the storage mutex
-    if (pthread_mutex_lock(&mutex_storage) == 0)
-    {
-        // create user directory path. + 1 because additional / to separate dir from file
-        int user_folder_path_len = strlen(STORAGE_DIR_PATH) + strlen(name) + 1;
-        int file_path_len = user_folder_path_len + MAX_FILENAME_LEN; 
-        char dir_path[user_folder_path_len + 1]; 
-        strcpy(dir_path, STORAGE_DIR_PATH);
-        strcat(dir_path, name);
-        strcat(dir_path, "/");
-
-        // first delete all user's files
-        int del_files_res = delete_all_user_files(dir_path, file_path_len);
-        if (del_files_res == DELETE_ALL_USER_FILES_SUCCESS)
-        {
-            // remove user directory
-            if (remove(dir_path) != 0)
-                res = DELETE_USER_ERR_REMOVE_FOLDER;
-        }
-        else if (del_files_res == DELETE_ALL_USER_FILES_ERR_NO_SUCH_USER)
-            res = DELETE_USER_ERR_NOT_EXISTS;
-        else
-            res = DELETE_USER_ERR_REMOVE_FILE;
+    if (pthread_rwlock_wrlock(&rwlock_storage) == 0)
+    {
+        res = delete_locked_user(name);
 
         // unlock the storage mutex
-        if (pthread_mutex_unlock(&mutex_storage) != 0)
+        if (pthread_rwlock_unlock(&rwlock_storage) != 0)
         {
             res = DELETE_USER_ERR_MUTEX_UNLOCK;
             printf("ERROR delete_user - could not unlock mutex\n");
@@ -187,6 +360,28 @@ int delete_user(char* name)
 
 
 
+int delete_users(char** usernames, uint32_t num_of_users, int* results)
+{
+    if (pthread_rwlock_wrlock(&rwlock_storage) != 0)
+    {
+        printf("ERROR delete_users - could not lock mutex\n");
+        return DELETE_USERS_ERR_MUTEX_LOCK;
+    }
+
+    for (uint32_t i = 0; i < num_of_users; i++)
+        results[i] = delete_locked_user(usernames[i]);
+
+    if (pthread_rwlock_unlock(&rwlock_storage) != 0)
+    {
+        printf("ERROR delete_users - could not unlock mutex\n");
+        return DELETE_USERS_ERR_MUTEX_UNLOCK;
+    }
+
+    return DELETE_USERS_SUCCESS;
+}
+
+
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // get_user_files_list
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -209,19 +404,19 @@ uint32_t count_user_files(DIR* p_directory)
 
 
 
-int get_user_files_list(char* username, char*** p_user_files, uint32_t* p_quantity)
+int get_user_files_list(char* username, char*** p_user_files, uint32_t* p_quantity,
+    struct arena* p_arena)
 {
     int res = GET_USER_FILES_LIST_SUCCESS;
 
     // create user directory path
-    int user_folder_path_len = strlen(STORAGE_DIR_PATH) + strlen(username) + 1; // + 1 --> /
-    char user_dir_path[user_folder_path_len + 1]; 
-    strcpy(user_dir_path, STORAGE_DIR_PATH);
-    strcat(user_dir_path, username);
+    char user_dir_path[USER_DIR_PATH_LEN(username) + 2];
+    if (get_user_dir_path(username, user_dir_path) != 0)
+        return GET_USER_FILES_LIST_ERR_NO_SUCH_USER;
     strcat(user_dir_path, "/");
 
 	// open user directory
-    if (pthread_mutex_lock(&mutex_storage) == 0)
+    if (pthread_rwlock_rdlock(&rwlock_storage) == 0)
     {
         DIR* p_user_dir = opendir(user_dir_path);
         if (p_user_dir != NULL)
@@ -229,21 +424,39 @@ int get_user_files_list(char* username, char*** p_user_files, uint32_t* p_quanti
             struct dirent* p_next_file;
             char* file_name;
             *p_quantity = count_user_files(p_user_dir);
-            char** user_files = malloc(*p_quantity * sizeof(char*));
-            int file_idx = 0;
+            char** user_files = arena_alloc(p_arena, (*p_quantity + 1) * sizeof(char*));
+            uint32_t file_idx = 0;
 
-            while ((p_next_file = readdir(p_user_dir)) != NULL )
+            while (user_files != NULL && (p_next_file = readdir(p_user_dir)) != NULL )
             {
                 file_name = p_next_file->d_name;
-                if (file_name[0] != '.') // ignore 'non files'
+                if (file_name[0] != '.' && file_idx < *p_quantity) // ignore 'non files'
                 {
-                    user_files[file_idx] = malloc((strlen(file_name) + 1) * sizeof(char));
-                    strcpy(user_files[file_idx], file_name);
+                    if ((user_files[file_idx] = arena_strdup(p_arena, file_name)) == NULL)
+                    {
+                        res = GET_USER_FILES_LIST_ERR_MEMORY;
+                        break;
+                    }
                     ++file_idx;
                 }
             }
 
+            if (user_files == NULL)
+                res = GET_USER_FILES_LIST_ERR_MEMORY;
+            else if (res == GET_USER_FILES_LIST_ERR_MEMORY && p_arena == NULL)
+            {
+                for (uint32_t i = 0; i < file_idx; i++)
+                    free(user_files[i]);
+                free(user_files);
+            }
+
+            if (res == GET_USER_FILES_LIST_ERR_MEMORY)
+            {
+                user_files = NULL;
+                file_idx = 0;
+            }
             *p_user_files = user_files;
+            *p_quantity = file_idx;
             
             if (closedir(p_user_dir) != 0)
             {
@@ -254,7 +467,7 @@ int get_user_files_list(char* username, char*** p_user_files, uint32_t* p_quanti
         else // no such user
             res = GET_USER_FILES_LIST_ERR_NO_SUCH_USER;
 
-        if (pthread_mutex_unlock(&mutex_storage) != 0)
+        if (pthread_rwlock_unlock(&rwlock_storage) != 0)
         {
             res = GET_USER_FILES_LIST_ERR_MUTEX_UNLOCK;
             printf("ERROR get_user_files_list - could not unlock mutex\n");
@@ -277,12 +490,488 @@ int get_user_files_list(char* username, char*** p_user_files, uint32_t* p_quanti
 
 int is_registered(char* username)
 {
-    int user_folder_path_len = strlen(STORAGE_DIR_PATH) + strlen(username);
-    char dir_path[user_folder_path_len + 1]; 
-    strcpy(dir_path, STORAGE_DIR_PATH);
-    strcat(dir_path, username);
+    char dir_path[USER_DIR_PATH_LEN(username) + 1];
+    if (get_user_dir_path(username, dir_path) != 0)
+        return 0;
 
     struct stat st = {0};
 
     return stat(dir_path, &st) == 0 ? 1 : 0;
-}
\ No newline at end of file
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// publish_file
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    creates the file_name file of the registered user with the description as its content, the
+    storage mutex must be locked. A description published before is only linked (see
+    blob_store.h), a new one is written and becomes the blob.
+*/
+int write_published_file(char* username, char* file_name, char* description)
+{
+    int res = PUBLISH_FILE_SUCCESS;
+
+    char file_path[USER_DIR_PATH_LEN(username) + strlen(file_name) + 2];
+    if (get_user_file_path(username, file_name, file_path) != 0)
+        return PUBLISH_FILE_ERR_NO_SUCH_USER;
+
+    size_t len = strlen(description);
+    int link_res = link_blob(description, len, file_path);
+    int fd = -1;
+    if (link_res == LINK_BLOB_SUCCESS)
+        res = PUBLISH_FILE_SUCCESS;
+    else if (link_res == LINK_BLOB_ERR_EXISTS)
+        res = PUBLISH_FILE_ERR_EXISTS;
+    else if ((fd = open(file_path, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR)) >= 0)
+    {
+        if (write(fd, description, len) != (ssize_t) len)
+        {
+            perror("ERROR publish_file - could not write description");
+            res = PUBLISH_FILE_ERR_WRITE;
+            unlink(file_path);
+        }
+        close(fd);
+
+        // the file stays unshared if it can't be linked
+        if (res == PUBLISH_FILE_SUCCESS)
+            dedup_file(file_path, description, len);
+    }
+    else if (errno == EEXIST)
+        res = PUBLISH_FILE_ERR_EXISTS;
+    else
+    {
+        perror("ERROR publish_file - could not create file");
+        res = PUBLISH_FILE_ERR_WRITE;
+    }
+
+    if (res == PUBLISH_FILE_SUCCESS)
+        invalidate_cached_listing(username);
+
+    return res;
+}
+
+
+
+int publish_file(char* username, char* file_name, char* description)
+{
+    int res = PUBLISH_FILE_SUCCESS;
+
+    if (pthread_rwlock_wrlock(&rwlock_storage) == 0)
+    {
+        if (is_registered(username))
+            res = write_published_file(username, file_name, description);
+        else
+            res = PUBLISH_FILE_ERR_NO_SUCH_USER;
+
+        if (pthread_rwlock_unlock(&rwlock_storage) != 0)
+        {
+            res = PUBLISH_FILE_ERR_MUTEX_UNLOCK;
+            printf("ERROR publish_file - could not unlock mutex\n");
+        }
+    }
+    else
+    {
+        res = PUBLISH_FILE_ERR_MUTEX_LOCK;
+        printf("ERROR publish_file - could not lock mutex\n");
+    }
+
+    return res;
+}
+
+
+
+int publish_files(char* username, char** file_names, char** descriptions, uint32_t num_of_files,
+    int* results)
+{
+    if (pthread_rwlock_wrlock(&rwlock_storage) != 0)
+    {
+        printf("ERROR publish_files - could not lock mutex\n");
+        return PUBLISH_FILES_ERR_MUTEX_LOCK;
+    }
+
+    int is_user_registered = is_registered(username);
+    for (uint32_t i = 0; i < num_of_files; i++)
+        results[i] = is_user_registered ? write_published_file(username, file_names[i], 
+            descriptions[i]) : PUBLISH_FILE_ERR_NO_SUCH_USER;
+
+    if (pthread_rwlock_unlock(&rwlock_storage) != 0)
+    {
+        printf("ERROR publish_files - could not unlock mutex\n");
+        return PUBLISH_FILES_ERR_MUTEX_UNLOCK;
+    }
+
+    return PUBLISH_FILES_SUCCESS;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// delete_file
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    reads the description of the file with the specified path into description, which must have
+    room for MAX_DESCRIPTION_LEN + 1 characters.
+*/
+void read_description(char* file_path, char* description)
+{
+    ssize_t len = 0;
+    int fd = open(file_path, O_RDONLY);
+    if (fd >= 0)
+    {
+        len = read(fd, description, MAX_DESCRIPTION_LEN);
+        close(fd);
+    }
+
+    description[len > 0 ? len : 0] = '\0';
+}
+
+
+
+int delete_file(char* username, char* file_name)
+{
+    int res = DELETE_FILE_SUCCESS;
+
+    char file_path[USER_DIR_PATH_LEN(username) + strlen(file_name) + 2];
+    if (get_user_file_path(username, file_name, file_path) != 0)
+        return DELETE_FILE_ERR_NO_SUCH_USER;
+    char description[MAX_DESCRIPTION_LEN + 1];
+
+    if (pthread_rwlock_wrlock(&rwlock_storage) == 0)
+    {
+        // the description names its blob, which may not be needed anymore afterwards
+        read_description(file_path, description);
+        if (!is_registered(username))
+            res = DELETE_FILE_ERR_NO_SUCH_USER;
+        else if (unlink(file_path) != 0)
+            res = errno == ENOENT ? DELETE_FILE_ERR_NOT_EXISTS : DELETE_FILE_ERR_REMOVE;
+        else
+        {
+            invalidate_cached_listing(username);
+            release_blob(description, strlen(description));
+        }
+
+        if (pthread_rwlock_unlock(&rwlock_storage) != 0)
+        {
+            res = DELETE_FILE_ERR_MUTEX_UNLOCK;
+            printf("ERROR delete_file - could not unlock mutex\n");
+        }
+    }
+    else
+    {
+        res = DELETE_FILE_ERR_MUTEX_LOCK;
+        printf("ERROR delete_file - could not lock mutex\n");
+    }
+
+    return res;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// scan_storage
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    arguments of scan_user_files
+*/
+struct scan_storage_args
+{
+    void (*on_file)(char* username, char* file_name, char* description, void* arg);
+    void* arg;
+};
+
+
+
+/*
+    calls on_file of the scan_storage_args for every file of the user
+*/
+void scan_user_files(char* username, char* user_dir_path, void* arg)
+{
+    struct scan_storage_args* p_args = (struct scan_storage_args*) arg;
+
+    DIR* p_user_dir = opendir(user_dir_path);
+    if (p_user_dir == NULL)
+        return;
+
+    struct dirent* p_next_file;
+    char file_path[strlen(user_dir_path) + MAX_FILENAME_LEN + 1];
+    char description[MAX_DESCRIPTION_LEN + 1];
+
+    while ((p_next_file = readdir(p_user_dir)) != NULL)
+    {
+        if (p_next_file->d_name[0] == '.') // ignore 'non files'
+            continue;
+
+        sprintf(file_path, "%s%s", user_dir_path, p_next_file->d_name);
+        read_description(file_path, description);
+        p_args->on_file(username, p_next_file->d_name, description, p_args->arg);
+    }
+
+    closedir(p_user_dir);
+}
+
+
+
+int scan_storage(void (*on_file)(char* username, char* file_name, char* description, void* arg),
+    void* arg)
+{
+    int res = SCAN_STORAGE_SUCCESS;
+
+    if (pthread_rwlock_rdlock(&rwlock_storage) != 0)
+    {
+        printf("ERROR scan_storage - could not lock mutex\n");
+        return SCAN_STORAGE_ERR_MUTEX_LOCK;
+    }
+
+    struct scan_storage_args args = {on_file, arg};
+    if (for_each_user_dir(scan_user_files, &args) != 0)
+        res = SCAN_STORAGE_ERR_OPEN_DIR;
+
+    if (pthread_rwlock_unlock(&rwlock_storage) != 0)
+    {
+        res = SCAN_STORAGE_ERR_MUTEX_UNLOCK;
+        printf("ERROR scan_storage - could not unlock mutex\n");
+    }
+
+    return res;
+}
+
+
+
+/*
+    arguments of scan_user
+*/
+struct scan_users_args
+{
+    void (*on_user)(char* username, void* arg);
+    void* arg;
+};
+
+
+
+/*
+    calls on_user of the scan_users_args for the user
+*/
+void scan_user(char* username, char* user_dir_path, void* arg)
+{
+    struct scan_users_args* p_args = (struct scan_users_args*) arg;
+    (void) user_dir_path;
+
+    p_args->on_user(username, p_args->arg);
+}
+
+
+
+int scan_users(void (*on_user)(char* username, void* arg), void* arg)
+{
+    int res = SCAN_USERS_SUCCESS;
+
+    if (pthread_rwlock_rdlock(&rwlock_storage) != 0)
+    {
+        printf("ERROR scan_users - could not lock mutex\n");
+        return SCAN_USERS_ERR_MUTEX_LOCK;
+    }
+
+    struct scan_users_args args = {on_user, arg};
+    if (for_each_user_dir(scan_user, &args) != 0)
+        res = SCAN_USERS_ERR_OPEN_DIR;
+
+    if (pthread_rwlock_unlock(&rwlock_storage) != 0)
+    {
+        res = SCAN_USERS_ERR_MUTEX_UNLOCK;
+        printf("ERROR scan_users - could not unlock mutex\n");
+    }
+
+    return res;
+}
+
+
+
+int scan_users_unlocked(void (*on_user)(char* username, void* arg), void* arg)
+{
+    // the directories which exist during the whole walk are read exactly once
+    struct scan_users_args args = {on_user, arg};
+
+    return for_each_user_dir(scan_user, &args) == 0 ? SCAN_USERS_SUCCESS
+        : SCAN_USERS_ERR_OPEN_DIR;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// is_published
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int is_published(char* username, char* file_name)
+{
+    char file_path[USER_DIR_PATH_LEN(username) + strlen(file_name) + 2];
+    if (get_user_file_path(username, file_name, file_path) != 0)
+        return 0;
+
+    struct stat st = {0};
+
+    return stat(file_path, &st) == 0 ? 1 : 0;
+}
+
+
+
+int get_file_description(char* username, char* file_name, char* description)
+{
+    if (!is_published(username, file_name))
+        return 0;
+
+    char file_path[USER_DIR_PATH_LEN(username) + strlen(file_name) + 2];
+    if (get_user_file_path(username, file_name, file_path) != 0)
+        return 0;
+    read_description(file_path, description);
+
+    return 1;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// migrate_storage
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int migrate_storage(uint32_t* p_num_of_moved)
+{
+    *p_num_of_moved = 0;
+    struct stat st = {0};
+
+    // interrupted between the two renames at the end
+    if (stat(STORAGE_DIR_PATH, &st) != 0)
+    {
+        if (stat(MIGRATION_DIR_PATH, &st) != 0)
+            return MIGRATE_STORAGE_SUCCESS; // no storage at all
+
+        if (rename(MIGRATION_DIR_PATH, STORAGE_DIR_PATH) != 0)
+            return MIGRATE_STORAGE_ERR_MOVE;
+    }
+
+    if (stat(FANOUT_MARKER_PATH, &st) == 0)
+    {
+        rmdir(MIGRATED_DIR_PATH);
+        return MIGRATE_STORAGE_SUCCESS;
+    }
+
+    // move the users, the ones moved before an interruption are not in the storage anymore
+    DIR* p_storage_dir = opendir(STORAGE_DIR_PATH);
+    if (p_storage_dir == NULL)
+        return MIGRATE_STORAGE_ERR_OPEN_DIR;
+
+    struct dirent* p_next_user;
+    int res = MIGRATE_STORAGE_SUCCESS;
+    while (res == MIGRATE_STORAGE_SUCCESS && (p_next_user = readdir(p_storage_dir)) != NULL)
+    {
+        char* username = p_next_user->d_name;
+        if (username[0] == '.')
+            continue;
+
+        char old_path[strlen(STORAGE_DIR_PATH) + strlen(username) + 1];
+        char new_path[strlen(MIGRATION_DIR_PATH) + FANOUT_PREFIX_LEN + strlen(username) + 1];
+        sprintf(old_path, "%s%s", STORAGE_DIR_PATH, username);
+
+        if (get_user_dir_path_in(MIGRATION_DIR_PATH, username, new_path) != 0
+            || make_parent_dirs(new_path) != 0 ||
+            (rename(old_path, new_path) != 0 && errno != ENOENT))
+        {
+            printf("ERROR migrate_storage - could not move %s to %s\n", old_path, new_path);
+            res = MIGRATE_STORAGE_ERR_MOVE;
+        }
+        else
+            (*p_num_of_moved)++;
+    }
+    closedir(p_storage_dir);
+
+    if (res != MIGRATE_STORAGE_SUCCESS)
+        return res;
+
+    // an empty storage has no users to move
+    if (mkdir(MIGRATION_DIR_PATH, S_IRWXU) != 0 && errno != EEXIST)
+        return MIGRATE_STORAGE_ERR_MOVE;
+
+    char marker_path[strlen(MIGRATION_DIR_PATH) + strlen(".fanout") + 1];
+    sprintf(marker_path, "%s.fanout", MIGRATION_DIR_PATH);
+    int fd = open(marker_path, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
+    if (fd < 0)
+        return MIGRATE_STORAGE_ERR_MARKER;
+    close(fd);
+
+    // the flat storage is empty now, the fan-out one takes its place
+    if (rename(STORAGE_DIR_PATH, MIGRATED_DIR_PATH) != 0 ||
+        rename(MIGRATION_DIR_PATH, STORAGE_DIR_PATH) != 0)
+    {
+        return MIGRATE_STORAGE_ERR_MOVE;
+    }
+    rmdir(MIGRATED_DIR_PATH);
+
+    return MIGRATE_STORAGE_SUCCESS;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// dedup_storage
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    counters of dedup_user_files
+*/
+struct dedup_storage_args
+{
+    uint32_t num_of_files;
+    uint32_t num_of_linked;
+};
+
+
+
+/*
+    shares the files of the user, see dedup_file
+*/
+void dedup_user_files(char* username, char* user_dir_path, void* arg)
+{
+    struct dedup_storage_args* p_args = (struct dedup_storage_args*) arg;
+    (void) username;
+
+    DIR* p_user_dir = opendir(user_dir_path);
+    if (p_user_dir == NULL)
+        return;
+
+    struct dirent* p_next_file;
+    char file_path[strlen(user_dir_path) + MAX_FILENAME_LEN + 1];
+
+    while ((p_next_file = readdir(p_user_dir)) != NULL)
+    {
+        if (p_next_file->d_name[0] == '.') // ignore 'non files'
+            continue;
+
+        sprintf(file_path, "%s%s", user_dir_path, p_next_file->d_name);
+        int dedup_res = dedup_file(file_path, NULL, 0);
+        if (dedup_res == DEDUP_FILE_LINKED)
+            p_args->num_of_linked++;
+        else if (dedup_res != DEDUP_FILE_SUCCESS)
+            printf("ERROR dedup_storage - could not share %s. Code: %d\n", file_path, dedup_res);
+        p_args->num_of_files++;
+    }
+
+    closedir(p_user_dir);
+}
+
+
+
+int dedup_storage(uint32_t* p_num_of_files, uint32_t* p_num_of_linked)
+{
+    struct dedup_storage_args args = {0, 0};
+    int res = for_each_user_dir(dedup_user_files, &args) == 0 ? DEDUP_STORAGE_SUCCESS
+        : DEDUP_STORAGE_ERR_OPEN_DIR;
+
+    *p_num_of_files = args.num_of_files;
+    *p_num_of_linked = args.num_of_linked;
+
+    return res;
+}
@@ -1,6 +1,12 @@
 #include <stdint.h>
+#include "arena.h"
 /*
     encapsulates functions dealing with physicall storage.
+    The directory of a user is storage/<2 hex digits>/<2 hex digits>/<username>, by the hash of
+    the username, so no directory holds more than a few thousand entries however many users there
+    are. The storage/.fanout file marks this layout. A storage of the older layout, with the users
+    right in storage/, must be converted with migrate_storage() before init().
+    The files of the same description are links to one blob (see blob_store.h).
     IMPORTANT before any operation will be performed it is required to call the init() function and
     if the file won't be used anymore then the destroy() function must be called.
 */
@@ -11,6 +17,7 @@
 #define INIT_USER_DAO_SUCCESS 0
 #define INIT_USER_DAO_ERR_FOLDER_CREATION 1
 #define INIT_USER_DAO_ERR_MUTEX_INIT 2
+#define INIT_USER_DAO_ERR_LAYOUT 3
 // destroy
 #define DESTROY_USER_DAO_SUCCESS 0
 #define DESTROY_USER_DAO_ERR_MUTEX 1
@@ -18,19 +25,65 @@
 #define CREATE_USER_SUCCESS 0
 #define CREATE_USER_ERR_EXISTS 1
 #define CREATE_USER_ERR_DIRECTORY 2
+// create users
+#define CREATE_USERS_SUCCESS 0
+#define CREATE_USERS_ERR_MUTEX_LOCK 1
+#define CREATE_USERS_ERR_MUTEX_UNLOCK 2
 // delete user
 #define DELETE_USER_SUCCESS 0
 #define DELETE_USER_ERR_MUTEX_LOCK 1
 #define DELETE_USER_ERR_MUTEX_UNLOCK 2
 #define DELETE_USER_ERR_NOT_EXISTS 3
 #define DELETE_USER_ERR_REMOVE_FOLDER 4
-#define DELETE_USER_ERR_REMOVE_FILE 5
+// delete users
+#define DELETE_USERS_SUCCESS 0
+#define DELETE_USERS_ERR_MUTEX_LOCK 1
+#define DELETE_USERS_ERR_MUTEX_UNLOCK 2
 // get user files list
 #define GET_USER_FILES_LIST_SUCCESS 0
 #define GET_USER_FILES_LIST_ERR_NO_SUCH_USER 1
 #define GET_USER_FILES_LIST_ERR_MUTEX_LOCK 2
 #define GET_USER_FILES_LIST_ERR_MUTEX_UNLOCK 3
 #define GET_USER_FILES_LIST_ERR_CLOSE_DIR 4
+#define GET_USER_FILES_LIST_ERR_MEMORY 5
+// publish file
+#define PUBLISH_FILE_SUCCESS 0
+#define PUBLISH_FILE_ERR_NO_SUCH_USER 1
+#define PUBLISH_FILE_ERR_EXISTS 2
+#define PUBLISH_FILE_ERR_WRITE 3
+#define PUBLISH_FILE_ERR_MUTEX_LOCK 4
+#define PUBLISH_FILE_ERR_MUTEX_UNLOCK 5
+// publish files
+#define PUBLISH_FILES_SUCCESS 0
+#define PUBLISH_FILES_ERR_MUTEX_LOCK 1
+#define PUBLISH_FILES_ERR_MUTEX_UNLOCK 2
+// delete file
+#define DELETE_FILE_SUCCESS 0
+#define DELETE_FILE_ERR_NO_SUCH_USER 1
+#define DELETE_FILE_ERR_NOT_EXISTS 2
+#define DELETE_FILE_ERR_REMOVE 3
+#define DELETE_FILE_ERR_MUTEX_LOCK 4
+#define DELETE_FILE_ERR_MUTEX_UNLOCK 5
+// scan storage
+#define SCAN_STORAGE_SUCCESS 0
+#define SCAN_STORAGE_ERR_OPEN_DIR 1
+#define SCAN_STORAGE_ERR_MUTEX_LOCK 2
+#define SCAN_STORAGE_ERR_MUTEX_UNLOCK 3
+// scan users
+#define SCAN_USERS_SUCCESS 0
+#define SCAN_USERS_ERR_OPEN_DIR 1
+#define SCAN_USERS_ERR_MUTEX_LOCK 2
+#define SCAN_USERS_ERR_MUTEX_UNLOCK 3
+// migrate
+#define MIGRATE_STORAGE_SUCCESS 0
+#define MIGRATE_STORAGE_ERR_OPEN_DIR 1
+#define MIGRATE_STORAGE_ERR_MOVE 2
+#define MIGRATE_STORAGE_ERR_MARKER 3
+// dedup
+#define DEDUP_STORAGE_SUCCESS 0
+#define DEDUP_STORAGE_ERR_OPEN_DIR 1
+// descriptions
+#define MAX_DESCRIPTION_LEN 256
 
 
 
@@ -41,6 +94,7 @@
         INIT_USER_DAO_SUCCESS               - success
         INIT_USER_DAO_ERR_FOLDER_CREATION   - could not create the storage folder
         INIT_USER_DAO_ERR_MUTEX_INIT        - could not initialize the storage mutex
+        INIT_USER_DAO_ERR_LAYOUT            - the storage has the flat layout, see migrate_storage
 */
 int init_user_dao();
 /*
@@ -59,31 +113,149 @@ int destroy_user_dao();
 */
 int create_user(char* username);
 /*
-    deletes the user with the specified username.
+    creates the num_of_users users with the usernames with one acquisition of the storage mutex.
+    The result of every user (CREATE_USER_*) is put in results.
+    Returns:
+        CREATE_USERS_SUCCESS            - success, see the results
+        CREATE_USERS_ERR_MUTEX_LOCK     - could not lock the storage mutex, nothing was created
+        CREATE_USERS_ERR_MUTEX_UNLOCK   - could not unlock the storage mutex
+*/
+int create_users(char** usernames, uint32_t num_of_users, int* results);
+/*
+    deletes the user with the specified username. Its folder is moved to the trash at once, the
+    files are deleted in the background (see reclaimer.h).
     Returns:
         DELETE_USER_SUCCESS             - success
         DELETE_USER_ERR_MUTEX_LOCK      - could not lock the storage mutex
         DELETE_USER_ERR_MUTEX_UNLOCK    - could not unlock the storage mutex
         DELETE_USER_ERR_NOT_EXISTS      - there is no user with such username
-        DELETE_USER_ERR_REMOVE_FOLDER   - could not delete the user folder
-        DELETE_USER_ERR_REMOVE_FILE     - could not delete files from user folder
+        DELETE_USER_ERR_REMOVE_FOLDER   - could not move the user folder to the trash
 */
 int delete_user(char* username);
 /*
-    collects names of all files of the user with the specified username in a dynamically allocated
-    array of dynamically allocated strings, so it has to be deleted afterwards. Number of the 
-    files will be put where the p_quantity points.
+    deletes the num_of_users users with the usernames with one acquisition of the storage mutex.
+    The result of every user (DELETE_USER_*) is put in results.
+    Returns:
+        DELETE_USERS_SUCCESS            - success, see the results
+        DELETE_USERS_ERR_MUTEX_LOCK     - could not lock the storage mutex, nothing was deleted
+        DELETE_USERS_ERR_MUTEX_UNLOCK   - could not unlock the storage mutex
+*/
+int delete_users(char** usernames, uint32_t num_of_users, int* results);
+/*
+    collects names of all files of the user with the specified username in an array of strings
+    allocated in the arena. When p_arena is NULL they are allocated dynamically, so they have to
+    be deleted afterwards. Number of the files will be put where the p_quantity points.
     Returns:
         GET_USER_FILES_LIST_SUCCESS             - success
         GET_USER_FILES_LIST_ERR_NO_SUCH_USER    - there is no user with such username
         GET_USER_FILES_LIST_ERR_MUTEX_LOCK      - could not lock the storage mutex
         GET_USER_FILES_LIST_ERR_MUTEX_UNLOCK    - could not unlock the storage mutex
         GET_USER_FILES_LIST_ERR_CLOSE_DIR       - could not close the user directory
+        GET_USER_FILES_LIST_ERR_MEMORY          - could not allocate the list
 */
-int get_user_files_list(char* username, char*** p_user_files, uint32_t* p_quantity);
+int get_user_files_list(char* username, char*** p_user_files, uint32_t* p_quantity,
+    struct arena* p_arena);
 /*
 	checks if the user with the specified username is registered.
 	Returns 1 if the user is registered and 0 if no
 */
 int is_registered(char* username);
-
+/*
+    checks if the user with the specified username published the file_name file.
+    Returns 1 if yes and 0 if no
+*/
+int is_published(char* username, char* file_name);
+/*
+    reads the description of the published file_name file of the user into description, which
+    must have room for MAX_DESCRIPTION_LEN + 1 characters.
+    Returns 1 if the file is published and 0 if no
+*/
+int get_file_description(char* username, char* file_name, char* description);
+/*
+    publishes the file_name file of the user with the specified username, i.e. creates the file in
+    the user directory with the description as its content.
+    Returns:
+        PUBLISH_FILE_SUCCESS            - success
+        PUBLISH_FILE_ERR_NO_SUCH_USER   - there is no user with such username
+        PUBLISH_FILE_ERR_EXISTS         - the user has already published such file
+        PUBLISH_FILE_ERR_WRITE          - could not write the description
+        PUBLISH_FILE_ERR_MUTEX_LOCK     - could not lock the storage mutex
+        PUBLISH_FILE_ERR_MUTEX_UNLOCK   - could not unlock the storage mutex
+*/
+int publish_file(char* username, char* file_name, char* description);
+/*
+    publishes the num_of_files files of the user with the file_names and the descriptions with one
+    acquisition of the storage mutex. The result of every file (PUBLISH_FILE_*) is put in results.
+    Returns:
+        PUBLISH_FILES_SUCCESS           - success, see the results
+        PUBLISH_FILES_ERR_MUTEX_LOCK    - could not lock the storage mutex, nothing was published
+        PUBLISH_FILES_ERR_MUTEX_UNLOCK  - could not unlock the storage mutex
+*/
+int publish_files(char* username, char** file_names, char** descriptions, uint32_t num_of_files,
+    int* results);
+/*
+    deletes the published file_name file of the user with the specified username.
+    Returns:
+        DELETE_FILE_SUCCESS             - success
+        DELETE_FILE_ERR_NO_SUCH_USER    - there is no user with such username
+        DELETE_FILE_ERR_NOT_EXISTS      - the user has not published such file
+        DELETE_FILE_ERR_REMOVE          - could not remove the file
+        DELETE_FILE_ERR_MUTEX_LOCK      - could not lock the storage mutex
+        DELETE_FILE_ERR_MUTEX_UNLOCK    - could not unlock the storage mutex
+*/
+int delete_file(char* username, char* file_name);
+/*
+    calls on_file for every published file in the storage with the owner's username, the name of
+    the file, its description and arg. Used to build in-memory indexes at start up.
+    Returns:
+        SCAN_STORAGE_SUCCESS            - success
+        SCAN_STORAGE_ERR_OPEN_DIR       - could not open the storage directory
+        SCAN_STORAGE_ERR_MUTEX_LOCK     - could not lock the storage mutex
+        SCAN_STORAGE_ERR_MUTEX_UNLOCK   - could not unlock the storage mutex
+*/
+int scan_storage(void (*on_file)(char* username, char* file_name, char* description, void* arg),
+    void* arg);
+/*
+    calls on_user for every registered user with the username and arg, also for the users which
+    have not published any file. The storage can't change meanwhile, so on_user must not call
+    other functions from this file.
+    Returns:
+        SCAN_USERS_SUCCESS          - success
+        SCAN_USERS_ERR_OPEN_DIR     - could not open the storage directory
+        SCAN_USERS_ERR_MUTEX_LOCK   - could not lock the storage mutex
+        SCAN_USERS_ERR_MUTEX_UNLOCK - could not unlock the storage mutex
+*/
+int scan_users(void (*on_user)(char* username, void* arg), void* arg);
+/*
+    calls on_user for every registered user like scan_users, but without locking the storage, so
+    it changes meanwhile. The users which are registered during the whole scan are reported
+    exactly once, the ones registered or deleted meanwhile may be reported or not.
+    Returns:
+        SCAN_USERS_SUCCESS          - success
+        SCAN_USERS_ERR_OPEN_DIR     - could not open the storage directory
+*/
+int scan_users_unlocked(void (*on_user)(char* username, void* arg), void* arg);
+/*
+    converts a storage of the flat layout (storage/<username>) to the fan-out one. The users are
+    moved one by one to storage.fanout/, which then replaces storage/. It must be called before
+    init(), while no server uses the storage. When it is interrupted it can be called again and
+    continues where it stopped. A storage which has the fan-out layout already is left as it is.
+    p_num_of_moved is set to the number of users moved.
+    Returns:
+        MIGRATE_STORAGE_SUCCESS         - success
+        MIGRATE_STORAGE_ERR_OPEN_DIR    - could not read the storage directory
+        MIGRATE_STORAGE_ERR_MOVE        - could not move a user or the storage directory
+        MIGRATE_STORAGE_ERR_MARKER      - could not create the layout marker
+*/
+int migrate_storage(uint32_t* p_num_of_moved);
+/*
+    shares the descriptions written before the storage used the blob store: every file becomes the
+    blob of its description or a link to it. It must be called after init_blob_store(), while no
+    server uses the storage, and it can be called again any time, the shared files stay as they
+    are. p_num_of_files is set to the number of files looked at and p_num_of_linked to the number
+    of them replaced by links.
+    Returns:
+        DEDUP_STORAGE_SUCCESS           - success
+        DEDUP_STORAGE_ERR_OPEN_DIR      - could not read the storage directory
+*/
+int dedup_storage(uint32_t* p_num_of_files, uint32_t* p_num_of_linked);
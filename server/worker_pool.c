@@ -0,0 +1,202 @@
+#include "worker_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// global variables
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// guards the queue and the done items of every job
+pthread_mutex_t mutex_pool = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t cond_pool = PTHREAD_COND_INITIALIZER;
+struct pool_item* p_first_queued;
+struct pool_item* p_last_queued;
+int is_pool_running;
+pthread_t t_workers[MAX_WORKER_POOL_SIZE];
+uint32_t num_of_workers_started;
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// helpers
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+    takes the items from the queue and works on them till destroy() is called
+*/
+void* run_worker(void* arg)
+{
+    (void) arg;
+    struct arena arena;
+    memset(&arena, 0, sizeof(arena));
+
+    pthread_mutex_lock(&mutex_pool);
+    while (1)
+    {
+        while (is_pool_running && p_first_queued == NULL)
+            pthread_cond_wait(&cond_pool, &mutex_pool);
+        if (p_first_queued == NULL)
+            break;
+
+        struct pool_item* p_item = p_first_queued;
+        p_first_queued = p_item->p_next;
+        if (p_first_queued == NULL)
+            p_last_queued = NULL;
+
+        struct pool_job* p_job = p_item->p_job;
+        if (!p_job->is_cancelled)
+        {
+            pthread_mutex_unlock(&mutex_pool);
+            p_item->output = p_job->work(p_item->input, &arena, &p_item->output_len);
+            arena_reset(&arena);
+            pthread_mutex_lock(&mutex_pool);
+        }
+
+        p_item->p_next = NULL;
+        if (p_job->p_last_done != NULL)
+            p_job->p_last_done->p_next = p_item;
+        else
+            p_job->p_first_done = p_item;
+        p_job->p_last_done = p_item;
+        p_job->num_of_done++;
+        pthread_cond_signal(&p_job->cond_done);
+    }
+    pthread_mutex_unlock(&mutex_pool);
+
+    destroy_arena(&arena);
+
+    return NULL;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// init / destroy
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int init_worker_pool(uint32_t num_of_workers)
+{
+    if (num_of_workers > MAX_WORKER_POOL_SIZE)
+        num_of_workers = MAX_WORKER_POOL_SIZE;
+
+    is_pool_running = 1;
+    for (num_of_workers_started = 0; num_of_workers_started < num_of_workers;
+        num_of_workers_started++)
+    {
+        if (pthread_create(&t_workers[num_of_workers_started], NULL, run_worker, NULL) != 0)
+        {
+            destroy_worker_pool();
+            return INIT_WORKER_POOL_ERR_THREAD;
+        }
+    }
+
+    return INIT_WORKER_POOL_SUCCESS;
+}
+
+
+
+void destroy_worker_pool()
+{
+    pthread_mutex_lock(&mutex_pool);
+    is_pool_running = 0;
+    pthread_cond_broadcast(&cond_pool);
+    pthread_mutex_unlock(&mutex_pool);
+
+    for (uint32_t i = 0; i < num_of_workers_started; i++)
+        pthread_join(t_workers[i], NULL);
+    num_of_workers_started = 0;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// jobs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int start_pool_job(struct pool_job* p_job, char** inputs, uint32_t num_of_items,
+    char* (*work)(char* input, struct arena* p_arena, size_t* p_output_len))
+{
+    memset(p_job, 0, sizeof(*p_job));
+    p_job->work = work;
+    p_job->num_of_items = num_of_items;
+    p_job->items = calloc(num_of_items + 1, sizeof(struct pool_item));
+    if (p_job->items == NULL)
+        return START_POOL_JOB_ERR_MEMORY;
+
+    if (pthread_cond_init(&p_job->cond_done, NULL) != 0)
+    {
+        free(p_job->items);
+        return START_POOL_JOB_ERR_MEMORY;
+    }
+
+    for (uint32_t i = 0; i < num_of_items; i++)
+    {
+        p_job->items[i].input = inputs[i];
+        p_job->items[i].p_job = p_job;
+        p_job->items[i].p_next = i + 1 < num_of_items ? &p_job->items[i + 1] : NULL;
+    }
+
+    pthread_mutex_lock(&mutex_pool);
+    if (!is_pool_running || num_of_workers_started == 0)
+    {
+        pthread_mutex_unlock(&mutex_pool);
+        pthread_cond_destroy(&p_job->cond_done);
+        free(p_job->items);
+        return START_POOL_JOB_ERR_STOPPED;
+    }
+
+    if (num_of_items > 0)
+    {
+        if (p_last_queued != NULL)
+            p_last_queued->p_next = &p_job->items[0];
+        else
+            p_first_queued = &p_job->items[0];
+        p_last_queued = &p_job->items[num_of_items - 1];
+        pthread_cond_broadcast(&cond_pool);
+    }
+    pthread_mutex_unlock(&mutex_pool);
+
+    return START_POOL_JOB_SUCCESS;
+}
+
+
+
+struct pool_item* next_done_item(struct pool_job* p_job)
+{
+    if (p_job->num_of_taken == p_job->num_of_items)
+        return NULL;
+
+    pthread_mutex_lock(&mutex_pool);
+    while (p_job->p_first_done == NULL)
+        pthread_cond_wait(&p_job->cond_done, &mutex_pool);
+
+    struct pool_item* p_item = p_job->p_first_done;
+    p_job->p_first_done = p_item->p_next;
+    if (p_job->p_first_done == NULL)
+        p_job->p_last_done = NULL;
+    pthread_mutex_unlock(&mutex_pool);
+
+    p_job->num_of_taken++;
+
+    return p_item;
+}
+
+
+
+void finish_pool_job(struct pool_job* p_job)
+{
+    pthread_mutex_lock(&mutex_pool);
+    p_job->is_cancelled = 1;
+    while (p_job->num_of_done < p_job->num_of_items)
+        pthread_cond_wait(&p_job->cond_done, &mutex_pool);
+    pthread_mutex_unlock(&mutex_pool);
+
+    for (uint32_t i = 0; i < p_job->num_of_items; i++)
+        free(p_job->items[i].output);
+
+    pthread_cond_destroy(&p_job->cond_done);
+    free(p_job->items);
+    p_job->items = NULL;
+}
@@ -0,0 +1,94 @@
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+/*
+    pool of threads doing the parts of a request which don't depend on each other in parallel,
+    e.g. scanning the storage of many users for one listing. A job is a list of items, the work
+    of the job is called for each of them in one of the workers and its output is handed to the
+    thread which started the job as soon as it's done, in the order the items are done in, so the
+    thread can send it while the rest of the items are still being worked on.
+    The items of all the jobs wait in one queue, so a job with many items does not take the pool
+    from the others for longer than one item takes.
+    IMPORTANT before any operation will be performed it is required to call the init() function and
+    if the pool won't be used anymore then the destroy() function must be called.
+*/
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// constants
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define WORKER_POOL_SIZE 4      // default
+#define MAX_WORKER_POOL_SIZE 64
+// init
+#define INIT_WORKER_POOL_SUCCESS 0
+#define INIT_WORKER_POOL_ERR_THREAD 1
+// start job
+#define START_POOL_JOB_SUCCESS 0
+#define START_POOL_JOB_ERR_MEMORY 1
+#define START_POOL_JOB_ERR_STOPPED 2
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// structs
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct pool_job;
+
+struct pool_item
+{
+    char* input;
+    char* output;                   // allocated with malloc() by the work, NULL if it failed
+    size_t output_len;
+    struct pool_job* p_job;
+    struct pool_item* p_next;       // in the queue of the pool, then in the done items of the job
+};
+
+struct pool_job
+{
+    // called in a worker, the arena is reset after every item
+    char* (*work)(char* input, struct arena* p_arena, size_t* p_output_len);
+    struct pool_item* items;
+    uint32_t num_of_items;
+    uint32_t num_of_done;
+    uint32_t num_of_taken;          // by next_done_item()
+    int is_cancelled;               // the items not started yet are skipped
+    struct pool_item* p_first_done;
+    struct pool_item* p_last_done;
+    pthread_cond_t cond_done;
+};
+
+
+
+/*
+    must be called exactly once at the beginning, before the first call to any function
+    from this file has been done. Starts num_of_workers (at most MAX_WORKER_POOL_SIZE) workers.
+    Returns:
+        INIT_WORKER_POOL_SUCCESS        - success
+        INIT_WORKER_POOL_ERR_THREAD     - could not start the workers
+*/
+int init_worker_pool(uint32_t num_of_workers);
+/*
+    must be called exactly once when the functions won't be used anymore, after all the jobs have
+    been finished. Stops the workers.
+*/
+void destroy_worker_pool();
+/*
+    queues the num_of_items inputs to be worked on by the work. The inputs must stay valid till
+    the job is finished.
+    Returns:
+        START_POOL_JOB_SUCCESS          - success, finish_pool_job() must be called
+        START_POOL_JOB_ERR_MEMORY       - could not allocate the items
+        START_POOL_JOB_ERR_STOPPED      - the pool is stopped
+*/
+int start_pool_job(struct pool_job* p_job, char** inputs, uint32_t num_of_items,
+    char* (*work)(char* input, struct arena* p_arena, size_t* p_output_len));
+/*
+    waits till the next item of the job is done.
+    Returns the item, its output is freed by finish_pool_job(), NULL if all the items were taken
+*/
+struct pool_item* next_done_item(struct pool_job* p_job);
+/*
+    skips the items which were not started yet, waits for the ones being worked on and frees the
+    job. Must be called for every started job, also when not all of its items were taken.
+*/
+void finish_pool_job(struct pool_job* p_job);